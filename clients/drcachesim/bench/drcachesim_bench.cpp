@@ -0,0 +1,499 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* drcachesim_bench: measures the throughput and memory footprint of the
+ * simulators and analysis tools on synthetic traces, independently of any
+ * tracing or trace file I/O.
+ */
+
+#ifdef WINDOWS
+# define UNICODE
+# define _UNICODE
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <stdlib.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "droption.h"
+#include "dr_frontend.h"
+#include "synthetic_trace.h"
+#include "analysis_tool.h"
+#include "../simulator/cache_simulator_create.h"
+#include "../simulator/tlb_simulator_create.h"
+#include "../simulator/cache_lru.h"
+#include "../simulator/cache_stats.h"
+#include "../tools/histogram_create.h"
+#include "../tools/reuse_distance_create.h"
+
+#define FATAL_ERROR(msg, ...) do { \
+    fprintf(stderr, "ERROR: " msg "\n", ##__VA_ARGS__);    \
+    fflush(stderr); \
+    exit(1); \
+} while (0)
+
+static droption_t<std::string> op_patterns
+(DROPTION_SCOPE_FRONTEND, "patterns", "strided,random,chase,zipf",
+ "Comma-separated access patterns",
+ "Specifies the synthetic access patterns to benchmark, separated by commas.  "
+ "Supported patterns are 'strided' (sequential with -stride), 'random' (uniform), "
+ "'chase' (a dependent random cycle through the working set), and 'zipf' "
+ "(Zipfian-distributed with -zipf_skew).");
+
+static droption_t<std::string> op_tools
+(DROPTION_SCOPE_FRONTEND, "tools", "cache,tlb,reuse_distance,histogram,l1miss",
+ "Comma-separated tools to drive",
+ "Specifies the analysis tools to benchmark, separated by commas.  'cache' and "
+ "'tlb' are the cache and TLB simulators, 'reuse_distance' and 'histogram' are "
+ "the analysis tools of the same names, and 'l1miss' is the L2/L3/L4 hierarchy "
+ "driven by L1 miss events as in l1missdriver.  For 'l1miss' every reference is "
+ "treated as an L1 miss and a per-level latency is reported as well.  It is not "
+ "measured directly but estimated by subtraction: the hierarchy is re-timed with "
+ "the L2 and then also the L3 removed, and each level is charged the "
+ "difference.  The estimate inherits the timing noise of both runs and can come "
+ "out slightly negative for a level that adds little work.");
+
+static droption_t<bytesize_t> op_num_refs
+(DROPTION_SCOPE_FRONTEND, "num_refs", 1000000, "Number of data references",
+ "Specifies the number of data references to generate per pattern.  Each data "
+ "reference is preceded by an instruction fetch.");
+
+static droption_t<bytesize_t> op_working_set
+(DROPTION_SCOPE_FRONTEND, "working_set", 8*1024*1024, "Per-thread data footprint",
+ "Specifies the size of each thread's data region in bytes.");
+
+static droption_t<unsigned int> op_stride
+(DROPTION_SCOPE_FRONTEND, "stride", 64, "Access granularity",
+ "Specifies the distance between consecutive strided accesses, which is also the "
+ "granularity of the other patterns.");
+
+static droption_t<bytesize_t> op_code_size
+(DROPTION_SCOPE_FRONTEND, "code_size", 16*1024, "Code footprint",
+ "Specifies the size of the code region that instruction fetches walk through.");
+
+static droption_t<unsigned int> op_write_percent
+(DROPTION_SCOPE_FRONTEND, "write_percent", 25, "Percentage of writes",
+ "Specifies the percentage of data references that are writes.");
+
+static droption_t<std::string> op_zipf_skew
+(DROPTION_SCOPE_FRONTEND, "zipf_skew", "0.99", "Zipfian exponent",
+ "Specifies the exponent of the Zipfian distribution for the 'zipf' pattern.");
+
+static droption_t<unsigned int> op_threads
+(DROPTION_SCOPE_FRONTEND, "threads", 1, "Number of threads",
+ "Specifies the number of application threads whose references are interleaved "
+ "in the synthetic trace.");
+
+static droption_t<unsigned int> op_interleave
+(DROPTION_SCOPE_FRONTEND, "interleave", 64, "References per thread switch",
+ "Specifies how many data references each thread issues before the trace "
+ "switches to the next thread.");
+
+static droption_t<unsigned int> op_seed
+(DROPTION_SCOPE_FRONTEND, "seed", 0, "Random seed",
+ "Specifies the seed for the random number generator used by the patterns.");
+
+static droption_t<unsigned int> op_repeat
+(DROPTION_SCOPE_FRONTEND, "repeat", 3, "Timed runs per measurement",
+ "Specifies how many times each tool is run over each trace.  The fastest run "
+ "is reported.");
+
+static droption_t<bool> op_print_results
+(DROPTION_SCOPE_FRONTEND, "print_results", false, "Print each tool's results",
+ "Invokes each tool's own results printing after its first run.");
+
+// XXX i#2006: these are duplicated from drcachesim's options, as in
+// histogram_launcher.cpp.
+
+static droption_t<unsigned int> op_num_cores
+(DROPTION_SCOPE_FRONTEND, "cores", 4, "Number of cores",
+ "Specifies the number of cores to simulate.");
+
+static droption_t<unsigned int> op_line_size
+(DROPTION_SCOPE_FRONTEND, "line_size", 64, "Cache line size",
+ "Specifies the cache line size, which is assumed to be identical for all levels.");
+
+static droption_t<bytesize_t> op_L1I_size
+(DROPTION_SCOPE_FRONTEND, "L1I_size", 32*1024U, "Instruction cache total size",
+ "Specifies the total size of each L1 instruction cache.");
+
+static droption_t<bytesize_t> op_L1D_size
+(DROPTION_SCOPE_FRONTEND, "L1D_size", 32*1024U, "Data cache total size",
+ "Specifies the total size of each L1 data cache.");
+
+static droption_t<bytesize_t> op_L2_size
+(DROPTION_SCOPE_FRONTEND, "L2_size", 256*1024U, "Private L2 cache total size",
+ "Specifies the total size of each core's L2 cache.");
+
+static droption_t<bytesize_t> op_L3_size
+(DROPTION_SCOPE_FRONTEND, "L3_size", 8*1024*1024U, "Shared L3 cache total size",
+ "Specifies the total size of the shared L3 cache.");
+
+// The default is much smaller than drcachesim's as the L4's block array
+// otherwise dominates both setup time and the reported footprint.
+static droption_t<bytesize_t> op_L4_size
+(DROPTION_SCOPE_FRONTEND, "L4_size", 64*1024*1024U, "Shared L4 cache total size",
+ "Specifies the total size of the shared L4 cache.");
+
+static droption_t<unsigned int> op_verbose
+(DROPTION_SCOPE_ALL, "verbose", 0, 0, 64, "Verbosity level",
+ "Verbosity level for notifications.");
+
+/***************************************************************************
+ * Heap accounting: we track live bytes from the global allocator so we can
+ * report how much state each tool holds.
+ */
+
+static size_t heap_live_bytes;
+
+// We keep the requested size in a header that preserves max alignment.
+static const size_t HEAP_HEADER_SIZE = 2 * sizeof(void *);
+
+void *
+operator new(size_t size)
+{
+    char *ptr = (char *) malloc(size + HEAP_HEADER_SIZE);
+    if (ptr == NULL)
+        throw std::bad_alloc();
+    *(size_t *)ptr = size;
+    heap_live_bytes += size;
+    return ptr + HEAP_HEADER_SIZE;
+}
+
+void *
+operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void
+operator delete(void *ptr) throw()
+{
+    if (ptr == NULL)
+        return;
+    char *base = (char *)ptr - HEAP_HEADER_SIZE;
+    heap_live_bytes -= *(size_t *)base;
+    free(base);
+}
+
+void
+operator delete[](void *ptr) throw()
+{
+    operator delete(ptr);
+}
+
+/***************************************************************************
+ * The L2/L3/L4 hierarchy of l1missdriver, fed with L1 miss events.
+ */
+
+class l1miss_hierarchy_t : public analysis_tool_t
+{
+ public:
+    // The num_levels lowest levels are built: 1 is the L4 alone and 3 is the
+    // full L2-L3-L4 hierarchy.
+    l1miss_hierarchy_t(unsigned int num_levels, unsigned int num_cores,
+                       unsigned int line_size, uint64_t L2_size, uint64_t L3_size,
+                       uint64_t L4_size) :
+        num_cores(num_cores), l2caches(num_cores, nullptr), l3cache(nullptr),
+        l4cache(nullptr)
+    {
+        l4cache = create_level(16, line_size, L4_size, NULL);
+        if (l4cache == NULL)
+            return;
+        if (num_levels >= 2) {
+            l3cache = create_level(16, line_size, L3_size, l4cache);
+            if (l3cache == NULL)
+                return;
+        }
+        for (unsigned int i = 0; i < num_cores; i++) {
+            if (num_levels >= 3) {
+                l2caches[i] = create_level(16, line_size, L2_size, l3cache);
+                if (l2caches[i] == NULL)
+                    return;
+            } else
+                l2caches[i] = l3cache != NULL ? l3cache : l4cache;
+        }
+    }
+    virtual ~l1miss_hierarchy_t()
+    {
+        for (size_t i = 0; i < all_caches.size(); i++) {
+            delete all_caches[i]->get_stats();
+            delete all_caches[i];
+        }
+    }
+    virtual bool process_memref(const memref_t &memref)
+    {
+        if (memref.exit.type == TRACE_TYPE_THREAD_EXIT)
+            return true;
+        ext_memref_t ext;
+        memset(&ext, 0, sizeof(ext));
+        ext.ref = memref;
+        ext.inst = type_is_instr(memref.instr.type);
+        if (ext.inst) {
+            // Instruction misses arrive as reads of the whole line, as in
+            // the l1logger trace.
+            ext.ref.data.type = TRACE_TYPE_READ;
+            ext.ref.data.size = 1;
+        }
+        if (type_is_write(ext.ref.data.type))
+            ext.wrcount = 1;
+        else
+            ext.rdcount = 1;
+        ext.core = core_for_thread(memref.data.tid);
+        l2caches[ext.core]->request(ext);
+        return true;
+    }
+    virtual bool print_results()
+    {
+        for (size_t i = 0; i < all_caches.size(); i++) {
+            std::cerr << "Level " << i << " stats:" << std::endl;
+            all_caches[i]->get_stats()->print_stats("    ");
+        }
+        return true;
+    }
+
+ protected:
+    cache_t *create_level(int assoc, unsigned int line_size, uint64_t size,
+                          cache_t *parent)
+    {
+        cache_t *cache = new cache_lru_t;
+        if (!cache->init(assoc, (int)line_size, (int)size, parent,
+                         new cache_stats_t)) {
+            delete cache;
+            success = false;
+            return NULL;
+        }
+        all_caches.push_back(cache);
+        return cache;
+    }
+    int core_for_thread(memref_tid_t tid)
+    {
+        std::unordered_map<memref_tid_t, int>::iterator it = thread2core.find(tid);
+        if (it != thread2core.end())
+            return it->second;
+        int core = (int)(thread2core.size() % num_cores);
+        thread2core[tid] = core;
+        return core;
+    }
+
+    unsigned int num_cores;
+    std::vector<cache_t *> l2caches;
+    cache_t *l3cache;
+    cache_t *l4cache;
+    std::vector<cache_t *> all_caches;
+    std::unordered_map<memref_tid_t, int> thread2core;
+};
+
+/***************************************************************************
+ * Benchmark driver.
+ */
+
+static std::vector<std::string>
+split_list(const std::string &list)
+{
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty())
+            items.push_back(item);
+    }
+    return items;
+}
+
+static analysis_tool_t *
+create_tool(const std::string &name, unsigned int l1miss_levels = 3)
+{
+    if (name == "cache") {
+        return cache_simulator_create(op_num_cores.get_value(), op_line_size.get_value(),
+                                      op_L1I_size.get_value(), op_L1D_size.get_value(),
+                                      8, 8, op_L2_size.get_value(), 16,
+                                      op_L3_size.get_value(), 16,
+                                      op_L4_size.get_value(), 16, "", "", "LRU",
+                                      "nextline", 0, 0, 1ULL << 63,
+                                      op_verbose.get_value());
+    } else if (name == "tlb") {
+        return tlb_simulator_create(op_num_cores.get_value());
+    } else if (name == "reuse_distance") {
+        return reuse_distance_tool_create(op_line_size.get_value());
+    } else if (name == "histogram") {
+        return histogram_tool_create(op_line_size.get_value());
+    } else if (name == "l1miss") {
+        return new l1miss_hierarchy_t(l1miss_levels, op_num_cores.get_value(),
+                                      op_line_size.get_value(), op_L2_size.get_value(),
+                                      op_L3_size.get_value(), op_L4_size.get_value());
+    }
+    return NULL;
+}
+
+struct bench_result_t {
+    double best_seconds;
+    size_t state_bytes;
+};
+
+// Runs the named tool over the trace op_repeat times.  The footprint is
+// measured after the first run, once all lazily-grown state exists.
+static bench_result_t
+run_tool(const std::string &name, const synthetic_trace_t &trace,
+         unsigned int l1miss_levels = 3)
+{
+    bench_result_t result = { 0.0, 0 };
+    unsigned int repeat = op_repeat.get_value() == 0 ? 1 : op_repeat.get_value();
+    for (unsigned int run = 0; run < repeat; run++) {
+        // The simulators announce each cache they create on stdout; keep that
+        // out of our results table.
+        std::streambuf *saved_buf = std::cout.rdbuf(NULL);
+        size_t base_bytes = heap_live_bytes;
+        analysis_tool_t *tool = create_tool(name, l1miss_levels);
+        std::cout.rdbuf(saved_buf);
+        if (tool == NULL || !*tool)
+            FATAL_ERROR("failed to create tool %s", name.c_str());
+
+        synthetic_reader_t reader(trace);
+        synthetic_reader_t reader_end;
+        if (!reader.init())
+            FATAL_ERROR("failed to initialize synthetic reader");
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (; reader != reader_end; ++reader) {
+            if (!tool->process_memref(*reader))
+                FATAL_ERROR("tool %s failed to process the trace", name.c_str());
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        if (run == 0) {
+            result.state_bytes = heap_live_bytes - base_bytes;
+            result.best_seconds = elapsed.count();
+            if (op_print_results.get_value())
+                tool->print_results();
+        } else if (elapsed.count() < result.best_seconds)
+            result.best_seconds = elapsed.count();
+        delete tool;
+    }
+    return result;
+}
+
+static void
+print_row(const std::string &pattern, const std::string &tool, uint64_t num_refs,
+          const bench_result_t &result)
+{
+    double refs_per_sec = result.best_seconds > 0 ?
+        (double)num_refs / result.best_seconds : 0;
+    std::cout << std::setw(10) << std::left << pattern
+              << std::setw(16) << std::left << tool
+              << std::setw(16) << std::right << std::fixed << std::setprecision(0)
+              << refs_per_sec
+              << std::setw(16) << std::right << result.state_bytes
+              << std::setw(12) << std::right << std::setprecision(2)
+              << (double)result.state_bytes / num_refs << std::endl;
+}
+
+int
+_tmain(int argc, const TCHAR *targv[])
+{
+    // Convert to UTF-8 if necessary
+    char **argv;
+    drfront_status_t sc = drfront_convert_args(targv, &argv, argc);
+    if (sc != DRFRONT_SUCCESS)
+        FATAL_ERROR("Failed to process args: %d", sc);
+
+    std::string parse_err;
+    if (!droption_parser_t::parse_argv(DROPTION_SCOPE_FRONTEND, argc, (const char **)argv,
+                                       &parse_err, NULL)) {
+        FATAL_ERROR("Usage error: %s\nUsage:\n%s", parse_err.c_str(),
+                    droption_parser_t::usage_short(DROPTION_SCOPE_ALL).c_str());
+    }
+
+    std::vector<std::string> patterns = split_list(op_patterns.get_value());
+    std::vector<std::string> tools = split_list(op_tools.get_value());
+    for (size_t i = 0; i < tools.size(); i++) {
+        if (tools[i] != "cache" && tools[i] != "tlb" && tools[i] != "reuse_distance" &&
+            tools[i] != "histogram" && tools[i] != "l1miss")
+            FATAL_ERROR("Usage error: unknown tool %s", tools[i].c_str());
+    }
+
+    std::cout << std::setw(10) << std::left << "pattern"
+              << std::setw(16) << std::left << "tool"
+              << std::setw(16) << std::right << "refs/sec"
+              << std::setw(16) << std::right << "state bytes"
+              << std::setw(12) << std::right << "bytes/ref" << std::endl;
+
+    for (size_t p = 0; p < patterns.size(); p++) {
+        synthetic_trace_config_t config;
+        if (!synthetic_trace_t::pattern_from_name(patterns[p], &config.pattern))
+            FATAL_ERROR("Usage error: unknown pattern %s", patterns[p].c_str());
+        config.num_refs = op_num_refs.get_value();
+        config.working_set = op_working_set.get_value();
+        config.stride = op_stride.get_value();
+        config.code_size = op_code_size.get_value();
+        config.write_percent = op_write_percent.get_value();
+        config.zipf_skew = atof(op_zipf_skew.get_value().c_str());
+        config.num_threads = op_threads.get_value();
+        config.interleave = op_interleave.get_value();
+        config.seed = op_seed.get_value();
+        synthetic_trace_t trace(config);
+        uint64_t num_refs = trace.get_num_memrefs();
+
+        for (size_t t = 0; t < tools.size(); t++) {
+            bench_result_t result = run_tool(tools[t], trace);
+            print_row(patterns[p], tools[t], num_refs, result);
+            if (tools[t] != "l1miss")
+                continue;
+            // Attribute the hierarchy's cost to its levels by timing it
+            // with the upper levels removed one at a time.  A level's latency
+            // is estimated by subtraction, as the time with it minus the time
+            // without it, so it is only as precise as the two timings and
+            // ignores any interaction between levels.
+            double level_ns[3];
+            level_ns[0] = result.best_seconds * 1e9 / num_refs;
+            for (unsigned int levels = 2; levels >= 1; levels--) {
+                bench_result_t partial = run_tool(tools[t], trace, levels);
+                level_ns[3 - levels] = partial.best_seconds * 1e9 / num_refs;
+            }
+            static const char * const level_names[] = { "L2", "L3", "L4" };
+            for (int i = 0; i < 3; i++) {
+                double own_ns = level_ns[i] - (i < 2 ? level_ns[i + 1] : 0);
+                std::cout << std::setw(10) << "" << "  " << level_names[i]
+                          << " latency: " << std::setprecision(2) << own_ns
+                          << " ns/ref" << std::endl;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,234 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+#include <algorithm>
+#include <assert.h>
+#include <math.h>
+#include <random>
+#include "synthetic_trace.h"
+#include "../common/utils.h"
+
+// Each thread's data lives in its own region so that threads do not share
+// cache lines.  All threads execute the same code region.
+static const addr_t SYNTHETIC_CODE_BASE = 0x00400000;
+static const addr_t SYNTHETIC_DATA_BASE = 0x10000000;
+static const memref_pid_t SYNTHETIC_PID = 1;
+static const memref_tid_t SYNTHETIC_TID_BASE = 1000;
+static const unsigned short SYNTHETIC_INSTR_SIZE = 4;
+static const unsigned short SYNTHETIC_DATA_SIZE = 8;
+
+static const char * const pattern_names[] = {
+    "strided",
+    "random",
+    "chase",
+    "zipf",
+};
+
+bool
+synthetic_trace_t::pattern_from_name(const std::string &name,
+                                     synthetic_pattern_t *pattern)
+{
+    for (size_t i = 0; i < BUFFER_SIZE_ELEMENTS(pattern_names); i++) {
+        if (name == pattern_names[i]) {
+            *pattern = (synthetic_pattern_t) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *
+synthetic_trace_t::pattern_name(synthetic_pattern_t pattern)
+{
+    return pattern_names[pattern];
+}
+
+static inline void
+append_entry(std::vector<trace_entry_t> &entries, trace_type_t type,
+             unsigned short size, addr_t addr)
+{
+    trace_entry_t entry;
+    entry.type = (unsigned short) type;
+    entry.size = size;
+    entry.addr = addr;
+    entries.push_back(entry);
+}
+
+synthetic_trace_t::synthetic_trace_t(const synthetic_trace_config_t &config) :
+    num_memrefs(0)
+{
+    std::mt19937_64 rng(config.seed);
+    unsigned int num_threads = config.num_threads == 0 ? 1 : config.num_threads;
+    unsigned int interleave = config.interleave == 0 ? 1 : config.interleave;
+    unsigned int stride = config.stride == 0 ? 1 : config.stride;
+    uint64_t num_slots = config.working_set / stride;
+    if (num_slots == 0)
+        num_slots = 1;
+    uint64_t code_size = config.code_size < SYNTHETIC_INSTR_SIZE ?
+        SYNTHETIC_INSTR_SIZE : config.code_size;
+    // Keep per-thread regions page-aligned and disjoint.
+    addr_t region_size = (addr_t)((num_slots * stride + 4095) & ~(uint64_t)4095);
+
+    // The pointer-chase pattern follows a single random cycle through all slots
+    // (Sattolo's algorithm) so that every access depends on the previous one
+    // and hardware-style prefetching does not help.  The Zipfian pattern uses a
+    // random permutation to scatter its hot slots across the working set.
+    std::vector<uint64_t> next_slot;
+    std::vector<double> zipf_cdf;
+    if (config.pattern == SYNTHETIC_POINTER_CHASE ||
+        config.pattern == SYNTHETIC_ZIPF) {
+        next_slot.resize(num_slots);
+        for (uint64_t i = 0; i < num_slots; i++)
+            next_slot[i] = i;
+        if (config.pattern == SYNTHETIC_POINTER_CHASE) {
+            for (uint64_t i = num_slots - 1; i > 0; i--) {
+                uint64_t j = rng() % i;
+                std::swap(next_slot[i], next_slot[j]);
+            }
+        } else
+            std::shuffle(next_slot.begin(), next_slot.end(), rng);
+    }
+    if (config.pattern == SYNTHETIC_ZIPF) {
+        zipf_cdf.resize(num_slots);
+        double sum = 0;
+        for (uint64_t i = 0; i < num_slots; i++) {
+            sum += 1.0 / pow((double)(i + 1), config.zipf_skew);
+            zipf_cdf[i] = sum;
+        }
+        for (uint64_t i = 0; i < num_slots; i++)
+            zipf_cdf[i] /= sum;
+    }
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    std::vector<uint64_t> cur_slot(num_threads);
+    std::vector<addr_t> cur_pc(num_threads, 0);
+    for (unsigned int t = 0; t < num_threads; t++)
+        cur_slot[t] = (num_slots / num_threads) * t;
+
+    // One instr plus one data entry per reference, plus thread switches.
+    uint64_t num_switches = config.num_refs / interleave + num_threads;
+    entries.reserve((size_t)(config.num_refs * 2 + num_switches * 2 + num_threads + 2));
+    append_entry(entries, TRACE_TYPE_HEADER, 0, TRACE_ENTRY_VERSION);
+
+    unsigned int thread = 0;
+    uint64_t generated = 0;
+    while (generated < config.num_refs) {
+        append_entry(entries, TRACE_TYPE_THREAD, 0,
+                     (addr_t)(SYNTHETIC_TID_BASE + thread));
+        append_entry(entries, TRACE_TYPE_PID, 0, (addr_t)SYNTHETIC_PID);
+        addr_t data_base = SYNTHETIC_DATA_BASE + thread * region_size;
+        for (unsigned int i = 0; i < interleave && generated < config.num_refs;
+             i++, generated++) {
+            append_entry(entries, TRACE_TYPE_INSTR, SYNTHETIC_INSTR_SIZE,
+                         SYNTHETIC_CODE_BASE + cur_pc[thread]);
+            cur_pc[thread] += SYNTHETIC_INSTR_SIZE;
+            if (cur_pc[thread] >= code_size)
+                cur_pc[thread] = 0;
+
+            uint64_t slot;
+            switch (config.pattern) {
+            case SYNTHETIC_STRIDED:
+                slot = cur_slot[thread];
+                cur_slot[thread] = (slot + 1) % num_slots;
+                break;
+            case SYNTHETIC_RANDOM:
+                slot = rng() % num_slots;
+                break;
+            case SYNTHETIC_POINTER_CHASE:
+                slot = cur_slot[thread];
+                cur_slot[thread] = next_slot[slot];
+                break;
+            case SYNTHETIC_ZIPF: {
+                std::vector<double>::iterator it =
+                    std::lower_bound(zipf_cdf.begin(), zipf_cdf.end(), uniform(rng));
+                if (it == zipf_cdf.end())
+                    --it;
+                slot = next_slot[it - zipf_cdf.begin()];
+                break;
+            }
+            default:
+                assert(false);
+                slot = 0;
+            }
+            bool is_write = (rng() % 100) < config.write_percent;
+            append_entry(entries, is_write ? TRACE_TYPE_WRITE : TRACE_TYPE_READ,
+                         SYNTHETIC_DATA_SIZE, data_base + (addr_t)(slot * stride));
+        }
+        thread = (thread + 1) % num_threads;
+    }
+    num_memrefs = generated * 2;
+
+    for (unsigned int t = 0; t < num_threads; t++) {
+        append_entry(entries, TRACE_TYPE_THREAD_EXIT, 0,
+                     (addr_t)(SYNTHETIC_TID_BASE + t));
+        num_memrefs++;
+    }
+    append_entry(entries, TRACE_TYPE_FOOTER, 0, 0);
+}
+
+synthetic_reader_t::synthetic_reader_t() : entries(NULL), index(0)
+{
+    /* Empty. */
+}
+
+synthetic_reader_t::synthetic_reader_t(const synthetic_trace_t &trace) :
+    entries(&trace.get_entries()), index(0)
+{
+    /* Empty. */
+}
+
+bool
+synthetic_reader_t::init()
+{
+    at_eof = false;
+    index = 0;
+    trace_entry_t *first_entry = read_next_entry();
+    if (first_entry == NULL)
+        return false;
+    if (first_entry->type != TRACE_TYPE_HEADER ||
+        first_entry->addr != TRACE_ENTRY_VERSION) {
+        ERRMSG("missing header or version mismatch\n");
+        return false;
+    }
+    ++*this;
+    return true;
+}
+
+trace_entry_t *
+synthetic_reader_t::read_next_entry()
+{
+    if (entries == NULL || index >= entries->size())
+        return NULL;
+    // reader_t does not modify the entry, but its interface is non-const.
+    return const_cast<trace_entry_t *>(&(*entries)[index++]);
+}
@@ -0,0 +1,114 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* synthetic_trace: generates in-memory trace_entry_t streams with well-known
+ * access patterns for benchmarking the simulator and analysis tools, and
+ * presents them through the regular reader_t interface.
+ */
+
+#ifndef _SYNTHETIC_TRACE_H_
+#define _SYNTHETIC_TRACE_H_ 1
+
+#include <string>
+#include <vector>
+#include "reader.h"
+#include "memref.h"
+#include "trace_entry.h"
+
+typedef enum {
+    SYNTHETIC_STRIDED,
+    SYNTHETIC_RANDOM,
+    SYNTHETIC_POINTER_CHASE,
+    SYNTHETIC_ZIPF,
+} synthetic_pattern_t;
+
+struct synthetic_trace_config_t {
+    synthetic_trace_config_t() :
+        pattern(SYNTHETIC_STRIDED), num_refs(1000000), working_set(8*1024*1024),
+        stride(64), code_size(16*1024), write_percent(25), zipf_skew(0.99),
+        num_threads(1), interleave(64), seed(0) {}
+    synthetic_pattern_t pattern;
+    // Number of data references to generate, summed over all threads.  Each
+    // data reference is preceded by an instruction fetch.
+    uint64_t num_refs;
+    // Per-thread data footprint in bytes.
+    uint64_t working_set;
+    // Distance between consecutive strided accesses.  Also the granularity
+    // of the random, pointer-chase, and Zipfian patterns.
+    unsigned int stride;
+    // Per-thread code footprint in bytes, walked sequentially.
+    uint64_t code_size;
+    unsigned int write_percent;
+    double zipf_skew;
+    unsigned int num_threads;
+    // Number of data references each thread issues before switching threads.
+    unsigned int interleave;
+    unsigned int seed;
+};
+
+class synthetic_trace_t
+{
+ public:
+    explicit synthetic_trace_t(const synthetic_trace_config_t &config);
+    const std::vector<trace_entry_t> &get_entries() const { return entries; }
+    // The number of memref_t records a reader_t produces for this trace.
+    uint64_t get_num_memrefs() const { return num_memrefs; }
+
+    static bool pattern_from_name(const std::string &name, synthetic_pattern_t *pattern);
+    static const char *pattern_name(synthetic_pattern_t pattern);
+
+ private:
+    std::vector<trace_entry_t> entries;
+    uint64_t num_memrefs;
+};
+
+// Iterates over a synthetic_trace_t without copying it.  Each instance reads
+// the trace from the start.  Following typical stream iterator convention, the
+// default constructor produces an EOF object.
+class synthetic_reader_t : public reader_t
+{
+ public:
+    synthetic_reader_t();
+    explicit synthetic_reader_t(const synthetic_trace_t &trace);
+    virtual ~synthetic_reader_t() {}
+    virtual bool init();
+
+ protected:
+    virtual trace_entry_t * read_next_entry();
+
+ private:
+    const std::vector<trace_entry_t> *entries;
+    size_t index;
+};
+
+#endif /* _SYNTHETIC_TRACE_H_ */
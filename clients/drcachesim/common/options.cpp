@@ -68,30 +68,30 @@ droption_t<std::string> op_infile
  "such a file neeeds to be converted via drposttrace or -indir first).");
 
 droption_t<unsigned int> op_num_cores
-(DROPTION_SCOPE_FRONTEND, "cores", 4, "Number of cores",
+(DROPTION_SCOPE_ALL, "cores", 4, "Number of cores",
  "Specifies the number of cores to simulate.");
 
 droption_t<unsigned int> op_line_size
-(DROPTION_SCOPE_FRONTEND, "line_size", 64, "Cache line size",
+(DROPTION_SCOPE_ALL, "line_size", 64, "Cache line size",
  "Specifies the cache line size, which is assumed to be identical for L1 and L2 "
  "caches.  Must be a power of 2.");
 
 droption_t<bytesize_t> op_L1I_size
-(DROPTION_SCOPE_FRONTEND, "L1I_size", 32*1024U, "Instruction cache total size",
+(DROPTION_SCOPE_ALL, "L1I_size", 32*1024U, "Instruction cache total size",
  "Specifies the total size of each L1 instruction cache.  Must be a power of 2 "
  "and a multiple of -line_size.");
 
 droption_t<bytesize_t> op_L1D_size
-(DROPTION_SCOPE_FRONTEND, "L1D_size", bytesize_t(32*1024), "Data cache total size",
+(DROPTION_SCOPE_ALL, "L1D_size", bytesize_t(32*1024), "Data cache total size",
  "Specifies the total size of each L1 data cache.  Must be a power of 2 "
  "and a multiple of -line_size.");
 
 droption_t<unsigned int> op_L1I_assoc
-(DROPTION_SCOPE_FRONTEND, "L1I_assoc", 8, "Instruction cache associativity",
+(DROPTION_SCOPE_ALL, "L1I_assoc", 8, "Instruction cache associativity",
  "Specifies the associativity of each L1 instruction cache.  Must be a power of 2.");
 
 droption_t<unsigned int> op_L1D_assoc
-(DROPTION_SCOPE_FRONTEND, "L1D_assoc", 8, "Data cache associativity",
+(DROPTION_SCOPE_ALL, "L1D_assoc", 8, "Data cache associativity",
  "Specifies the associativity of each L1 data cache.  Must be a power of 2.");
 
 droption_t<bytesize_t> op_L2_size
@@ -132,9 +132,29 @@ droption_t<std::string> op_LL_miss_file
  "with zlib, the file is written in gzip-compressed format.");
 
 droption_t<std::string> op_L1_trace_file
-(DROPTION_SCOPE_FRONTEND, "L1_trace_file", "",
+(DROPTION_SCOPE_ALL, "L1_trace_file", "",
  "Path for writing the L1 miss/evict trace", "If non-empty, requests that "
- "every L1 miss and evict is traced to a file, in order.");
+ "every L1 miss and evict is traced to a file, in order.  This is also where "
+ "-L1_filter writes its output.");
+
+droption_t<bool> op_L1_filter
+(DROPTION_SCOPE_ALL, "L1_filter", false,
+ "Simulate the L1 caches during tracing and trace only their misses",
+ "Simulates a private L1 instruction cache and L1 data cache for each thread during "
+ "tracing itself, with the geometry given by -L1I_size, -L1I_assoc, -L1D_size, "
+ "-L1D_assoc, and -line_size, and writes only the L1 misses and evictions to "
+ "-L1_trace_file, in the same format the simulator uses for -L1_trace_file.  No "
+ "other trace is produced and no simulator is launched.  Accesses to the "
+ "most-recently-used line of each cache set are filtered inline; the rest are "
+ "simulated with LRU replacement when the trace buffer is full.  The misses and "
+ "evictions match the simulator's, except that the inline filter only checks the "
+ "first line of an access that straddles two cache lines, so a miss on the "
+ "second line of such an unaligned access can be lost.  The read and write "
+ "counts on evictions only include accesses that were not filtered inline, and "
+ "instruction counts between data misses are only exact in aggregate.  Each "
+ "thread is assigned to a core in round-robin order modulo -cores.  It uses "
+ "virtual addresses regardless of -use_physical.  Incompatible with -offline and "
+ "-L0_filter.");
 
 droption_t<bool> op_L0_filter
 (DROPTION_SCOPE_CLIENT, "L0_filter", false,
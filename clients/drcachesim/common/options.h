@@ -72,6 +72,7 @@ extern droption_t<bytesize_t>   op_L4_size;
 extern droption_t<unsigned int> op_L4_assoc;
 extern droption_t<std::string>  op_LL_miss_file;
 extern droption_t<std::string>  op_L1_trace_file;
+extern droption_t<bool>         op_L1_filter;
 extern droption_t<bytesize_t>   op_L0I_size;
 extern droption_t<bool>         op_L0_filter;
 extern droption_t<bytesize_t>   op_L0D_size;
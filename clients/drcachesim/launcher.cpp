@@ -232,7 +232,8 @@ _tmain(int argc, const TCHAR *targv[])
         if (!file_is_writable(op_outdir.get_value().c_str())) {
             FATAL_ERROR("invalid -outdir %s", op_outdir.get_value().c_str());
         }
-    } else {
+    } else if (!op_L1_filter.get_value() || have_trace_file) {
+        // With -L1_filter the tracer simulates the L1 caches itself.
         analyzer = new analyzer_multi_t;
         if (!*analyzer) {
             FATAL_ERROR("failed to initialize analyzer");
@@ -248,7 +249,7 @@ _tmain(int argc, const TCHAR *targv[])
         NOTIFY(1, "INFO", "DynamoRIO configuration directory is %s", buf);
 
 #ifdef UNIX
-        if (op_offline.get_value())
+        if (op_offline.get_value() || op_L1_filter.get_value())
             child = 0;
         else
             child = fork();
@@ -274,7 +275,7 @@ _tmain(int argc, const TCHAR *targv[])
 #endif
     }
 
-    if (!op_offline.get_value() || have_trace_file) {
+    if (analyzer != NULL) {
         if (!analyzer->run()) {
             FATAL_ERROR("failed to run analyzer");
         }
@@ -304,7 +305,8 @@ _tmain(int argc, const TCHAR *targv[])
     } else
         errcode = 0;
 
-    analyzer->print_stats();
+    if (analyzer != NULL)
+        analyzer->print_stats();
 
     // release analyzer's space
     delete analyzer;
@@ -54,7 +54,7 @@ struct include_bloom : public cache_inclusion_t {
     int hashcount;
     vector<bool> filt;
     include_bloom(int _size, int _hashcount, int _threshold, bool _clean) :
-		size(_size), hashcount(_hashcount), threshold(_threshold), clean(_clean) {
+		size(_size), threshold(_threshold), clean(_clean), hashcount(_hashcount) {
         filt.resize(size);
     }
     void update_evict(uint64_t addr) {
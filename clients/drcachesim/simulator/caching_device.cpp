@@ -42,7 +42,7 @@
 #include <iomanip>
 
 caching_device_t::caching_device_t() :
-    blocks(NULL), stats(NULL), logger(NULL), prefetcher(NULL)
+    blocks(NULL), stats(NULL), logger(NULL), isicache(false), core(0), prefetcher(NULL)
 {
     /* Empty. */
 }
@@ -0,0 +1,252 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Feeds the same reference stream, including accesses that straddle cache
+ * lines, to the tracer's -L1_filter simulation and to the cache simulator with
+ * -L1_trace_file, and checks that they report the same L1 misses and evictions.
+ * The instruction bundle counts and the per-line access counts on evictions are
+ * documented to differ, so only the event kinds and addresses are compared.
+ *
+ * With "-check <file>", instead checks the -L1_filter output of a traced app,
+ * whose reference stream is not known, for consistency.
+ */
+
+#include "dr_api.h"
+#include <assert.h>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "../common/memref.h"
+#include "../simulator/cache_simulator_create.h"
+#include "../tracer/l1_filter.h"
+
+static const uint LINE_SIZE = 64;
+static const uint64 L1I_SIZE = 4*1024;
+static const uint L1I_ASSOC = 4;
+static const uint64 L1D_SIZE = 8*1024;
+static const uint L1D_ASSOC = 4;
+static const size_t BUFFER_ENTRIES = 1024;
+static const int NUM_INSTRS = 200000;
+
+static std::string filter_text;
+
+static void
+filter_output(const char *text, size_t len)
+{
+    filter_text.append(text, len);
+}
+
+static uint
+next_rand(uint *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 16) & 0x7fff;
+}
+
+// Each instruction is followed by a data reference half of the time.  Code and
+// data both loop over footprints a few times the cache sizes, with some
+// unaligned data references that straddle two lines.
+static void
+generate_trace(std::vector<trace_entry_t> *trace)
+{
+    uint seed = 42;
+    addr_t pc = 0x400000;
+    for (int i = 0; i < NUM_INSTRS; i++) {
+        trace_entry_t entry;
+        entry.type = TRACE_TYPE_INSTR;
+        entry.size = (unsigned short)(1 + next_rand(&seed) % 8);
+        entry.addr = pc;
+        trace->push_back(entry);
+        pc += entry.size;
+        if (next_rand(&seed) % 64 == 0)
+            pc = 0x400000 + next_rand(&seed) % (4 * L1I_SIZE);
+        if (next_rand(&seed) % 2 == 0) {
+            uint r = next_rand(&seed);
+            entry.type = (r % 4 == 0) ? TRACE_TYPE_WRITE : TRACE_TYPE_READ;
+            entry.size = (unsigned short)(1 << (r % 4));
+            entry.addr = 0x10000000 + (next_rand(&seed) % (4 * L1D_SIZE / 8)) * 8;
+            if (r % 16 == 1)
+                entry.addr += LINE_SIZE - 3; // straddles into the next line
+            trace->push_back(entry);
+        }
+    }
+}
+
+// Returns the miss and eviction events as "<kind> <core> <addr>".
+static std::vector<std::string>
+parse_events(std::istream &in)
+{
+    std::vector<std::string> events;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string kind, core, addr;
+        fields >> kind >> core >> addr;
+        if (kind == "IB")
+            continue;
+        events.push_back(kind + " " + core + " " + addr);
+    }
+    return events;
+}
+
+// Checks that every eviction in the -L1_filter output in path is of a
+// resident line and that no resident line misses again, per core and cache,
+// and that the app ran enough to miss in both caches.
+static int
+check_trace(const char *path)
+{
+    std::ifstream in(path);
+    std::set<std::string> resident; // "<I or D> <core> <addr>"
+    uint64 imisses = 0, dmisses = 0, instrs = 0;
+    std::string line;
+    if (!in) {
+        std::cerr << "failed to open " << path << "\n";
+        return 1;
+    }
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string kind, core, addr;
+        uint64 val = 0;
+        fields >> kind >> core >> addr;
+        std::istringstream(addr) >> val;
+        if (kind == "IB") {
+            instrs += val;
+            continue;
+        }
+        std::string key = kind.substr(0, 1) + " " + core + " " + addr;
+        if (addr.empty() || val % LINE_SIZE != 0) {
+            std::cerr << "malformed line '" << line << "'\n";
+            return 1;
+        } else if (kind == "IE" || kind == "DE") {
+            if (resident.erase(key) == 0) {
+                std::cerr << "'" << line << "' evicts a line that is not cached\n";
+                return 1;
+            }
+        } else if (kind == "IM" || kind == "DR" || kind == "DW") {
+            if (!resident.insert(key).second) {
+                std::cerr << "'" << line << "' misses on a cached line\n";
+                return 1;
+            }
+            if (kind == "IM")
+                imisses++;
+            else
+                dmisses++;
+        } else {
+            std::cerr << "unknown event '" << line << "'\n";
+            return 1;
+        }
+    }
+    if (imisses == 0 || dmisses == 0 || instrs == 0) {
+        std::cerr << "too few events in " << path << "\n";
+        return 1;
+    }
+    std::cerr << "L1_filter trace is consistent\n";
+    return 0;
+}
+
+int
+main(int argc, const char *argv[])
+{
+    if (argc > 2 && strcmp(argv[1], "-check") == 0)
+        return check_trace(argv[2]);
+    std::vector<trace_entry_t> trace;
+    generate_trace(&trace);
+    std::string sim_file = "L1_filter_cmp.sim.txt";
+    if (argc > 1)
+        sim_file = argv[1];
+
+    dr_standalone_init();
+    {
+        l1_filter_t filter(0, LINE_SIZE, L1I_SIZE, L1I_ASSOC, L1D_SIZE, L1D_ASSOC,
+                           filter_output);
+        for (size_t start = 0; start < trace.size(); start += BUFFER_ENTRIES) {
+            size_t end = start + BUFFER_ENTRIES;
+            if (end > trace.size())
+                end = trace.size();
+            uint64 instrs = 0;
+            for (size_t i = start; i < end; i++) {
+                if (type_is_instr((trace_type_t)trace[i].type))
+                    instrs++;
+            }
+            filter.process(&trace[start], &trace[end], instrs);
+        }
+    }
+
+    analysis_tool_t *sim =
+        cache_simulator_create(1, LINE_SIZE, L1I_SIZE, L1D_SIZE, L1I_ASSOC, L1D_ASSOC,
+                               64*1024, 8, 128*1024, 8, 256*1024, 8, "", sim_file,
+                               "LRU", "none");
+    if (sim == NULL || !*sim) {
+        std::cerr << "failed to create the cache simulator\n";
+        return 1;
+    }
+    for (size_t i = 0; i < trace.size(); i++) {
+        memref_t memref;
+        memref.data.type = (trace_type_t)trace[i].type;
+        memref.data.pid = 1;
+        memref.data.tid = 1;
+        memref.data.addr = trace[i].addr;
+        memref.data.size = trace[i].size;
+        memref.data.pc = 0;
+        if (!sim->process_memref(memref)) {
+            std::cerr << "the cache simulator failed on entry #" << i << "\n";
+            return 1;
+        }
+    }
+    delete sim; // flushes sim_file
+
+    std::istringstream filter_in(filter_text);
+    std::vector<std::string> filter_events = parse_events(filter_in);
+    std::ifstream sim_in(sim_file.c_str());
+    std::vector<std::string> sim_events = parse_events(sim_in);
+    for (size_t i = 0; i < filter_events.size() || i < sim_events.size(); i++) {
+        std::string f = i < filter_events.size() ? filter_events[i] : "<none>";
+        std::string s = i < sim_events.size() ? sim_events[i] : "<none>";
+        if (f != s) {
+            std::cerr << "event #" << i << " differs: L1_filter has '" << f
+                      << "', the simulator has '" << s << "'\n";
+            return 1;
+        }
+    }
+    if (filter_events.size() < NUM_INSTRS / 10) {
+        std::cerr << "too few events to be meaningful: " << filter_events.size()
+                  << "\n";
+        return 1;
+    }
+    std::cerr << "L1_filter matches the simulator's L1 misses and evictions\n";
+    return 0;
+}
@@ -0,0 +1,204 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+#include <stdarg.h>
+#include <string.h>
+#include "l1_filter.h"
+#include "../common/utils.h"
+
+bool
+l1_filter_t::check_geometry(uint64 size, uint assoc, uint line_size)
+{
+    return IS_POWER_OF_2(size) && IS_POWER_OF_2(assoc) && IS_POWER_OF_2(line_size) &&
+        size >= (uint64)assoc * line_size;
+}
+
+l1_filter_t::l1_filter_t(int core_in, uint line_size,
+                         uint64 icache_size, uint icache_assoc,
+                         uint64 dcache_size, uint dcache_assoc,
+                         output_func_t output_in)
+    : core(core_in), line_bits(compute_log2(line_size)),
+      pending_instrs(0), output(output_in), text_len(0)
+{
+    cache_init(&icache, icache_size >> line_bits, icache_assoc);
+    cache_init(&dcache, dcache_size >> line_bits, dcache_assoc);
+}
+
+l1_filter_t::~l1_filter_t()
+{
+    flush();
+    cache_free(&icache);
+    cache_free(&dcache);
+}
+
+void
+l1_filter_t::cache_init(cache_t *cache, uint64 num_lines, uint assoc)
+{
+    cache->assoc = assoc;
+    cache->num_sets = (uint)(num_lines / assoc);
+    cache->tags = (addr_t *) dr_global_alloc((size_t)num_lines * sizeof(addr_t));
+    cache->counters = (uint *) dr_global_alloc((size_t)num_lines * sizeof(uint));
+    cache->rdcount = (uint *) dr_global_alloc((size_t)num_lines * sizeof(uint));
+    cache->wrcount = (uint *) dr_global_alloc((size_t)num_lines * sizeof(uint));
+    memset(cache->tags, 0xff, (size_t)num_lines * sizeof(addr_t)); // TAG_INVALID
+    memset(cache->counters, 0, (size_t)num_lines * sizeof(uint));
+    memset(cache->rdcount, 0, (size_t)num_lines * sizeof(uint));
+    memset(cache->wrcount, 0, (size_t)num_lines * sizeof(uint));
+}
+
+void
+l1_filter_t::cache_free(cache_t *cache)
+{
+    size_t num_lines = (size_t)cache->num_sets * cache->assoc;
+    dr_global_free(cache->tags, num_lines * sizeof(addr_t));
+    dr_global_free(cache->counters, num_lines * sizeof(uint));
+    dr_global_free(cache->rdcount, num_lines * sizeof(uint));
+    dr_global_free(cache->wrcount, num_lines * sizeof(uint));
+}
+
+void
+l1_filter_t::append(const char *fmt, ...)
+{
+    va_list ap;
+    int len;
+    if (text_len + TEXT_MAX_LINE > TEXT_BUF_SIZE)
+        flush();
+    va_start(ap, fmt);
+    len = dr_vsnprintf(text + text_len, TEXT_BUF_SIZE - text_len, fmt, ap);
+    va_end(ap);
+    DR_ASSERT(len > 0);
+    text_len += len;
+}
+
+void
+l1_filter_t::flush()
+{
+    if (text_len > 0)
+        (*output)(text, text_len);
+    text_len = 0;
+}
+
+// This mirrors cache_lru_t::access_update(): a hit on the most-recently-used
+// way, the only kind the inlined filter drops, changes nothing.
+void
+l1_filter_t::lru_update(cache_t *cache, uint base, uint way)
+{
+    uint cnt = cache->counters[way];
+    if (cnt == 0)
+        return;
+    for (uint i = base; i < base + cache->assoc; i++) {
+        if (i != way && cache->counters[i] <= cnt)
+            cache->counters[i]++;
+    }
+    cache->counters[way] = 0;
+}
+
+bool
+l1_filter_t::access(cache_t *cache, addr_t tag, bool write, bool is_icache)
+{
+    uint set = (uint)(tag & (cache->num_sets - 1));
+    uint base = set * cache->assoc;
+    uint victim = base;
+    uint max_counter = 0;
+    for (uint i = base; i < base + cache->assoc; i++) {
+        if (cache->tags[i] == tag) {
+            lru_update(cache, base, i);
+            if (write)
+                cache->wrcount[i]++;
+            else
+                cache->rdcount[i]++;
+            return false;
+        }
+    }
+    // Pick the victim as cache_lru_t::replace_which_way() does, including its
+    // tie-breaking, so that our misses and evictions match the simulator's.
+    for (uint i = base; i < base + cache->assoc; i++) {
+        if (cache->tags[i] == TAG_INVALID) {
+            victim = i;
+            break;
+        }
+        if (cache->counters[i] > max_counter) {
+            max_counter = cache->counters[i];
+            victim = i;
+        }
+    }
+    if (cache->tags[victim] != TAG_INVALID) {
+        append("%s %d " UINT64_FORMAT_STRING" %u %u\n", is_icache ? "IE" : "DE", core,
+               (uint64)cache->tags[victim] << line_bits,
+               cache->rdcount[victim], cache->wrcount[victim]);
+    }
+    cache->tags[victim] = tag;
+    cache->counters[victim] = 1;
+    lru_update(cache, base, victim);
+    cache->rdcount[victim] = write ? 0 : 1;
+    cache->wrcount[victim] = write ? 1 : 0;
+    return true;
+}
+
+void
+l1_filter_t::process(const trace_entry_t *start, const trace_entry_t *end,
+                     uint64 instr_count)
+{
+    // We do not know where within the buffer the instructions were executed,
+    // so we assume they are spread evenly across its entries.  Whatever has
+    // not been reported by the last data miss carries over to the next buffer.
+    uint64 total = pending_instrs + instr_count;
+    uint64 reported = 0;
+    size_t num_entries = end - start;
+    for (const trace_entry_t *entry = start; entry < end; entry++) {
+        trace_type_t type = (trace_type_t)entry->type;
+        bool is_icache = type_is_instr(type) || type == TRACE_TYPE_PREFETCH_INSTR;
+        bool write = type_is_write(type);
+        if (type == TRACE_TYPE_INSTR_BUNDLE ||
+            (!is_icache && !write && type != TRACE_TYPE_READ && !type_is_prefetch(type)))
+            continue;
+        addr_t size = entry->size == 0 ? 1 : entry->size;
+        addr_t tag = entry->addr >> line_bits;
+        addr_t final_tag = (entry->addr + size - 1) >> line_bits;
+        for (; tag <= final_tag; ++tag) {
+            if (!access(is_icache ? &icache : &dcache, tag, write, is_icache))
+                continue;
+            if (is_icache) {
+                append("IM %d " UINT64_FORMAT_STRING"\n", core,
+                       (uint64)tag << line_bits);
+            } else {
+                uint64 upto = total * (entry - start + 1) / num_entries;
+                append("IB %d " UINT64_FORMAT_STRING"\n", core, upto - reported);
+                reported = upto;
+                append("%s %d " UINT64_FORMAT_STRING"\n", write ? "DW" : "DR", core,
+                       (uint64)tag << line_bits);
+            }
+        }
+    }
+    pending_instrs = total - reported;
+}
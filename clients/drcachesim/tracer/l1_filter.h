@@ -0,0 +1,112 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+
+/* l1_filter: the out-of-line half of the tracer's -L1_filter mode.
+ */
+
+#ifndef _L1_FILTER_H_
+#define _L1_FILTER_H_ 1
+
+#include "dr_api.h"
+#include "../common/trace_entry.h"
+
+// Simulates the private L1 instruction and data caches of one traced thread
+// over the buffer entries that were not filtered inline, and produces the
+// resulting misses and evictions as text in the format written by
+// cache_simulator_t's -L1_trace_file (see simulator/l1logger.h).
+// Replacement is LRU, with the same recency counters as cache_lru_t.  The
+// inlined filter only drops accesses to the most-recently-used line of a set,
+// which never change LRU order or residency, so for the accesses it is given
+// the misses and evictions match the simulator.  The per-line read and write
+// counts reported on evictions do not: they only include accesses that reached
+// this class, including the access that brought the line in.
+// XXX i#2439: the inlined filter only checks the first line touched by an
+// access, so the second line of a straddling access is dropped along with it
+// when the first line hits.
+class l1_filter_t
+{
+ public:
+    typedef void (*output_func_t)(const char *text, size_t len);
+
+    // Returns false if the geometry is invalid.  All sizes must be powers of 2.
+    static bool check_geometry(uint64 size, uint assoc, uint line_size);
+
+    l1_filter_t(int core, uint line_size,
+                uint64 icache_size, uint icache_assoc,
+                uint64 dcache_size, uint dcache_assoc,
+                output_func_t output);
+    ~l1_filter_t();
+
+    // Processes one buffer's worth of trace_entry_t records.  instr_count is
+    // the number of instructions executed since the prior call: it is
+    // apportioned among the data cache misses in this buffer by position.
+    void process(const trace_entry_t *start, const trace_entry_t *end,
+                 uint64 instr_count);
+    // Hands any buffered text to the output function.
+    void flush();
+    // Drops any buffered text, for a new process after a fork.
+    void discard_output() { text_len = 0; }
+
+ private:
+    static const addr_t TAG_INVALID = (addr_t)-1;
+    struct cache_t {
+        uint num_sets;
+        uint assoc;
+        addr_t *tags;
+        // 0 is the most recent; as in cache_lru_t, ties are possible.
+        uint *counters;
+        uint *rdcount;
+        uint *wrcount;
+    };
+
+    void cache_init(cache_t *cache, uint64 num_lines, uint assoc);
+    void cache_free(cache_t *cache);
+    // Returns true on a miss.
+    bool access(cache_t *cache, addr_t tag, bool write, bool icache);
+    void lru_update(cache_t *cache, uint base, uint way);
+    void append(const char *fmt, ...);
+
+    int core;
+    int line_bits;
+    cache_t icache;
+    cache_t dcache;
+    // Instructions not yet reported in an IB line.
+    uint64 pending_instrs;
+    output_func_t output;
+    static const size_t TEXT_BUF_SIZE = 16*1024;
+    static const size_t TEXT_MAX_LINE = 64;
+    char text[TEXT_BUF_SIZE];
+    size_t text_len;
+};
+
+#endif /* _L1_FILTER_H_ */
@@ -53,6 +53,7 @@
 #include "instru.h"
 #include "raw2trace.h"
 #include "physaddr.h"
+#include "l1_filter.h"
 #include "../common/trace_entry.h"
 #include "../common/named_pipe.h"
 #include "../common/options.h"
@@ -112,9 +113,12 @@ typedef struct {
     /* For file_ops_func.handoff_buf */
     uint num_buffers;
     byte *reserve_buf;
-    /* For level 0 filters */
+    /* For level 0 filters, or the most-recently-used lines for -L1_filter */
     byte *l0_dcache;
     byte *l0_icache;
+    /* For -L1_filter */
+    l1_filter_t *l1_filter;
+    ptr_uint_t last_instr_count;
 } per_thread_t;
 
 #define MAX_NUM_DELAY_INSTRS 32
@@ -125,6 +129,7 @@ typedef struct {
     int num_delay_instrs;
     instr_t *delay_instrs[MAX_NUM_DELAY_INSTRS];
     bool repstr;
+    uint num_app_instrs; /* only computed for -L1_filter */
     void *instru_field; /* for use by instru_t */
 } user_data_t;
 
@@ -140,6 +145,13 @@ static uint64 num_refs; /* keep a global memory reference count */
 static uint64 num_refs_racy; /* racy global memory reference count */
 static volatile bool exited_process;
 
+/* Set for either -L0_filter or -L1_filter: both filter hits inline. */
+static bool inline_filter;
+
+/* For -L1_filter, all threads' misses and evictions go to a single file. */
+static file_t l1_file;
+static uint l1_num_threads;
+
 /* virtual to physical translation */
 static bool have_phys;
 static physaddr_t physaddr;
@@ -150,6 +162,8 @@ enum {
     /* XXX: we could make these dynamic to save slots when there's no -L0_filter. */
     MEMTRACE_TLS_OFFS_DCACHE,
     MEMTRACE_TLS_OFFS_ICACHE,
+    /* Instruction count, only maintained for -L1_filter. */
+    MEMTRACE_TLS_OFFS_INSTR_COUNT,
     MEMTRACE_TLS_COUNT, /* total number of TLS slots allocated */
 };
 static reg_id_t tls_seg;
@@ -316,6 +330,16 @@ write_trace_data(void *drcontext, byte *towrite_start, byte *towrite_end)
         return atomic_pipe_write(drcontext, towrite_start, towrite_end);
 }
 
+/* Called by l1_filter_t to write out -L1_filter results. */
+static void
+write_l1_output(const char *text, size_t len)
+{
+    dr_mutex_lock(mutex);
+    if (file_ops_func.write_file(l1_file, text, len) < (ssize_t)len)
+        FATAL("Fatal error: failed to write L1 trace\n");
+    dr_mutex_unlock(mutex);
+}
+
 static void
 memtrace(void *drcontext, bool skip_size_cap)
 {
@@ -350,7 +374,19 @@ memtrace(void *drcontext, bool skip_size_cap)
     } else
         data->bytes_written += buf_ptr - pipe_start;
 
-    if (do_write) {
+    if (do_write && op_L1_filter.get_value()) {
+        // We simulate the rest of the L1 caches here instead of writing out
+        // the entries that missed the inlined filter.
+        ptr_uint_t instr_count = (ptr_uint_t)
+            *TLS_SLOT(data->seg_base, MEMTRACE_TLS_OFFS_INSTR_COUNT);
+        data->l1_filter->process((trace_entry_t *)(data->buf_base + header_size),
+                                 (trace_entry_t *)buf_ptr,
+                                 instr_count - data->last_instr_count);
+        data->last_instr_count = instr_count;
+        num_refs = (uint)((buf_ptr - data->buf_base - header_size) /
+                          instru->sizeof_entry());
+        data->num_refs += num_refs;
+    } else if (do_write) {
         for (mem_ref = data->buf_base + header_size; mem_ref < buf_ptr;
              mem_ref += instru->sizeof_entry()) {
             num_refs++;
@@ -460,7 +496,7 @@ insert_update_buf_ptr(void *drcontext, instrlist_t *ilist, instr_t *where,
 {
     if (adjust == 0)
         return;
-    if (!op_L0_filter.get_value()) // Filter skips over this for !pred.
+    if (!inline_filter) // Filter skips over this for !pred.
         instrlist_set_auto_predicate(ilist, pred);
     MINSERT(ilist, where,
             XINST_CREATE_add(drcontext,
@@ -592,6 +628,32 @@ instrument_clean_call(void *drcontext, instrlist_t *ilist, instr_t *where,
 #endif
 }
 
+// Returns the number of sets in the inlined filter for the given cache.
+static ptr_int_t
+filter_num_sets(bool is_icache)
+{
+    if (op_L1_filter.get_value()) {
+        return is_icache ?
+            (ptr_int_t)(op_L1I_size.get_value() / op_line_size.get_value() /
+                        op_L1I_assoc.get_value()) :
+            (ptr_int_t)(op_L1D_size.get_value() / op_line_size.get_value() /
+                        op_L1D_assoc.get_value());
+    }
+    return is_icache ?
+        (ptr_int_t)(op_L0I_size.get_value() / op_line_size.get_value()) :
+        (ptr_int_t)(op_L0D_size.get_value() / op_line_size.get_value());
+}
+
+// Returns the size in bytes of the inlined filter's table for the given cache.
+// For -L1_filter, each data cache set has a second slot holding the
+// most-recently-used line if it has been written since becoming the MRU.
+static size_t
+filter_table_size(bool is_icache)
+{
+    size_t slots = (op_L1_filter.get_value() && !is_icache) ? 2 : 1;
+    return (size_t)filter_num_sets(is_icache) * slots * sizeof(void*);
+}
+
 // Called before writing to the trace buffer.
 // reg_ptr is treated as scratch and may be clobbered by this routine.
 // Returns DR_REG_NULL to indicate *not* to insert the instrumentation to
@@ -602,21 +664,32 @@ instrument_clean_call(void *drcontext, instrlist_t *ilist, instr_t *where,
 static reg_id_t
 insert_filter_addr(void *drcontext, instrlist_t *ilist, instr_t *where,
                    user_data_t *ud, reg_id_t reg_ptr, reg_id_t reg_addr,
-                   opnd_t ref, instr_t *app, instr_t *skip, dr_pred_type_t pred)
+                   opnd_t ref, bool write, instr_t *app, instr_t *skip,
+                   dr_pred_type_t pred)
 {
-    // Our "level 0" inlined direct-mapped cache filter.
-    DR_ASSERT(op_L0_filter.get_value());
+    // Our "level 0" inlined direct-mapped cache filter.  For -L1_filter the
+    // same code checks just the most-recently-used line of each set: a hit
+    // there can change neither the LRU order nor the dirty state (for writes,
+    // we check a separate slot that is only set by a write), so it is safe to
+    // drop it, other than for the second line of a straddling access (see the
+    // i#2439 notes below).  The rest of the L1 simulation happens out of line in
+    // memtrace().
+    DR_ASSERT(inline_filter);
     reg_id_t reg_idx;
     bool is_icache = opnd_is_null(ref);
-    uint64 cache_size = is_icache ? op_L0I_size.get_value() : op_L0D_size.get_value();
-    ptr_int_t mask = (ptr_int_t)(cache_size / op_line_size.get_value()) - 1;
+    bool two_slots = op_L1_filter.get_value() && !is_icache;
+    int slot_disp = (two_slots && write) ? sizeof(app_pc) : 0;
+    ptr_int_t mask = filter_num_sets(is_icache) - 1;
     int line_bits = compute_log2(op_line_size.get_value());
     uint offs = is_icache ? MEMTRACE_TLS_OFFS_ICACHE : MEMTRACE_TLS_OFFS_DCACHE;
     if (is_icache) {
         // For filtering the icache, we disable bundles + delays and call here on
-        // every instr.  We skip if we're still on the same cache line.
+        // every instr.  We skip if we're still on the same cache line.  We compare
+        // whole line addresses rather than set indices: the consecutive lines of a
+        // block only share a set when there is just one, where comparing indices
+        // would drop every line after the block's first.
         if (ud->last_app_pc != NULL) {
-            ptr_uint_t prior_line = ((ptr_uint_t)ud->last_app_pc >> line_bits) & mask;
+            ptr_uint_t prior_line = (ptr_uint_t)ud->last_app_pc >> line_bits;
             // FIXME i#2439: we simplify and ignore a 2nd cache line touched by an
             // instr that straddles cache lines.  However, that is not uncommon on
             // x86 and we should check the L0 cache for both lines, do regular instru
@@ -624,7 +697,7 @@ insert_filter_addr(void *drcontext, instrlist_t *ilist, instr_t *where,
             // only do half the instr if only one missed (for offline this flag would
             // have to propagate to raw2trace; for online we could use a mid-instr PC
             // and size).
-            ptr_uint_t new_line = ((ptr_uint_t)instr_get_app_pc(app) >> line_bits) & mask;
+            ptr_uint_t new_line = (ptr_uint_t)instr_get_app_pc(app) >> line_bits;
             if (prior_line == new_line)
                 return DR_REG_NULL; // Skip instru.
         }
@@ -687,9 +760,17 @@ insert_filter_addr(void *drcontext, instrlist_t *ilist, instr_t *where,
             XINST_CREATE_add_sll
             (drcontext, opnd_create_reg(reg_ptr), opnd_create_reg(reg_ptr),
              opnd_create_reg(reg_idx), compute_log2(sizeof(app_pc))));
+    if (two_slots) {
+        // x86 can't scale by 16, so we add the index twice.
+        MINSERT(ilist, where,
+                XINST_CREATE_add_sll
+                (drcontext, opnd_create_reg(reg_ptr), opnd_create_reg(reg_ptr),
+                 opnd_create_reg(reg_idx), compute_log2(sizeof(app_pc))));
+    }
     MINSERT(ilist, where,
             XINST_CREATE_load
-            (drcontext, opnd_create_reg(reg_idx), OPND_CREATE_MEMPTR(reg_ptr, 0)));
+            (drcontext, opnd_create_reg(reg_idx),
+             OPND_CREATE_MEMPTR(reg_ptr, slot_disp)));
     // Now see whether it's a hit or a miss.
     MINSERT(ilist, where,
             XINST_CREATE_cmp
@@ -699,7 +780,26 @@ insert_filter_addr(void *drcontext, instrlist_t *ilist, instr_t *where,
     // On a miss, replace the cache entry with the new cache line.
     MINSERT(ilist, where,
             XINST_CREATE_store
-            (drcontext, OPND_CREATE_MEMPTR(reg_ptr, 0), opnd_create_reg(reg_addr)));
+            (drcontext, OPND_CREATE_MEMPTR(reg_ptr, slot_disp),
+             opnd_create_reg(reg_addr)));
+    if (two_slots) {
+        // The line is now the set's MRU for reads, and for writes only if
+        // this is a write.
+        if (write) {
+            MINSERT(ilist, where,
+                    XINST_CREATE_store
+                    (drcontext, OPND_CREATE_MEMPTR(reg_ptr, 0),
+                     opnd_create_reg(reg_addr)));
+        } else {
+            MINSERT(ilist, where,
+                    XINST_CREATE_load_int
+                    (drcontext, opnd_create_reg(reg_idx), OPND_CREATE_INT32(0)));
+            MINSERT(ilist, where,
+                    XINST_CREATE_store
+                    (drcontext, OPND_CREATE_MEMPTR(reg_ptr, sizeof(app_pc)),
+                     opnd_create_reg(reg_idx)));
+        }
+    }
     // Restore app value b/c the caller will re-compute the app addr.
     // We can avoid clobbering the app address if we either get a 4th scratch or
     // keep re-computing the tag and the mask but it's better to keep the common
@@ -716,25 +816,25 @@ instrument_memref(void *drcontext, user_data_t *ud, instrlist_t *ilist, instr_t
 {
     instr_t *skip = INSTR_CREATE_label(drcontext);
     reg_id_t reg_third = DR_REG_NULL;
-    if (op_L0_filter.get_value()) {
+    if (inline_filter) {
         reg_third = insert_filter_addr(drcontext, ilist, where, ud, reg_ptr, reg_tmp,
-                                       ref, NULL, skip, pred);
+                                       ref, write, NULL, skip, pred);
         if (reg_third == DR_REG_NULL) {
             instr_destroy(drcontext, skip);
             return adjust;
         }
     }
-    if (op_L0_filter.get_value())
+    if (inline_filter)
         insert_load_buf_ptr(drcontext, ilist, where, reg_ptr);
     adjust = instru->instrument_memref(drcontext, ilist, where, reg_ptr,
                                        reg_tmp, adjust, app, ref, write, pred);
-    if (op_L0_filter.get_value() && adjust != 0) {
+    if (inline_filter && adjust != 0) {
         // When filtering we can't combine buf_ptr adjustments.
         insert_update_buf_ptr(drcontext, ilist, where, reg_ptr, pred, adjust);
         adjust = 0;
     }
     MINSERT(ilist, where, skip);
-    if (op_L0_filter.get_value()) {
+    if (inline_filter) {
         // drreg requires parity on all paths, so we need to restore the scratch regs
         // for the filter *after* the skip target.
         if (reg_third != DR_REG_NULL &&
@@ -754,25 +854,26 @@ instrument_instr(void *drcontext, void *tag, user_data_t *ud,
 {
     instr_t *skip = INSTR_CREATE_label(drcontext);
     reg_id_t reg_third = DR_REG_NULL;
-    if (op_L0_filter.get_value()) {
+    if (inline_filter) {
         reg_third = insert_filter_addr(drcontext, ilist, where, ud, reg_ptr, reg_tmp,
-                                       opnd_create_null(), app, skip, DR_PRED_NONE);
+                                       opnd_create_null(), false, app, skip,
+                                       DR_PRED_NONE);
         if (reg_third == DR_REG_NULL) {
             instr_destroy(drcontext, skip);
             return adjust;
         }
     }
-    if (op_L0_filter.get_value()) // Else already loaded.
+    if (inline_filter) // Else already loaded.
         insert_load_buf_ptr(drcontext, ilist, where, reg_ptr);
     adjust = instru->instrument_instr(drcontext, tag, &ud->instru_field, ilist,
                                       where, reg_ptr, reg_tmp, adjust, app);
-    if (op_L0_filter.get_value() && adjust != 0) {
+    if (inline_filter && adjust != 0) {
         // When filtering we can't combine buf_ptr adjustments.
         insert_update_buf_ptr(drcontext, ilist, where, reg_ptr, DR_PRED_NONE, adjust);
         adjust = 0;
     }
     MINSERT(ilist, where, skip);
-    if (op_L0_filter.get_value()) {
+    if (inline_filter) {
         // drreg requires parity on all paths, so we need to restore the scratch regs
         // for the filter *after* the skip target.
         if (reg_third != DR_REG_NULL &&
@@ -801,7 +902,7 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
 
     drmgr_disable_auto_predication(drcontext, bb);
 
-    if (op_L0_filter.get_value() && ud->repstr &&
+    if (inline_filter && ud->repstr &&
         drmgr_is_first_instr(drcontext, instr)) {
         // XXX: the control flow added for repstr ends up jumping over the
         // aflags spill for the memref, yet it hits the lazily-delayed aflags
@@ -856,7 +957,7 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
          (!op_offline.get_value() && !op_online_instr_types.get_value())) &&
         ud->strex == NULL &&
         // We can't bundle with a filter.
-        !op_L0_filter.get_value() &&
+        !inline_filter &&
         // The delay instr buffer is not full.
         ud->num_delay_instrs < MAX_NUM_DELAY_INSTRS) {
         ud->delay_instrs[ud->num_delay_instrs++] = instr;
@@ -872,7 +973,7 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
     drreg_init_and_fill_vector(&rvec2, true);
 #ifdef X86
     drreg_set_vector_entry(&rvec1, DR_REG_XCX, true);
-    if (op_L0_filter.get_value()) {
+    if (inline_filter) {
         /* We need to preserve the flags so we need xax. */
         drreg_set_vector_entry(&rvec2, DR_REG_XAX, false);
     }
@@ -889,7 +990,7 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
     drvector_delete(&rvec2);
 
     /* load buf ptr into reg_ptr, unless we're filtering */
-    if (!op_L0_filter.get_value())
+    if (!inline_filter)
         insert_load_buf_ptr(drcontext, bb, instr, reg_ptr);
 
     if (ud->num_delay_instrs != 0) {
@@ -961,7 +1062,21 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
      * assuming the clean call does not need the two register values.
      */
     if (drmgr_is_last_instr(drcontext, instr)) {
-        if (op_L0_filter.get_value())
+        if (op_L1_filter.get_value()) {
+            // Count the bb's instrs for the IB entries.  XINST_CREATE_add does
+            // not touch the flags.
+            dr_insert_read_raw_tls(drcontext, bb, instr, tls_seg,
+                                   tls_offs + sizeof(void*)*MEMTRACE_TLS_OFFS_INSTR_COUNT,
+                                   reg_tmp);
+            MINSERT(bb, instr,
+                    XINST_CREATE_add(drcontext, opnd_create_reg(reg_tmp),
+                                     OPND_CREATE_INT16(ud->num_app_instrs)));
+            dr_insert_write_raw_tls(drcontext, bb, instr, tls_seg,
+                                    tls_offs +
+                                    sizeof(void*)*MEMTRACE_TLS_OFFS_INSTR_COUNT,
+                                    reg_tmp);
+        }
+        if (inline_filter)
             insert_load_buf_ptr(drcontext, bb, instr, reg_ptr);
         instrument_clean_call(drcontext, bb, instr, reg_ptr, reg_tmp);
     }
@@ -984,6 +1099,7 @@ event_bb_app2app(void *drcontext, void *tag, instrlist_t *bb,
     data->last_app_pc = NULL;
     data->strex = NULL;
     data->num_delay_instrs = 0;
+    data->num_app_instrs = 0;
     data->instru_field = NULL;
     *user_data = (void *)data;
     if (!drutil_expand_rep_string_ex(drcontext, bb, &data->repstr, NULL)) {
@@ -999,6 +1115,16 @@ event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
 {
     user_data_t *ud = (user_data_t *) user_data;
     instru->bb_analysis(drcontext, tag, &ud->instru_field, bb, ud->repstr);
+    if (op_L1_filter.get_value()) {
+        // For an expanded string loop we count just the string instr.
+        if (ud->repstr)
+            ud->num_app_instrs = 1;
+        else {
+            for (instr_t *instr = instrlist_first_app(bb); instr != NULL;
+                 instr = instr_get_next_app(instr))
+                ud->num_app_instrs++;
+        }
+    }
     return DR_EMIT_DEFAULT;
 }
 
@@ -1249,6 +1375,28 @@ init_thread_in_process(void *drcontext)
             instru->append_tid(BUF_PTR(data->seg_base), dr_get_thread_id(drcontext));
         BUF_PTR(data->seg_base) +=
             instru->append_pid(BUF_PTR(data->seg_base), dr_get_process_id());
+    } else if (op_L1_filter.get_value()) {
+        /* There is no simulator to register with: our own L1 simulation stands in.
+         * After a fork we keep the cache state but drop the parent's pending output.
+         */
+        int core;
+        void *filter_buf;
+        if (data->l1_filter != NULL) {
+            data->l1_filter->discard_output();
+            BUF_PTR(data->seg_base) = data->buf_base + buf_hdr_slots_size;
+            return;
+        }
+        dr_mutex_lock(mutex);
+        core = l1_num_threads++ % op_num_cores.get_value();
+        dr_mutex_unlock(mutex);
+        /* we use placement new for better isolation */
+        filter_buf = dr_global_alloc(sizeof(l1_filter_t));
+        data->l1_filter = new(filter_buf)
+            l1_filter_t(core, op_line_size.get_value(),
+                        op_L1I_size.get_value(), op_L1I_assoc.get_value(),
+                        op_L1D_size.get_value(), op_L1D_assoc.get_value(),
+                        write_l1_output);
+        BUF_PTR(data->seg_base) = data->buf_base + buf_hdr_slots_size;
     } else {
         /* pass pid and tid to the simulator to register current thread */
         proc_info = (byte *)buf;
@@ -1262,14 +1410,12 @@ init_thread_in_process(void *drcontext)
         BUF_PTR(data->seg_base) = data->buf_base + buf_hdr_slots_size;
     }
 
-    if (op_L0_filter.get_value()) {
+    if (inline_filter) {
         data->l0_dcache = (byte *) dr_raw_mem_alloc
-            ((size_t)op_L0D_size.get_value()/op_line_size.get_value()*sizeof(void*),
-             DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+            (filter_table_size(false), DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
         *(byte **)TLS_SLOT(data->seg_base, MEMTRACE_TLS_OFFS_DCACHE) = data->l0_dcache;
         data->l0_icache = (byte *) dr_raw_mem_alloc
-            ((size_t)op_L0I_size.get_value()/op_line_size.get_value()*sizeof(void*),
-             DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+            (filter_table_size(true), DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
         *(byte **)TLS_SLOT(data->seg_base, MEMTRACE_TLS_OFFS_ICACHE) = data->l0_icache;
     }
 
@@ -1315,13 +1461,13 @@ event_thread_exit(void *drcontext)
     if (op_offline.get_value())
         file_ops_func.close_file(data->file);
 
-    if (op_L0_filter.get_value()) {
-        dr_raw_mem_free(data->l0_dcache,
-                        (size_t)op_L0D_size.get_value()/op_line_size.get_value()
-                        *sizeof(void*));
-        dr_raw_mem_free(data->l0_icache,
-                        (size_t)op_L0D_size.get_value()/op_line_size.get_value()
-                        *sizeof(void*));
+    if (inline_filter) {
+        dr_raw_mem_free(data->l0_dcache, filter_table_size(false));
+        dr_raw_mem_free(data->l0_icache, filter_table_size(true));
+    }
+    if (data->l1_filter != NULL) {
+        data->l1_filter->~l1_filter_t();
+        dr_global_free(data->l1_filter, sizeof(l1_filter_t));
     }
 
     dr_mutex_lock(mutex);
@@ -1346,6 +1492,8 @@ event_exit(void)
 
     if (op_offline.get_value())
         file_ops_func.close_file(module_file);
+    else if (op_L1_filter.get_value())
+        file_ops_func.close_file(l1_file);
     else
         ipc_pipe.close();
 
@@ -1428,6 +1576,24 @@ init_offline_dir(void)
     return (module_file != INVALID_FILE);
 }
 
+static void
+open_l1_file(bool new_process)
+{
+    char buf[MAXIMUM_PATH];
+    const char *path = op_L1_trace_file.get_value().c_str();
+    if (new_process) {
+        /* Each child process gets its own file. */
+        dr_snprintf(buf, BUFFER_SIZE_ELEMENTS(buf), "%s." PIDFMT, path,
+                    dr_get_process_id());
+        NULL_TERMINATE_BUFFER(buf);
+        path = buf;
+    }
+    l1_file = file_ops_func.open_file(path, IF_UNIX(DR_FILE_CLOSE_ON_FORK |)
+                                      DR_FILE_ALLOW_LARGE | DR_FILE_WRITE_OVERWRITE);
+    if (l1_file == INVALID_FILE)
+        FATAL("Fatal error: failed to create L1 trace file %s\n", path);
+}
+
 #ifdef UNIX
 static void
 fork_init(void *drcontext)
@@ -1446,7 +1612,8 @@ fork_init(void *drcontext)
         if (!init_offline_dir()) {
             FATAL("Failed to create a subdir in %s\n", op_outdir.get_value().c_str());
         }
-    }
+    } else if (op_L1_filter.get_value())
+        open_l1_file(true);
     init_thread_in_process(drcontext);
 }
 #endif
@@ -1460,9 +1627,6 @@ drmemtrace_client_main(client_id_t id, int argc, const char *argv[])
 {
     /* We need 2 reg slots beyond drreg's eflags slots => 3 slots */
     drreg_options_t ops = {sizeof(ops), 3, false};
-    /* We need an extra for -L0_filter. */
-    if (op_L0_filter.get_value())
-        ++ops.num_spill_slots;
 
     dr_set_client_name("DynamoRIO Cache Simulator Tracer",
                        "http://dynamorio.org/issues");
@@ -1473,7 +1637,8 @@ drmemtrace_client_main(client_id_t id, int argc, const char *argv[])
         FATAL("Usage error: %s\nUsage:\n%s", parse_err.c_str(),
               droption_parser_t::usage_short(DROPTION_SCOPE_ALL).c_str());
     }
-    if (!op_offline.get_value() && op_ipc_name.get_value().empty()) {
+    if (!op_offline.get_value() && !op_L1_filter.get_value() &&
+        op_ipc_name.get_value().empty()) {
         FATAL("Usage error: ipc name is required\nUsage:\n%s",
               droption_parser_t::usage_short(DROPTION_SCOPE_ALL).c_str());
     } else if (op_offline.get_value() && op_outdir.get_value().empty()) {
@@ -1485,6 +1650,26 @@ drmemtrace_client_main(client_id_t id, int argc, const char *argv[])
          !IS_POWER_OF_2(op_L0D_size.get_value()))) {
         FATAL("Usage error: L0I_size and L0D_size must be powers of 2.");
     }
+    if (op_L1_filter.get_value()) {
+        if (op_offline.get_value() || op_L0_filter.get_value())
+            FATAL("Usage error: -L1_filter is incompatible with -offline and "
+                  "-L0_filter.");
+        if (op_L1_trace_file.get_value().empty())
+            FATAL("Usage error: -L1_filter requires -L1_trace_file.");
+        if (!l1_filter_t::check_geometry(op_L1I_size.get_value(),
+                                         op_L1I_assoc.get_value(),
+                                         op_line_size.get_value()) ||
+            !l1_filter_t::check_geometry(op_L1D_size.get_value(),
+                                         op_L1D_assoc.get_value(),
+                                         op_line_size.get_value())) {
+            FATAL("Usage error: L1I_size, L1D_size, L1I_assoc, L1D_assoc, and "
+                  "line_size must be powers of 2, with room for at least one set.");
+        }
+    }
+    inline_filter = op_L0_filter.get_value() || op_L1_filter.get_value();
+    /* We need an extra for the inlined filter. */
+    if (inline_filter)
+        ++ops.num_spill_slots;
 
     if (op_offline.get_value()) {
         void *buf;
@@ -1504,7 +1689,13 @@ drmemtrace_client_main(client_id_t id, int argc, const char *argv[])
         DR_ASSERT(MAX_INSTRU_SIZE >= sizeof(online_instru_t));
         buf = dr_global_alloc(MAX_INSTRU_SIZE);
         instru = new(buf) online_instru_t(insert_load_buf_ptr,
-                                          op_L0_filter.get_value());
+                                          inline_filter);
+    }
+    if (op_L1_filter.get_value()) {
+        // We use the online entry format, but write our own simulation results
+        // instead of the entries.
+        open_l1_file(false);
+    } else if (!op_offline.get_value()) {
         if (!ipc_pipe.set_name(op_ipc_name.get_value().c_str()))
             DR_ASSERT(false);
 #ifdef UNIX
@@ -42,6 +42,10 @@
  * The runtime options for this client include:
  * -dump_text         Dumps the log file in text format
  * -dump_binary       Dumps the log file in binary format
+ * -dump_incremental  Appends newly executed basic blocks to a binary log file
+ *                    at each dump instead of dumping once at exit
+ * -dump_interval <ms> With -dump_incremental, dumps every <ms> milliseconds
+ * -hit_counts        Records how many times each basic block was executed
  * -[no_]nudge_kills  On by default.
  *                    Uses nudge to notify a child process being terminated
  *                    by its parent, so that the exit event will be called.
@@ -132,6 +136,16 @@ options_init(client_id_t id, int argc, const char *argv[], drcovlib_options_t *o
             ops->flags |= DRCOVLIB_DUMP_AS_TEXT;
         else if (strcmp(token, "-dump_binary") == 0)
             ops->flags &= ~DRCOVLIB_DUMP_AS_TEXT;
+        else if (strcmp(token, "-dump_incremental") == 0)
+            ops->flags |= DRCOVLIB_DUMP_INCREMENTAL;
+        else if (strcmp(token, "-hit_counts") == 0)
+            ops->flags |= DRCOVLIB_HIT_COUNTS;
+        else if (strcmp(token, "-dump_interval") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing -dump_interval milliseconds");
+            token = argv[++i];
+            if (dr_sscanf(token, "%u", &ops->dump_interval_ms) != 1)
+                USAGE_CHECK(false, "invalid -dump_interval milliseconds");
+        }
         else if (strcmp(token, "-no_nudge_kills") == 0)
             nudge_kills = false;
         else if (strcmp(token, "-nudge_kills") == 0)
@@ -162,7 +176,17 @@ options_init(client_id_t id, int argc, const char *argv[], drcovlib_options_t *o
             USAGE_CHECK(false, "invalid option");
         }
     }
-    if (dr_using_all_private_caches())
+    USAGE_CHECK(!TEST(DRCOVLIB_DUMP_AS_TEXT, ops->flags) ||
+                !TEST(DRCOVLIB_DUMP_INCREMENTAL, ops->flags),
+                "-dump_incremental requires a binary log");
+    USAGE_CHECK(ops->dump_interval_ms == 0 ||
+                TEST(DRCOVLIB_DUMP_INCREMENTAL, ops->flags),
+                "-dump_interval requires -dump_incremental");
+    USAGE_CHECK(!TEST(DRCOVLIB_HIT_COUNTS, ops->flags) ||
+                !TEST(DRCOVLIB_DUMP_INCREMENTAL, ops->flags),
+                "-hit_counts cannot be combined with -dump_incremental");
+    /* Hit counters are process-wide. */
+    if (dr_using_all_private_caches() && !TEST(DRCOVLIB_HIT_COUNTS, ops->flags))
         ops->flags |= DRCOVLIB_THREAD_PRIVATE;
 }
 
@@ -178,7 +202,7 @@ dr_client_main(client_id_t id, int argc, const char *argv[])
         NOTIFY(0, "fatal error: drcovlib failed to initialize\n");
         dr_abort();
     }
-    if (!dr_using_all_private_caches()) {
+    if (!TEST(DRCOVLIB_THREAD_PRIVATE, ops.flags)) {
         const char *logname;
         if (drcovlib_logfile(NULL, &logname) == DRCOVLIB_SUCCESS)
             NOTIFY(1, "<created log file %s>\n", logname);
@@ -45,7 +45,17 @@
 #include "drsyms.h"
 #include "hashtable.h"
 #include "dr_frontend.h"
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <list>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "../../common/utils.h"
 #undef ASSERT /* we're standalone, so no client assert */
@@ -58,6 +68,10 @@
 #ifdef UNIX
 # include <dirent.h> /* opendir, readdir */
 # include <unistd.h> /* getcwd */
+# include <sys/stat.h>
+# ifdef LINUX
+#  include <elf.h> /* for .gnu_debuglink */
+# endif
 #else
 # include <windows.h>
 # include <direct.h> /* _getcwd */
@@ -122,6 +136,14 @@ static droption_t<std::string> op_list
 (DROPTION_SCOPE_FRONTEND, "list", "", "Text file listing log files to process",
  "Specifies a text file that contains a list of paths of log files for processing.");
 
+static droption_t<unsigned int> op_jobs
+(DROPTION_SCOPE_FRONTEND, "jobs", 0, "Number of threads for reading log files",
+ "Specifies the number of threads used to read the input log files.  Each thread "
+ "records coverage separately and the results are merged once all files are read.  "
+ "-reduce_set also uses these threads to count the new blocks of large log files.  "
+ "0 means one thread per hardware thread.  -test_pattern always uses one thread, as "
+ "its attribution of code to tests depends on the order in which files are read.");
+
 static droption_t<std::string> op_output
 (DROPTION_SCOPE_FRONTEND, "output", DEFAULT_OUTPUT_FILE, "Names the output file",
  "Specifies the name for the output file.");
@@ -159,8 +181,10 @@ static droption_t<std::string> op_src_skip_filter
 static droption_t<std::string> op_reduce_set
 (DROPTION_SCOPE_FRONTEND, "reduce_set", "", "Output minimal inputs with same coverage",
  "Results in drcov2lcov identifying a smaller set of log files from the inputs that "
- "have the same code coverage as the full set.  The smaller set's file paths are "
- "written to the given output file path.");
+ "have the same code coverage as the full set.  The set is chosen greedily: the log "
+ "file covering the most basic blocks not yet covered is picked until every basic "
+ "block is covered.  The smaller set's file paths are written to the given output "
+ "file path in the order they were picked.");
 
 static droption_t<twostring_t> op_pathmap
 (DROPTION_SCOPE_FRONTEND, "pathmap", 0, twostring_t("",""), "Map library to local path",
@@ -168,6 +192,13 @@ static droption_t<twostring_t> op_pathmap
  "log file and the second specifies the path to replace it with before looking "
  "for debug information for that library.  Only one path is currently supported.");
 
+static droption_t<std::string> op_line_cache_dir
+(DROPTION_SCOPE_FRONTEND, "line_cache_dir", "", "Directory for caching line tables",
+ "If non-empty, the line table of each module is saved in this directory the first "
+ "time it is read from the module's debug information, in a file named after a hash "
+ "of the module's contents.  Later runs load the table from there instead of reading "
+ "the debug information again.");
+
 static droption_t<bool> op_include_tool
 (DROPTION_SCOPE_FRONTEND, "include_tool_code", false, "Include execution of tool itself",
  "Requests that execution from the drcov tool libraries themselves be included in the "
@@ -532,6 +563,7 @@ enum {
 
 typedef struct _module_table_t {
     size_t size;
+    uint index;              /* position in module_list */
     union {
         byte *bitmap;        /* store exec info (bit) for each app byte */
         const char **array;  /* store test info (char *) for each app byte */
@@ -539,6 +571,29 @@ typedef struct _module_table_t {
     hashtable_t test_htable; /* hashtable for test functions found in the module */
 } module_table_t;
 
+/* All module tables other than MODULE_TABLE_IGNORE, in creation order.
+ * module_lock guards this and module_htable while log files are read.
+ */
+static std::vector<module_table_t *> module_list;
+static std::mutex module_lock;
+
+/* Per-thread state for reading log files in parallel.  Each thread records the
+ * basic blocks it sees in its own bitmaps, which are merged into the module
+ * tables once all files are read.
+ */
+typedef struct _reader_state_t {
+    std::vector<byte *> bitmaps; /* indexed by module_table_t.index */
+} reader_state_t;
+
+/* One input log file.  For -reduce_set we also keep the basic blocks it covers,
+ * as sorted unique (module index << 32 | start offset) keys.
+ */
+typedef struct _log_file_t {
+    std::string path;
+    bool valid;
+    std::vector<uint64> bbs;
+} log_file_t;
+
 static void
 module_table_delete(void *p)
 {
@@ -564,10 +619,9 @@ bb_bitmap_lookup(module_table_t *table, uint addr)
 
 /* add an entry into a bitmap bb_table */
 static inline bool
-bb_bitmap_add(module_table_t *table, bb_entry_t *entry)
+bb_bitmap_add(byte *bm, bb_entry_t *entry)
 {
     uint idx, offs, addr_end, idx_end, offs_end, i;
-    byte *bm = table->bb_table.bitmap;
     idx = BITMAP_INDEX(entry->start);
     /* we assume that the whole bb is seen if its start addr is seen */
     if (bm[idx] == BB_TABLE_RANGE_SET)
@@ -576,10 +630,10 @@ bb_bitmap_add(module_table_t *table, bb_entry_t *entry)
     if (TEST(BITMAP_MASK(offs), bm[idx]))
         return false;
     /* now we add a new bb */
-    PRINT(6, "Add " PFX"-" PFX" in table " PFX"\n",
+    PRINT(6, "Add " PFX"-" PFX" in bitmap " PFX"\n",
           (ptr_uint_t)entry->start,
           (ptr_uint_t)entry->start + entry->size,
-          (ptr_uint_t)table);
+          (ptr_uint_t)bm);
     addr_end = entry->start + entry->size - 1;
     idx_end  = BITMAP_INDEX(addr_end);
     offs_end = (idx_end > idx) ? BITS_PER_BYTE-1 : BITMAP_OFFSET(addr_end);
@@ -652,8 +706,9 @@ module_table_bb_lookup(module_table_t *table, uint addr, const char **info)
         return bb_bitmap_lookup(table, addr);
 }
 
+/* bitmap is the bitmap to update in place of the table's own, or NULL */
 static inline bool
-module_table_bb_add(module_table_t *table, bb_entry_t *entry)
+module_table_bb_add(module_table_t *table, byte *bitmap, bb_entry_t *entry)
 {
     if (table == MODULE_TABLE_IGNORE)
         return false;
@@ -666,7 +721,7 @@ module_table_bb_add(module_table_t *table, bb_entry_t *entry)
     if (op_test_pattern.specified())
         return bb_array_add(table, entry);
     else
-        return bb_bitmap_add(table, entry);
+        return bb_bitmap_add(bitmap == NULL ? table->bb_table.bitmap : bitmap, entry);
 }
 
 static bool
@@ -758,6 +813,7 @@ read_module_list(const char *buf, module_table_t ***tables, uint *num_mods)
     void *handle;
 
     PRINT(3, "Reading module table...\n");
+    std::lock_guard<std::mutex> guard(module_lock);
     /* module table header */
     if (drmodtrack_offline_read(INVALID_FILE, buf, &buf, &handle, num_mods) !=
         DRCOVLIB_SUCCESS) {
@@ -773,9 +829,28 @@ read_module_list(const char *buf, module_table_t ***tables, uint *num_mods)
         if (drmodtrack_offline_lookup(handle, i, &info) != DRCOVLIB_SUCCESS)
             ASSERT(false, "Failed to read module table");
         PRINT(5, "Module: %u, " PFX", %s\n", i, (ptr_uint_t)info.size, info.path);
-        mod_table = (module_table_t *)hashtable_lookup(&module_htable, (void*)info.path);
+        /* The table is keyed by the path we look up symbols with, so we apply
+         * -pathmap before the lookup.
+         */
+        modpath = info.path;
+        if (op_pathmap.specified()) {
+            const char *tofind = op_pathmap.get_value().first.c_str();
+            const char *match = strstr(info.path, tofind);
+            if (match != NULL) {
+                if (dr_snprintf(subst, BUFFER_SIZE_ELEMENTS(subst),
+                                "%.*s%s%s", match - info.path, info.path,
+                                op_pathmap.get_value().second.c_str(),
+                                match + strlen(tofind)) <= 0) {
+                    WARN(1, "Failed to replace %s in %s\n", tofind, info.path);
+                } else {
+                    NULL_TERMINATE_BUFFER(subst);
+                    PRINT(4, "Substituting |%s| for |%s|\n", subst, info.path);
+                    modpath = subst;
+                }
+            }
+        }
+        mod_table = (module_table_t *)hashtable_lookup(&module_htable, (void*)modpath);
         if (mod_table == NULL) {
-            modpath = info.path;
             if (info.size >= UINT_MAX)
                 ASSERT(false, "module size is too large");
             /* FIXME i#1445: we have seen the pdb convert paths to all-lowercase,
@@ -789,23 +864,9 @@ read_module_list(const char *buf, module_table_t ***tables, uint *num_mods)
                 (!op_include_tool.get_value() && module_is_from_tool(info.path)))
                 mod_table = (module_table_t *) MODULE_TABLE_IGNORE;
             else {
-                if (op_pathmap.specified()) {
-                    const char *tofind = op_pathmap.get_value().first.c_str();
-                    const char *match = strstr(info.path, tofind);
-                    if (match != NULL) {
-                        if (dr_snprintf(subst, BUFFER_SIZE_ELEMENTS(subst),
-                                        "%.*s%s%s", match - info.path, info.path,
-                                        op_pathmap.get_value().second.c_str(),
-                                        match + strlen(tofind)) <= 0) {
-                            WARN(1, "Failed to replace %s in %s\n", tofind, info.path);
-                        } else {
-                            NULL_TERMINATE_BUFFER(subst);
-                            PRINT(2, "Substituting |%s| for |%s|\n", subst, info.path);
-                            modpath = subst;
-                        }
-                    }
-                }
                 mod_table = module_table_create(modpath, info.size);
+                mod_table->index = (uint)module_list.size();
+                module_list.push_back(mod_table);
             }
             PRINT(4, "Create module table " PFX" for module %s\n",
                   (ptr_uint_t)mod_table, modpath);
@@ -820,12 +881,46 @@ read_module_list(const char *buf, module_table_t ***tables, uint *num_mods)
     return buf;
 }
 
-static bool
-read_bb_list(const char *buf, module_table_t **tables, uint num_mods, uint num_bbs)
+/* Returns the bitmap that state's thread should record table's blocks in,
+ * or NULL to use the table's own bitmap.
+ */
+static byte *
+reader_state_bitmap(reader_state_t *state, module_table_t *table)
+{
+    if (state == NULL || table == MODULE_TABLE_IGNORE)
+        return NULL;
+    if (table->index >= state->bitmaps.size())
+        state->bitmaps.resize(table->index + 1, NULL);
+    if (state->bitmaps[table->index] == NULL) {
+        state->bitmaps[table->index] = (byte *) calloc(1, table->size/BITS_PER_BYTE);
+        ASSERT(state->bitmaps[table->index] != NULL, "Failed to create bitmap");
+    }
+    return state->bitmaps[table->index];
+}
+
+/* Merges a reading thread's bitmaps into the module tables and frees them. */
+static void
+reader_state_merge(reader_state_t *state)
+{
+    size_t i, j;
+    for (i = 0; i < state->bitmaps.size(); i++) {
+        byte *bm = state->bitmaps[i];
+        module_table_t *table = module_list[i];
+        if (bm == NULL)
+            continue;
+        for (j = 0; j < table->size/BITS_PER_BYTE; j++)
+            table->bb_table.bitmap[j] |= bm[j];
+        free(bm);
+    }
+    state->bitmaps.clear();
+}
+
+static void
+read_bb_list(const char *buf, module_table_t **tables, uint num_mods, uint num_bbs,
+             reader_state_t *state, log_file_t *log)
 {
     uint i;
     bb_entry_t *entry;
-    bool add_new_bb = false;
 
     PRINT(4, "Reading %u basic blocks\n", num_bbs);
     if (op_test_pattern.specified()) {
@@ -838,11 +933,22 @@ read_bb_list(const char *buf, module_table_t **tables, uint num_mods, uint num_b
         PRINT(6, "BB: " PFX", %u, %u\n",
               (ptr_uint_t)entry->start, entry->size, entry->mod_id);
         /* we could have mod id USHRT_MAX for unknown module e.g., [vdso] */
-        if (entry->mod_id < num_mods)
-            add_new_bb = module_table_bb_add(tables[entry->mod_id], entry) || add_new_bb;
+        if (entry->mod_id < num_mods) {
+            module_table_t *table = tables[entry->mod_id];
+            module_table_bb_add(table, reader_state_bitmap(state, table), entry);
+            if (log != NULL && table != MODULE_TABLE_IGNORE &&
+                entry->start + entry->size <= table->size)
+                log->bbs.push_back(((uint64)table->index << 32) | entry->start);
+        }
     }
-    free(tables);
-    return add_new_bb;
+}
+
+/* Sorts and de-duplicates log's blocks once it has been read. */
+static void
+log_file_finalize(log_file_t *log)
+{
+    std::sort(log->bbs.begin(), log->bbs.end());
+    log->bbs.erase(std::unique(log->bbs.begin(), log->bbs.end()), log->bbs.end());
 }
 
 static const char *
@@ -929,49 +1035,134 @@ close_input_file(file_t f, const char *map, size_t map_size)
     dr_close_file(f);
 }
 
+/* Reads a DRCOVLIB_DUMP_INCREMENTAL log file: see drcov_incr_header_t. */
 static bool
-read_drcov_file(const char *input)
+read_drcov_incr_file(const char *input, const char *map, uint64 file_size,
+                     reader_state_t *state, log_file_t *log)
+{
+    const drcov_incr_header_t *header = (const drcov_incr_header_t *)map;
+    const char *ptr, *end = map + file_size;
+    module_table_t **tables = NULL;
+    uint num_mods = 0;
+    char flavor[sizeof(header->flavor) + 1];
+
+    PRINT(3, "Reading incremental file header...\n");
+    memcpy(flavor, header->flavor, sizeof(header->flavor));
+    flavor[sizeof(header->flavor)] = '\0';
+    if (header->version != DRCOV_VERSION ||
+        header->header_size < sizeof(*header) || header->header_size > file_size ||
+        strcmp(flavor, DRCOV_FLAVOR) != 0) {
+        WARN(1, "Invalid version or bitwidth in drcov log file %s\n", input);
+        return false;
+    }
+    ptr = map + header->header_size;
+    while (ptr < end) {
+        const drcov_record_t *record = (const drcov_record_t *)ptr;
+        const char *payload = ptr + sizeof(*record);
+        if (payload > end || record->size > (uint64)(end - payload)) {
+            /* The process was likely killed in the middle of a dump. */
+            WARN(1, "Ignoring truncated record at end of %s\n", input);
+            break;
+        }
+        if (record->type == DRCOV_RECORD_MODULES) {
+            if (record->count == 0 || record->count > record->size ||
+                payload[record->count - 1] != '\0') {
+                WARN(1, "Invalid module list in drcov log file %s\n", input);
+                break;
+            }
+            free(tables);
+            if (read_module_list(payload, &tables, &num_mods) == NULL) {
+                tables = NULL;
+                break;
+            }
+        } else if (record->type == DRCOV_RECORD_BBS) {
+            if (tables == NULL ||
+                (uint64)record->count * sizeof(bb_entry_t) > record->size) {
+                WARN(1, "Invalid bb list in drcov log file %s\n", input);
+                break;
+            }
+            read_bb_list(payload, tables, num_mods, record->count, state, log);
+        } else
+            PRINT(3, "Skipping unknown record type %u\n", record->type);
+        ptr = payload + record->size;
+    }
+    free(tables);
+    return true;
+}
+
+/* May be called concurrently from multiple threads, each with its own state.
+ * state may be NULL for single-threaded reading.
+ */
+static bool
+read_drcov_file(const char *input, reader_state_t *state, log_file_t *log_info)
 {
     file_t log;
     const char  *map, *ptr;
     size_t map_size;
+    uint64 file_size;
     module_table_t **tables;
     uint   num_mods, num_bbs;
-    bool   res;
+    bool res;
 
     PRINT(2, "Reading drcov log file: %s\n", input);
-    log = open_input_file(input, &map, &map_size, NULL);
+    log = open_input_file(input, &map, &map_size, &file_size);
     if (log == INVALID_FILE) {
         WARN(1, "Failed to read drcov log file %s\n", input);
         return false;
     }
+    if (!op_reduce_set.specified())
+        log_info = NULL;
+    if (file_size >= sizeof(drcov_incr_header_t) &&
+        memcmp(map, DRCOV_INCR_MAGIC, strlen(DRCOV_INCR_MAGIC)) == 0) {
+        res = read_drcov_incr_file(input, map, file_size, state, log_info);
+        close_input_file(log, map, map_size);
+        if (log_info != NULL)
+            log_file_finalize(log_info);
+        return res;
+    }
     ptr = read_file_header(map);
     if (ptr == NULL) {
         WARN(1, "Invalid version or bitwidth in drcov log file %s\n", input);
+        close_input_file(log, map, map_size);
         return false;
     }
 
     ptr = read_module_list(ptr, &tables, &num_mods);
-    if (ptr == NULL)
+    if (ptr == NULL) {
+        close_input_file(log, map, map_size);
         return false;
+    }
 
     if (dr_sscanf(ptr, "BB Table: %u bbs\n", &num_bbs) != 1) {
         WARN(1, "Failed to read bb list from %s\n", input);
+        free(tables);
+        close_input_file(log, map, map_size);
         return false;
     }
     ptr = move_to_next_line(ptr);
     if (num_bbs*sizeof(bb_entry_t) > map_size) {
         WARN(1, "Wrong number of bbs, corrupt log file %s\n", input);
+        free(tables);
         close_input_file(log, map, map_size);
         return false;
     }
-    res = read_bb_list(ptr, tables, num_mods, num_bbs);
-    if (res && set_log != INVALID_FILE)
-        dr_fprintf(set_log, "%s\n", input);
+    read_bb_list(ptr, tables, num_mods, num_bbs, state, log_info);
+    free(tables);
     close_input_file(log, map, map_size);
+    if (log_info != NULL)
+        log_file_finalize(log_info);
     return true;
 }
 
+static void
+add_log_file(std::vector<log_file_t> *logs, const char *path)
+{
+    log_file_t log;
+    log.path = path;
+    log.valid = false;
+    logs->push_back(log);
+}
+
 static inline bool
 is_drcov_log_file(const char *fname)
 {
@@ -987,7 +1178,7 @@ is_drcov_log_file(const char *fname)
 
 #ifdef UNIX
 static bool
-read_drcov_dir(void)
+read_drcov_dir(std::vector<log_file_t> *logs)
 {
     DIR *dir;
     struct dirent *ent;
@@ -1006,7 +1197,7 @@ read_drcov_dir(void)
                     WARN(1, "Fail to get full path of log file %s\n", ent->d_name);
                 } else {
                     NULL_TERMINATE_BUFFER(path);
-                    read_drcov_file(path);
+                    add_log_file(logs, path);
                     found_logs = true;
                 }
             }
@@ -1023,7 +1214,7 @@ read_drcov_dir(void)
 }
 #else
 static bool
-read_drcov_dir(void)
+read_drcov_dir(std::vector<log_file_t> *logs)
 {
     HANDLE hFind = INVALID_HANDLE_VALUE;
     WIN32_FIND_DATA ffd;
@@ -1053,7 +1244,8 @@ read_drcov_dir(void)
             if (!has_sep)
                 strcat(path, "\\");
             strcat(path, ffd.cFileName);
-            found_logs = read_drcov_file(path) || found_logs;
+            add_log_file(logs, path);
+            found_logs = true;
         }
     } while (FindNextFile(hFind, &ffd) != 0);
     FindClose(hFind);
@@ -1064,7 +1256,7 @@ read_drcov_dir(void)
 #endif
 
 static bool
-read_drcov_list(void)
+read_drcov_list(std::vector<log_file_t> *logs)
 {
     file_t list;
     const char  *map, *ptr;
@@ -1086,7 +1278,8 @@ read_drcov_list(void)
         NULL_TERMINATE_BUFFER(path);
         ptr = move_to_next_line(ptr);
         null_terminate_path(path);
-        found_logs = read_drcov_file(path) || found_logs;
+        add_log_file(logs, path);
+        found_logs = true;
     }
     close_input_file(list, map, map_size);
     if (!found_logs)
@@ -1094,57 +1287,472 @@ read_drcov_list(void)
     return found_logs;
 }
 
+static std::atomic<size_t> next_log_file;
+
+static void
+read_drcov_thread(std::vector<log_file_t> *logs, reader_state_t *state)
+{
+    size_t i;
+    while ((i = next_log_file++) < logs->size())
+        (*logs)[i].valid = read_drcov_file((*logs)[i].path.c_str(), state, &(*logs)[i]);
+}
+
+/* Returns the number of -jobs threads to use for max_jobs units of work. */
+static size_t
+num_jobs(size_t max_jobs)
+{
+    size_t num_threads = op_jobs.get_value();
+    if (num_threads == 0)
+        num_threads = std::thread::hardware_concurrency();
+    if (op_test_pattern.specified() || num_threads == 0)
+        num_threads = 1;
+    if (num_threads > max_jobs)
+        num_threads = max_jobs;
+    return num_threads;
+}
+
+/* Reads the files in logs using -jobs threads. */
+static void
+read_drcov_files(std::vector<log_file_t> *logs)
+{
+    size_t i, num_threads = num_jobs(logs->size());
+    next_log_file = 0;
+    if (num_threads <= 1) {
+        read_drcov_thread(logs, NULL);
+        return;
+    }
+    PRINT(2, "Reading %u log files with %u threads\n", (uint)logs->size(),
+          (uint)num_threads);
+    std::vector<reader_state_t> states(num_threads);
+    std::vector<std::thread> threads;
+    for (i = 0; i < num_threads; i++)
+        threads.push_back(std::thread(read_drcov_thread, logs, &states[i]));
+    for (i = 0; i < num_threads; i++) {
+        threads[i].join();
+        reader_state_merge(&states[i]);
+    }
+}
+
+/* The fewest blocks per thread when counting the new blocks of a log file */
+#define MIN_BBS_PER_JOB (64*1024)
+
+static void
+count_uncovered_range(const std::vector<uint64> *bbs, size_t start, size_t end,
+                      const std::unordered_set<uint64> *covered, size_t *count)
+{
+    size_t i;
+    *count = 0;
+    for (i = start; i < end; i++) {
+        if (covered->find((*bbs)[i]) == covered->end())
+            (*count)++;
+    }
+}
+
+/* Returns how many of bbs are not in covered, splitting a large list across
+ * -jobs threads.  covered is not modified while they run.
+ */
+static size_t
+count_uncovered(const std::vector<uint64> &bbs, const std::unordered_set<uint64> &covered)
+{
+    size_t i, gain = 0, num_threads = num_jobs(bbs.size() / MIN_BBS_PER_JOB);
+    if (num_threads <= 1) {
+        count_uncovered_range(&bbs, 0, bbs.size(), &covered, &gain);
+        return gain;
+    }
+    std::vector<size_t> counts(num_threads);
+    std::vector<std::thread> threads;
+    size_t chunk = (bbs.size() + num_threads - 1) / num_threads;
+    for (i = 0; i < num_threads; i++) {
+        threads.push_back(std::thread(count_uncovered_range, &bbs, i * chunk,
+                                      std::min(bbs.size(), (i + 1) * chunk), &covered,
+                                      &counts[i]));
+    }
+    for (i = 0; i < num_threads; i++) {
+        threads[i].join();
+        gain += counts[i];
+    }
+    return gain;
+}
+
+/* For -reduce_set: greedily picks the log file that adds the most uncovered
+ * basic blocks until all are covered.  A file's gain can only shrink as
+ * more blocks are covered, so we keep stale gains in a priority queue and only
+ * recompute the gain of the file at the top.  Each pick depends on the
+ * previous one, so the picks themselves are serial: only the recomputation of
+ * a large file's gain is split across -jobs threads.
+ */
+static void
+write_reduced_set(std::vector<log_file_t> *logs)
+{
+    /* <gain, rank>, where a higher rank is an earlier file */
+    typedef std::pair<size_t, size_t> gain_t;
+    std::priority_queue<gain_t> queue;
+    std::unordered_set<uint64> covered;
+    size_t i, num_picked = 0;
+
+    for (i = 0; i < logs->size(); i++) {
+        if ((*logs)[i].valid && !(*logs)[i].bbs.empty())
+            queue.push(gain_t((*logs)[i].bbs.size(), logs->size() - i));
+    }
+    while (!queue.empty()) {
+        gain_t top = queue.top();
+        log_file_t *log = &(*logs)[logs->size() - top.second];
+        size_t gain;
+        queue.pop();
+        gain = count_uncovered(log->bbs, covered);
+        if (gain == 0)
+            continue;
+        /* Ties go to the earlier file. */
+        if (!queue.empty() && gain_t(gain, top.second) < queue.top()) {
+            queue.push(gain_t(gain, top.second));
+            continue;
+        }
+        covered.insert(log->bbs.begin(), log->bbs.end());
+        dr_fprintf(set_log, "%s\n", log->path.c_str());
+        num_picked++;
+    }
+    PRINT(1, "Picked %u of %u log files for the reduced set\n", (uint)num_picked,
+          (uint)logs->size());
+}
+
 static bool
 read_drcov_input(void)
 {
     bool res = true;
+    std::vector<log_file_t> logs;
+    size_t i, num_read = 0;
     if (op_input.specified())
-        res = read_drcov_file(input_file_buf) && res;
+        add_log_file(&logs, input_file_buf);
     if (op_list.specified())
-        res = read_drcov_list() && res;
+        res = read_drcov_list(&logs) && res;
     if (op_dir.specified())
-        res = read_drcov_dir() && res;
-    return res;
+        res = read_drcov_dir(&logs) && res;
+    read_drcov_files(&logs);
+    for (i = 0; i < logs.size(); i++) {
+        if (logs[i].valid)
+            num_read++;
+        else if (op_input.specified() && i == 0)
+            res = false;
+    }
+    PRINT(2, "Read %u of %u log files\n", (uint)num_read, (uint)logs.size());
+    if (set_log != INVALID_FILE)
+        write_reduced_set(&logs);
+    return res && num_read > 0;
 }
 
-static bool
-enum_line_cb(drsym_line_info_t *info, void *data)
+static void
+add_line_info(module_table_t *table, const char *file, uint64 line, uint64 line_addr)
 {
     int   status;
-    module_table_t *table = (module_table_t *)data;
     line_table_t *line_table;
     const char *test_info = NULL;
     /* FIXME i#1445: we have seen the pdb convert paths to all-lowercase,
      * so these should be case-insensitive on Windows.
      */
-    if (info->file == NULL ||
+    if (file == NULL ||
         (op_src_filter.specified() &&
-         strstr(info->file, op_src_filter.get_value().c_str()) == NULL) ||
+         strstr(file, op_src_filter.get_value().c_str()) == NULL) ||
         (op_src_skip_filter.specified() &&
-         strstr(info->file, op_src_skip_filter.get_value().c_str()) != NULL))
-        return true;
-    line_table = (line_table_t *) hashtable_lookup(&line_htable, (void *)info->file);
+         strstr(file, op_src_skip_filter.get_value().c_str()) != NULL))
+        return;
+    line_table = (line_table_t *) hashtable_lookup(&line_htable, (void *)file);
     if (line_table == NULL) {
         num_line_htable_entries++;
-        line_table = line_table_create(info->file);
-        if (!hashtable_add(&line_htable, (void *)info->file, line_table))
+        line_table = line_table_create(file);
+        if (!hashtable_add(&line_htable, (void *)file, line_table))
             ASSERT(false, "Failed to add new source line table");
     }
-    status = module_table_bb_lookup(table, (uint)info->line_addr, &test_info);
-    /* info->line is uint64 */
-    ASSERT((uint)info->line == info->line, "info->line is too large");
+    status = module_table_bb_lookup(table, (uint)line_addr, &test_info);
+    /* line is uint64 */
+    ASSERT((uint)line == line, "line number is too large");
     if (status == BB_TABLE_ENTRY_SET) {
         PRINT(5, "exec: ");
-        line_table_add(line_table, (uint)info->line,
+        line_table_add(line_table, (uint)line,
                        (byte)SOURCE_LINE_STATUS_EXEC, test_info);
     } else if (status == BB_TABLE_ENTRY_CLEAR) {
         PRINT(5, "skip: ");
-        line_table_add(line_table, (uint)info->line,
+        line_table_add(line_table, (uint)line,
                        (byte)SOURCE_LINE_STATUS_SKIP, test_info);
     } else {
         WARN(2, "Invalid bb lookup, Table: " PFX", Addr: " PFX"\n",
-             (ptr_uint_t)table, (ptr_uint_t)info->line);
+             (ptr_uint_t)table, (ptr_uint_t)line);
     }
+}
+
+/****************************************************************************
+ * Line-Table Cache
+ */
+
+/* With -line_cache_dir, the drsym_enumerate_lines() results for each module are
+ * saved in a file named after a hash of the module's contents, laid out as:
+ * - LINE_CACHE_MAGIC
+ * - uint number of source files, uint number of lines
+ * - for each source file: uint name length, then the name without a terminator
+ * - for each line: a line_cache_entry_t
+ */
+#define LINE_CACHE_MAGIC "DRCOV2LCOV LINE CACHE 1\n"
+
+typedef struct _line_cache_entry_t {
+    uint file;   /* index of the source file */
+    uint line;
+    uint64 addr; /* module offset */
+} line_cache_entry_t;
+
+typedef struct _line_cache_t {
+    std::vector<std::string> files;
+    std::unordered_map<std::string, uint> file_index;
+    std::vector<line_cache_entry_t> lines;
+} line_cache_t;
+
+/* Source file names from loaded caches.  A line_table_t points at its name, so
+ * these must live as long as line_htable does.
+ */
+static std::list<std::string> line_cache_names;
+
+typedef struct _enum_line_data_t {
+    module_table_t *table;
+    line_cache_t *cache; /* NULL if not saving to the cache */
+} enum_line_data_t;
+
+static uint64
+line_cache_hash(uint64 hash, const void *data, size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; i++) {
+        hash ^= ((const byte *)data)[i];
+        hash *= 1099511628211ULL; /* FNV-1a */
+    }
+    return hash;
+}
+
+#ifdef LINUX
+/* Returns the file name in the .gnu_debuglink section of the ELF image map, or
+ * NULL if there is none.
+ */
+template <typename Ehdr, typename Shdr>
+static const char *
+elf_debuglink(const char *map, uint64 file_size)
+{
+    const Ehdr *ehdr = (const Ehdr *)map;
+    const Shdr *shdr, *strtab;
+    uint i;
+    if (file_size < sizeof(Ehdr) || ehdr->e_shentsize != sizeof(Shdr) ||
+        ehdr->e_shoff + (uint64)ehdr->e_shnum * sizeof(Shdr) > file_size ||
+        ehdr->e_shstrndx >= ehdr->e_shnum)
+        return NULL;
+    shdr = (const Shdr *)(map + ehdr->e_shoff);
+    strtab = &shdr[ehdr->e_shstrndx];
+    for (i = 0; i < ehdr->e_shnum; i++) {
+        const char *link = map + shdr[i].sh_offset;
+        if (strtab->sh_offset + shdr[i].sh_name >= file_size ||
+            shdr[i].sh_offset + shdr[i].sh_size > file_size || shdr[i].sh_size == 0 ||
+            strncmp(map + strtab->sh_offset + shdr[i].sh_name, ".gnu_debuglink",
+                    file_size - (strtab->sh_offset + shdr[i].sh_name)) != 0)
+            continue;
+        /* The name is followed by padding and a CRC */
+        if (memchr(link, '\0', (size_t)shdr[i].sh_size) == NULL)
+            return NULL;
+        return link;
+    }
+    return NULL;
+}
+
+/* Adds the size and modification time of module's separate debug file to
+ * hash, looking where drsyms does, so that installing or rebuilding it
+ * invalidates the cache.
+ */
+static uint64
+line_cache_hash_debuglink(uint64 hash, const char *module, const char *map,
+                          uint64 file_size)
+{
+    const char *link = NULL;
+    char dir[MAXIMUM_PATH], path[MAXIMUM_PATH];
+    const char *fmt[] = {"%s/%s", "%s/.debug/%s", "/usr/lib/debug%s/%s"};
+    char *slash;
+    struct stat mod_st, st;
+    uint i;
+    if (file_size >= EI_NIDENT && memcmp(map, ELFMAG, SELFMAG) == 0) {
+        if (map[EI_CLASS] == ELFCLASS64)
+            link = elf_debuglink<Elf64_Ehdr, Elf64_Shdr>(map, file_size);
+        else if (map[EI_CLASS] == ELFCLASS32)
+            link = elf_debuglink<Elf32_Ehdr, Elf32_Shdr>(map, file_size);
+    }
+    if (link == NULL || stat(module, &mod_st) != 0)
+        return hash;
+    strncpy(dir, module, BUFFER_SIZE_ELEMENTS(dir));
+    NULL_TERMINATE_BUFFER(dir);
+    slash = strrchr(dir, '/');
+    if (slash == NULL)
+        return hash;
+    *slash = '\0';
+    for (i = 0; i < BUFFER_SIZE_ELEMENTS(fmt); i++) {
+        if (dr_snprintf(path, BUFFER_SIZE_ELEMENTS(path), fmt[i], dir, link) <= 0)
+            continue;
+        NULL_TERMINATE_BUFFER(path);
+        if (stat(path, &st) != 0 ||
+            (st.st_dev == mod_st.st_dev && st.st_ino == mod_st.st_ino))
+            continue;
+        hash = line_cache_hash(hash, &st.st_size, sizeof(st.st_size));
+        return line_cache_hash(hash, &st.st_mtime, sizeof(st.st_mtime));
+    }
+    return hash;
+}
+#endif
+
+/* Computes the cache file path for module, which must be readable.  The key
+ * covers the module's contents and the kind of debug information drsyms finds
+ * for it.  A PDB or a dSYM is identified by the GUID or UUID recorded in the
+ * module itself.  A .gnu_debuglink file is not, so on Linux the key also
+ * covers its size and modification time.
+ */
+static bool
+line_cache_path(const char *module, char *path, size_t path_len)
+{
+    file_t f;
+    const char *map;
+    size_t map_size;
+    uint64 file_size, hash = 14695981039346656037ULL;
+    drsym_debug_kind_t kind;
+
+    f = open_input_file(module, &map, &map_size, &file_size);
+    if (f == INVALID_FILE)
+        return false;
+    hash = line_cache_hash(hash, map, (size_t)file_size);
+#ifdef LINUX
+    hash = line_cache_hash_debuglink(hash, module, map, file_size);
+#endif
+    close_input_file(f, map, map_size);
+    if (drsym_get_module_debug_kind(module, &kind) != DRSYM_SUCCESS)
+        kind = (drsym_debug_kind_t)0;
+    hash = line_cache_hash(hash, &kind, sizeof(kind));
+    if (dr_snprintf(path, path_len, "%s%c" ZHEX64_FORMAT_STRING".lines",
+                    op_line_cache_dir.get_value().c_str(),
+                    IF_WINDOWS_ELSE('\\', '/'), hash) <= 0)
+        return false;
+    path[path_len - 1] = '\0';
+    return true;
+}
+
+static bool
+line_cache_load(const char *path, module_table_t *table)
+{
+    file_t f;
+    const char *map, *ptr, *end;
+    size_t map_size;
+    uint64 file_size;
+    uint i, num_files, num_lines;
+    std::vector<const char *> files;
+    bool res = false;
+
+    f = open_input_file(path, &map, &map_size, &file_size);
+    if (f == INVALID_FILE)
+        return false;
+    end = map + file_size;
+    ptr = map + strlen(LINE_CACHE_MAGIC);
+    if (ptr + 2*sizeof(uint) > end ||
+        memcmp(map, LINE_CACHE_MAGIC, strlen(LINE_CACHE_MAGIC)) != 0)
+        goto load_done;
+    memcpy(&num_files, ptr, sizeof(uint));
+    memcpy(&num_lines, ptr + sizeof(uint), sizeof(uint));
+    ptr += 2*sizeof(uint);
+    for (i = 0; i < num_files; i++) {
+        uint len;
+        if (ptr + sizeof(uint) > end)
+            goto load_done;
+        memcpy(&len, ptr, sizeof(uint));
+        ptr += sizeof(uint);
+        if (len > (size_t)(end - ptr))
+            goto load_done;
+        line_cache_names.push_back(std::string(ptr, len));
+        files.push_back(line_cache_names.back().c_str());
+        ptr += len;
+    }
+    if ((uint64)num_lines * sizeof(line_cache_entry_t) > (uint64)(end - ptr))
+        goto load_done;
+    /* Validate every entry before adding any: on failure the caller falls back
+     * to the debug information, which would add the same lines again.
+     */
+    for (i = 0; i < num_lines; i++) {
+        line_cache_entry_t entry;
+        memcpy(&entry, ptr + i * sizeof(entry), sizeof(entry));
+        if (entry.file >= num_files)
+            goto load_done;
+    }
+    for (i = 0; i < num_lines; i++, ptr += sizeof(line_cache_entry_t)) {
+        line_cache_entry_t entry;
+        memcpy(&entry, ptr, sizeof(entry));
+        add_line_info(table, files[entry.file], entry.line, entry.addr);
+    }
+    res = true;
+ load_done:
+    if (!res)
+        WARN(1, "Corrupt line cache file %s\n", path);
+    close_input_file(f, map, map_size);
+    return res;
+}
+
+static void
+line_cache_save(const char *path, line_cache_t *cache)
+{
+    char tmp_path[MAXIMUM_PATH];
+    file_t f;
+    uint i, num;
+    bool ok;
+
+    /* We write to a temporary file and rename it so concurrent runs never see
+     * a partial file.
+     */
+    dr_snprintf(tmp_path, BUFFER_SIZE_ELEMENTS(tmp_path), "%s.%d.tmp", path,
+                dr_get_process_id());
+    NULL_TERMINATE_BUFFER(tmp_path);
+    f = dr_open_file(tmp_path, DR_FILE_WRITE_OVERWRITE | DR_FILE_ALLOW_LARGE);
+    if (f == INVALID_FILE) {
+        WARN(1, "Failed to create line cache file %s\n", tmp_path);
+        return;
+    }
+    ok = dr_write_file(f, LINE_CACHE_MAGIC, strlen(LINE_CACHE_MAGIC)) ==
+        (ssize_t)strlen(LINE_CACHE_MAGIC);
+    num = (uint)cache->files.size();
+    ok = ok && dr_write_file(f, &num, sizeof(num)) == sizeof(num);
+    num = (uint)cache->lines.size();
+    ok = ok && dr_write_file(f, &num, sizeof(num)) == sizeof(num);
+    for (i = 0; ok && i < cache->files.size(); i++) {
+        num = (uint)cache->files[i].size();
+        ok = dr_write_file(f, &num, sizeof(num)) == sizeof(num) &&
+            dr_write_file(f, cache->files[i].c_str(), num) == (ssize_t)num;
+    }
+    if (ok && !cache->lines.empty()) {
+        size_t sz = cache->lines.size() * sizeof(cache->lines[0]);
+        ok = dr_write_file(f, &cache->lines[0], sz) == (ssize_t)sz;
+    }
+    dr_close_file(f);
+    if (!ok || !dr_rename_file(tmp_path, path, true/*replace*/)) {
+        WARN(1, "Failed to write line cache file %s\n", path);
+        dr_delete_file(tmp_path);
+    } else
+        PRINT(3, "Saved line cache %s\n", path);
+}
+
+static bool
+enum_line_cb(drsym_line_info_t *info, void *data)
+{
+    enum_line_data_t *enum_data = (enum_line_data_t *)data;
+    if (enum_data->cache != NULL && info->file != NULL) {
+        line_cache_t *cache = enum_data->cache;
+        line_cache_entry_t entry;
+        std::unordered_map<std::string, uint>::iterator it =
+            cache->file_index.find(info->file);
+        if (it == cache->file_index.end()) {
+            entry.file = (uint)cache->files.size();
+            cache->file_index[info->file] = entry.file;
+            cache->files.push_back(info->file);
+        } else
+            entry.file = it->second;
+        entry.line = (uint)info->line;
+        entry.addr = info->line_addr;
+        cache->lines.push_back(entry);
+    }
+    add_line_info(enum_data->table, info->file, info->line, info->line_addr);
     PRINT(5, "%s, %s, %llu, " PFX"\n",
           info->cu_name, info->file, (unsigned long long)info->line,
           (ptr_uint_t)info->line_addr);
@@ -1161,13 +1769,28 @@ enumerate_line_info(void)
         drsym_error_t res;
         for (e = module_htable.table[i]; e != NULL; e = e->next) {
             bool has_lines = true;
+            char cache_path[MAXIMUM_PATH];
+            line_cache_t cache;
+            enum_line_data_t data = {(module_table_t *)e->payload, NULL};
             num_entries++;
             PRINT(3, "Enumerate line info for %s\n", (char *)e->key);
             if (strcmp((char *)e->key, "<unknown>") == 0)
                 continue;
             if (e->payload == MODULE_TABLE_IGNORE)
                 continue;
-            res = drsym_enumerate_lines((const char *)e->key, enum_line_cb, e->payload);
+            if (!op_line_cache_dir.get_value().empty() &&
+                line_cache_path((const char *)e->key, cache_path,
+                                BUFFER_SIZE_ELEMENTS(cache_path))) {
+                if (dr_file_exists(cache_path) &&
+                    line_cache_load(cache_path, data.table)) {
+                    PRINT(3, "Loaded line cache %s\n", cache_path);
+                    /* computing the key loaded the module into drsyms */
+                    drsym_free_resources((char *)e->key);
+                    continue;
+                }
+                data.cache = &cache;
+            }
+            res = drsym_enumerate_lines((const char *)e->key, enum_line_cb, &data);
             if (res != DRSYM_SUCCESS) {
                 WARN(1, "Failed to enumerate lines for %s\n", (char *)e->key);
                 has_lines = false;
@@ -1176,6 +1799,8 @@ enumerate_line_info(void)
             /* I'm using has_lines to avoid warning on vdso. */
             if (res != DRSYM_SUCCESS && has_lines)
                 WARN(1, "Failed to free resource for %s\n", (char *)e->key);
+            if (data.cache != NULL && has_lines)
+                line_cache_save(cache_path, data.cache);
         }
     }
     ASSERT(num_entries == num_module_htable_entries,
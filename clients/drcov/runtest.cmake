@@ -85,6 +85,108 @@ endif (cmd_result)
 
 file(READ ${cov_file} cov_out)
 
+# Re-runs postcmd on the logs in ${log_dir} with the extra args passed after the
+# output file name and checks that the coverage matches the first run's.
+set(log_dir ./)
+function(run_postcmd_and_compare out_file)
+  execute_process(COMMAND ${postcmd}
+    -dir        ${log_dir}
+    -mod_filter ${test_name}
+    -src_filter ${test_name}
+    -output     ${out_file}
+    ${ARGN}
+    RESULT_VARIABLE cmd_result
+    ERROR_VARIABLE cmd_err
+    OUTPUT_VARIABLE cmd_out)
+  if (cmd_result)
+    message(FATAL_ERROR "*** ${postcmd} ${ARGN} failed (${cmd_result}): ${cmd_err} ${cmd_out}***\n")
+  endif (cmd_result)
+  file(READ ${out_file} new_out)
+  file(REMOVE ${out_file})
+  if (NOT "${new_out}" STREQUAL "${cov_out}")
+    message(FATAL_ERROR "${postcmd} ${ARGN} output ${new_out} differs from ${cov_out}")
+  endif ()
+endfunction(run_postcmd_and_compare)
+
+# A single reader thread must produce the same output as the default pool.
+run_postcmd_and_compare(${cov_file}.jobs -jobs 1)
+
+# With one log the reader pool is a single thread, so read several copies of the
+# logs with several threads: they must merge into the same coverage, and the
+# reduced set needs only one copy of each log.
+set(log_dir "${CMAKE_CURRENT_BINARY_DIR}/logs.${test_name}")
+file(REMOVE_RECURSE ${log_dir})
+file(MAKE_DIRECTORY ${log_dir})
+foreach (copy RANGE 3)
+  foreach (logfile ${drcov_logs})
+    get_filename_component(log_name ${logfile} NAME)
+    string(REGEX REPLACE "^drcov\\." "drcov.${copy}." log_name ${log_name})
+    configure_file(${logfile} ${log_dir}/${log_name} COPYONLY)
+  endforeach ()
+endforeach ()
+set(set_file "${CMAKE_CURRENT_BINARY_DIR}/set.${test_name}")
+file(REMOVE ${set_file})
+run_postcmd_and_compare(${cov_file}.multi -jobs 4 -reduce_set ${set_file})
+file(STRINGS ${set_file} set_lines)
+file(REMOVE ${set_file})
+list(LENGTH set_lines set_count)
+list(LENGTH drcov_logs log_count)
+if (set_count GREATER log_count)
+  message(FATAL_ERROR "-reduce_set picked duplicate logs: ${set_lines}")
+endif ()
+file(REMOVE_RECURSE ${log_dir})
+set(log_dir ./)
+
+# The first run fills the line cache and the second one reads from it.
+set(cache_dir "${CMAKE_CURRENT_BINARY_DIR}/lines.${test_name}")
+file(REMOVE_RECURSE ${cache_dir})
+file(MAKE_DIRECTORY ${cache_dir})
+run_postcmd_and_compare(${cov_file}.cold -line_cache_dir ${cache_dir})
+file(GLOB cache_files "${cache_dir}/*.lines")
+if (NOT cache_files)
+  message(FATAL_ERROR "-line_cache_dir did not write a line cache file")
+endif ()
+run_postcmd_and_compare(${cov_file}.warm -line_cache_dir ${cache_dir})
+file(REMOVE_RECURSE ${cache_dir})
+
+# With a single log file the reduced set is that file.
+set(set_file "${CMAKE_CURRENT_BINARY_DIR}/set.${test_name}")
+file(REMOVE ${set_file})
+run_postcmd_and_compare(${cov_file}.set -reduce_set ${set_file})
+file(READ ${set_file} set_out)
+file(REMOVE ${set_file})
+if (NOT "${set_out}" MATCHES "drcov\\.[^\n]*${test_name}[^\n]*\\.log")
+  message(FATAL_ERROR "-reduce_set output ${set_out} does not name the log file")
+endif ()
+
+# With -hit_counts, the log ends with "BB Hit Counts: N bbs\n" and a 32-bit
+# count per block.  Recursion in the app should run some block more than once.
+if ("${cmd}" MATCHES "-hit_counts")
+  set(multi_hits_seen OFF)
+  foreach(logfile ${drcov_logs})
+    file(READ ${logfile} log_hex HEX)
+    # Hex for "BB Hit Counts: ".
+    string(FIND "${log_hex}" "42422048697420436f756e74733a20" hits_pos)
+    if (hits_pos EQUAL -1)
+      message(FATAL_ERROR "${logfile} has no hit counts")
+    endif ()
+    string(SUBSTRING "${log_hex}" ${hits_pos} -1 hits_hex)
+    string(FIND "${hits_hex}" "0a" eol_pos)
+    math(EXPR eol_pos "${eol_pos} + 2")
+    string(SUBSTRING "${hits_hex}" ${eol_pos} -1 hits_hex)
+    set(hex_byte "[0-9a-f][0-9a-f]")
+    string(REGEX MATCHALL "${hex_byte}${hex_byte}${hex_byte}${hex_byte}"
+      counts "${hits_hex}")
+    list(REMOVE_ITEM counts "00000000" "01000000")
+    if (counts)
+      set(multi_hits_seen ON)
+    endif ()
+  endforeach(logfile)
+  if (NOT multi_hits_seen)
+    message(FATAL_ERROR "no block has a hit count above 1")
+  endif ()
+endif ()
+
 # cleanup
 foreach(logfile ${drcov_logs})
   file(REMOVE ${logfile})
@@ -367,6 +367,17 @@ check_callee_instr_level2(dcontext_t *dcontext, callee_info_t *ci, app_pc next_p
     return NULL;
 }
 
+bool
+check_callee_instr_simd(dcontext_t *dcontext, instr_t *instr)
+{
+    uint i;
+    for (i = 0; i < NUM_SIMD_REGS; i++) {
+        if (instr_uses_reg(instr, (DR_REG_Q0 + (reg_id_t)i)))
+            return true;
+    }
+    return false;
+}
+
 bool
 check_callee_ilist_inline(dcontext_t *dcontext, callee_info_t *ci)
 {
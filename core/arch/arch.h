@@ -1280,12 +1280,14 @@ typedef struct _callee_info_t {
     app_pc fwd_tgt;           /* last forward branch target */
     int num_simd_used;        /* number of SIMD registers (xmms) used by callee */
     bool simd_used[NUM_SIMD_REGS]; /* SIMD (xmm/ymm) registers usage */
+    bool simd_free;           /* callee and its call tree never touch SIMD regs */
     bool reg_used[NUM_GP_REGS];   /* general purpose registers usage */
     int num_callee_save_regs; /* number of regs callee saved */
     bool callee_save_regs[NUM_GP_REGS]; /* callee-save registers */
     bool has_locals;          /* if reference local via stack */
     bool standard_fp;         /* if standard reg (xbp/x29) is used as frame pointer */
     bool opt_inline;          /* can be inlined or not */
+    const char *no_inline_reason; /* why it cannot be inlined, for the exit log */
     bool write_flags;         /* if the function changes flags */
     bool read_flags;          /* if the function reads flags from caller */
     bool tls_used;            /* application accesses TLS (errno, etc.) */
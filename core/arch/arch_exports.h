@@ -68,7 +68,7 @@
 #endif /* X86 */
 
 /* Number of slots for spills from inlined clean calls. */
-#define CLEANCALL_NUM_INLINE_SLOTS 5
+#define CLEANCALL_NUM_INLINE_SLOTS 8
 
 typedef enum {
     IBL_NONE = -1,
@@ -229,6 +229,26 @@ typedef struct _local_state_extended_t {
                                   + offsetof(table_stat_state_t, stats)))
 #endif
 
+#ifdef X86
+/* -shadow_ret_stack: per-thread ring of (app return address, cache pc of a
+ * direct exit to that address) pairs pushed by mangled calls and checked by
+ * mangled returns.  The top index is kept to a byte in the cache so the ring
+ * wraps without clobbering eflags; a mismatch simply goes to the ret IBL.
+ */
+# define SHADOW_RET_STACK_ENTRIES 256
+typedef struct _shadow_ret_entry_t {
+    app_pc tag;
+    cache_pc pc;
+} shadow_ret_entry_t;
+
+typedef struct _shadow_ret_stack_t {
+    ptr_uint_t top;
+    /* value of the global deletion epoch the entries are valid for */
+    uint epoch;
+    shadow_ret_entry_t entry[SHADOW_RET_STACK_ENTRIES];
+} shadow_ret_stack_t;
+#endif
+
 #define TLS_NUM_SLOTS                                  \
    (DYNAMO_OPTION(ibl_table_in_tls) ?                  \
     sizeof(local_state_extended_t) / sizeof(void *) :  \
@@ -1836,7 +1856,8 @@ build_basic_block_fragment(dcontext_t *dcontext, app_pc start_pc,
 void interp(dcontext_t *dcontext);
 uint extend_trace(dcontext_t *dcontext, fragment_t *f, linkstub_t *prev_l);
 int append_trace_speculate_last_ibl(dcontext_t *dcontext, instrlist_t *trace,
-                                    app_pc speculate_next_tag, bool record_translation);
+                                    app_pc *speculate_next_tags, uint num_tags,
+                                    uint *site_counters, bool record_translation);
 
 uint
 forward_eflags_analysis(dcontext_t *dcontext, instrlist_t *ilist, instr_t *instr);
@@ -2043,6 +2064,20 @@ void optimize_trace(dcontext_t *dcontext, app_pc tag, instrlist_t *trace);
 #ifdef DEBUG
 void print_optimization_stats(void);
 #endif
+#if defined(INTERNAL) && defined(X86) && !defined(X64) && defined(CLIENT_SIDELINE) && \
+    !defined(SIDELINE)
+/* -optimize_async: optimize_trace() runs on a background client thread and the
+ * result replaces the private trace at the owner's next cache exit.
+ */
+# define OPTIMIZE_ASYNC
+void optimize_trace_async_safe(dcontext_t *dcontext, app_pc tag, instrlist_t *trace);
+void optimize_async_queue(dcontext_t *dcontext, fragment_t *trace, instrlist_t *ilist);
+bool optimize_async_pending(void);
+instrlist_t *optimize_async_take(dcontext_t *dcontext, fragment_t *busy,
+                                 fragment_t **trace OUT);
+void optimize_async_cancel(dcontext_t *dcontext, fragment_t *trace);
+void optimize_async_exit(void);
+#endif
 
 #ifdef SIDELINE
 /* exact overlap with sideline.h */
@@ -63,6 +63,13 @@ check_callee_instr_level2(dcontext_t *dcontext, callee_info_t *ci, app_pc next_p
     return NULL;
 }
 
+bool
+check_callee_instr_simd(dcontext_t *dcontext, instr_t *instr)
+{
+    ASSERT_NOT_IMPLEMENTED(false); /* FIXME i#2094: NYI on ARM */
+    return true;
+}
+
 bool
 check_callee_ilist_inline(dcontext_t *dcontext, callee_info_t *ci)
 {
@@ -65,6 +65,9 @@ check_callee_instr_level2(dcontext_t *dcontext, callee_info_t *ci, app_pc next_p
 bool
 check_callee_ilist_inline(dcontext_t *dcontext, callee_info_t *ci);
 
+bool
+check_callee_instr_simd(dcontext_t *dcontext, instr_t *instr);
+
 void
 analyze_clean_call_aflags(dcontext_t *dcontext,
                           clean_call_info_t *cci, instr_t *where);
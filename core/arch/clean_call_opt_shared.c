@@ -164,6 +164,25 @@ callee_info_table_init(void)
 static void
 callee_info_table_destroy(void)
 {
+    DOLOG(1, LOG_CLEANCALL, {
+        /* per-callee inlining decisions */
+        ptr_uint_t key;
+        callee_info_t *ci;
+        int iter = 0;
+        TABLE_RWLOCK(callee_info_table, read, lock);
+        do {
+            iter = generic_hash_iterate_next(GLOBAL_DCONTEXT, callee_info_table,
+                                             iter, &key, (void **)&ci);
+            if (iter < 0)
+                break;
+            LOG(GLOBAL, LOG_CLEANCALL, 1,
+                "CLEANCALL: callee "PFX": %d instrs, %s%s\n", ci->start,
+                ci->num_instrs, ci->opt_inline ? "inlined" : "not inlined: ",
+                ci->opt_inline ? "" : (ci->no_inline_reason == NULL ? "unknown" :
+                                       ci->no_inline_reason));
+        } while (true);
+        TABLE_RWLOCK(callee_info_table, read, unlock);
+    });
     callee_info_table_exit = true;
     generic_hash_destroy(GLOBAL_DCONTEXT, callee_info_table);
 }
@@ -247,6 +266,70 @@ decode_callee_instr(dcontext_t *dcontext, callee_info_t *ci, app_pc instr_pc)
     return next_pc;
 }
 
+/* The max number of instructions of a leaf function spliced into a callee. */
+# define MAX_NUM_LEAF_INSTRS 10
+
+/* Replaces a call from the callee to a small leaf function with the leaf's body.
+ * The leaf must be straight-line code ending in a plain return that neither
+ * touches the stack nor calls out, so dropping the call and return leaves
+ * the callee's stack layout unchanged.  Returns false, with ci->ilist
+ * untouched, if the leaf does not qualify.
+ */
+static bool
+decode_callee_leaf(dcontext_t *dcontext, callee_info_t *ci, app_pc leaf_pc)
+{
+    instrlist_t *body = instrlist_create(GLOBAL_DCONTEXT);
+    instr_t *instr;
+    app_pc pc = leaf_pc;
+    bool spliced = false;
+    int i, num_instrs = 0;
+
+    while (num_instrs <= MAX_NUM_LEAF_INSTRS) {
+        app_pc next_pc = NULL;
+        instr = instr_create(GLOBAL_DCONTEXT);
+        instrlist_append(body, instr);
+        TRY_EXCEPT(dcontext, {
+            next_pc = decode(GLOBAL_DCONTEXT, pc, instr);
+        }, { /* EXCEPT */
+            next_pc = NULL;
+        });
+        if (next_pc == NULL || !instr_valid(instr))
+            break;
+        instr_set_translation(instr, pc);
+        if (instr_is_return(instr)) {
+            /* A return that pops extra bytes would unbalance the stack. */
+            for (i = 0; i < instr_num_srcs(instr); i++) {
+                if (opnd_is_immed_int(instr_get_src(instr, i)))
+                    break;
+            }
+            spliced = (i == instr_num_srcs(instr));
+            break;
+        }
+        if (instr_is_cti(instr) || instr_is_syscall(instr) ||
+            instr_is_interrupt(instr) || instr_uses_reg(instr, DR_REG_XSP)
+            IF_X86(|| instr_uses_reg(instr, DR_REG_XBP)))
+            break;
+        num_instrs++;
+        pc = next_pc;
+    }
+    if (spliced) {
+        instr = instrlist_last(body);
+        instrlist_remove(body, instr);
+        instr_destroy(GLOBAL_DCONTEXT, instr);
+        for (instr = instrlist_first(body); instr != NULL;
+             instr = instrlist_first(body)) {
+            instrlist_remove(body, instr);
+            instrlist_append(ci->ilist, instr);
+        }
+        ci->num_instrs += num_instrs;
+        LOG(THREAD, LOG_CLEANCALL, 2,
+            "CLEANCALL: spliced %d-instr leaf "PFX" into callee "PFX"\n",
+            num_instrs, leaf_pc, ci->start);
+    }
+    instrlist_clear_and_destroy(GLOBAL_DCONTEXT, body);
+    return spliced;
+}
+
 /* check newly decoded instruction from callee */
 static app_pc
 check_callee_instr(dcontext_t *dcontext, callee_info_t *ci, app_pc next_pc)
@@ -283,11 +366,14 @@ check_callee_instr(dcontext_t *dcontext, callee_info_t *ci, app_pc next_pc)
         } else if (instr_is_call(instr)) {
             tgt_pc = opnd_get_pc(instr_get_target(instr));
             /* remove and destroy the call instruction */
-            ci->bailout = true;
             instrlist_remove(ilist, instr);
             instr_destroy(GLOBAL_DCONTEXT, instr);
             instr = NULL;
             ci->num_instrs--;
+            if (INTERNAL_OPTION(opt_cleancall) >= 3 &&
+                decode_callee_leaf(dcontext, ci, tgt_pc))
+                return next_pc;
+            ci->bailout = true;
             LOG(THREAD, LOG_CLEANCALL, 2,
                 "CLEANCALL: callee calls out at: "PFX" to "PFX"\n",
                 cur_pc, tgt_pc);
@@ -355,6 +441,23 @@ check_callee_ilist(dcontext_t *dcontext, callee_info_t *ci)
                 ci->bailout = true;
                 break;
             }
+            if (INTERNAL_OPTION(opt_cleancall) >= 3 && ci->bwd_tgt == NULL) {
+                /* Retarget the branch to a label so that it survives the
+                 * removal of frame setup and of the return, and can be
+                 * inlined as a meta branch.
+                 */
+                instr_t *label = instr_get_prev(tgt);
+                if (IF_X86_ELSE(instr_is_cti_loop(cti), false)) {
+                    /* no long form to fall back to if the inlined code grows */
+                    ci->bailout = true;
+                    break;
+                }
+                if (label == NULL || !instr_is_label(label)) {
+                    label = INSTR_CREATE_label(GLOBAL_DCONTEXT);
+                    instrlist_preinsert(ilist, tgt, label);
+                }
+                instr_set_target(cti, opnd_create_instr(label));
+            }
         }
         /* remove RETURN as we do not need it any more */
         instrlist_remove(ilist, ret);
@@ -384,6 +487,142 @@ decode_callee_ilist(dcontext_t *dcontext, callee_info_t *ci)
     check_callee_ilist(dcontext, ci);
 }
 
+/* Bounds on the SIMD usage scan of a callee that calls out: the scan gives up
+ * (and assumes SIMD is used) once any of these is exceeded.
+ */
+# define MAX_SIMD_SCAN_INSTRS 1024
+# define MAX_SIMD_SCAN_DEPTH  4
+# define MAX_SIMD_SCAN_PCS    64
+
+typedef struct _simd_scan_t {
+    int instrs_left;                  /* decode budget shared by the whole tree */
+    uint num_seen;
+    app_pc seen[MAX_SIMD_SCAN_PCS];   /* function entries and branch targets queued */
+} simd_scan_t;
+
+/* Returns false if pc was already queued.  Sets *full if the set overflowed. */
+static bool
+simd_scan_add_pc(simd_scan_t *scan, app_pc pc, bool *full)
+{
+    uint i;
+    for (i = 0; i < scan->num_seen; i++) {
+        if (scan->seen[i] == pc)
+            return false;
+    }
+    if (scan->num_seen == MAX_SIMD_SCAN_PCS) {
+        *full = true;
+        return false;
+    }
+    scan->seen[scan->num_seen++] = pc;
+    return true;
+}
+
+/* Returns true if the function at func, or anything it calls directly, may
+ * touch SIMD registers.  Any construct we cannot follow statically (indirect
+ * branches or calls, calls into DR, undecodable code, or running out of budget)
+ * is treated as SIMD usage.
+ */
+static bool
+callee_tree_uses_simd(dcontext_t *dcontext, simd_scan_t *scan, app_pc func, uint depth)
+{
+    app_pc pending[MAX_SIMD_SCAN_PCS];
+    uint num_pending = 0;
+    bool full = false, uses_simd = false;
+    instr_t instr;
+
+    if (depth > MAX_SIMD_SCAN_DEPTH)
+        return true;
+    pending[num_pending++] = func;
+    instr_init(dcontext, &instr);
+    while (num_pending > 0 && !uses_simd) {
+        app_pc pc = pending[--num_pending];
+        while (pc != NULL && !uses_simd) {
+            app_pc cur_pc = pc, tgt_pc;
+            if (--scan->instrs_left < 0) {
+                uses_simd = true;
+                break;
+            }
+            instr_reset(dcontext, &instr);
+            TRY_EXCEPT(dcontext, {
+                pc = decode(dcontext, cur_pc, &instr);
+            }, { /* EXCEPT */
+                pc = NULL;
+            });
+            if (pc == NULL || !instr_valid(&instr)) {
+                uses_simd = true;
+                break;
+            }
+            if (check_callee_instr_simd(dcontext, &instr)) {
+                LOG(THREAD, LOG_CLEANCALL, 2,
+                    "CLEANCALL: callee "PFX" touches SIMD at "PFX"\n", func, cur_pc);
+                uses_simd = true;
+                break;
+            }
+            if (!instr_is_cti(&instr))
+                continue;
+            if (instr_is_return(&instr))
+                break;
+            if (instr_is_mbr(&instr) || instr_is_far_cti(&instr)) {
+                LOG(THREAD, LOG_CLEANCALL, 2,
+                    "CLEANCALL: callee "PFX" has indirect cti at "PFX"\n",
+                    func, cur_pc);
+                uses_simd = true;
+                break;
+            }
+            tgt_pc = opnd_get_pc(instr_get_target(&instr));
+            if (instr_is_call(&instr)) {
+                callee_info_t *ci;
+                if (is_in_dynamo_dll(tgt_pc)) {
+                    /* e.g., dr_get_mcontext() reads the saved SIMD slots.
+                     * XXX i#975: is_in_dynamo_dll() misses a static DR.
+                     */
+                    uses_simd = true;
+                    break;
+                }
+                if (!simd_scan_add_pc(scan, tgt_pc, &full)) {
+                    if (full)
+                        uses_simd = true;
+                    continue;
+                }
+                ci = callee_info_table_lookup(tgt_pc);
+                if (ci != NULL && (ci->simd_free || (!ci->bailout &&
+                                                     ci->num_simd_used == 0)))
+                    continue;
+                if (callee_tree_uses_simd(dcontext, scan, tgt_pc, depth + 1))
+                    uses_simd = true;
+                continue;
+            }
+            /* ubr or cbr: queue the target, and stop at a ubr */
+            if (simd_scan_add_pc(scan, tgt_pc, &full))
+                pending[num_pending++] = tgt_pc;
+            else if (full)
+                uses_simd = true;
+            if (instr_is_ubr(&instr))
+                break;
+        }
+    }
+    instr_free(dcontext, &instr);
+    return uses_simd;
+}
+
+/* Computes ci->simd_free for a callee whose full analysis bailed out. */
+static void
+analyze_callee_simd_tree(dcontext_t *dcontext, callee_info_t *ci)
+{
+    simd_scan_t scan;
+    /* DR's own callees may read the saved mcontext directly. */
+    if (is_in_dynamo_dll(ci->start))
+        return;
+    scan.instrs_left = MAX_SIMD_SCAN_INSTRS;
+    scan.seen[0] = ci->start;
+    scan.num_seen = 1;
+    STATS_INC(cleancall_simd_lazy_scans);
+    ci->simd_free = !callee_tree_uses_simd(dcontext, &scan, ci->start, 0);
+    LOG(THREAD, LOG_CLEANCALL, 2,
+        "CLEANCALL: callee "PFX" call tree is %sSIMD-free\n", ci->start,
+        ci->simd_free ? "" : "not ");
+}
+
 /* Pick a register to use as a base register pointing to our spill slots.
  * We can't use a register that is:
  * - DR_XSP (need a valid stack in case of fault)
@@ -410,9 +649,8 @@ analyze_callee_pick_spill_reg(dcontext_t *dcontext, callee_info_t *ci)
         }
     }
 
-    /* This won't happen unless someone increases CLEANCALL_NUM_INLINE_SLOTS or
-     * handles calls with more arguments.  There are at least 8 GPRs, 4 spills,
-     * and 3 other regs we can't touch, so one will be available.
+    /* This can happen on x86_32 now that there are CLEANCALL_NUM_INLINE_SLOTS
+     * spill slots: a callee using every GPR we can touch leaves none to pick.
      */
     LOG(THREAD, LOG_CLEANCALL, 2,
         "CLEANCALL: failed to pick spill reg for callee "PFX"\n", ci->start);
@@ -420,6 +658,16 @@ analyze_callee_pick_spill_reg(dcontext_t *dcontext, callee_info_t *ci)
     ci->spill_reg = DR_REG_INVALID;
 }
 
+static void
+callee_info_no_inline(callee_info_t *ci, const char *reason)
+{
+    LOG(THREAD_GET, LOG_CLEANCALL, 1,
+        "CLEANCALL: callee "PFX" cannot be inlined: %s.\n", ci->start, reason);
+    /* keep the first reason for the decision log at exit */
+    if (ci->no_inline_reason == NULL)
+        ci->no_inline_reason = reason;
+}
+
 static void
 analyze_callee_inline(dcontext_t *dcontext, callee_info_t *ci)
 {
@@ -427,45 +675,37 @@ analyze_callee_inline(dcontext_t *dcontext, callee_info_t *ci)
 
     /* a set of condition checks */
     if (INTERNAL_OPTION(opt_cleancall) < 2) {
-        LOG(THREAD, LOG_CLEANCALL, 1,
-            "CLEANCALL: callee "PFX" cannot be inlined: opt_cleancall: %d.\n",
-            ci->start, INTERNAL_OPTION(opt_cleancall));
+        callee_info_no_inline(ci, "opt_cleancall < 2");
         opt_inline = false;
     }
     if (ci->num_instrs > MAX_NUM_INLINE_INSTRS) {
         LOG(THREAD, LOG_CLEANCALL, 1,
-            "CLEANCALL: callee "PFX" cannot be inlined: num of instrs: %d.\n",
-            ci->start, ci->num_instrs);
+            "CLEANCALL: callee "PFX" has %d instrs.\n", ci->start, ci->num_instrs);
+        callee_info_no_inline(ci, "too many instrs");
         opt_inline = false;
     }
-    if (ci->bwd_tgt != NULL || ci->fwd_tgt != NULL) {
-        LOG(THREAD, LOG_CLEANCALL, 1,
-            "CLEANCALL: callee "PFX" cannot be inlined: has control flow.\n",
-            ci->start);
+    /* Forward-only branches are turned into meta branches to labels by
+     * check_callee_ilist at -opt_cleancall 3.
+     */
+    if (ci->bwd_tgt != NULL ||
+        (ci->fwd_tgt != NULL && INTERNAL_OPTION(opt_cleancall) < 3)) {
+        callee_info_no_inline(ci, "has control flow");
         opt_inline = false;
     }
     if (ci->num_simd_used != 0) {
-        LOG(THREAD, LOG_CLEANCALL, 1,
-            "CLEANCALL: callee "PFX" cannot be inlined: uses XMM.\n",
-            ci->start);
+        callee_info_no_inline(ci, "uses XMM");
         opt_inline = false;
     }
     if (ci->tls_used) {
-        LOG(THREAD, LOG_CLEANCALL, 1,
-            "CLEANCALL: callee "PFX" cannot be inlined: accesses TLS.\n",
-            ci->start);
+        callee_info_no_inline(ci, "accesses TLS");
         opt_inline = false;
     }
     if (ci->spill_reg == DR_REG_INVALID) {
-        LOG(THREAD, LOG_CLEANCALL, 1,
-            "CLEANCALL: callee "PFX" cannot be inlined:"
-            " unable to pick spill reg.\n", ci->start);
+        callee_info_no_inline(ci, "unable to pick spill reg");
         opt_inline = false;
     }
     if (!SCRATCH_ALWAYS_TLS() || ci->slots_used > CLEANCALL_NUM_INLINE_SLOTS) {
-        LOG(THREAD, LOG_CLEANCALL, 1,
-            "CLEANCALL: callee "PFX" cannot be inlined:"
-            " not enough scratch slots.\n", ci->start);
+        callee_info_no_inline(ci, "not enough scratch slots");
         opt_inline = false;
     }
     if (!opt_inline) {
@@ -484,8 +724,7 @@ analyze_callee_inline(dcontext_t *dcontext, callee_info_t *ci)
             "CLEANCALL: callee "PFX" can be inlined.\n", ci->start);
     } else {
         /* not inline callee, so ilist is not needed. */
-        LOG(THREAD, LOG_CLEANCALL, 1,
-            "CLEANCALL: callee "PFX" cannot be inlined.\n", ci->start);
+        callee_info_no_inline(ci, "unsupported stack usage");
         instrlist_clear_and_destroy(GLOBAL_DCONTEXT, ci->ilist);
         ci->ilist = NULL;
     }
@@ -608,8 +847,76 @@ analyze_clean_call_args(dcontext_t *dcontext,
      */
 }
 
+/* Multiple args are materialized one after another straight into their param
+ * regs, so no arg may read a param reg, the spill reg, or xax (which holds the
+ * aflags while they are saved).
+ */
+static bool
+clean_call_args_inlineable(clean_call_info_t *cci, opnd_t *args)
+{
+    callee_info_t *info = cci->callee_info;
+    uint i, j;
+    for (i = 0; i < cci->num_args; i++) {
+        if (opnd_uses_reg(args[i], info->spill_reg)
+            IF_X86(|| opnd_uses_reg(args[i], DR_REG_XAX)))
+            return false;
+        for (j = 0; j < cci->num_args && j < NUM_REGPARM; j++) {
+            if (opnd_uses_reg(args[i], regparms[j]))
+                return false;
+        }
+    }
+    return true;
+}
+
+/* Skips the save and restore of GPRs that are dead after the call site: fully
+ * written before being read, with nothing in between that could fault or
+ * leave the block (either would expose the clobbered value).
+ * This scan happens at insertion time and assumes the client does not add
+ * instrumentation at or after "where" that reads the reg, which is why it is
+ * behind -cleancall_skip_dead_regs.
+ */
+static void
+analyze_clean_call_regs_liveness(dcontext_t *dcontext, clean_call_info_t *cci,
+                                 instr_t *where)
+{
+    callee_info_t *info = cci->callee_info;
+    instr_t *instr;
+    uint i;
+
+    for (i = 0; i < NUM_GP_REGS; i++) {
+        reg_id_t reg = DR_REG_START_GPR + (reg_id_t)i;
+        if (cci->reg_skip[i] || reg == DR_REG_XSP || reg == info->spill_reg)
+            continue;
+# ifdef X86
+        /* xax carries the aflags through the save and restore, and the arg on x86 */
+        if (reg == DR_REG_XAX &&
+            (!cci->skip_save_flags || IF_X64_ELSE(false, cci->num_args > 0)))
+            continue;
+# endif
+        for (instr = where; instr != NULL; instr = instr_get_next(instr)) {
+            if (instr_reads_from_reg(instr, reg, DR_QUERY_INCLUDE_ALL) ||
+                instr_is_cti(instr) || instr_is_syscall(instr) ||
+                instr_is_interrupt(instr) || instr_reads_memory(instr) ||
+                instr_writes_memory(instr))
+                break;
+            if (instr_writes_to_exact_reg(instr, reg, DR_QUERY_DEFAULT)
+                IF_X86_64(|| instr_writes_to_exact_reg(instr, reg_64_to_32(reg),
+                                                       DR_QUERY_DEFAULT))) {
+                LOG(THREAD, LOG_CLEANCALL, 2,
+                    "CLEANCALL: inlining clean call "PFX", %s is dead.\n",
+                    info->start, reg_names[reg]);
+                cci->reg_skip[i] = true;
+                cci->num_regs_skip++;
+                STATS_INC(cleancall_dead_reg_save_skipped);
+                break;
+            }
+        }
+    }
+}
+
 static bool
-analyze_clean_call_inline(dcontext_t *dcontext, clean_call_info_t *cci)
+analyze_clean_call_inline(dcontext_t *dcontext, clean_call_info_t *cci,
+                          instr_t *where, opnd_t *args)
 {
     callee_info_t *info = cci->callee_info;
     bool opt_inline = true;
@@ -620,7 +927,9 @@ analyze_clean_call_inline(dcontext_t *dcontext, clean_call_info_t *cci)
             info->start, INTERNAL_OPTION(opt_cleancall));
         opt_inline = false;
     }
-    if (cci->num_args > 1) {
+    if (cci->num_args > 1 &&
+        (INTERNAL_OPTION(opt_cleancall) < 3 ||
+         IF_X64_ELSE(cci->num_args > NUM_REGPARM, true))) {
         LOG(THREAD, LOG_CLEANCALL, 2,
             "CLEANCALL: fail inlining clean call "PFX", number of args %d > 1.\n",
             info->start, cci->num_args);
@@ -652,6 +961,12 @@ analyze_clean_call_inline(dcontext_t *dcontext, clean_call_info_t *cci)
             info->start, info->slots_used, CLEANCALL_NUM_INLINE_SLOTS);
         opt_inline = false;
     }
+    if (opt_inline && cci->num_args > 1 && !clean_call_args_inlineable(cci, args)) {
+        LOG(THREAD, LOG_CLEANCALL, 2,
+            "CLEANCALL: fail inlining clean call "PFX", args use param regs.\n",
+            info->start);
+        opt_inline = false;
+    }
     if (!opt_inline) {
         if (cci->save_all_regs) {
             LOG(THREAD, LOG_CLEANCALL, 2,
@@ -680,6 +995,9 @@ analyze_clean_call_inline(dcontext_t *dcontext, clean_call_info_t *cci)
             STATS_INC(cleancall_aflags_clear_skipped);
         }
     } else {
+        if (INTERNAL_OPTION(opt_cleancall) >= 3 &&
+            INTERNAL_OPTION(cleancall_skip_dead_regs))
+            analyze_clean_call_regs_liveness(dcontext, cci, where);
         cci->ilist = instrlist_clone(dcontext, info->ilist);
     }
     return opt_inline;
@@ -693,6 +1011,7 @@ analyze_clean_call(dcontext_t *dcontext, clean_call_info_t *cci, instr_t *where,
     callee_info_t *ci;
     /* by default, no inline optimization */
     bool should_inline = false;
+    bool lazy_simd_skip = false;
 
     CLIENT_ASSERT(callee != NULL, "Clean call target is NULL");
     /* 1. init clean_call_info */
@@ -713,6 +1032,9 @@ analyze_clean_call(dcontext_t *dcontext, clean_call_info_t *cci, instr_t *where,
             if (ci->bailout) {
                 callee_info_init(ci);
                 ci->start = (app_pc)callee;
+                ci->no_inline_reason = "analysis bailed out";
+                if (DYNAMO_OPTION(cleancall_lazy_simd))
+                    analyze_callee_simd_tree(dcontext, ci);
             } else
                 analyze_callee_ilist(dcontext, ci);
             /* 4.4. add info into callee list */
@@ -727,9 +1049,25 @@ analyze_clean_call(dcontext_t *dcontext, clean_call_info_t *cci, instr_t *where,
             /* 7. check arguments */
             analyze_clean_call_args(dcontext, cci, args);
             /* 8. inline optimization analysis */
-            should_inline = analyze_clean_call_inline(dcontext, cci);
+            should_inline = analyze_clean_call_inline(dcontext, cci, where, args);
+        } else if (ci->simd_free) {
+            /* The callee can't be analyzed fully but nothing it runs touches
+             * SIMD state, so only the SIMD save is skipped.  We keep the
+             * mcontext shape in case the callee reaches DR in a way the scan
+             * missed.
+             */
+            uint i;
+            cci->preserve_mcontext = true;
+            for (i = 0; i < NUM_SIMD_REGS; i++)
+                cci->simd_skip[i] = true;
+            cci->num_simd_skip = NUM_SIMD_REGS;
+            lazy_simd_skip = true;
+            STATS_INC(cleancall_simd_lazy_skipped);
         }
     }
+    if (cci->num_simd_skip != NUM_SIMD_REGS) {
+        STATS_INC(cleancall_simd_saved);
+    }
 
 /* Thresholds for out-of-line calls. The values are based on a guess. The bar
  * for generating out-of-line calls is quite low, so the code size is kept low.
@@ -758,9 +1096,11 @@ analyze_clean_call(dcontext_t *dcontext, clean_call_info_t *cci, instr_t *where,
     /* Use out-of-line calls if more than SIMD_SAVE_TRESHOLD SIMD registers have
      * to be saved or if more than GPR_SAVE_TRESHOLD GP registers have to be saved.
      * XXX: This should probably be in arch-specific clean_call_opt.c.
+     * The shared out-of-line routine always saves the SIMD registers, so a
+     * lazily skipped SIMD save keeps the GPR save inline.
      */
     if ((NUM_SIMD_REGS - cci->num_simd_skip) > SIMD_SAVE_TRESHOLD ||
-        (NUM_GP_REGS - cci->num_regs_skip) > GPR_SAVE_TRESHOLD ||
+        ((NUM_GP_REGS - cci->num_regs_skip) > GPR_SAVE_TRESHOLD && !lazy_simd_skip) ||
         always_out_of_line)
         cci->out_of_line_swap = true;
 # endif
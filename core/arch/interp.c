@@ -5560,6 +5560,13 @@ recreate_fragment_ilist(dcontext_t *dcontext, byte *pc,
                         optimize_trace(dcontext, f->tag, ilist);
                     /* else, never optimized */
                 } else
+# endif
+# ifdef OPTIMIZE_ASYNC
+                if (DYNAMO_OPTION(optimize_async)) {
+                    if (TEST(FRAG_OPTIMIZED_ASYNC, f->flags))
+                        optimize_trace_async_safe(dcontext, f->tag, ilist);
+                    /* else, not yet replaced */
+                } else
 # endif
                     optimize_trace(dcontext, f->tag, ilist);
             }
@@ -6408,13 +6415,17 @@ fixup_last_cti(dcontext_t *dcontext, instrlist_t *trace,
     return added_size;
 }
 
-/* Add a speculative counter on last IBL exit
+/* Add speculative comparisons against num_tags targets, in order, on the last
+ * IBL exit.  Each matching target gets its own direct exit; a miss on all of
+ * them falls through to the IBL.
+ * With -speculate_last_exit_stats, site_counters, if non-NULL, has num_tags+1
+ * entries: [0] counts executions of the exit and [1+i] matches of target i.
  * Returns additional size to add to trace estimate.
  */
 int
 append_trace_speculate_last_ibl(dcontext_t *dcontext, instrlist_t *trace,
-                                app_pc speculate_next_tag,
-                                bool record_translation)
+                                app_pc *speculate_next_tags, uint num_tags,
+                                uint *site_counters, bool record_translation)
 {
     /* unlike fixup_last_cti() here we are about to go directly to the IBL routine */
     /* spill XCX in a scratch slot - note always using TLS */
@@ -6424,10 +6435,10 @@ append_trace_speculate_last_ibl(dcontext_t *dcontext, instrlist_t *trace,
     instr_t *inst = instrlist_last(trace); /* currently only relevant to last CTI */
     instr_t *where = inst;         /* preinsert before last CTI */
 
-    instr_t *next = instr_get_next(inst);
+    uint i;
     DEBUG_DECLARE(bool ok;)
 
-    ASSERT(speculate_next_tag != NULL);
+    ASSERT(num_tags > 0 && speculate_next_tags != NULL);
     ASSERT(inst != NULL);
     ASSERT(instr_is_exit_cti(inst));
 
@@ -6457,6 +6468,11 @@ append_trace_speculate_last_ibl(dcontext_t *dcontext, instrlist_t *trace,
                 (dcontext, trace, where,
                  &get_ibl_per_type_statistics(dcontext, ibl_type.branch_type)
                  ->ib_trace_last_ibl_exit);
+            if (site_counters != NULL) {
+                added_size +=
+                    insert_increment_stat_counter(dcontext, trace, where,
+                                                  &site_counters[0]);
+            }
             added_size +=
                 tracelist_add(dcontext, trace, where,
                               XINST_CREATE_load
@@ -6465,97 +6481,139 @@ append_trace_speculate_last_ibl(dcontext_t *dcontext, instrlist_t *trace,
         }
     });
 #endif
-    /* preinsert comparison before exit CTI, but increment of success
-     * statistics after it
-     */
 
-    /* we need to compare to speculate_next_tag now */
-    /* XCX holds value to match */
-
-    /* should use similar eflags-clobbering scheme to inline cmp */
-    IF_X64(ASSERT_NOT_IMPLEMENTED(false));
-    /*
-     *    8d 89 76 9b bf ff    lea    -tag(%ecx) -> %ecx
-     *    e3 0b                jecxz  continue
-     *    8d 89 8a 64 40 00    lea    tag(%ecx) -> %ecx
-     *    e9 17 00 00 00       jmp    <exit stub 1: IBL>
+    /* Each target's comparison is followed by its own landing pad, so each
+     * jecxz only has to reach past one lea and one jmp, whatever the number of
+     * targets and whether stats are on:
      *
-     * continue:
-     *                        <increment stats>
-     *                        # see FIXME whether to go to prefix or do here
-     *                        <restore app ecx>
-     *    e9 cc aa dd 00       jmp speculate_next_tag
+     *    lea    -tag1(%ecx) -> %ecx
+     *    jecxz  match1
+     *    lea    tag1(%ecx) -> %ecx
+     *    jmp    check2
+     *  match1:
+     *           <increment stats>
+     *           <restore app ecx>
+     *    jmp    tag1               # direct exit
+     *  check2:
+     *    ...
+     *    jmp    <exit stub: IBL>   # the original exit cti
      *
+     * FIXME: this duplicates the comparison in insert_transparent_comparison(),
+     * whose landing pad must follow the targeter.
      */
+    for (i = 0; i < num_tags; i++) {
+        app_pc speculate_next_tag = speculate_next_tags[i];
+#ifdef X86
+        instr_t *match = INSTR_CREATE_label(dcontext);
+        instr_t *next = INSTR_CREATE_label(dcontext);
+        instr_t *jecxz, *jmp;
+#endif
+        ASSERT(speculate_next_tag != NULL);
 
-    /* leave jmp as it is, a jmp to exit stub (thence to ind br lookup) */
-    added_size +=
-        insert_transparent_comparison(dcontext, trace, where, speculate_next_tag);
+        /* XCX holds value to match */
+        IF_X64(ASSERT_NOT_IMPLEMENTED(false));
+#ifdef X86
+        added_size += tracelist_add
+            (dcontext, trace, where,
+             INSTR_CREATE_lea
+             (dcontext, opnd_create_reg(REG_ECX),
+              opnd_create_base_disp(REG_ECX, REG_NULL, 0,
+                                    -((int)(ptr_int_t)speculate_next_tag), OPSZ_lea)));
+        jecxz = INSTR_CREATE_jecxz(dcontext, opnd_create_instr(match));
+        /* do not treat jecxz as exit cti! */
+        instr_set_meta(jecxz);
+        added_size += tracelist_add(dcontext, trace, where, jecxz);
+        added_size += tracelist_add
+            (dcontext, trace, where,
+             INSTR_CREATE_lea
+             (dcontext, opnd_create_reg(REG_ECX),
+              opnd_create_base_disp(REG_ECX, REG_NULL, 0,
+                                    ((int)(ptr_int_t)speculate_next_tag), OPSZ_lea)));
+        jmp = INSTR_CREATE_jmp(dcontext, opnd_create_instr(next));
+        instr_set_meta(jmp);
+        added_size += tracelist_add(dcontext, trace, where, jmp);
+        added_size += tracelist_add(dcontext, trace, where, match);
+#elif defined(ARM)
+        /* FIXME i#1551: NYI on ARM */
+        ASSERT_NOT_IMPLEMENTED(false);
+#endif
 
 #ifdef HASHTABLE_STATISTICS
-    DOSTATS({
-        reg_id_t reg = IF_X86_ELSE(REG_XCX, DR_REG_R2);
-        if (INTERNAL_OPTION(speculate_last_exit_stats)) {
-            int tls_stat_scratch_slot = os_tls_offset(HTABLE_STATS_SPILL_SLOT);
-            /* XCX already saved */
-
-            added_size +=
-                insert_increment_stat_counter
-                (dcontext, trace, next,
-                 &get_ibl_per_type_statistics(dcontext, ibl_type.branch_type)
-                 ->ib_trace_last_ibl_speculate_success);
-            /* restore XCX to app IB target*/
-            added_size +=
-                tracelist_add(dcontext, trace, next,
-                              XINST_CREATE_load
-                              (dcontext, opnd_create_reg(reg),
-                               opnd_create_tls_slot(tls_stat_scratch_slot)));
-        }
-    });
+        DOSTATS({
+            reg_id_t reg = IF_X86_ELSE(REG_XCX, DR_REG_R2);
+            if (INTERNAL_OPTION(speculate_last_exit_stats)) {
+                int tls_stat_scratch_slot = os_tls_offset(HTABLE_STATS_SPILL_SLOT);
+                /* XCX already saved */
+
+                added_size +=
+                    insert_increment_stat_counter
+                    (dcontext, trace, where,
+                     &get_ibl_per_type_statistics(dcontext, ibl_type.branch_type)
+                     ->ib_trace_last_ibl_speculate_success);
+                if (site_counters != NULL) {
+                    added_size +=
+                        insert_increment_stat_counter(dcontext, trace, where,
+                                                      &site_counters[1 + i]);
+                }
+                /* restore XCX to app IB target*/
+                added_size +=
+                    tracelist_add(dcontext, trace, where,
+                                  XINST_CREATE_load
+                                  (dcontext, opnd_create_reg(reg),
+                                   opnd_create_tls_slot(tls_stat_scratch_slot)));
+            }
+        });
 #endif
-    /* adding a new CTI for speculative target that is a pseudo
-     * direct exit.  Although we could have used the indirect stub
-     * to be the unlinked path, with a new CTI way we can unlink a
-     * speculated fragment without affecting any other targets
-     * reached by the IBL.  Also in general we could decide to add
-     * multiple speculative comparisons and to chain them we'd
-     * need new CTIs for them.
-     */
+        /* adding a new CTI for speculative target that is a pseudo
+         * direct exit.  Although we could have used the indirect stub
+         * to be the unlinked path, with a new CTI way we can unlink a
+         * speculated fragment without affecting any other targets
+         * reached by the IBL.  Also in general we could decide to add
+         * multiple speculative comparisons and to chain them we'd
+         * need new CTIs for them.
+         */
 
-    /* Ensure all register state is properly preserved on both linked
-     * and unlinked paths - currently only XCX is in use.
-     *
-     *
-     * Preferably we should be targeting prefix of target to
-     * save some space for recovering XCX from hot path.  We'd
-     * restore XCX in the exit stub when unlinked.
-     * So it would act like a direct CTI when linked and like indirect
-     * when unlinked.  It could just be an unlinked indirect stub, if
-     * we haven't modified any other registers or flags.
-     *
-     * For simplicity, we currently restore XCX here and use a plain
-     * direct exit stub that goes to target start_pc instead of
-     * prefixes.
-     *
-     * FIXME: (case 5085) the problem with the current scheme is that
-     * when we exit unlinked the source will be marked as a DIRECT
-     * exit - therefore no security policies will be enforced.
-     *
-     * FIXME: (case 4718) should add speculated target to current list
-     * in case of RCT policy that needs to be invalidated if target is
-     * flushed
-     */
+        /* Ensure all register state is properly preserved on both linked
+         * and unlinked paths - currently only XCX is in use.
+         *
+         *
+         * Preferably we should be targeting prefix of target to
+         * save some space for recovering XCX from hot path.  We'd
+         * restore XCX in the exit stub when unlinked.
+         * So it would act like a direct CTI when linked and like indirect
+         * when unlinked.  It could just be an unlinked indirect stub, if
+         * we haven't modified any other registers or flags.
+         *
+         * For simplicity, we currently restore XCX here and use a plain
+         * direct exit stub that goes to target start_pc instead of
+         * prefixes.
+         *
+         * FIXME: (case 5085) the problem with the current scheme is that
+         * when we exit unlinked the source will be marked as a DIRECT
+         * exit - therefore no security policies will be enforced.
+         *
+         * FIXME: (case 4718) should add speculated target to current list
+         * in case of RCT policy that needs to be invalidated if target is
+         * flushed
+         */
 
-    /* must restore xcx to app value, FIXME: see above for doing this in prefix+stub */
-    added_size += insert_restore_spilled_xcx(dcontext, trace, next);
+        /* must restore xcx to app value,
+         * FIXME: see above for doing this in prefix+stub
+         */
+        added_size += insert_restore_spilled_xcx(dcontext, trace, where);
 
-    /* add a new direct exit stub */
-    added_size += tracelist_add(dcontext, trace, next,
-                                XINST_CREATE_jump(dcontext,
-                                                  opnd_create_pc(speculate_next_tag)));
-    LOG(THREAD, LOG_INTERP, 3,
-        "append_trace_speculate_last_ibl: added cmp vs. "PFX" for ind br\n",
-        speculate_next_tag);
+        /* add a new direct exit stub */
+        added_size +=
+            tracelist_add(dcontext, trace, where,
+                          XINST_CREATE_jump(dcontext,
+                                            opnd_create_pc(speculate_next_tag)));
+#ifdef X86
+        added_size += tracelist_add(dcontext, trace, where, next);
+#endif
+        LOG(THREAD, LOG_INTERP, 3,
+            "append_trace_speculate_last_ibl: added cmp vs. "PFX" for ind br\n",
+            speculate_next_tag);
+    }
 
     if (record_translation)
         instrlist_set_translation_target(trace, NULL);
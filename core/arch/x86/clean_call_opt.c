@@ -409,6 +409,23 @@ check_callee_instr_level2(dcontext_t *dcontext, callee_info_t *ci, app_pc next_p
         return next_pc;
 }
 
+bool
+check_callee_instr_simd(dcontext_t *dcontext, instr_t *instr)
+{
+    uint i;
+    int opc = instr_get_opcode(instr);
+    /* These touch the vector state without listing the registers as operands. */
+    if (opc == OP_vzeroupper || opc == OP_vzeroall ||
+        opc == OP_fxrstor32 || opc == OP_fxrstor64 ||
+        opc == OP_xrstor32 || opc == OP_xrstor64)
+        return true;
+    for (i = 0; i < NUM_SIMD_REGS; i++) {
+        if (instr_uses_reg(instr, (DR_REG_XMM0 + (reg_id_t)i)))
+            return true;
+    }
+    return false;
+}
+
 bool
 check_callee_ilist_inline(dcontext_t *dcontext, callee_info_t *ci)
 {
@@ -718,6 +735,38 @@ insert_inline_arg_setup(dcontext_t *dcontext, clean_call_info_t *cci,
     if (cci->num_args == 0)
         return;
 
+#ifdef X64
+    if (cci->num_args > 1) {
+        uint i;
+        /* analyze_clean_call_inline made sure no arg reads a param reg, the
+         * spill reg, or xax, so we can write each param reg in turn.  As in
+         * the single-arg case below, an un-referenced param reg was not
+         * spilled, so we must not write it.
+         */
+        for (i = 0; i < cci->num_args; i++) {
+            if (!ci->reg_used[regparms[i] - DR_REG_XAX]) {
+                LOG(THREAD, LOG_CLEANCALL, 2,
+                    "CLEANCALL: callee "PFX" doesn't read arg %d, skipping.\n",
+                    ci->start, i);
+                continue;
+            }
+            arg = args[i];
+            regparm = shrink_reg_for_param(regparms[i], arg);
+            LOG(THREAD, LOG_CLEANCALL, 2,
+                "CLEANCALL: inlining clean call "PFX", passing arg %d via reg %s.\n",
+                ci->start, i, reg_names[regparm]);
+            if (opnd_is_immed_int(arg)) {
+                PRE(ilist, where, INSTR_CREATE_mov_imm
+                    (dcontext, opnd_create_reg(regparm), arg));
+            } else {
+                PRE(ilist, where, INSTR_CREATE_mov_ld
+                    (dcontext, opnd_create_reg(regparm), arg));
+            }
+        }
+        return;
+    }
+#endif
+
     /* If the arg is un-referenced, don't set it up.  This is actually necessary
      * for correctness because we will not have spilled regparm[0] on x64 or
      * reserved SLOT_LOCAL for x86_32.
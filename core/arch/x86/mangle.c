@@ -1394,6 +1394,162 @@ insert_push_cs(dcontext_t *dcontext, instrlist_t *ilist, instr_t *instr,
      instr_create_restore_from_tls(dc, reg, tls_offs) :                           \
      instr_create_restore_from_dcontext((dc), (reg), (dc_offs)))
 
+/***************************************************************************
+ * SHADOW RETURN STACK
+ *
+ * With -shadow_ret_stack, each mangled call in a bb pushes its app return
+ * address and the cache pc of an extra direct exit to that address onto the
+ * thread's shadow_ret_stack_t.  A mangled return compares its target against
+ * the top entry and on a match pops it and jumps to that exit, which is linked
+ * to the after-call fragment like any other direct exit, skipping the ret IBL.
+ * A mismatch (longjmp, stack switch, overflowed ring) just falls through to the
+ * IBL, so correctness never depends on the app's call/return discipline.
+ * Entries are discarded whenever a fragment is removed: see
+ * fragment_shadow_ret_stack_refresh().
+ * All arithmetic uses lea/movzx/not/xchg/jecxz to leave eflags untouched.
+ */
+
+static bool
+shadow_ret_stack_applies(dcontext_t *dcontext, uint flags)
+{
+    return (DYNAMO_OPTION(shadow_ret_stack) &&
+            !TESTANY(FRAG_IS_TRACE | FRAG_COARSE_GRAIN | FRAG_SELFMOD_SANDBOXED,
+                     flags) &&
+            /* no x86_to_x64: the register spills differ there */
+            X64_CACHE_MODE_DC(dcontext) == X64_MODE_DC(dcontext));
+}
+
+/* Spills xax and xdx and leaves the shadow_ret_stack_t in xdx and the address of
+ * the entry at (top + delta) in xax, storing the new top if delta != 0.
+ */
+static void
+insert_shadow_ret_entry_address(dcontext_t *dcontext, instrlist_t *ilist,
+                                instr_t *where, int delta, bool spill)
+{
+    ASSERT(sizeof(shadow_ret_entry_t) == 2 * sizeof(void *));
+    if (spill) {
+        PRE(ilist, where, SAVE_TO_TLS(dcontext, REG_XDX, TLS_XDX_SLOT));
+        PRE(ilist, where, SAVE_TO_TLS(dcontext, REG_XAX, TLS_XAX_SLOT));
+    }
+    PRE(ilist, where, RESTORE_FROM_TLS(dcontext, REG_XDX, TLS_DCONTEXT_SLOT));
+    PRE(ilist, where, INSTR_CREATE_mov_ld
+        (dcontext, opnd_create_reg(REG_XDX),
+         OPND_CREATE_MEMPTR(REG_XDX, offsetof(dcontext_t, shadow_ret))));
+    PRE(ilist, where, INSTR_CREATE_movzx
+        (dcontext, opnd_create_reg(REG_EAX),
+         OPND_CREATE_MEM8(REG_XDX, offsetof(shadow_ret_stack_t, top))));
+    if (delta != 0) {
+        /* the byte store wraps the index around the ring */
+        PRE(ilist, where, INSTR_CREATE_lea
+            (dcontext, opnd_create_reg(REG_XAX),
+             opnd_create_base_disp(REG_XAX, REG_NULL, 0, delta, OPSZ_lea)));
+        PRE(ilist, where, INSTR_CREATE_mov_st
+            (dcontext, OPND_CREATE_MEM8(REG_XDX, offsetof(shadow_ret_stack_t, top)),
+             opnd_create_reg(REG_AL)));
+        PRE(ilist, where, INSTR_CREATE_movzx
+            (dcontext, opnd_create_reg(REG_EAX), opnd_create_reg(REG_AL)));
+    }
+#ifdef X64
+    /* entries are 16 bytes, beyond the largest scale, so double the index */
+    PRE(ilist, where, INSTR_CREATE_lea
+        (dcontext, opnd_create_reg(REG_XAX),
+         opnd_create_base_disp(REG_XAX, REG_XAX, 1, 0, OPSZ_lea)));
+#endif
+    PRE(ilist, where, INSTR_CREATE_lea
+        (dcontext, opnd_create_reg(REG_XAX),
+         opnd_create_base_disp(REG_XDX, REG_XAX, 8,
+                               offsetof(shadow_ret_stack_t, entry), OPSZ_lea)));
+}
+
+static void
+insert_shadow_ret_restore(dcontext_t *dcontext, instrlist_t *ilist, instr_t *where)
+{
+    PRE(ilist, where, RESTORE_FROM_TLS(dcontext, REG_XAX, TLS_XAX_SLOT));
+    PRE(ilist, where, RESTORE_FROM_TLS(dcontext, REG_XDX, TLS_XDX_SLOT));
+}
+
+/* Inserts the shadow push for a call with return address retaddr before where,
+ * and appends the exit to retaddr that a matching return will target.
+ */
+static void
+insert_shadow_ret_push(dcontext_t *dcontext, instrlist_t *ilist, instr_t *where,
+                       ptr_uint_t retaddr)
+{
+    instr_t *ret_exit = XINST_CREATE_jump(dcontext, opnd_create_pc((app_pc)retaddr));
+    /* Only ever reached from a matching return, at which point the app is
+     * at retaddr.  It sits after the bb's final exit so it is never fallen into.
+     */
+    instr_set_translation(ret_exit, (app_pc)retaddr);
+    instr_set_our_mangling(ret_exit, true);
+    instr_exit_branch_set_type(ret_exit, LINK_DIRECT|LINK_JMP);
+    instrlist_append(ilist, ret_exit);
+
+    insert_shadow_ret_entry_address(dcontext, ilist, where, 1, true/*spill*/);
+    insert_mov_immed_ptrsz(dcontext, (ptr_int_t)retaddr,
+                           OPND_CREATE_MEMPTR(REG_XAX,
+                                              offsetof(shadow_ret_entry_t, tag)),
+                           ilist, where, NULL, NULL);
+    insert_mov_instr_addr(dcontext, ret_exit, NULL, opnd_create_reg(REG_XDX),
+                          ilist, where, NULL, NULL);
+    PRE(ilist, where, INSTR_CREATE_mov_st
+        (dcontext, OPND_CREATE_MEMPTR(REG_XAX, offsetof(shadow_ret_entry_t, pc)),
+         opnd_create_reg(REG_XDX)));
+    insert_shadow_ret_restore(dcontext, ilist, where);
+    STATS_INC(num_shadow_ret_calls_mangled);
+}
+
+/* Inserts the shadow check for a return whose target is in xcx, with the app
+ * xcx spilled, before the ret IBL exit cti ibl_exit.
+ */
+static void
+insert_shadow_ret_check(dcontext_t *dcontext, instrlist_t *ilist, instr_t *ibl_exit,
+                        uint flags)
+{
+    instr_t *match = INSTR_CREATE_label(dcontext);
+    instr_t *in;
+
+    insert_shadow_ret_entry_address(dcontext, ilist, ibl_exit, 0, true/*spill*/);
+    /* xcx = target - entry->tag, with the target kept in xdx */
+    PRE(ilist, ibl_exit, INSTR_CREATE_mov_ld
+        (dcontext, opnd_create_reg(REG_XDX),
+         OPND_CREATE_MEMPTR(REG_XAX, offsetof(shadow_ret_entry_t, tag))));
+    PRE(ilist, ibl_exit, INSTR_CREATE_not(dcontext, opnd_create_reg(REG_XDX)));
+    PRE(ilist, ibl_exit, INSTR_CREATE_lea
+        (dcontext, opnd_create_reg(REG_XDX),
+         opnd_create_base_disp(REG_XCX, REG_XDX, 1, 1, OPSZ_lea)));
+    PRE(ilist, ibl_exit, INSTR_CREATE_xchg
+        (dcontext, opnd_create_reg(REG_XCX), opnd_create_reg(REG_XDX)));
+    in = INSTR_CREATE_jecxz(dcontext, opnd_create_instr(match));
+    /* do not treat as exit cti or app instrs */
+    instr_set_meta(in);
+    PRE(ilist, ibl_exit, in);
+
+    /* mismatch: back to the ret IBL with the target in xcx */
+    PRE(ilist, ibl_exit, INSTR_CREATE_mov_ld
+        (dcontext, opnd_create_reg(REG_XCX), opnd_create_reg(REG_XDX)));
+    insert_shadow_ret_restore(dcontext, ilist, ibl_exit);
+    in = INSTR_CREATE_jmp(dcontext, opnd_create_instr(ibl_exit));
+    instr_set_meta(in);
+    PRE(ilist, ibl_exit, in);
+
+    /* match: pop and go to the call's exit for this return address */
+    PRE(ilist, ibl_exit, match);
+    PRE(ilist, ibl_exit, INSTR_CREATE_mov_ld
+        (dcontext, opnd_create_reg(REG_XCX),
+         OPND_CREATE_MEMPTR(REG_XAX, offsetof(shadow_ret_entry_t, pc))));
+    PRE(ilist, ibl_exit, SAVE_TO_TLS(dcontext, REG_XCX, TLS_XBX_SLOT));
+    insert_shadow_ret_entry_address(dcontext, ilist, ibl_exit, -1, false/*spilled*/);
+    PRE(ilist, ibl_exit,
+        RESTORE_FROM_DC_OR_TLS(dcontext, flags, REG_XCX,
+                               MANGLE_XCX_SPILL_SLOT, XCX_OFFSET));
+    insert_shadow_ret_restore(dcontext, ilist, ibl_exit);
+    in = INSTR_CREATE_jmp_ind(dcontext,
+                              opnd_create_tls_slot(os_tls_offset(TLS_XBX_SLOT)));
+    instr_set_meta(in);
+    PRE(ilist, ibl_exit, in);
+    STATS_INC(num_shadow_ret_rets_mangled);
+}
+
 static void
 mangle_far_direct_helper(dcontext_t *dcontext, instrlist_t *ilist, instr_t *instr,
                          instr_t *next_instr, uint flags)
@@ -1519,6 +1675,11 @@ mangle_direct_call(dcontext_t *dcontext, instrlist_t *ilist, instr_t *instr,
     /* convert a direct call to a push of the return address */
     insert_push_retaddr(dcontext, ilist, instr, retaddr, pushsz);
 
+    /* a call to the next instr is a pc read, never returned to */
+    if (shadow_ret_stack_applies(dcontext, flags) && target != (app_pc)retaddr &&
+        instr_get_opcode(instr) == OP_call)
+        insert_shadow_ret_push(dcontext, ilist, instr, retaddr);
+
     /* remove the call */
     instrlist_remove(ilist, instr);
     instr_destroy(dcontext, instr);
@@ -1691,6 +1852,8 @@ mangle_indirect_call(dcontext_t *dcontext, instrlist_t *ilist, instr_t *instr,
     if (TEST(INSTR_IND_CALL_DIRECT, instr->flags)) {
         /* convert the call to a push of the return address */
         insert_push_retaddr(dcontext, ilist, instr, retaddr, pushsz);
+        if (shadow_ret_stack_applies(dcontext, flags))
+            insert_shadow_ret_push(dcontext, ilist, instr, retaddr);
         /* remove the call */
         instrlist_remove(ilist, instr);
         instr_destroy(dcontext, instr);
@@ -1710,6 +1873,9 @@ mangle_indirect_call(dcontext_t *dcontext, instrlist_t *ilist, instr_t *instr,
          */
     }
     insert_push_retaddr(dcontext, ilist, next_instr, retaddr, pushsz);
+    if (shadow_ret_stack_applies(dcontext, flags) &&
+        instr_get_opcode(instr) == OP_call_ind)
+        insert_shadow_ret_push(dcontext, ilist, next_instr, retaddr);
 
     /* save away xcx so that we can use it */
     /* (it's restored in x86.s (indirect_branch_lookup) */
@@ -1991,6 +2157,11 @@ mangle_return(dcontext_t *dcontext, instrlist_t *ilist, instr_t *instr,
 #endif
     }
 
+    /* next_instr is the exit cti to the ret IBL that interp added */
+    if (shadow_ret_stack_applies(dcontext, flags) && instr_get_opcode(instr) == OP_ret &&
+        retsz == OPSZ_PTR && next_instr != NULL && instr_is_exit_cti(next_instr))
+        insert_shadow_ret_check(dcontext, ilist, next_instr, flags);
+
     /* remove the ret */
     instrlist_remove(ilist, instr);
     instr_destroy(dcontext, instr);
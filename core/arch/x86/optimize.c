@@ -56,6 +56,8 @@
 #include "../fragment.h"
 #include "disassemble.h"
 #include "proc.h"
+#include "instrument.h" /* for dr_create_client_thread */
+#include "../synch.h"   /* for should_wait_at_safe_spot */
 #include <string.h> /* for memset */
 
 /* IMPORTANT INSTRUCTIONS FOR WRITING OPTIMIZATIONS:
@@ -130,8 +132,34 @@ void logtrace(dcontext_t *dcontext, uint level, instrlist_t *trace, const char *
 /****************************************************************************/
 /* master routine */
 
+static void
+optimize_trace_passes(dcontext_t *dcontext, app_pc tag, instrlist_t *trace,
+                      bool async_safe);
+
 void
 optimize_trace(dcontext_t *dcontext, app_pc tag, instrlist_t *trace)
+{
+    optimize_trace_passes(dcontext, tag, trace, false);
+}
+
+#ifdef OPTIMIZE_ASYNC
+/* Runs only the passes that -optimize_async trusts: those that look at nothing
+ * but the trace's own instructions, so that the code built off-thread, and again
+ * at state recreation time, matches exactly.  constant_prop reads app memory,
+ * and call_return_matching, unroll_loops, vectorize, prefetch and rlr rely on
+ * assumptions about stack discipline, aliasing or the processor that should
+ * only be made when the user asked for them up front, so those are skipped.
+ */
+void
+optimize_trace_async_safe(dcontext_t *dcontext, app_pc tag, instrlist_t *trace)
+{
+    optimize_trace_passes(dcontext, tag, trace, true);
+}
+#endif
+
+static void
+optimize_trace_passes(dcontext_t *dcontext, app_pc tag, instrlist_t *trace,
+                      bool async_safe)
 {
     /* we have un-truncation-check 32-bit casts for opnd_get_immed_int(), for
      * one thing, here and in loadtoconst.c */
@@ -159,23 +187,23 @@ optimize_trace(dcontext_t *dcontext, app_pc tag, instrlist_t *trace)
         instr_counts(dcontext, tag, trace, true);
     }
 
-    if (dynamo_options.call_return_matching) {
+    if (dynamo_options.call_return_matching && !async_safe) {
         call_return_matching(dcontext, tag, trace);
     }
 
-    if (dynamo_options.unroll_loops) {
+    if (dynamo_options.unroll_loops && !async_safe) {
         unroll_loops(dcontext, tag, trace);
     }
 
-    if (dynamo_options.vectorize) {
+    if (dynamo_options.vectorize && !async_safe) {
         identify_for_loop(dcontext, tag, trace);
     }
 
-    if (dynamo_options.prefetch) {
+    if (dynamo_options.prefetch && !async_safe) {
         prefetch_optimize_trace(dcontext, tag, trace);
     }
 
-    if (dynamo_options.rlr) {
+    if (dynamo_options.rlr && !async_safe) {
         remove_redundant_loads(dcontext, tag, trace);
     }
 
@@ -183,7 +211,7 @@ optimize_trace(dcontext_t *dcontext, app_pc tag, instrlist_t *trace)
         remove_unnecessary_zeroing(dcontext, tag, trace);
     }
 
-    if (dynamo_options.constant_prop) {
+    if (dynamo_options.constant_prop && !async_safe) {
         constant_propagation(dcontext, tag, trace);
     }
 
@@ -4693,4 +4721,255 @@ is_nop(instr_t *inst)
     return false;
 }
 
+/****************************************************************************/
+/* -optimize_async: a background thread runs the async-safe passes on copies
+ * of new private traces, and each owner swaps in its optimized traces the next
+ * time it exits the cache (see dispatch_replace_optimized_traces()).
+ */
+#ifdef OPTIMIZE_ASYNC
+
+typedef struct _optimize_job_t {
+    dcontext_t *owner;      /* NULL once the owner no longer wants the result */
+    fragment_t *trace;      /* only dereferenced by the owner */
+    app_pc tag;
+    instrlist_t *ilist;     /* GLOBAL_DCONTEXT copy of the trace's ilist */
+    struct _optimize_job_t *next;
+} optimize_job_t;
+
+/* All protected by optimize_async_lock.  Jobs move from the queued list to
+ * optimize_job_current while the thread works on them and then onto the done
+ * list, from which their owners take them.
+ */
+static optimize_job_t *optimize_jobs_queued;
+static optimize_job_t *optimize_jobs_queued_tail;
+static optimize_job_t *optimize_jobs_done;
+static optimize_job_t *optimize_job_current;
+static bool optimize_thread_started;
+static event_t optimize_job_event;
+/* read without the lock as a hint at each cache exit */
+static volatile int optimize_jobs_num_done;
+DECLARE_CXTSWPROT_VAR(static mutex_t optimize_async_lock,
+                      INIT_LOCK_FREE(optimize_async_lock));
+
+static void
+optimize_job_free(optimize_job_t *job)
+{
+    if (job->ilist != NULL)
+        instrlist_clear_and_destroy(GLOBAL_DCONTEXT, job->ilist);
+    HEAP_TYPE_FREE(GLOBAL_DCONTEXT, job, optimize_job_t, ACCT_OTHER, UNPROTECTED);
+}
+
+/* The optimizer thread runs the passes in DR code, where synch_with_all_threads()
+ * never considers a client thread safe, so without this a synchall would wait for
+ * the whole queue to drain.  Between jobs it holds no locks and has no job in
+ * flight (optimize_job_current is NULL), so we mark it safe there, like
+ * dr_event_wait() does, and stay put until every pending synch is done.  A
+ * THREAD_SYNCH_TERMINATED_AND_CLEANED synch may kill it here, which leaves only
+ * the lists for optimize_async_exit() to free.
+ */
+static void
+optimize_async_safe_point(dcontext_t *dcontext)
+{
+    ASSERT_OWN_NO_LOCKS();
+    ASSERT(optimize_job_current == NULL);
+    if (!should_wait_at_safe_spot(dcontext))
+        return;
+    STATS_INC(num_optimize_async_synch_waits);
+    dcontext->client_data->client_thread_safe_for_synch = true;
+    while (should_wait_at_safe_spot(dcontext))
+        os_thread_yield();
+    dcontext->client_data->client_thread_safe_for_synch = false;
+}
+
+static void
+optimize_async_thread(void *arg)
+{
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    optimize_job_t *job;
+    ASSERT(IS_CLIENT_THREAD(dcontext));
+    LOG(GLOBAL, LOG_OPTS, 1, "optimize_async thread "TIDFMT" started\n",
+        get_thread_id());
+    while (true) {
+        dr_event_wait((void *)optimize_job_event);
+        while (true) {
+            optimize_async_safe_point(dcontext);
+            mutex_lock(&optimize_async_lock);
+            job = optimize_jobs_queued;
+            if (job != NULL) {
+                optimize_jobs_queued = job->next;
+                if (optimize_jobs_queued == NULL)
+                    optimize_jobs_queued_tail = NULL;
+                job->next = NULL;
+            }
+            optimize_job_current = job;
+            mutex_unlock(&optimize_async_lock);
+            if (job == NULL)
+                break;
+
+            /* the owner may cancel this job meanwhile but job->ilist is ours */
+            LOG(GLOBAL, LOG_OPTS, 2, "optimize_async: optimizing trace "PFX"\n",
+                job->tag);
+            optimize_trace_async_safe(GLOBAL_DCONTEXT, job->tag, job->ilist);
+            STATS_INC(num_optimize_async_optimized);
+
+            mutex_lock(&optimize_async_lock);
+            optimize_job_current = NULL;
+            if (job->owner != NULL) {
+                job->next = optimize_jobs_done;
+                optimize_jobs_done = job;
+                optimize_jobs_num_done++;
+                job = NULL;
+            }
+            mutex_unlock(&optimize_async_lock);
+            if (job != NULL) {
+                STATS_INC(num_optimize_async_discarded);
+                optimize_job_free(job);
+            }
+        }
+    }
+}
+
+/* Hands ilist, a GLOBAL_DCONTEXT copy of the unpadded code just emitted as the
+ * private trace "trace", to the optimizer thread, starting that thread on first
+ * use.  Takes ownership of ilist.
+ */
+void
+optimize_async_queue(dcontext_t *dcontext, fragment_t *trace, instrlist_t *ilist)
+{
+    optimize_job_t *job;
+    bool start_thread = false;
+    ASSERT(DYNAMO_OPTION(optimize_async));
+    ASSERT(TEST(FRAG_IS_TRACE, trace->flags) && !TEST(FRAG_SHARED, trace->flags));
+    job = HEAP_TYPE_ALLOC(GLOBAL_DCONTEXT, optimize_job_t, ACCT_OTHER, UNPROTECTED);
+    job->owner = dcontext;
+    job->trace = trace;
+    job->tag = trace->tag;
+    job->ilist = ilist;
+    job->next = NULL;
+
+    mutex_lock(&optimize_async_lock);
+    if (!optimize_thread_started) {
+        optimize_thread_started = true;
+        optimize_job_event = create_event();
+        start_thread = true;
+    }
+    if (optimize_jobs_queued_tail == NULL)
+        optimize_jobs_queued = job;
+    else
+        optimize_jobs_queued_tail->next = job;
+    optimize_jobs_queued_tail = job;
+    mutex_unlock(&optimize_async_lock);
+    STATS_INC(num_optimize_async_queued);
+
+    if (start_thread && !dr_create_client_thread(optimize_async_thread, NULL)) {
+        /* the queue just grows until exit; not worth a fallback */
+        SYSLOG_INTERNAL_WARNING("-optimize_async failed to create its thread");
+    }
+    signal_event(optimize_job_event);
+}
+
+bool
+optimize_async_pending(void)
+{
+    return optimize_jobs_num_done > 0;
+}
+
+/* Removes and returns an optimized ilist for one of dcontext's traces other than
+ * busy, or NULL if there is none; the caller owns the returned GLOBAL_DCONTEXT
+ * ilist.
+ */
+instrlist_t *
+optimize_async_take(dcontext_t *dcontext, fragment_t *busy, fragment_t **trace OUT)
+{
+    optimize_job_t *job, *prev = NULL;
+    instrlist_t *ilist = NULL;
+    mutex_lock(&optimize_async_lock);
+    for (job = optimize_jobs_done; job != NULL; prev = job, job = job->next) {
+        if (job->owner == dcontext && job->trace != busy) {
+            if (prev == NULL)
+                optimize_jobs_done = job->next;
+            else
+                prev->next = job->next;
+            optimize_jobs_num_done--;
+            break;
+        }
+    }
+    mutex_unlock(&optimize_async_lock);
+    if (job != NULL) {
+        *trace = job->trace;
+        ilist = job->ilist;
+        job->ilist = NULL;
+        optimize_job_free(job);
+    }
+    return ilist;
+}
+
+/* Drops all of dcontext's jobs for trace, or for every trace if trace is NULL.
+ * Must be called before any of its private traces with jobs is freed.
+ */
+void
+optimize_async_cancel(dcontext_t *dcontext, fragment_t *trace)
+{
+    optimize_job_t *job, *next, *prev, *dead = NULL;
+    optimize_job_t **lists[2] = { &optimize_jobs_queued, &optimize_jobs_done };
+    int i;
+    if (!optimize_thread_started)
+        return;
+    mutex_lock(&optimize_async_lock);
+    for (i = 0; i < BUFFER_SIZE_ELEMENTS(lists); i++) {
+        prev = NULL;
+        for (job = *lists[i]; job != NULL; job = next) {
+            next = job->next;
+            if (job->owner == dcontext && (trace == NULL || job->trace == trace)) {
+                if (prev == NULL)
+                    *lists[i] = next;
+                else
+                    prev->next = next;
+                if (lists[i] == &optimize_jobs_done)
+                    optimize_jobs_num_done--;
+                else if (job == optimize_jobs_queued_tail)
+                    optimize_jobs_queued_tail = prev;
+                job->next = dead;
+                dead = job;
+            } else
+                prev = job;
+        }
+    }
+    if (optimize_job_current != NULL && optimize_job_current->owner == dcontext &&
+        (trace == NULL || optimize_job_current->trace == trace))
+        optimize_job_current->owner = NULL;
+    mutex_unlock(&optimize_async_lock);
+    for (job = dead; job != NULL; job = next) {
+        next = job->next;
+        STATS_INC(num_optimize_async_discarded);
+        optimize_job_free(job);
+    }
+}
+
+/* Called once all threads are synched at process exit, when the optimizer
+ * thread is no longer running.
+ */
+void
+optimize_async_exit(void)
+{
+    optimize_job_t *job, *next;
+    if (!optimize_thread_started)
+        return;
+    for (job = optimize_jobs_queued; job != NULL; job = next) {
+        next = job->next;
+        optimize_job_free(job);
+    }
+    for (job = optimize_jobs_done; job != NULL; job = next) {
+        next = job->next;
+        optimize_job_free(job);
+    }
+    if (optimize_job_current != NULL)
+        optimize_job_free(optimize_job_current);
+    optimize_jobs_queued = optimize_jobs_queued_tail = NULL;
+    optimize_jobs_done = optimize_job_current = NULL;
+    destroy_event(optimize_job_event);
+    DELETE_LOCK(optimize_async_lock);
+}
+#endif /* OPTIMIZE_ASYNC */
+
 #endif /* INTERNAL around whole file */
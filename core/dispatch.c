@@ -397,6 +397,11 @@ dispatch_enter_fcache(dcontext_t *dcontext, fragment_t *targetf)
 
     dispatch_enter_fcache_stats(dcontext, targetf);
 
+#ifdef X86
+    /* drop shadow return entries that may target fragments removed since */
+    fragment_shadow_ret_stack_refresh(dcontext);
+#endif
+
     /* FIXME: for now we do this before the synch point to avoid complexity of
      * missing a KSTART(fcache_* for cases like NtSetContextThread where a thread
      * appears back at dispatch() from the synch point w/o ever entering the cache.
@@ -1005,6 +1010,52 @@ dispatch_enter_dynamorio(dcontext_t *dcontext)
  *       (bug 2464 was back when tried to carry last_exit through syscall)
  *       so this will end up looking like the system call case
  */
+#ifdef OPTIMIZE_ASYNC
+/* Swaps in this thread's traces that the -optimize_async thread has finished
+ * with, in the same way as the client fragment replacement below.  The trace we
+ * just exited is left for a later exit as last_exit still points into it.
+ */
+static void
+dispatch_replace_optimized_traces(dcontext_t *dcontext)
+{
+    fragment_t *f, *new_f;
+    instrlist_t *ilist;
+    while ((ilist = optimize_async_take(dcontext, dcontext->last_fragment, &f)) != NULL) {
+        uint orig_flags = f->flags;
+        void *vmlist = NULL;
+        instrlist_t *global_ilist = ilist;
+        DEBUG_DECLARE(bool ok;)
+        ASSERT(TEST(FRAG_IS_TRACE, f->flags) && !TEST(FRAG_SHARED, f->flags));
+        ASSERT(fragment_lookup_trace(dcontext, f->tag) == f);
+        LOG(THREAD, LOG_INTERP|LOG_OPTS, 3,
+            "Replacing F%d("PFX") with its -optimize_async version\n", f->id, f->tag);
+        /* emit pads with our own heap */
+        ilist = instrlist_clone(dcontext, global_ilist);
+        instrlist_clear_and_destroy(GLOBAL_DCONTEXT, global_ilist);
+        /* prevent emit from deleting f, we still need it */
+        f->flags |= FRAG_CANNOT_DELETE;
+        DEBUG_DECLARE(ok =)
+            vm_area_add_to_list(dcontext, f->tag, &vmlist, orig_flags, f,
+                                false/*no locks*/);
+        ASSERT(ok); /* should never fail for private fragments */
+        new_f = emit_invisible_fragment(dcontext, f->tag, ilist,
+                                        orig_flags | FRAG_OPTIMIZED_ASYNC, vmlist);
+        f->flags = orig_flags;
+        instrlist_clear_and_destroy(dcontext, ilist);
+        fragment_copy_data_fields(dcontext, f, new_f);
+        shift_links_to_new_fragment(dcontext, f, new_f);
+        fragment_replace(dcontext, f, new_f);
+        STATS_INC(num_optimize_async_replaced);
+        STATS_ADD(optimize_async_bytes_before, f->size);
+        STATS_ADD(optimize_async_bytes_after, new_f->size);
+        DOLOG(3, LOG_OPTS, {
+            disassemble_fragment(dcontext, new_f, stats->loglevel < 3);
+        });
+        fragment_delete(dcontext, f, FRAGDEL_NO_UNLINK | FRAGDEL_NO_HTABLE);
+    }
+}
+#endif
+
 static void
 dispatch_exit_fcache(dcontext_t *dcontext)
 {
@@ -1163,6 +1214,11 @@ dispatch_exit_fcache(dcontext_t *dcontext)
     }
 #endif
 
+#ifdef OPTIMIZE_ASYNC
+    if (DYNAMO_OPTION(optimize_async) && optimize_async_pending())
+        dispatch_replace_optimized_traces(dcontext);
+#endif
+
 #ifdef CLIENT_INTERFACE
     /* is ok to put the lock after the null check, this is only
      * place they can be deleted
@@ -997,6 +997,10 @@ dynamo_shared_exit(thread_record_t *toexit /* must ==cur thread for Linux */
     /* Some lock can only be deleted if only one thread left. */
     instrument_exit_post_sideline();
 #endif /* CLIENT_INTERFACE */
+#ifdef OPTIMIZE_ASYNC
+    /* after the optimizer thread is gone */
+    optimize_async_exit();
+#endif
     fragment_exit_post_sideline();
 
     /* The dynamo_exited_and_cleaned should be set after the second synch-all.
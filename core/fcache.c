@@ -418,6 +418,8 @@ typedef struct _fcache_unit_t {
 #endif
     uint flushtime;            /* free this unit when this flushtime is freed --
                                 * used only for units_to_free list, else 0 */
+    uint hotness;              /* decaying count of trace head hits in this unit,
+                                * used to pick finite shared cache victims */
     struct _fcache_unit_t *next_global; /* used to link all units */
     struct _fcache_unit_t *prev_global; /* used to link all units */
     struct _fcache_unit_t *next_local;  /* used to link an fcache_t's units */
@@ -1114,6 +1116,29 @@ fcache_lookup_unit(cache_pc pc)
     return (fcache_unit_t *) vmvector_lookup(fcache_unit_areas, pc);
 }
 
+/* Called on each trace head counter increment for f.  Credits f's unit with
+ * the hit so that finite shared caches evict cold units first.
+ */
+void
+fcache_note_trace_head_hit(dcontext_t *dcontext, fragment_t *f)
+{
+    fcache_unit_t *unit;
+    fcache_t *cache;
+    if (!DYNAMO_OPTION(finite_shared_hot_units) || !TEST(FRAG_SHARED, f->flags) ||
+        TEST(FRAG_COARSE_GRAIN, f->flags))
+        return;
+    /* Avoid the unit lookup on every hit when the cache never evicts. */
+    cache = TEST(FRAG_IS_TRACE, f->flags) ? shared_cache_trace : shared_cache_bb;
+    if (cache == NULL || !cache->finite_cache)
+        return;
+    unit = fcache_lookup_unit(f->start_pc);
+    /* A racy increment is fine: this is only a heuristic, and the unit
+     * cannot be freed while we're in dispatch with a pointer to f.
+     */
+    if (unit != NULL && unit->hotness < UINT_MAX)
+        unit->hotness++;
+}
+
 /* Returns the fragment_t whose body (not cache slot) contains lookup_pc */
 fragment_t *
 fcache_fragment_pclookup(dcontext_t *dcontext, cache_pc lookup_pc, fragment_t *wrapper)
@@ -1357,6 +1382,7 @@ fcache_create_unit(dcontext_t *dcontext, fcache_t *cache, cache_pc pc, size_t si
     u->pending_free = false;
     DODEBUG({ u->pending_flush = false; });
     u->flushtime = 0;
+    u->hotness = 0;
 
     RSTATS_ADD_PEAK(fcache_num_live, 1);
     STATS_FCACHE_ADD(u->cache, capacity, u->size);
@@ -1875,6 +1901,7 @@ fcache_increase_size(dcontext_t *dcontext, fcache_t *cache, fcache_unit_t *unit,
     /* i#696: Incompatible with clients that use labels-as-values. */
     IF_CLIENT_INTERFACE(ASSERT(!dr_bb_hook_exists() &&
                                !dr_trace_hook_exists()));
+    IF_X86(ASSERT(!DYNAMO_OPTION(shadow_ret_stack)));
     /* we shouldn't come here if we have reservation room */
     ASSERT(unit->reserved_end_pc == unit->end_pc);
     if (new_size*4 <= cache->max_quadrupled_unit_size)
@@ -2462,6 +2489,56 @@ extend_unit_end(dcontext_t *dcontext, fcache_t *cache,
     return extra;
 }
 
+/* Picks the unit of finite shared cache to flush and returns it, with the unit
+ * preceding it on cache->units in *prev_out (NULL if it is the head).
+ * Without -finite_shared_hot_units this is simply the oldest unit.  Otherwise
+ * the newest unit is treated as a nursery and never chosen (unless it is the
+ * only unit), and among the rest, which have survived at least one round, we
+ * pick the one with the fewest trace head hits, preferring older units on ties.
+ * Each round halves the hotness of the survivors so that formerly-hot units
+ * eventually age out when the program changes phase.
+ */
+static fcache_unit_t *
+pick_shared_unit_to_evict(dcontext_t *dcontext, fcache_t *cache,
+                          fcache_unit_t **prev_out)
+{
+    fcache_unit_t *u, *prev, *victim, *victim_prev;
+    ASSERT(CACHE_PROTECTED(cache));
+    ASSERT(cache->units != NULL);
+    victim = cache->units;
+    victim_prev = NULL;
+    if (!DYNAMO_OPTION(finite_shared_hot_units) || cache->units->next_local == NULL) {
+        /* another place where a prev_local would be nice */
+        for (; victim->next_local != NULL;
+             victim_prev = victim, victim = victim->next_local)
+            ; /* nothing */
+        *prev_out = victim_prev;
+        return victim;
+    }
+    /* skip the nursery at the head */
+    victim_prev = cache->units;
+    victim = victim_prev->next_local;
+    for (prev = victim, u = victim->next_local; u != NULL;
+         prev = u, u = u->next_local) {
+        if (u->hotness <= victim->hotness) {
+            victim = u;
+            victim_prev = prev;
+        }
+    }
+    LOG(THREAD, LOG_CACHE, 2, "%s: evicting unit "PFX" with hotness %u\n",
+        cache->name, victim->start_pc, victim->hotness);
+    DOSTATS({
+        if (victim->next_local != NULL)
+            STATS_INC(cache_units_wset_kept_hot);
+    });
+    for (u = cache->units; u != NULL; u = u->next_local) {
+        if (u != victim)
+            u->hotness /= 2;
+    }
+    *prev_out = victim_prev;
+    return victim;
+}
+
 /* Returns whether was able to either resize unit or create a new unit.
  * For non-FIFO caches this routine cannot fail and must suspend the world
  * and reset if necessary.
@@ -2503,10 +2580,12 @@ try_for_more_space(dcontext_t *dcontext, fcache_t *cache, fcache_unit_t *unit,
          * re-linking when resize.
          * i#696: Don't try to resize fcache units when clients are present.
          * They may use labels to insert absolute fragment PCs.
+         * -shadow_ret_stack does the same for its return exits.
          */
         if (unit->size >= cache->max_unit_size
             IF_CLIENT_INTERFACE(|| dr_bb_hook_exists()
-                                || dr_trace_hook_exists())) {
+                                || dr_trace_hook_exists())
+            IF_X86(|| DYNAMO_OPTION(shadow_ret_stack))) {
             fcache_unit_t *newunit;
             size_t newsize;
             ASSERT(!USE_FIFO_FOR_CACHE(cache) ||
@@ -2527,16 +2606,14 @@ try_for_more_space(dcontext_t *dcontext, fcache_t *cache, fcache_unit_t *unit,
                  */
                 if (!check_regen_replace_ratio(dcontext, cache,
                                                0 /*not adding a fragment*/)) {
-                    /* flush the oldest unit, at the end of the list */
+                    /* flush the oldest unit, at the end of the list, or with
+                     * -finite_shared_hot_units the coldest non-nursery unit
+                     */
                     fcache_thread_units_t *tu = (fcache_thread_units_t *)
                         dcontext->fcache_field;
-                    fcache_unit_t *oldest = cache->units, *prev = NULL;
-                    ASSERT(oldest != NULL);
-
-                    /* another place where a prev_local would be nice */
-                    for (; oldest->next_local != NULL;
-                         prev = oldest, oldest = oldest->next_local)
-                        ; /* nothing */
+                    fcache_unit_t *oldest, *prev;
+                    ASSERT(cache->units != NULL);
+                    oldest = pick_shared_unit_to_evict(dcontext, cache, &prev);
 
                     /* Indicate unit is still live even though off live list.
                      * Flag will be cleared once really flushed in
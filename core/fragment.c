@@ -97,6 +97,11 @@ DECLARE_FREQPROT_VAR(static dcontext_t *allsynch_flusher, NULL);
 /* Current flush base and size, protected by thread_initexit_lock. */
 DECLARE_FREQPROT_VAR(static app_pc flush_base, NULL);
 DECLARE_FREQPROT_VAR(static size_t flush_size, 0);
+/* For a flush_vmvector_regions() flush, the thread-private vector of regions
+ * being flushed (flush_base and flush_size then hold their bounds), else NULL.
+ * Protected by thread_initexit_lock.
+ */
+DECLARE_FREQPROT_VAR(static vm_area_vector_t *flush_regions, NULL);
 
 /* These global tables are kept on the heap for selfprot (case 7957) */
 
@@ -165,6 +170,24 @@ DECLARE_CXTSWPROT_VAR(mutex_t shared_cache_flush_lock,
  */
 DECLARE_FREQPROT_VAR(uint flushtime_global, 0);
 
+#ifdef X86
+/* -shadow_ret_stack: bumped whenever a fragment is removed, so that threads
+ * drop shadow return entries that may point into it before re-entering the
+ * cache.  Written from many paths, so never protected.
+ */
+DECLARE_NEVERPROT_VAR(static volatile int shadow_ret_epoch, 0);
+
+/* Called when a fragment is removed: any shadow return entry may point at
+ * its direct exit for the return address, so every thread's stack is stale.
+ */
+static inline void
+shadow_ret_stack_invalidate(void)
+{
+    if (DYNAMO_OPTION(shadow_ret_stack))
+        ATOMIC_INC(int, shadow_ret_epoch);
+}
+#endif
+
 #ifdef CLIENT_INTERFACE
 DECLARE_CXTSWPROT_VAR(mutex_t client_flush_request_lock,
                       INIT_LOCK_FREE(client_flush_request_lock));
@@ -1458,6 +1481,9 @@ fragment_reset_free(void)
     if (RUNNING_WITHOUT_CODE_CACHE())
         return;
 
+    /* the whole cache is going away, not all of it via fragment_delete() */
+    IF_X86(shadow_ret_stack_invalidate());
+
     /* We must study the ibl tables before the trace/bb tables so that we're
      * not looking at freed entries
      */
@@ -2017,6 +2043,36 @@ fragment_thread_reset_init(dcontext_t *dcontext)
     update_generated_hashtable_access(dcontext);
 }
 
+#ifdef X86
+static void
+shadow_ret_stack_clear(shadow_ret_stack_t *srs)
+{
+    uint i;
+    srs->top = 0;
+    srs->epoch = (uint) shadow_ret_epoch;
+    /* no app return targets this, so these entries never match */
+    for (i = 0; i < SHADOW_RET_STACK_ENTRIES; i++) {
+        srs->entry[i].tag = (app_pc) POINTER_MAX;
+        srs->entry[i].pc = NULL;
+    }
+}
+
+/* Must be called on every cache entry, after any fragment deletion this thread
+ * performed.  A removed shared fragment is not freed until each thread has
+ * passed a synch point, which precedes this, so clearing here means no entry
+ * can reach freed cache memory.
+ */
+void
+fragment_shadow_ret_stack_refresh(dcontext_t *dcontext)
+{
+    shadow_ret_stack_t *srs = dcontext->shadow_ret;
+    if (srs != NULL && srs->epoch != (uint) shadow_ret_epoch) {
+        shadow_ret_stack_clear(srs);
+        STATS_INC(num_shadow_ret_stack_resets);
+    }
+}
+#endif
+
 void
 fragment_thread_init(dcontext_t *dcontext)
 {
@@ -2060,6 +2116,15 @@ fragment_thread_init(dcontext_t *dcontext)
     pt->finished_all_unlink = create_event();
     pt->soon_to_be_linking = false;
     pt->at_syscall_at_flush = false;
+
+#ifdef X86
+    if (DYNAMO_OPTION(shadow_ret_stack)) {
+        /* read and written from the cache */
+        dcontext->shadow_ret =
+            HEAP_TYPE_ALLOC(dcontext, shadow_ret_stack_t, ACCT_OTHER, UNPROTECTED);
+        shadow_ret_stack_clear(dcontext->shadow_ret);
+    }
+#endif
 }
 
 static bool
@@ -2076,6 +2141,11 @@ fragment_thread_reset_free(dcontext_t *dcontext)
     if (RUNNING_WITHOUT_CODE_CACHE())
         return;
 
+#ifdef OPTIMIZE_ASYNC
+    if (DYNAMO_OPTION(optimize_async))
+        optimize_async_cancel(dcontext, NULL);
+#endif
+
     /* Dec ref count on any shared tables that are pointed to. */
     dec_all_table_ref_counts(dcontext, pt);
 
@@ -2218,6 +2288,14 @@ fragment_thread_exit(dcontext_t *dcontext)
 
     fragment_thread_reset_free(dcontext);
 
+#ifdef X86
+    if (dcontext->shadow_ret != NULL) {
+        HEAP_TYPE_FREE(dcontext, dcontext->shadow_ret, shadow_ret_stack_t,
+                       ACCT_OTHER, UNPROTECTED);
+        dcontext->shadow_ret = NULL;
+    }
+#endif
+
     /* events are global */
     destroy_event(pt->waiting_for_unlink);
     destroy_event(pt->finished_with_unlink);
@@ -3037,11 +3115,17 @@ fragment_delete(dcontext_t *dcontext, fragment_t *f, uint actions)
     ASSERT((f->flags & FRAG_CANNOT_DELETE) == 0);
     ASSERT((f->flags & FRAG_IS_FUTURE) == 0);
 
+#ifdef OPTIMIZE_ASYNC
+    if (DYNAMO_OPTION(optimize_async) && TEST(FRAG_IS_TRACE, f->flags))
+        optimize_async_cancel(dcontext, f);
+#endif
+
     /* ensure the actual free of a shared fragment is done only
      * after a multi-stage flush or a reset
      */
     ASSERT(!TEST(FRAG_SHARED, f->flags) || TEST(FRAG_WAS_DELETED, f->flags) ||
            dynamo_exited || dynamo_resetting || is_self_allsynch_flushing());
+    IF_X86(shadow_ret_stack_invalidate());
 
 #if defined(CLIENT_INTERFACE) && defined(CLIENT_SIDELINE)
     /* need to protect ability to reference frag fields and fcache space */
@@ -3255,6 +3339,7 @@ fragment_remove_shared_no_flush(dcontext_t *dcontext, fragment_t *f)
      * flag to determine validity
      */
     f->flags |= FRAG_WAS_DELETED;
+    IF_X86(shadow_ret_stack_invalidate());
 
     release_vm_areas_lock(dcontext, f->flags);
     release_recursive_lock(&change_linking_lock);
@@ -3354,6 +3439,7 @@ fragment_unlink_for_deletion(dcontext_t *dcontext, fragment_t *f)
      * for this fragment.
      */
     f->flags |= FRAG_WAS_DELETED;
+    IF_X86(shadow_ret_stack_invalidate());
 
     /* the original app code cannot be used to recreate state, so we must
      * store translation info now
@@ -4255,8 +4341,8 @@ fragment_add_ibl_target(dcontext_t *dcontext, app_pc tag,
          * enter_couldbelinking() but that could also prove to be more
          * expensive by invoking the update logic when an IBL miss didn't
          * occur. However, more frequent updates could lead to old tables
-         * being freed earlier. We can revisit this if we see old tables
-         * piling up and not being freed in a timely manner.
+         * being freed earlier.  -ibt_table_quiescent_update does the latter
+         * so old tables do not pile up behind idle threads.
          */
         update_private_ibt_table_ptrs(dcontext, ibl_table
                                       _IF_DEBUG(&orig_lookuptable));
@@ -5695,30 +5781,58 @@ static void
 process_client_flush_requests(dcontext_t *dcontext, dcontext_t *alloc_dcontext,
                               client_flush_req_t *req, bool flush)
 {
-    client_flush_req_t *iter = req;
-    while (iter != NULL) {
-        client_flush_req_t *next = iter->next;
+    client_flush_req_t *iter, *next;
+    if (flush && req != NULL) {
+        /* A JIT emitting many small patches queues many small, often adjacent,
+         * regions between two of our cache entries.  We gather them all in a
+         * vector, which merges overlapping and adjacent regions, and flush the
+         * lot with a single synch.  Flushes for selfmod write faults and for
+         * munmap are not queued here: they must complete before we return to
+         * the app, so they still flush immediately.
+         */
+        /* FIXME - for implementation simplicity we do a synch-all flush for
+         * requests with a callback, so that we can inform the client right away,
+         * it might be nice to use the more performant regular flush when
+         * possible.  We keep those requests in their own vector so that they do
+         * not force a synch-all flush onto the requests without a callback.
+         */
+        vm_area_vector_t toflush, toflush_synchall;
+        DEBUG_DECLARE(int num_requests = 0;)
+        /* no lock init needed since not used */
+        vmvector_init_vector(&toflush, 0);
+        vmvector_init_vector(&toflush_synchall, 0);
+        for (iter = req; iter != NULL; iter = iter->next) {
+            vmvector_add(iter->flush_callback != NULL ? &toflush_synchall : &toflush,
+                         iter->start, iter->start + iter->size, NULL);
+            DODEBUG({ num_requests++; });
+        }
+        /* Note that we don't free futures from potentially linked-to region b/c we
+         * don't have lazy linking (xref case 2236) */
+        if (!vmvector_empty(&toflush)) {
+            flush_vmvector_regions(dcontext, &toflush, false/*keep futures*/,
+                                   false/*exec valid*/, false/*!synchall*/);
+            STATS_INC(num_delayed_flushes);
+        }
+        if (!vmvector_empty(&toflush_synchall)) {
+            flush_vmvector_regions(dcontext, &toflush_synchall, false/*keep futures*/,
+                                   false/*exec valid*/, true/*synchall*/);
+            STATS_INC(num_delayed_flushes);
+        }
+        STATS_ADD(num_delayed_flush_coalesced,
+                  num_requests - toflush.length - toflush_synchall.length);
+        vmvector_reset_vector(GLOBAL_DCONTEXT, &toflush);
+        vmvector_reset_vector(GLOBAL_DCONTEXT, &toflush_synchall);
+    }
+    /* Callbacks run in the order the requests were queued. */
+    for (iter = req; iter != NULL; iter = next) {
+        next = iter->next;
         if (flush) {
-            /* Note that we don't free futures from potentially linked-to region b/c we
-             * don't have lazy linking (xref case 2236) */
-            /* FIXME - if there's more then one of these would be nice to batch them
-             * especially for the synch all ones. */
-            if (iter->flush_callback != NULL) {
-                /* FIXME - for implementation simplicity we do a synch-all flush so
-                 * that we can inform the client right away, it might be nice to use
-                 * the more performant regular flush when possible. */
-                flush_fragments_from_region(dcontext, iter->start, iter->size,
-                                            true/*force synchall*/);
+            STATS_INC(num_delayed_flush_requests);
+            if (iter->flush_callback != NULL)
                 (*iter->flush_callback)(iter->flush_id);
-            } else {
-                /* do a regular flush */
-                flush_fragments_from_region(dcontext, iter->start, iter->size,
-                                            false/*don't force synchall*/);
-            }
         }
         HEAP_TYPE_FREE(alloc_dcontext, iter, client_flush_req_t, ACCT_CLIENT,
                        UNPROTECTED);
-        iter = next;
     }
 }
 #endif
@@ -5820,6 +5934,19 @@ enter_nolinking(dcontext_t *dcontext, fragment_t *was_I_flushed, bool cache_tran
         req = client_flush_requests;
         client_flush_requests = NULL;
         mutex_unlock(&client_flush_request_lock);
+        /* dr_delay_flush_region() pushes onto the front of the list: reverse it
+         * so that requests are processed in the order they were queued.
+         */
+        {
+            client_flush_req_t *prev = NULL, *next;
+            while (req != NULL) {
+                next = req->next;
+                req->next = prev;
+                prev = req;
+                req = next;
+            }
+            req = prev;
+        }
         /* NOTE - we must release the lock before doing the flush. */
         process_client_flush_requests(dcontext, GLOBAL_DCONTEXT, req, true/*flush*/);
         /* FIXME - this is an ugly, yet effective, hack.  The problem is there is no
@@ -5873,6 +6000,21 @@ enter_couldbelinking(dcontext_t *dcontext, fragment_t *was_I_flushed,
     not_flushed = check_flush_queue(dcontext, was_I_flushed);
     mutex_unlock(&pt->linking_lock);
 
+    /* A cache exit is a quiescent point for this thread's view of the shared
+     * IBT tables: it holds no pointers into them until it re-enters the cache.
+     * Moving to the live tables here, rather than waiting for the next IBL miss
+     * on each branch type, drops this thread's ref on any table retired by a
+     * resize so the dead table list is drained as soon as every thread has
+     * passed through dispatch once.  The check is a few racy compares and
+     * only takes the table lock when a pointer is actually stale.
+     * update_private_ptr_to_shared_ibt_table() acquires the table lock, so we
+     * must not hold pt->linking_lock here.
+     */
+    if (cache_transition && DYNAMO_OPTION(ibt_table_quiescent_update)) {
+        if (update_all_private_ibt_table_ptrs(dcontext, pt))
+            STATS_INC(num_shared_tables_updated_quiescent);
+    }
+
     return not_flushed;
 }
 
@@ -6016,15 +6158,59 @@ flush_fragments_free_futures(app_pc base, size_t size)
     } /* else we leak them */
 }
 
+/* Iterates over the regions of a flush: the areas of regions for a
+ * flush_vmvector_regions() flush, else the single region [base, base+size).
+ * Callers must keep calling flush_region_iter_next() until it returns false.
+ */
+typedef struct _flush_region_iter_t {
+    vm_area_vector_t *regions;
+    vmvector_iterator_t vmvi;
+    app_pc base;
+    size_t size;
+} flush_region_iter_t;
+
+static void
+flush_region_iter_start(flush_region_iter_t *fri, vm_area_vector_t *regions,
+                        app_pc base, size_t size)
+{
+    fri->regions = regions;
+    fri->base = base;
+    fri->size = size;
+    /* regions is thread-private so the iterator takes no lock */
+    if (regions != NULL)
+        vmvector_iterator_start(regions, &fri->vmvi);
+}
+
+static bool
+flush_region_iter_next(flush_region_iter_t *fri, app_pc *start, app_pc *end)
+{
+    if (fri->regions != NULL) {
+        if (vmvector_iterator_hasnext(&fri->vmvi)) {
+            vmvector_iterator_next(&fri->vmvi, start, end);
+            return true;
+        }
+        vmvector_iterator_stop(&fri->vmvi);
+        return false;
+    }
+    if (fri->size == 0)
+        return false;
+    *start = fri->base;
+    *end = fri->base + fri->size;
+    fri->size = 0;
+    return true;
+}
+
 /* This routine begins a flush that requires full thread synch: currently,
  * it is used for flushing coarse-grain units and for dr_flush_region()
  */
 static void
 flush_fragments_synchall_start(dcontext_t *ignored, app_pc base, size_t size,
-                               bool exec_invalid)
+                               vm_area_vector_t *regions, bool exec_invalid)
 {
     dcontext_t *my_dcontext = get_thread_private_dcontext();
     app_pc exec_start = NULL, exec_end = NULL;
+    app_pc region_start, region_end;
+    flush_region_iter_t fri;
     bool all_synched = true;
     int i;
     const thread_synch_state_t desired_state =
@@ -6065,29 +6251,10 @@ flush_fragments_synchall_start(dcontext_t *ignored, app_pc base, size_t size,
 
     LOG(GLOBAL, LOG_FRAGMENT, 2,
         "flush_fragments_synchall_start: walking the threads\n");
-    /* We rely on coarse fragments not touching more than one vmarea region
-     * for our ibl invalidation.  It's
-     * ok to invalidate more than we need to so we don't care if there are
-     * multiple coarse units within this range.  We just need the exec areas
-     * bounds that overlap the flush region.
-     */
-    if (!executable_area_overlap_bounds(base, base+size, &exec_start, &exec_end,
-                                        0, true/*doesn't matter w/ 0*/)) {
-        /* caller checks for overlap but lock let go so can get here; go ahead
-         * and do synch per flushing contract.
-         */
-        exec_start = base;
-        exec_end = base+size;
-    }
-    LOG(GLOBAL, LOG_FRAGMENT, 2,
-        "flush_fragments_synchall_start: from "PFX"-"PFX" => coarse "PFX"-"PFX"\n",
-        base, base+size, exec_start, exec_end);
-
     /* FIXME: share some of this code that I duplicated from reset */
     for (i = 0; i < flush_num_threads; i++) {
         dcontext_t *dcontext = flush_threads[i]->dcontext;
         if (dcontext != NULL) { /* include my_dcontext here */
-            DEBUG_DECLARE(uint removed;)
             LOG(GLOBAL, LOG_FRAGMENT, 2,
                 "\tconsidering thread #%d "TIDFMT"\n", i, flush_threads[i]->id);
             if (dcontext != my_dcontext) {
@@ -6140,41 +6307,76 @@ flush_fragments_synchall_start(dcontext_t *ignored, app_pc base, size_t size,
                     trace_abort(dcontext);
                 }
             }
-            /* Since coarse fragments never cross coarse/non-coarse executable region
-             * bounds, we can bound their bodies by taking
-             * executable_area_distinct_bounds().  This lets us remove by walking the
-             * ibl tables and looking only at tags, rather than walking the htable of
-             * each coarse unit.  FIXME: not clear this is a perf win: I arbitrarily
-             * picked it under assumption that ibl tables are relatively small.  It
-             * would be a clearer win if we could do the fine fragments this way
-             * also, but fine fragments are not constrained and could be missed using
-             * only a tag-based range remove.
-             */
-            DEBUG_DECLARE(removed =)
-                fragment_remove_all_ibl_in_region(dcontext, exec_start, exec_end);
-            LOG(THREAD, LOG_FRAGMENT, 2,
-                "\tremoved %d ibl entries in "PFX"-"PFX"\n",
-                removed, exec_start, exec_end);
-            /* Free any fine private fragments in the region */
-            vm_area_allsynch_flush_fragments(dcontext, dcontext, base, base+size,
-                                             exec_invalid, all_synched/*ignored*/);
-            if (!SHARED_IBT_TABLES_ENABLED() && SHARED_FRAGMENTS_ENABLED()) {
-                /* Remove shared fine fragments from private ibl tables */
-                vm_area_allsynch_flush_fragments(dcontext, GLOBAL_DCONTEXT,
-                                                 base, base+size,
-                                                 exec_invalid, all_synched/*ignored*/);
-            }
         }
     }
-    /* Removed shared coarse fragments from ibl tables, before freeing any */
-    if (SHARED_IBT_TABLES_ENABLED() && SHARED_FRAGMENTS_ENABLED())
-        fragment_remove_all_ibl_in_region(GLOBAL_DCONTEXT, exec_start, exec_end);
-    /* Free coarse units and shared fine fragments, as well as removing shared fine
-     * entries in any shared ibl tables
+
+    /* Every thread is now out of the cache, so we can free the fragments of each
+     * region being flushed.
      */
-    if (SHARED_FRAGMENTS_ENABLED()) {
-        vm_area_allsynch_flush_fragments(GLOBAL_DCONTEXT, GLOBAL_DCONTEXT,
-                                         base, base+size, exec_invalid, all_synched);
+    flush_region_iter_start(&fri, regions, base, size);
+    while (flush_region_iter_next(&fri, &region_start, &region_end)) {
+        /* We rely on coarse fragments not touching more than one vmarea region
+         * for our ibl invalidation.  It's
+         * ok to invalidate more than we need to so we don't care if there are
+         * multiple coarse units within this range.  We just need the exec areas
+         * bounds that overlap the flush region.
+         */
+        if (!executable_area_overlap_bounds(region_start, region_end, &exec_start,
+                                            &exec_end, 0,
+                                            true/*doesn't matter w/ 0*/)) {
+            /* caller checks for overlap but lock let go so can get here; go ahead
+             * and do synch per flushing contract.
+             */
+            exec_start = region_start;
+            exec_end = region_end;
+        }
+        LOG(GLOBAL, LOG_FRAGMENT, 2,
+            "flush_fragments_synchall_start: from "PFX"-"PFX" => coarse "PFX"-"PFX"\n",
+            region_start, region_end, exec_start, exec_end);
+        for (i = 0; i < flush_num_threads; i++) {
+            dcontext_t *dcontext = flush_threads[i]->dcontext;
+            if (dcontext != NULL) { /* include my_dcontext and unsynched threads */
+                DEBUG_DECLARE(uint removed;)
+                /* Since coarse fragments never cross coarse/non-coarse executable
+                 * region bounds, we can bound their bodies by taking
+                 * executable_area_distinct_bounds().  This lets us remove by walking
+                 * the ibl tables and looking only at tags, rather than walking the
+                 * htable of each coarse unit.  FIXME: not clear this is a perf win:
+                 * I arbitrarily picked it under assumption that ibl tables are
+                 * relatively small.  It would be a clearer win if we could do the
+                 * fine fragments this way also, but fine fragments are not
+                 * constrained and could be missed using only a tag-based range
+                 * remove.
+                 */
+                DEBUG_DECLARE(removed =)
+                    fragment_remove_all_ibl_in_region(dcontext, exec_start, exec_end);
+                LOG(THREAD, LOG_FRAGMENT, 2,
+                    "\tremoved %d ibl entries in "PFX"-"PFX"\n",
+                    removed, exec_start, exec_end);
+                /* Free any fine private fragments in the region */
+                vm_area_allsynch_flush_fragments(dcontext, dcontext, region_start,
+                                                 region_end, exec_invalid,
+                                                 all_synched/*ignored*/);
+                if (!SHARED_IBT_TABLES_ENABLED() && SHARED_FRAGMENTS_ENABLED()) {
+                    /* Remove shared fine fragments from private ibl tables */
+                    vm_area_allsynch_flush_fragments(dcontext, GLOBAL_DCONTEXT,
+                                                     region_start, region_end,
+                                                     exec_invalid,
+                                                     all_synched/*ignored*/);
+                }
+            }
+        }
+        /* Removed shared coarse fragments from ibl tables, before freeing any */
+        if (SHARED_IBT_TABLES_ENABLED() && SHARED_FRAGMENTS_ENABLED())
+            fragment_remove_all_ibl_in_region(GLOBAL_DCONTEXT, exec_start, exec_end);
+        /* Free coarse units and shared fine fragments, as well as removing shared
+         * fine entries in any shared ibl tables
+         */
+        if (SHARED_FRAGMENTS_ENABLED()) {
+            vm_area_allsynch_flush_fragments(GLOBAL_DCONTEXT, GLOBAL_DCONTEXT,
+                                             region_start, region_end, exec_invalid,
+                                             all_synched);
+        }
     }
 }
 
@@ -6239,6 +6441,9 @@ flush_fragments_thread_unlink(dcontext_t *dcontext, int thread_index,
                                   dcontext_t *tgt_dcontext)
 {
     per_thread_t *tgt_pt = (per_thread_t *) tgt_dcontext->fragment_field;
+    flush_region_iter_t fri;
+    app_pc start, end;
+    bool overlap = false;
 
     /* if a trace-in-progress crosses this region, must squash the trace
      * (all traces are essentially frozen now since threads stop in dispatch)
@@ -6246,9 +6451,15 @@ flush_fragments_thread_unlink(dcontext_t *dcontext, int thread_index,
     if (flush_size > 0 /* else, no region to cross */ &&
         is_building_trace(tgt_dcontext)) {
         void *trace_vmlist = cur_trace_vmlist(tgt_dcontext);
-        if (trace_vmlist != NULL &&
-            vm_list_overlaps(tgt_dcontext, trace_vmlist, flush_base,
-                             flush_base+flush_size)) {
+        bool squash = false;
+        if (trace_vmlist != NULL) {
+            flush_region_iter_start(&fri, flush_regions, flush_base, flush_size);
+            while (flush_region_iter_next(&fri, &start, &end)) {
+                if (vm_list_overlaps(tgt_dcontext, trace_vmlist, start, end))
+                    squash = true;
+            }
+        }
+        if (squash) {
             LOG(THREAD, LOG_FRAGMENT, 2,
                 "\tsquashing trace of thread "TIDFMT"\n", tgt_dcontext->owning_thread);
             trace_abort(tgt_dcontext);
@@ -6289,8 +6500,12 @@ flush_fragments_thread_unlink(dcontext_t *dcontext, int thread_index,
     }
 
     /* don't need to go any further if thread has no frags in region */
-    if (flush_size == 0 ||
-        !thread_vm_area_overlap(tgt_dcontext, flush_base, flush_base+flush_size)) {
+    flush_region_iter_start(&fri, flush_regions, flush_base, flush_size);
+    while (flush_region_iter_next(&fri, &start, &end)) {
+        if (thread_vm_area_overlap(tgt_dcontext, start, end))
+            overlap = true;
+    }
+    if (!overlap) {
         LOG(THREAD, LOG_FRAGMENT, 2,
             "\tthread "TIDFMT" has no fragments in region to flush\n",
             tgt_dcontext->owning_thread);
@@ -6310,11 +6525,14 @@ flush_fragments_thread_unlink(dcontext_t *dcontext, int thread_index,
     if (flush_size > 0) {
         /* unlink all frags in overlapping regions, and mark regions for deletion */
         tgt_pt->flush_queue_nonempty = true;
+        flush_region_iter_start(&fri, flush_regions, flush_base, flush_size);
+        while (flush_region_iter_next(&fri, &start, &end)) {
 #ifdef DEBUG
-        num_flushed +=
+            num_flushed +=
 #endif
-            vm_area_unlink_fragments(tgt_dcontext, flush_base, flush_base + flush_size, 0
-                                     _IF_DGCDIAG(written_pc));
+                vm_area_unlink_fragments(tgt_dcontext, start, end, 0
+                                         _IF_DGCDIAG(written_pc));
+        }
     }
 
     return false; /* false: syscalls remain unlinked until vm_area_flush_fragments */
@@ -6565,7 +6783,7 @@ flush_fragments_synch_unlink_priv(dcontext_t *dcontext, app_pc base, size_t size
          */
         ASSERT(!own_initexit_lock);
         /* The synchall will flush fine as well as coarse so we'll be done */
-        flush_fragments_synchall_start(dcontext, base, size, exec_invalid);
+        flush_fragments_synchall_start(dcontext, base, size, NULL, exec_invalid);
         return true;
     }
 
@@ -6652,9 +6870,16 @@ flush_fragments_unlink_shared(dcontext_t *dcontext, app_pc base, size_t size,
          * fragments from private/shared ibl tables
          */
         if (list == NULL) {
-            shared_flushed =
-                vm_area_unlink_fragments(GLOBAL_DCONTEXT, base, base + size,
-                                         pending_delete_threads _IF_DGCDIAG(written_pc));
+            flush_region_iter_t fri;
+            app_pc start, end;
+            shared_flushed = 0;
+            flush_region_iter_start(&fri, flush_regions, base, size);
+            while (flush_region_iter_next(&fri, &start, &end)) {
+                shared_flushed +=
+                    vm_area_unlink_fragments(GLOBAL_DCONTEXT, start, end,
+                                             pending_delete_threads
+                                             _IF_DGCDIAG(written_pc));
+            }
         } else {
             shared_flushed = unlink_fragments_for_deletion(GLOBAL_DCONTEXT, list,
                                                            pending_delete_threads);
@@ -6962,40 +7187,76 @@ invalidate_code_cache()
     flush_fragments_in_region_finish(dcontext, false);
 }
 
-/* Flushes all areas stored in the vector toflush.
+/* Flushes all areas stored in the vector toflush with a single synch.
  * Synchronization of toflush is up to caller, but as locks cannot be
  * held when flushing, toflush must be thread-private.
- * Currently only used for pcache hotp interop (case 9970).
+ * Used for pcache hotp interop (case 9970) and for queued client flushes.
  */
 void
 flush_vmvector_regions(dcontext_t *dcontext, vm_area_vector_t *toflush,
-                       bool free_futures, bool exec_invalid)
+                       bool free_futures, bool exec_invalid, bool force_synchall)
 {
     vmvector_iterator_t vmvi;
-    app_pc start, end;
+    app_pc start, end, base = NULL, stop = NULL;
+    bool synchall = force_synchall;
     ASSERT(toflush != NULL && !TEST(VECTOR_SHARED, toflush->flags));
     ASSERT(!RUNNING_WITHOUT_CODE_CACHE());
-    ASSERT(DYNAMO_OPTION(coarse_units) && DYNAMO_OPTION(use_persisted)
-           IF_HOTP(&& DYNAMO_OPTION(hot_patching)));
+    ASSERT_OWN_NO_LOCKS();
     if (vmvector_empty(toflush))
         return;
+    /* Case 10086: we synch once for all the areas.  A synchall is needed if any
+     * area overlaps coarse code, as for a single-region flush.  The executable
+     * checks race with other threads just as they do in
+     * flush_fragments_synch_unlink_priv(), where they are only a filter.
+     */
     vmvector_iterator_start(toflush, &vmvi);
     while (vmvector_iterator_hasnext(&vmvi)) {
         vmvector_iterator_next(&vmvi, &start, &end);
-        /* FIXME case 10086: optimization: batch the flushes together so we only
-         * synch once.  Currently this is rarely used, and with few areas in the
-         * vector, so we don't bother.  To batch them we'd need to assume the
-         * worst and do a synchall up front, which could be more costly than 2
-         * or 3 separate flushes that do not involve coarse code.
-         */
-        ASSERT_OWN_NO_LOCKS();
-        flush_fragments_in_region_start(dcontext, start, end - start,
-                                        false/*no lock*/, free_futures, exec_invalid,
-                                        false/*don't force synchall*/ _IF_DGCDIAG(NULL));
-        flush_fragments_in_region_finish(dcontext, false/*no lock*/);
-        STATS_INC(num_flush_vmvector);
+        if (!executable_vm_area_executed_from(start, end))
+            continue;
+        if (base == NULL || start < base)
+            base = start;
+        if (end > stop)
+            stop = end;
+        if (executable_vm_area_coarse_overlap(start, end))
+            synchall = true;
     }
     vmvector_iterator_stop(&vmvi);
+    if (base == NULL) {
+        LOG(THREAD, LOG_FRAGMENT, 2,
+            "\tregions not executable, so no fragments to flush\n");
+        STATS_INC(num_noncode_flushes);
+        return;
+    }
+
+    KSTART(flush_region);
+    STATS_INC(num_flushes);
+    STATS_INC(num_flush_vmvector);
+    if (synchall) {
+        flush_fragments_synchall_start(dcontext, base, stop - base, toflush,
+                                       exec_invalid);
+    } else {
+        /* flush_fragments_synch_priv() sets flush_base and flush_size under
+         * thread_initexit_lock, so we set flush_regions once we hold it too.
+         */
+        mutex_lock(&thread_initexit_lock);
+        flush_regions = toflush;
+        flush_fragments_synch_priv(dcontext, base, stop - base, true/*own lock*/,
+                                   flush_fragments_thread_unlink _IF_DGCDIAG(NULL));
+    }
+    flush_fragments_unlink_shared(dcontext, base, stop - base, NULL _IF_DGCDIAG(NULL));
+    /* We need to free the futures after all fragments have been unlinked */
+    if (free_futures) {
+        vmvector_iterator_start(toflush, &vmvi);
+        while (vmvector_iterator_hasnext(&vmvi)) {
+            vmvector_iterator_next(&vmvi, &start, &end);
+            flush_fragments_free_futures(start, end - start);
+        }
+        vmvector_iterator_stop(&vmvi);
+    }
+    flush_regions = NULL;
+    executable_areas_lock();
+    flush_fragments_in_region_finish(dcontext, false/*no lock*/);
 }
 
 /****************************************************************************/
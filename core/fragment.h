@@ -152,6 +152,9 @@
 # endif
 #elif defined(SIDELINE)
 # define FRAG_DO_NOT_SIDELINE     0x40000000
+#elif defined(OPTIMIZE_ASYNC)
+/* this trace is the -optimize_async replacement of an unoptimized trace */
+# define FRAG_OPTIMIZED_ASYNC     0x40000000
 #endif
 
 /* This fragment immediately follows a free entry in the fcache */
@@ -627,6 +630,11 @@ void
 fragment_fork_init(dcontext_t *dcontext);
 #endif
 
+#ifdef X86
+void
+fragment_shadow_ret_stack_refresh(dcontext_t *dcontext);
+#endif
+
 fragment_t *
 fragment_create(dcontext_t *dcontext, app_pc tag,
                 int body_size, int direct_exits, int indirect_exits,
@@ -1158,13 +1166,13 @@ flush_fragments_custom_list(dcontext_t *dcontext, fragment_t *list,
 void
 invalidate_code_cache(void);
 
-/* Flushes all areas stored in the vector toflush.
+/* Flushes all areas stored in the vector toflush with a single synch.
  * Synch is up to caller, but as locks cannot be held when flushing,
  * toflush needs to be thread-private.
  */
 void
 flush_vmvector_regions(dcontext_t *dcontext, vm_area_vector_t *toflush,
-                       bool free_futures, bool exec_invalid);
+                       bool free_futures, bool exec_invalid, bool force_synchall);
 
 /*
  ****************************************************************************/
@@ -1038,6 +1038,10 @@ struct _dcontext_t {
     bool currently_stopped;
     /* This is a flag requesting that this thread go native. */
     bool go_native;
+#ifdef X86
+    /* -shadow_ret_stack only, else NULL.  Read and written from the cache. */
+    shadow_ret_stack_t *shadow_ret;
+#endif
 };
 
 /* sentinel value for dcontext_t* used to indicate
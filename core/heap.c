@@ -277,10 +277,23 @@ typedef struct _thread_units_t {
 #define SEPARATE_NONPERSISTENT_HEAP() \
     (DYNAMO_OPTION(enable_reset) IF_CLIENT_INTERFACE(|| true))
 
+/* Per-thread cache ("magazine") of free global heap blocks, with one free
+ * list per fixed-size bucket.  Only the owning thread touches it, so most
+ * global_heap_alloc() and global_heap_free() calls need no lock: we only go
+ * to heapmgt->global_units, under global_alloc_lock, to refill or return a
+ * batch of blocks.  Blocks sitting in a magazine are allocated as far as
+ * global_units is concerned and are accounted to ACCT_MEM_MGT.
+ */
+typedef struct _heap_magazine_t {
+    heap_pc free_list[BLOCK_TYPES-1];
+    uint count[BLOCK_TYPES-1];
+} heap_magazine_t;
+
 /* per-thread structure: */
 typedef struct _thread_heap_t {
     thread_units_t *local_heap;
     thread_units_t *nonpersistent_heap;
+    heap_magazine_t magazine; /* for -global_heap_magazine */
 } thread_heap_t;
 
 /* global, unique thread-shared structure:
@@ -719,12 +732,26 @@ vmm_heap_initialize_unusable(vm_heap_t *vmh)
     vmh->num_free_blocks = vmh->num_blocks = 0;
 }
 
+#ifdef LINUX
+/* Transparent huge pages only back 2MB-aligned ranges of a single mapping. */
+# define VMM_HUGE_PAGE_SIZE (2*1024*1024)
+# define VMM_USE_HUGE_PAGES(which) \
+    ((DYNAMO_OPTION(vm_huge_pages) && (which) == VMM_CACHE) || \
+     (DYNAMO_OPTION(vm_huge_pages_heap) && (which) == VMM_HEAP))
+#endif
+
 static void
 vmm_heap_unit_init(vm_heap_t *vmh, size_t size)
 {
     ptr_uint_t preferred = 0;
     heap_error_code_t error_code = 0;
+    /* alignment of the region start */
+    size_t align = DYNAMO_OPTION(vmm_block_size);
     ASSIGN_INIT_LOCK_FREE(vmh->lock, vmh_lock);
+#ifdef LINUX
+    if (DYNAMO_OPTION(vm_huge_pages) || DYNAMO_OPTION(vm_huge_pages_heap))
+        align = MAX(align, VMM_HUGE_PAGE_SIZE);
+#endif
 
     size = ALIGN_FORWARD(size, DYNAMO_OPTION(vmm_block_size));
     ASSERT(size <= MAX_VMM_HEAP_UNIT_SIZE);
@@ -762,10 +789,10 @@ vmm_heap_unit_init(vm_heap_t *vmh, size_t size)
                 vmh->alloc_start = os_heap_reserve_in_region
                     ((void *)ALIGN_FORWARD(reach_base, PAGE_SIZE),
                      (void *)ALIGN_BACKWARD(reach_end, PAGE_SIZE),
-                     size + DYNAMO_OPTION(vmm_block_size), &error_code, true/*+x*/);
+                     size + align, &error_code, true/*+x*/);
                 if (vmh->alloc_start != NULL) {
-                    vmh->start_addr = (heap_pc)
-                        ALIGN_FORWARD(vmh->alloc_start, DYNAMO_OPTION(vmm_block_size));
+                    vmh->alloc_size = size + align;
+                    vmh->start_addr = (heap_pc) ALIGN_FORWARD(vmh->alloc_start, align);
                     request_region_be_heap_reachable(app_base, app_end - app_base);
                 }
             }
@@ -786,7 +813,7 @@ vmm_heap_unit_init(vm_heap_t *vmh, size_t size)
                      + get_random_offset(DYNAMO_OPTION(vm_max_offset) /
                                          DYNAMO_OPTION(vmm_block_size)) *
                      DYNAMO_OPTION(vmm_block_size));
-        preferred = ALIGN_FORWARD(preferred, DYNAMO_OPTION(vmm_block_size));
+        preferred = ALIGN_FORWARD(preferred, align);
         /* overflow check: w/ vm_base shouldn't happen so debug-only check */
         ASSERT(!POINTER_OVERFLOW_ON_ADD(preferred, size));
         /* let's assume a single chunk is sufficient to reserve */
@@ -811,21 +838,19 @@ vmm_heap_unit_init(vm_heap_t *vmh, size_t size)
          * syslog or assert here
          */
         /* need extra size to ensure alignment */
-        vmh->alloc_size = size + DYNAMO_OPTION(vmm_block_size);
+        vmh->alloc_size = size + align;
 #ifdef X64
         /* PR 215395, make sure allocation satisfies heap reachability contraints */
         vmh->alloc_start = os_heap_reserve_in_region
             ((void *)ALIGN_FORWARD(heap_allowable_region_start, PAGE_SIZE),
              (void *)ALIGN_BACKWARD(heap_allowable_region_end, PAGE_SIZE),
-             size + DYNAMO_OPTION(vmm_block_size), &error_code,
+             size + align, &error_code,
              true/*+x*/);
 #else
         vmh->alloc_start = (heap_pc)
-            os_heap_reserve(NULL, size + DYNAMO_OPTION(vmm_block_size),
-                            &error_code, true/*+x*/);
+            os_heap_reserve(NULL, size + align, &error_code, true/*+x*/);
 #endif
-        vmh->start_addr = (heap_pc) ALIGN_FORWARD(vmh->alloc_start,
-                                                  DYNAMO_OPTION(vmm_block_size));
+        vmh->start_addr = (heap_pc) ALIGN_FORWARD(vmh->alloc_start, align);
         LOG(GLOBAL, LOG_HEAP, 1, "vmm_heap_unit_init unable to allocate at preferred="
             PFX" letting OS place sz=%dM addr="PFX"\n",
             preferred, size/(1024*1024), vmh->start_addr);
@@ -1086,7 +1111,18 @@ vmm_heap_reserve_blocks(vm_heap_t *vmh, size_t size_in, which_vmm_t which)
         mutex_unlock(&vmh->lock);
         return NULL;
     }
-    first_block = bitmap_allocate_blocks(vmh->blocks, vmh->num_blocks, request);
+    /* Keep the code cache together at the top of the region, away from heap
+     * data and from the (cold) separate exit stubs, which all grow up from the
+     * bottom.  Hot code is then denser in the i-cache and iTLB, and whole 2MB
+     * ranges of it can become huge pages.  The whole region is reachable from
+     * itself so this does not affect reachability.
+     */
+    if (which == VMM_CACHE &&
+        (DYNAMO_OPTION(vm_cache_top_down) IF_LINUX(|| DYNAMO_OPTION(vm_huge_pages)))) {
+        first_block = bitmap_allocate_blocks_from_end(vmh->blocks, vmh->num_blocks,
+                                                      request);
+    } else
+        first_block = bitmap_allocate_blocks(vmh->blocks, vmh->num_blocks, request);
     if (first_block != BITMAP_NOT_FOUND) {
         vmh->num_free_blocks -= request;
     }
@@ -1104,6 +1140,10 @@ vmm_heap_reserve_blocks(vm_heap_t *vmh, size_t size_in, which_vmm_t which)
                 STATS_ADD(vmm_multi_blocks, request);
             }
         });
+#ifdef LINUX
+        if (VMM_USE_HUGE_PAGES(which) && os_heap_advise_huge_pages(p, size, true))
+            STATS_ADD_PEAK(vmm_vsize_huge, size);
+#endif
     } else {
         p = NULL;
     }
@@ -1130,6 +1170,13 @@ vmm_heap_free_blocks(vm_heap_t *vmh, vm_addr_t p, size_t size_in, which_vmm_t wh
     LOG(GLOBAL, LOG_HEAP, 2, "vmm_heap_free_blocks: size=%d blocks=%d p="PFX"\n",
         size, request, p);
 
+#ifdef LINUX
+    /* os_heap_decommit() leaves the mapping in place, so clear the advice
+     * before these blocks are handed to some other kind of allocation.
+     */
+    if (VMM_USE_HUGE_PAGES(which) && os_heap_advise_huge_pages(p, size, false))
+        STATS_SUB(vmm_vsize_huge, size);
+#endif
     mutex_lock(&vmh->lock);
     bitmap_free_blocks(vmh->blocks, vmh->num_blocks, first_block, request);
     vmh->num_free_blocks += request;
@@ -2742,12 +2789,23 @@ heap_vmareas_synch_units()
     release_recursive_lock(&global_alloc_lock);
 }
 
+/* Acquires global_alloc_lock, counting how often we had to wait for it */
+static void
+global_alloc_lock_acquire(void)
+{
+    if (!try_recursive_lock(&global_alloc_lock)) {
+        STATS_INC(global_alloc_lock_contended);
+        acquire_recursive_lock(&global_alloc_lock);
+    }
+    STATS_INC(global_alloc_lock_acquired);
+}
+
 /* shared between global and global_unprotected */
 static void *
 common_global_heap_alloc(thread_units_t *tu, size_t size HEAPACCT(which_heap_t which))
 {
     void *p;
-    acquire_recursive_lock(&global_alloc_lock);
+    global_alloc_lock_acquire();
     p = common_heap_alloc(tu, size HEAPACCT(which));
     release_recursive_lock(&global_alloc_lock);
     if (p == NULL) {
@@ -2755,7 +2813,7 @@ common_global_heap_alloc(thread_units_t *tu, size_t size HEAPACCT(which_heap_t w
          * global alloc lock -- so we back out, grab it, and retry
          */
         dynamo_vm_areas_lock();
-        acquire_recursive_lock(&global_alloc_lock);
+        global_alloc_lock_acquire();
         p = common_heap_alloc(tu, size HEAPACCT(which));
         release_recursive_lock(&global_alloc_lock);
         dynamo_vm_areas_unlock();
@@ -2775,7 +2833,7 @@ common_global_heap_free(thread_units_t *tu, void *p, size_t size
         return;
     }
 
-    acquire_recursive_lock(&global_alloc_lock);
+    global_alloc_lock_acquire();
     ok = common_heap_free(tu, p, size HEAPACCT(which));
     release_recursive_lock(&global_alloc_lock);
     if (!ok) {
@@ -2783,7 +2841,7 @@ common_global_heap_free(thread_units_t *tu, void *p, size_t size
          * global alloc lock -- so we back out, grab it, and retry
          */
         dynamo_vm_areas_lock();
-        acquire_recursive_lock(&global_alloc_lock);
+        global_alloc_lock_acquire();
         ok = common_heap_free(tu, p, size HEAPACCT(which));
         release_recursive_lock(&global_alloc_lock);
         dynamo_vm_areas_unlock();
@@ -2791,11 +2849,137 @@ common_global_heap_free(thread_units_t *tu, void *p, size_t size
     ASSERT(ok);
 }
 
+/* Returns the calling thread's global heap magazine, or NULL if
+ * -global_heap_magazine is off or the thread has no heap set up (yet or any
+ * more).
+ */
+static heap_magazine_t *
+global_heap_magazine(void)
+{
+    dcontext_t *dcontext;
+    if (DYNAMO_OPTION(global_heap_magazine) == 0)
+        return NULL;
+    dcontext = get_thread_private_dcontext();
+    if (dcontext == NULL || dcontext == GLOBAL_DCONTEXT || dcontext->heap_field == NULL)
+        return NULL;
+    return &((thread_heap_t *) dcontext->heap_field)->magazine;
+}
+
+/* Returns the fixed-size bucket that size falls into, or -1 if it needs a
+ * variable-length block and so bypasses the magazines.
+ */
+static int
+global_heap_magazine_bucket(size_t size)
+{
+    size_t aligned_size = ALIGN_FORWARD(size, HEAP_ALIGNMENT);
+    int bucket = 0;
+    if (size == 0 || aligned_size > BLOCK_SIZES[BLOCK_TYPES-2])
+        return -1;
+    while (aligned_size > BLOCK_SIZES[bucket])
+        bucket++;
+    return bucket;
+}
+
+static uint
+global_heap_magazine_batch(void)
+{
+    return MAX(DYNAMO_OPTION(global_heap_magazine) / 2, 1);
+}
+
+/* Moves a batch of free blocks for bucket from global_units into mag with a
+ * single acquisition of global_alloc_lock.  May come back empty-handed if
+ * global_units needs to grow, which requires dynamo_vm_areas_lock: the
+ * caller then falls back to common_global_heap_alloc().
+ */
+static void
+global_heap_magazine_refill(heap_magazine_t *mag, int bucket)
+{
+    thread_units_t *tu = &heapmgt->global_units;
+    uint i, batch = global_heap_magazine_batch();
+    global_alloc_lock_acquire();
+    for (i = 0; i < batch; i++) {
+        heap_pc p = (heap_pc)
+            common_heap_alloc(tu, BLOCK_SIZES[bucket] HEAPACCT(ACCT_MEM_MGT));
+        if (p == NULL)
+            break;
+#ifdef DEBUG_MEMORY
+        DOCHECK(CHKLVL_MEMFILL, memset(p, HEAP_UNALLOCATED_BYTE, BLOCK_SIZES[bucket]););
+#endif
+        *((heap_pc *)p) = mag->free_list[bucket];
+        mag->free_list[bucket] = p;
+        mag->count[bucket]++;
+    }
+    release_recursive_lock(&global_alloc_lock);
+    STATS_INC(global_heap_magazine_refills);
+}
+
+/* Hands num blocks for bucket from mag back to global_units with a single
+ * acquisition of global_alloc_lock.
+ */
+static void
+global_heap_magazine_return(heap_magazine_t *mag, int bucket, uint num)
+{
+    thread_units_t *tu = &heapmgt->global_units;
+    DEBUG_DECLARE(bool ok;)
+    ASSERT(num <= mag->count[bucket]);
+    global_alloc_lock_acquire();
+    for (; num > 0; num--) {
+        heap_pc p = mag->free_list[bucket];
+        ASSERT(p != NULL);
+        mag->free_list[bucket] = *((heap_pc *)p);
+        mag->count[bucket]--;
+#ifdef DEBUG_MEMORY
+        /* global_units still considers the block allocated, and would take
+         * our unallocated fill for a double free.
+         */
+        DOCHECK(CHKLVL_MEMFILL, memset(p, HEAP_ALLOCATED_BYTE, BLOCK_SIZES[bucket]););
+#endif
+        /* fixed-size blocks never need dynamo_vm_areas_lock to be freed */
+        DEBUG_DECLARE(ok =)
+            common_heap_free(tu, p, BLOCK_SIZES[bucket] HEAPACCT(ACCT_MEM_MGT));
+        ASSERT(ok);
+    }
+    release_recursive_lock(&global_alloc_lock);
+    STATS_INC(global_heap_magazine_returns);
+}
+
+#ifdef HEAP_ACCOUNTING
+/* Blocks sitting in a magazine are charged to ACCT_MEM_MGT.  Moves the charge
+ * for one block to the caller's which on alloc, and back on free.  We take
+ * global_alloc_lock as that is what guards global_units' accounting.
+ */
+static void
+global_heap_magazine_account(int bucket, which_heap_t which, bool alloc)
+{
+    thread_units_t *tu = &heapmgt->global_units;
+    size_t size = BLOCK_SIZES[bucket];
+    which_heap_t from = alloc ? ACCT_MEM_MGT : which;
+    which_heap_t to = alloc ? which : ACCT_MEM_MGT;
+    global_alloc_lock_acquire();
+    ACCOUNT_FOR_FREE(tu, from, size);
+    ACCOUNT_FOR_ALLOC(alloc_reuse, tu, to, size, size);
+    release_recursive_lock(&global_alloc_lock);
+}
+#endif
+
+static void
+global_heap_magazine_drain(heap_magazine_t *mag)
+{
+    int bucket;
+    for (bucket = 0; bucket < BLOCK_TYPES-1; bucket++) {
+        if (mag->count[bucket] > 0)
+            global_heap_magazine_return(mag, bucket, mag->count[bucket]);
+        ASSERT(mag->free_list[bucket] == NULL);
+    }
+}
+
 /* these functions use the global heap instead of a thread's heap: */
 void *
 global_heap_alloc(size_t size HEAPACCT(which_heap_t which))
 {
     void *p;
+    heap_magazine_t *mag;
+    int bucket;
 #ifdef CLIENT_INTERFACE
     /* We pay the cost of this branch to support using DR's decode routines from the
      * regular DR library and not just drdecode, to support libraries that would use
@@ -2807,6 +2991,33 @@ global_heap_alloc(size_t size HEAPACCT(which_heap_t which))
         standalone_init();
     }
 #endif
+    mag = global_heap_magazine();
+    if (mag != NULL && (bucket = global_heap_magazine_bucket(size)) >= 0) {
+        if (mag->free_list[bucket] == NULL)
+            global_heap_magazine_refill(mag, bucket);
+        p = mag->free_list[bucket];
+        if (p != NULL) {
+            mag->free_list[bucket] = *((heap_pc *)p);
+            mag->count[bucket]--;
+#ifdef DEBUG_MEMORY
+            /* verify is unallocated memory, skip the free list next pointer */
+            DOCHECK(CHKLVL_MEMFILL, {
+                CLIENT_ASSERT(is_region_memset_to_char
+                              ((byte *)p + sizeof(heap_pc *),
+                               BLOCK_SIZES[bucket] - sizeof(heap_pc *),
+                               HEAP_UNALLOCATED_BYTE), "memory corruption detected");
+                memset(p, HEAP_ALLOCATED_BYTE, BLOCK_SIZES[bucket]);
+            });
+#endif
+#ifdef HEAP_ACCOUNTING
+            global_heap_magazine_account(bucket, which, true/*alloc*/);
+#endif
+            STATS_INC(global_heap_magazine_allocs);
+            LOG(GLOBAL, LOG_HEAP, 6, "\nglobal alloc: "PFX" (%d bytes, magazine)\n",
+                p, size);
+            return p;
+        }
+    }
     p = common_global_heap_alloc(&heapmgt->global_units, size HEAPACCT(which));
     ASSERT(p != NULL);
     LOG(GLOBAL, LOG_HEAP, 6, "\nglobal alloc: "PFX" (%d bytes)\n", p, size);
@@ -2816,6 +3027,25 @@ global_heap_alloc(size_t size HEAPACCT(which_heap_t which))
 void
 global_heap_free(void *p, size_t size HEAPACCT(which_heap_t which))
 {
+    heap_magazine_t *mag = global_heap_magazine();
+    int bucket;
+    if (mag != NULL && p != NULL && (bucket = global_heap_magazine_bucket(size)) >= 0) {
+#ifdef DEBUG_MEMORY
+        DOCHECK(CHKLVL_MEMFILL, memset(p, HEAP_UNALLOCATED_BYTE, BLOCK_SIZES[bucket]););
+#endif
+#ifdef HEAP_ACCOUNTING
+        global_heap_magazine_account(bucket, which, false/*free*/);
+#endif
+        *((heap_pc *)p) = mag->free_list[bucket];
+        mag->free_list[bucket] = (heap_pc) p;
+        mag->count[bucket]++;
+        STATS_INC(global_heap_magazine_frees);
+        LOG(GLOBAL, LOG_HEAP, 6, "\nglobal free: "PFX" (%d bytes, magazine)\n",
+            p, size);
+        if (mag->count[bucket] > DYNAMO_OPTION(global_heap_magazine))
+            global_heap_magazine_return(mag, bucket, global_heap_magazine_batch());
+        return;
+    }
     common_global_heap_free(&heapmgt->global_units, p, size HEAPACCT(which));
     LOG(GLOBAL, LOG_HEAP, 6, "\nglobal free: "PFX" (%d bytes)\n", p, size);
 }
@@ -3274,6 +3504,7 @@ heap_thread_init(dcontext_t *dcontext)
 {
     thread_heap_t *th = (thread_heap_t *)
         global_heap_alloc(sizeof(thread_heap_t) HEAPACCT(ACCT_MEM_MGT));
+    memset(&th->magazine, 0, sizeof(th->magazine));
     dcontext->heap_field = (void *) th;
     th->local_heap = (thread_units_t *) global_heap_alloc(sizeof(thread_units_t)
                                                        HEAPACCT(ACCT_MEM_MGT));
@@ -3307,6 +3538,12 @@ heap_thread_exit(dcontext_t *dcontext)
     thread_heap_t *th = (thread_heap_t *) dcontext->heap_field;
     threadunits_exit(th->local_heap, dcontext);
     heap_thread_reset_free(dcontext);
+    /* From here on this thread's global frees must go straight to
+     * global_units: clearing heap_field stops global_heap_magazine() from
+     * handing out th->magazine, which we then empty.
+     */
+    dcontext->heap_field = NULL;
+    global_heap_magazine_drain(&th->magazine);
     global_heap_free(th->local_heap, sizeof(thread_units_t) HEAPACCT(ACCT_MEM_MGT));
     if (SEPARATE_NONPERSISTENT_HEAP()) {
         ASSERT(th->nonpersistent_heap != NULL);
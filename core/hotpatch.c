@@ -3149,7 +3149,8 @@ nudge_action_read_policies(void)
                  * or non-persisted unit(s) (there can be multiple).
                  */
                 flush_vmvector_regions(get_thread_private_dcontext(), &toflush,
-                                       false/*keep futures*/, false/*exec still valid*/);
+                                       false/*keep futures*/, false/*exec still valid*/,
+                                       false/*don't force synchall*/);
             }
             /* FIXME: don't need to flush non-persisted coarse units since
              * patch points are fine-grained: would have to widen
@@ -3300,7 +3301,8 @@ hotp_nudge_handler(uint nudge_action_mask)
                  * or non-persisted unit(s) (there can be multiple).
                  */
                 flush_vmvector_regions(get_thread_private_dcontext(), &toflush,
-                                       false/*keep futures*/, false/*exec still valid*/);
+                                       false/*keep futures*/, false/*exec still valid*/,
+                                       false/*don't force synchall*/);
             }
             hotp_remove_hot_patches(GLOBAL_VUL_TABLE, NUM_GLOBAL_VULS, false,
                                     old_modes);
@@ -115,8 +115,7 @@ fragment_tree_overlap_lookup(fragment_tree_t *tree, app_pc start, app_pc end)
     return tree->nil;
 }
 
-#ifdef STANDALONE_UNIT_TEST
-/* Lookup a node in the tree by exact match. For testing only. */
+/* Lookup a node in the tree by exact match. */
 static bb_node_t *
 fragment_tree_lookup(fragment_tree_t *tree, app_pc start, app_pc end)
 {
@@ -134,7 +133,6 @@ fragment_tree_lookup(fragment_tree_t *tree, app_pc start, app_pc end)
     }
     return NULL;
 }
-#endif /* STANDALONE_UNIT_TEST */
 
 /* Locally update the maximum end pc for the subtree defined by node (i.e., node->max),
  * assuming that the maximum of node's two children (including nil) are currently correct.
@@ -548,6 +546,9 @@ fragment_tree_clear(fragment_tree_t *tree)
 
 static fragment_tree_t *fragment_tree;
 
+/* protects fragment_tree */
+DECLARE_CXTSWPROT_VAR(static mutex_t jitopt_lock, INIT_LOCK_FREE(jitopt_lock));
+
 void
 jitopt_init()
 {
@@ -570,13 +571,18 @@ jitopt_exit()
 {
     if (DYNAMO_OPTION(opt_jit))
         fragment_tree_destroy(fragment_tree);
+    DELETE_LOCK(jitopt_lock);
 }
 
 void
 jitopt_add_dgc_bb(app_pc start, app_pc end, bool is_trace_head)
 {
     ASSERT(DYNAMO_OPTION(opt_jit));
-    fragment_tree_insert(fragment_tree, start, end);
+    mutex_lock(&jitopt_lock);
+    /* thread-private caches build the same bb once per thread */
+    if (fragment_tree_lookup(fragment_tree, start, end) == NULL)
+        fragment_tree_insert(fragment_tree, start, end);
+    mutex_unlock(&jitopt_lock);
 }
 
 uint
@@ -587,6 +593,7 @@ jitopt_clear_span(app_pc start, app_pc end)
 
     ASSERT(DYNAMO_OPTION(opt_jit));
 
+    mutex_lock(&jitopt_lock);
     do {
         /* XXX i#1114: maybe more efficient to delete deepest overlapping node first */
         overlap = fragment_tree_overlap_lookup(fragment_tree, start, end);
@@ -596,6 +603,7 @@ jitopt_clear_span(app_pc start, app_pc end)
         removal_count++;
     } while (true);
 
+    mutex_unlock(&jitopt_lock);
     return removal_count;
 }
 
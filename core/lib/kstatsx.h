@@ -69,6 +69,7 @@ KSTAT_DEF("cache flush unit walk ", cache_flush_unit_walk)
 KSTAT_DEF("flush_region", flush_region)
 KSTAT_DEF("synchall flush ", synchall_flush)
 KSTAT_DEF("coarse pclookup", coarse_pclookup)
+KSTAT_DEF("executable area lookup", execarea_lookup)
 KSTAT_DEF("coarse freeze all", coarse_freeze_all)
 KSTAT_DEF("persisted cache generation", persisted_generation)
 KSTAT_DEF("persisted cache load", persisted_load)
@@ -143,6 +143,12 @@ under -rstats_to_stderr.
     STATS_DEF("System call trampolines, retakeover", num_syscall_trampolines_retakeover)
     RSTATS_DEF("Application mmaps", num_app_mmaps)
     RSTATS_DEF("Application munmaps", num_app_munmaps)
+#ifdef UNIX
+    STATS_DEF("Memory cache misses checked against maps file", num_memcache_os_checks)
+    STATS_DEF("Memory cache audits against maps file", num_memcache_audits)
+    STATS_DEF("Memory cache regions missing and repaired", num_memcache_drift_repairs)
+    STATS_DEF("Memory cache regions stale per maps file", num_memcache_drift_stale)
+#endif
     STATS_DEF("Module rebindings", num_app_rebinds)
 #ifdef WINDOWS
     STATS_DEF("Application map mismatches with sections", map_section_mismatch)
@@ -256,9 +262,13 @@ under -rstats_to_stderr.
     STATS_DEF("Fcache units on to-free list", cache_units_tofree)
     STATS_DEF("Peak fcache units on to-free list", peak_cache_units_tofree)
     STATS_DEF("Fcache units flushed for wset", cache_units_wset_flushed)
+    STATS_DEF("Fcache wset flushes sparing a hot unit", cache_units_wset_kept_hot)
     STATS_DEF("Fcache units allowed w/o a flush for wset", cache_units_wset_allowed)
     STATS_DEF("Fcache units flushed w/ no live fragments", cache_units_flushed_nolive)
     STATS_DEF("Flushes of vmvector areas", num_flush_vmvector)
+    STATS_DEF("Delayed flush requests processed", num_delayed_flush_requests)
+    STATS_DEF("Delayed flushes executed", num_delayed_flushes)
+    STATS_DEF("Delayed flush requests coalesced", num_delayed_flush_coalesced)
     STATS_DEF("Shared deletion regions unlinked", num_shared_flush_regions)
     STATS_DEF("Shared deletion region walks", num_shared_flush_walks)
     STATS_DEF("Shared deletion region at-syscall walks", num_shared_flush_atsyscall)
@@ -390,6 +400,12 @@ under -rstats_to_stderr.
     STATS_DEF("Fragments generated, bb and trace", num_fragments)
     RSTATS_DEF("Basic block fragments generated", num_bbs)
     RSTATS_DEF("Trace fragments generated", num_traces)
+    RSTATS_DEF("Trace bytes emitted", trace_bytes_emitted)
+    RSTATS_DEF("Component bb bytes copied into traces", trace_component_bb_bytes)
+    RSTATS_DEF("Trace exits reaching a trace head", num_trace_exits_to_heads)
+    RSTATS_DEF("Trace early exits reaching a trace head", num_trace_early_exits)
+    STATS_DEF("Adaptive trace threshold raises", trace_threshold_raised)
+    STATS_DEF("Adaptive trace threshold lowers", trace_threshold_lowered)
 #ifdef X64
     STATS_DEF("32-bit basic block fragments generated", num_32bit_bbs)
     STATS_DEF("32-bit trace fragments generated", num_32bit_traces)
@@ -514,6 +530,8 @@ under -rstats_to_stderr.
               num_shared_ibt_tables_freed_immediately)
     STATS_DEF("Pvt ptrs to shared tables updated at-sys walks",
               num_shared_tables_updated_atsyscall)
+    STATS_DEF("Pvt ptrs to shared tables updated at cache exit",
+              num_shared_tables_updated_quiescent)
     STATS_DEF("IBT unlinked entries NOT moved on resize",
               num_ibt_unlinked_entries_not_moved)
     STATS_DEF("BB fragments in 3 IBL tables", num_bbs_in_3_ibl_tables)
@@ -904,6 +922,12 @@ under -rstats_to_stderr.
     STATS_DEF("Peak heap bucket pad space (bytes)", peak_heap_bucket_pad)
     STATS_DEF("Heap allocs in buckets", heap_allocs_buckets)
     STATS_DEF("Heap allocs variable-sized", heap_allocs_variable)
+    STATS_DEF("Global heap lock acquisitions", global_alloc_lock_acquired)
+    STATS_DEF("Global heap lock acquisitions contended", global_alloc_lock_contended)
+    STATS_DEF("Global heap allocs from thread magazine", global_heap_magazine_allocs)
+    STATS_DEF("Global heap frees to thread magazine", global_heap_magazine_frees)
+    STATS_DEF("Global heap magazine refills", global_heap_magazine_refills)
+    STATS_DEF("Global heap magazine returns", global_heap_magazine_returns)
     STATS_DEF("Total reserved memory", reserved_memory_capacity)
     STATS_DEF("Peak total reserved memory", peak_reserved_memory_capacity)
     STATS_DEF("Guard pages, reserved virtual pages", guard_pages)
@@ -991,6 +1015,8 @@ under -rstats_to_stderr.
     STATS_DEF("Peak our virtual memory blocks in use", peak_vmm_vsize_blocks_used)
     STATS_DEF("Wasted vmm space due to alignment", vmm_vsize_wasted)
     STATS_DEF("Peak wasted vmm space due to alignment", peak_vmm_vsize_wasted)
+    STATS_DEF("Vmm space advised for huge pages (bytes)", vmm_vsize_huge)
+    STATS_DEF("Peak vmm space advised for huge pages (bytes)", peak_vmm_vsize_huge)
     STATS_DEF("Allocations using multiple vmm blocks", vmm_multi_block_allocs)
     STATS_DEF("Blocks used for multi-block allocs", vmm_multi_blocks)
     RSTATS_DEF("Current vmm virtual memory in use (bytes)", vmm_vsize_used)
@@ -1006,6 +1032,11 @@ under -rstats_to_stderr.
     STATS_DEF("Number of vmarea vector resize reallocations", num_vmareas_resized)
     STATS_DEF("Number of vmarea vector resize synch fixups", num_vmareas_resize_synch)
     STATS_DEF("Peak vmarea vector length", max_vmareas_length)
+    STATS_DEF("Vmarea entries shifted by adds and removes", vmareas_entries_shifted)
+    STATS_DEF("Lock-free vmarea lookups", num_vmareas_lockfree_lookups)
+    STATS_DEF("Lock-free vmarea lookups retried", num_vmareas_lockfree_retries)
+    STATS_DEF("Lock-free vmarea lookups falling back to lock",
+              num_vmareas_lockfree_fallbacks)
     STATS_DEF("Peak dynamo areas vector length", max_DRareas_length)
     STATS_DEF("Peak executable areas vector length", max_execareas_length)
     STATS_DEF("Peak module areas vector length", max_modareas_length)
@@ -1116,6 +1147,13 @@ under -rstats_to_stderr.
     STATS_DEF("Num synch yields for uninit threads", synch_yields_for_uninit_thread)
     STATS_DEF("Num synch yields", synch_yields)
     STATS_DEF("Num synch loops in wait_at_safe_spot", synch_loops_wait_safe)
+    STATS_DEF("Synchall suspend signals broadcast", synchall_broadcast_suspends)
+    STATS_DEF("Synchall successes", synchall_successes)
+    STATS_DEF("Synchall max passes", synchall_max_passes)
+    STATS_DEF("Synchall time to synch < 1ms", synchall_time_under_1ms)
+    STATS_DEF("Synchall time to synch 1-10ms", synchall_time_1_10ms)
+    STATS_DEF("Synchall time to synch 10-100ms", synchall_time_10_100ms)
+    STATS_DEF("Synchall time to synch >= 100ms", synchall_time_over_100ms)
     STATS_DEF("Multiple setcontexts while in wait_at_safe_spot", wait_multiple_setcxt)
 
 #ifdef WINDOWS
@@ -1142,6 +1180,20 @@ under -rstats_to_stderr.
     STATS_DEF("Trace fragment ending with an IBL, syscall", num_traces_end_at_ibl_syscall)
     STATS_DEF("Trace fragment ending at MUST_END_TRACE", num_traces_at_must_end_trace)
     STATS_DEF("Trace fragment ending with an IBL, speculative", num_traces_end_at_ibl_speculative_link)
+    STATS_DEF("Speculative IBL targets at trace ends", num_trace_speculative_ibl_targets)
+    STATS_DEF("IB site profile target replacements", num_ib_site_profile_replacements)
+    STATS_DEF("IB site profile slot conflicts", num_ib_site_profile_conflicts)
+    STATS_DEF("Calls pushing onto the shadow return stack", num_shadow_ret_calls_mangled)
+    STATS_DEF("Returns checking the shadow return stack", num_shadow_ret_rets_mangled)
+    STATS_DEF("Shadow return stack resets", num_shadow_ret_stack_resets)
+    STATS_DEF("Traces queued for -optimize_async", num_optimize_async_queued)
+    STATS_DEF("Traces optimized by -optimize_async", num_optimize_async_optimized)
+    STATS_DEF("Traces replaced by -optimize_async", num_optimize_async_replaced)
+    STATS_DEF("-optimize_async results discarded", num_optimize_async_discarded)
+    STATS_DEF("-optimize_async waits for a synch between jobs",
+              num_optimize_async_synch_waits)
+    STATS_DEF("-optimize_async replaced trace bytes", optimize_async_bytes_before)
+    STATS_DEF("-optimize_async replacement trace bytes", optimize_async_bytes_after)
     STATS_DEF("Yields in intercept_apc wait dynamo_initialized", apc_yields_while_initializing)
     STATS_DEF("IBL Tables groomed", num_ibt_groomed)
     STATS_DEF("IBL Tables reached maximum capacity", num_ibt_max_capacity)
@@ -1214,8 +1266,12 @@ under -rstats_to_stderr.
     STATS_DEF("Clean Call inserted", cleancall_inserted)
     STATS_DEF("Clean Call inlined", cleancall_inlined)
     STATS_DEF("Clean Call xmm skipped", cleancall_simd_skipped)
+    STATS_DEF("Clean Call lazy SIMD scans", cleancall_simd_lazy_scans)
+    STATS_DEF("Clean Call xmm skipped via call tree scan", cleancall_simd_lazy_skipped)
+    STATS_DEF("Clean Call xmm saved", cleancall_simd_saved)
     STATS_DEF("Clean Call aflags save skipped", cleancall_aflags_save_skipped)
     STATS_DEF("Clean Call aflags clear skipped", cleancall_aflags_clear_skipped)
+    STATS_DEF("Clean Call dead reg saves skipped", cleancall_dead_reg_save_skipped)
     /* i#107 handle application using same segment register */
     STATS_DEF("App reference with FS/GS seg being mangled", app_seg_refs_mangled)
     STATS_DEF("App access FS/GS seg being mangled", app_mov_seg_mangled)
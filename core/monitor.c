@@ -101,10 +101,36 @@ static void reset_trace_state(dcontext_t *dcontext, bool grab_link_lock);
 /* synchronization of shared traces */
 DECLARE_CXTSWPROT_VAR(mutex_t trace_building_lock, INIT_LOCK_FREE(trace_building_lock));
 
+#ifdef HASHTABLE_STATISTICS
+/* -speculate_last_exit_stats: per speculation site counters, incremented from
+ * the code cache.  counters[0] counts executions of the trace's last IBL exit
+ * and counters[1+i] matches of targets[i]; the rest went to the IBL.  Records
+ * are never freed before exit, as the traces referencing them may still run.
+ */
+typedef struct _ib_site_stats_t {
+    app_pc trace_tag;
+    app_pc src_tag;
+    uint num_targets;
+    app_pc targets[IB_SITE_MAX_TARGETS];
+    uint counters[1 + IB_SITE_MAX_TARGETS];
+    struct _ib_site_stats_t *next;
+} ib_site_stats_t;
+
+DECLARE_CXTSWPROT_VAR(static ib_site_stats_t *ib_site_stats, NULL);
+DECLARE_CXTSWPROT_VAR(static mutex_t ib_site_stats_lock,
+                      INIT_LOCK_FREE(ib_site_stats_lock));
+#endif
+
 /* For clearing counters on trace deletion we follow a lazy strategy
- * using a sentinel value to determine whether we've built a trace or not
+ * using a sentinel value to determine whether we've built a trace or not.
+ * With an adaptive threshold the sentinel must be above any threshold we use.
  */
-#define TH_COUNTER_CREATED_TRACE_VALUE() (INTERNAL_OPTION(trace_threshold) + 1U)
+#define TH_COUNTER_CREATED_TRACE_VALUE() \
+    ((DYNAMO_OPTION(trace_threshold_adapt) ? DYNAMO_OPTION(trace_threshold_max) : \
+      INTERNAL_OPTION(trace_threshold)) + 1U)
+
+/* Number of trace head hits between adaptive threshold adjustments */
+#define TH_ADAPT_WINDOW 256
 
 static void
 delete_private_copy(dcontext_t *dcontext)
@@ -335,6 +361,28 @@ monitor_exit()
 {
     LOG(GLOBAL, LOG_MONITOR|LOG_STATS, 1,
         "Trace fragments generated: %d\n", GLOBAL_STAT(num_traces));
+#ifdef HASHTABLE_STATISTICS
+    while (ib_site_stats != NULL) {
+        ib_site_stats_t *site = ib_site_stats;
+        DOLOG(1, LOG_MONITOR|LOG_STATS, {
+            uint i;
+            uint hits = 0;
+            for (i = 0; i < site->num_targets; i++)
+                hits += site->counters[1 + i];
+            LOG(GLOBAL, LOG_MONITOR|LOG_STATS, 1,
+                "Speculated IB exit of trace "PFX" (bb "PFX"): %u execs, "
+                "%u misses\n", site->trace_tag, site->src_tag, site->counters[0],
+                site->counters[0] - hits);
+            for (i = 0; i < site->num_targets; i++) {
+                LOG(GLOBAL, LOG_MONITOR|LOG_STATS, 1, "\t"PFX": %u hits\n",
+                    site->targets[i], site->counters[1 + i]);
+            }
+        });
+        ib_site_stats = site->next;
+        global_heap_free(site, sizeof(*site) HEAPACCT(ACCT_OTHER));
+    }
+    DELETE_LOCK(ib_site_stats_lock);
+#endif
     DELETE_LOCK(trace_building_lock);
 }
 
@@ -371,6 +419,19 @@ monitor_thread_init(dcontext_t *dcontext)
                                           HASHTABLE_PERSISTENT,
                                           thcounter_free _IF_DEBUG("trace heads"));
     md->thead_table->hash_func = HASH_FUNCTION_MULTIPLY_PHI;
+    md->th_threshold = INTERNAL_OPTION(trace_threshold);
+    if (DYNAMO_OPTION(trace_threshold_adapt)) {
+        md->th_threshold = MAX(md->th_threshold, DYNAMO_OPTION(trace_threshold_min));
+        md->th_threshold = MIN(md->th_threshold, DYNAMO_OPTION(trace_threshold_max));
+    }
+    if (DYNAMO_OPTION(speculate_last_exit) &&
+        DYNAMO_OPTION(speculate_last_exit_targets) > 1) {
+        md->ib_sites = (ib_site_profile_t *)
+            HEAP_ARRAY_ALLOC(dcontext, ib_site_profile_t,
+                             HASHTABLE_SIZE(IB_SITE_PROFILE_BITS), ACCT_TRACE, true);
+        memset(md->ib_sites, 0,
+               HASHTABLE_SIZE(IB_SITE_PROFILE_BITS) * sizeof(ib_site_profile_t));
+    }
 }
 
 /* atexit cleanup */
@@ -395,6 +456,10 @@ monitor_thread_exit(dcontext_t *dcontext)
     }
     if (md->thead_table != NULL)
         generic_hash_destroy(dcontext, md->thead_table);
+    if (md->ib_sites != NULL) {
+        HEAP_ARRAY_FREE(dcontext, md->ib_sites, ib_site_profile_t,
+                        HASHTABLE_SIZE(IB_SITE_PROFILE_BITS), ACCT_TRACE, true);
+    }
     heap_free(dcontext, md, sizeof(monitor_data_t) HEAPACCT(ACCT_TRACE));
 #endif
 }
@@ -422,6 +487,91 @@ thcounter_add(dcontext_t *dcontext, app_pc tag)
     return e;
 }
 
+/* Records target as seen from the indirect branch ending the bb src_tag.
+ * This is only called for transitions that come back to dispatch, i.e., IBL
+ * misses and every bb-sourced IB without -bb_ibl_targets, so it samples the
+ * target mix rather than counting it.  Each site keeps at most
+ * -speculate_last_exit_targets targets; a new target replaces the least-hit
+ * one, and all weights are halved when one saturates so that the profile
+ * follows phase changes.  Use -speculate_last_exit_stats for real hit counts.
+ */
+static void
+ib_site_profile_record(monitor_data_t *md, app_pc src_tag, app_pc target)
+{
+    ib_site_profile_t *site =
+        &md->ib_sites[HASH_FUNC_BITS((ptr_uint_t)src_tag, IB_SITE_PROFILE_BITS)];
+    uint num = DYNAMO_OPTION(speculate_last_exit_targets);
+    uint i, victim = 0;
+    if (site->src_tag != src_tag) {
+        DOSTATS({
+            if (site->src_tag != NULL)
+                STATS_INC(num_ib_site_profile_conflicts);
+        });
+        memset(site, 0, sizeof(*site));
+        site->src_tag = src_tag;
+    }
+    for (i = 0; i < num; i++) {
+        if (site->target[i] == target) {
+            if (++site->hits[i] == USHRT_MAX) {
+                uint j;
+                for (j = 0; j < num; j++)
+                    site->hits[j] /= 2;
+            }
+            return;
+        }
+        if (site->hits[i] < site->hits[victim])
+            victim = i;
+    }
+    DOSTATS({
+        if (site->target[victim] != NULL)
+            STATS_INC(num_ib_site_profile_replacements);
+    });
+    site->target[victim] = target;
+    site->hits[victim] = 1;
+}
+
+/* Fills tags with up to -speculate_last_exit_targets targets for the indirect
+ * branch ending the bb src_tag, hottest first.  cur_target, the target being
+ * taken right now, is always included.  Returns the number of tags.
+ */
+static uint
+ib_site_profile_targets(monitor_data_t *md, app_pc src_tag, app_pc cur_target,
+                        app_pc tags[IB_SITE_MAX_TARGETS])
+{
+    ib_site_profile_t *site;
+    uint num = DYNAMO_OPTION(speculate_last_exit_targets);
+    uint hits[IB_SITE_MAX_TARGETS];
+    uint count = 0, i, j;
+    bool have_cur = false;
+    if (md->ib_sites != NULL) {
+        site = &md->ib_sites[HASH_FUNC_BITS((ptr_uint_t)src_tag,
+                                            IB_SITE_PROFILE_BITS)];
+        if (site->src_tag == src_tag) {
+            /* insertion sort by descending hit count */
+            for (i = 0; i < num; i++) {
+                if (site->target[i] == NULL)
+                    continue;
+                for (j = count; j > 0 && hits[j-1] < site->hits[i]; j--) {
+                    tags[j] = tags[j-1];
+                    hits[j] = hits[j-1];
+                }
+                tags[j] = site->target[i];
+                hits[j] = site->hits[i];
+                count++;
+                if (site->target[i] == cur_target)
+                    have_cur = true;
+            }
+        }
+    }
+    if (!have_cur) {
+        /* evicted or never profiled: it displaces the coldest */
+        if (count == num)
+            count--;
+        tags[count++] = cur_target;
+    }
+    return count;
+}
+
 /* Deletes all trace head entries in [start,end) */
 void
 thcounter_range_remove(dcontext_t *dcontext, app_pc start, app_pc end)
@@ -530,6 +680,7 @@ reset_trace_state(dcontext_t *dcontext, bool grab_link_lock)
     md->trace_tag = NULL;  /* indicate return to search mode */
     md->trace_flags = 0;
     md->emitted_size = 0;
+    md->blk_bytes = 0;
     /* flags may not match, e.g., if frag was marked as trace head */
     ASSERT(md->last_fragment == NULL ||
            (md->last_fragment_flags & (FRAG_CANNOT_DELETE|FRAG_LINKED_OUTGOING)) ==
@@ -1197,6 +1348,9 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
 #if defined(DEBUG) || defined(INTERNAL) || defined(CLIENT_INTERFACE)
     /* was the trace passed through optimizations or the client interface? */
     bool externally_mangled = false;
+#endif
+#ifdef OPTIMIZE_ASYNC
+    instrlist_t *async_ilist = NULL;
 #endif
     /* we cannot simply upgrade a basic block fragment
      * to a trace b/c traces have prefixes that basic blocks don't!
@@ -1289,15 +1443,41 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
                     tag, dcontext->next_tag);
                 ASSERT_CURIOSITY(dcontext->next_tag != NULL);
                 if (DYNAMO_OPTION(speculate_last_exit)) {
-                    app_pc speculate_next_tag = dcontext->next_tag;
+                    app_pc speculate_next_tags[IB_SITE_MAX_TARGETS];
+                    uint num_tags =
+                        ib_site_profile_targets(md, md->blk_info[md->num_blks-1].info.tag,
+                                                dcontext->next_tag, speculate_next_tags);
 #ifdef SPECULATE_LAST_EXIT_STUDY
                     /* for a performance study: add overhead on
                      * all IBLs that never hit by comparing to a 0xbad tag */
-                    speculate_next_tag = 0xbad;
+                    speculate_next_tags[0] = 0xbad;
+                    num_tags = 1;
+#endif
+                    uint *site_counters = NULL;
+#ifdef HASHTABLE_STATISTICS
+                    DOSTATS({
+                        if (INTERNAL_OPTION(speculate_last_exit_stats)) {
+                            ib_site_stats_t *site = (ib_site_stats_t *)
+                                global_heap_alloc(sizeof(*site) HEAPACCT(ACCT_OTHER));
+                            memset(site, 0, sizeof(*site));
+                            site->trace_tag = tag;
+                            site->src_tag = md->blk_info[md->num_blks-1].info.tag;
+                            site->num_targets = num_tags;
+                            memcpy(site->targets, speculate_next_tags,
+                                   num_tags * sizeof(app_pc));
+                            mutex_lock(&ib_site_stats_lock);
+                            site->next = ib_site_stats;
+                            ib_site_stats = site;
+                            mutex_unlock(&ib_site_stats_lock);
+                            site_counters = site->counters;
+                        }
+                    });
 #endif
+                    STATS_ADD(num_trace_speculative_ibl_targets, num_tags);
                     md->emitted_size +=
                         append_trace_speculate_last_ibl(dcontext, trace,
-                                                        speculate_next_tag,
+                                                        speculate_next_tags,
+                                                        num_tags, site_counters,
                                                         false);
                 } else {
 #ifdef HASHTABLE_STATISTICS
@@ -1338,6 +1518,10 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
     if (dynamo_options.optimize
 # ifdef SIDELINE
         && !dynamo_options.sideline
+# endif
+# ifdef OPTIMIZE_ASYNC
+        /* optimized off-thread after emit, below */
+        && !DYNAMO_OPTION(optimize_async)
 # endif
         ) {
         optimize_trace(dcontext, tag, trace);
@@ -1495,6 +1679,15 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
     /* ensure trace was NOT aborted */
     ASSERT(md->trace_tag == tag);
 
+#ifdef OPTIMIZE_ASYNC
+    if (dynamo_options.optimize && DYNAMO_OPTION(optimize_async) &&
+        !TEST(FRAG_SHARED, md->trace_flags)) {
+        /* copy before emit pads it: this is what recreate_fragment_ilist()
+         * rebuilds prior to re-applying the optimizations
+         */
+        async_ilist = instrlist_clone(GLOBAL_DCONTEXT, trace);
+    }
+#endif
     /* emit trace fragment into fcache with tag value */
     if (replace_trace_head) {
 #ifndef CUSTOM_TRACES
@@ -1522,6 +1715,10 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
      * by how much though FIXME */
     ASSERT_CURIOSITY(trace_f->size == md->emitted_size || externally_mangled ||
                      PAD_FRAGMENT_JMPS(trace_f->flags));
+#ifdef OPTIMIZE_ASYNC
+    if (async_ilist != NULL)
+        optimize_async_queue(dcontext, trace_f, async_ilist);
+#endif
     trace_tr = TRACE_FIELDS(trace_f);
     trace_tr->num_bbs = md->num_blks;
     trace_tr->bbs = (trace_bb_info_t *)
@@ -1535,6 +1732,8 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
         mutex_unlock(&trace_building_lock);
 
     RSTATS_INC(num_traces);
+    RSTATS_ADD(trace_bytes_emitted, trace_f->size);
+    RSTATS_ADD(trace_component_bb_bytes, md->blk_bytes);
     DOSTATS({IF_X86_64(if (FRAG_IS_32(trace_f->flags)) {STATS_INC(num_32bit_traces);})});
     STATS_ADD(num_bbs_in_all_traces, md->num_blks);
     STATS_TRACK_MAX(max_bbs_in_a_trace, md->num_blks);
@@ -1688,6 +1887,7 @@ internal_extend_trace(dcontext_t *dcontext, fragment_t *f, linkstub_t *prev_l,
      * as well.
      */
     md->emitted_size += add_size;
+    md->blk_bytes += f->size;
 
     md->trace_flags |= trace_flags_from_component_flags(f->flags);
 
@@ -1866,6 +2066,66 @@ monitor_cache_exit(dcontext_t *dcontext)
     dcontext->whereami = WHERE_DISPATCH;
 }
 
+/* Called on every trace head counter increment.  Records whether we got here
+ * through a side exit of an existing trace and, with -trace_threshold_adapt,
+ * re-tunes this thread's threshold at the end of each window of hits.
+ * Trace head counters are thread-private, so the threshold is too.
+ *
+ * Many early exits from traces mean we are selecting paths that do not
+ * represent what later executes, so we raise the threshold to wait for more
+ * evidence before committing to a trace.  Few early exits and few
+ * re-translations of deleted traces mean our traces are good and we can
+ * afford to build them sooner, which helps short-running hot loops.
+ */
+static uint
+trace_threshold_update(dcontext_t *dcontext, monitor_data_t *md, bool retrace)
+{
+    fragment_t *from = dcontext->last_fragment;
+    linkstub_t *l = dcontext->last_exit;
+    if (from != NULL && TEST(FRAG_IS_TRACE, from->flags) &&
+        l != NULL && !LINKSTUB_FAKE(l)) {
+        RSTATS_INC(num_trace_exits_to_heads);
+        md->th_window_trace_exits++;
+        if (LINKSTUB_NEXT_EXIT(l) != NULL) {
+            /* not the trace's final exit */
+            RSTATS_INC(num_trace_early_exits);
+            md->th_window_early_exits++;
+        }
+    }
+    if (!DYNAMO_OPTION(trace_threshold_adapt))
+        return INTERNAL_OPTION(trace_threshold);
+    if (retrace)
+        md->th_window_retraces++;
+    md->th_window_hits++;
+    if (md->th_window_hits >= TH_ADAPT_WINDOW) {
+        uint exits = md->th_window_trace_exits;
+        uint early = md->th_window_early_exits;
+        if (exits * 8 >= md->th_window_hits && early * 2 > exits) {
+            if (md->th_threshold < DYNAMO_OPTION(trace_threshold_max)) {
+                md->th_threshold = MIN(md->th_threshold * 2,
+                                       DYNAMO_OPTION(trace_threshold_max));
+                STATS_INC(trace_threshold_raised);
+            }
+        } else if (early * 8 <= exits &&
+                   md->th_window_retraces * 4 <= md->th_window_hits) {
+            if (md->th_threshold > DYNAMO_OPTION(trace_threshold_min)) {
+                md->th_threshold = MAX(md->th_threshold / 2,
+                                       DYNAMO_OPTION(trace_threshold_min));
+                STATS_INC(trace_threshold_lowered);
+            }
+        }
+        LOG(THREAD, LOG_MONITOR, 2,
+            "trace threshold: %d hits, %d trace exits (%d early), %d retraces => %d\n",
+            md->th_window_hits, exits, early, md->th_window_retraces,
+            md->th_threshold);
+        md->th_window_hits = 0;
+        md->th_window_trace_exits = 0;
+        md->th_window_early_exits = 0;
+        md->th_window_retraces = 0;
+    }
+    return md->th_threshold;
+}
+
 static void
 check_fine_to_coarse_trace_head(dcontext_t *dcontext, fragment_t *f)
 {
@@ -1913,6 +2173,8 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
 #endif
     trace_head_counter_t *ctr;
     uint add_size = 0, prev_mangle_size = 0; /* NOTE these aren't set if end_trace */
+    uint threshold;
+    bool retrace = false;
 
     if (DYNAMO_OPTION(disable_traces) || f == NULL) {
         /* nothing to do */
@@ -1931,6 +2193,15 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
      */
     check_fine_to_coarse_trace_head(dcontext, f);
 
+    /* Profile indirect branch targets out of bbs for speculation at trace ends.
+     * Without -bb_ibl_targets every bb-sourced IB comes through here.
+     */
+    if (md->ib_sites != NULL && dcontext->last_exit != NULL &&
+        LINKSTUB_INDIRECT(dcontext->last_exit->flags) &&
+        dcontext->last_fragment != NULL &&
+        !TEST(FRAG_IS_TRACE, dcontext->last_fragment->flags))
+        ib_site_profile_record(md, dcontext->last_fragment->tag, f->tag);
+
     if (md->trace_tag != NULL) {      /* in trace selection mode */
         KSTART(trace_building);
 
@@ -2201,11 +2472,16 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
          */
         ctr->counter = INTERNAL_OPTION(trace_counter_on_delete);
         STATS_INC(th_counter_reset);
+        retrace = true;
     }
+    threshold = trace_threshold_update(dcontext, md, retrace);
 
     ctr->counter++;
+    fcache_note_trace_head_hit(dcontext, f);
     /* Should never be > here (assert is down below) but we check just in case */
-    if (ctr->counter >= INTERNAL_OPTION(trace_threshold)) {
+    if (ctr->counter >= threshold) {
+        /* an adaptive threshold may have dropped below a partial count */
+        ctr->counter = threshold;
         /* if cannot delete fragment, do not start trace -- wait until
          * can delete it (w/ exceptions, deletion status changes). */
         if (!TEST(FRAG_CANNOT_DELETE, f->flags)) {
@@ -2240,7 +2516,7 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
              * that our one-up sentinel works for lazy clearing.
              */
             ctr->counter--;
-            ASSERT(ctr->counter < INTERNAL_OPTION(trace_threshold));
+            ASSERT(ctr->counter < threshold);
         }
     }
 
@@ -2279,7 +2555,7 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
     if (start_trace) {
         KSTART(trace_building);
         /* ensure our sentinel counter value for counter clearing will work */
-        ASSERT(ctr->counter == INTERNAL_OPTION(trace_threshold));
+        ASSERT(ctr->counter == threshold);
         ctr->counter = TH_COUNTER_CREATED_TRACE_VALUE();
         /* Found a hot trace head.  Switch this thread into trace
            selection mode, and initialize the instrlist_t for the new
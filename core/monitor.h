@@ -120,6 +120,20 @@ typedef struct _trace_head_counter_t {
     uint   counter;
 } trace_head_counter_t;
 
+/* -speculate_last_exit_targets: per-thread profile of the targets seen from the
+ * indirect branch ending a bb, used to pick the speculated targets when that
+ * bb ends a trace.  Direct-mapped on the bb tag.
+ */
+#define IB_SITE_MAX_TARGETS 4
+#define IB_SITE_PROFILE_BITS 8
+
+typedef struct _ib_site_profile_t {
+    app_pc src_tag;
+    app_pc target[IB_SITE_MAX_TARGETS];
+    /* decaying weights, halved at USHRT_MAX */
+    ushort hits[IB_SITE_MAX_TARGETS];
+} ib_site_profile_t;
+
 typedef struct _trace_bb_build_t {
     trace_bb_info_t info;
     /* PR 299808: we need to check bb bounds at emit time.  Also used
@@ -150,6 +164,16 @@ typedef struct _monitor_data_t {
     trace_bb_build_t *blk_info;           /* info for all basic blocks making up trace */
     uint             blk_info_length;     /* length of blk_info array */
     uint             emitted_size;        /* calculated final trace size once emitted */
+    uint             blk_bytes;           /* sum of component bb sizes, for stats */
+
+    /* -trace_threshold_adapt state: this thread's current threshold and the
+     * counts for the current window of trace head hits.
+     */
+    uint             th_threshold;
+    uint             th_window_hits;
+    uint             th_window_trace_exits;
+    uint             th_window_early_exits;
+    uint             th_window_retraces;
 
     /* private copy of shared bb for trace building only
      * equals the previous last_fragment that was shared
@@ -163,6 +187,9 @@ typedef struct _monitor_data_t {
      */
     generic_table_t  *thead_table;
 
+    /* -speculate_last_exit_targets > 1 only, else NULL */
+    ib_site_profile_t *ib_sites;
+
 #ifdef CLIENT_INTERFACE
     /* PR 299808: we re-build each bb and pass to the client */
     instrlist_t      unmangled_ilist;
@@ -986,6 +986,20 @@ check_option_compatibility_helper(int recurse_count)
         dynamo_options.atomic_inlined_linking = true;
         changed_options = true;
     }
+    if (DYNAMO_OPTION(optimize_async)) {
+# ifndef OPTIMIZE_ASYNC
+        USAGE_ERROR("-optimize_async requires a 32-bit x86 INTERNAL build");
+        dynamo_options.optimize_async = false;
+        changed_options = true;
+# else
+        /* replacement goes through the private-only dr_replace_fragment() path */
+        if (DYNAMO_OPTION(shared_traces)) {
+            USAGE_ERROR("-optimize_async requires -no_shared_traces, disabling");
+            dynamo_options.optimize_async = false;
+            changed_options = true;
+        }
+# endif
+    }
 # ifdef SHARING_STUDY
     if (INTERNAL_OPTION(fragment_sharing_study) && SHARED_FRAGMENTS_ENABLED()) {
         USAGE_ERROR("-fragment_sharing_study requires only private fragments");
@@ -995,6 +1009,58 @@ check_option_compatibility_helper(int recurse_count)
 # endif
 #endif /* EXPOSE_INTERNAL_OPTIONS */
 
+    if (DYNAMO_OPTION(trace_threshold_adapt)) {
+#ifdef TRACE_HEAD_CACHE_INCR
+        /* the in-cache increment routine has the threshold baked in */
+        USAGE_ERROR("-trace_threshold_adapt not supported with TRACE_HEAD_CACHE_INCR");
+        dynamo_options.trace_threshold_adapt = false;
+        changed_options = true;
+#endif
+        if (DYNAMO_OPTION(trace_threshold_min) == 0 ||
+            DYNAMO_OPTION(trace_threshold_max) > USHRT_MAX ||
+            DYNAMO_OPTION(trace_threshold_min) > DYNAMO_OPTION(trace_threshold_max) ||
+            INTERNAL_OPTION(trace_counter_on_delete) >=
+            DYNAMO_OPTION(trace_threshold_min)) {
+            USAGE_ERROR("-trace_threshold_{min,max} must satisfy "
+                        "trace_counter_on_delete < min <= max <= USHRT_MAX, "
+                        "setting to defaults");
+            SET_DEFAULT_VALUE(trace_threshold_min);
+            SET_DEFAULT_VALUE(trace_threshold_max);
+            changed_options = true;
+        }
+    }
+
+    /* upper bound is IB_SITE_MAX_TARGETS in monitor.h */
+    if (DYNAMO_OPTION(speculate_last_exit_targets) == 0 ||
+        DYNAMO_OPTION(speculate_last_exit_targets) > 4) {
+        USAGE_ERROR("-speculate_last_exit_targets must be in [1,4], setting to default");
+        SET_DEFAULT_VALUE(speculate_last_exit_targets);
+        changed_options = true;
+    }
+
+    if (DYNAMO_OPTION(shadow_ret_stack)) {
+#if !defined(X86) || !defined(UNIX)
+        USAGE_ERROR("-shadow_ret_stack is only supported on x86 Linux");
+        dynamo_options.shadow_ret_stack = false;
+        changed_options = true;
+#else
+        if (!DYNAMO_OPTION(disable_traces)) {
+            USAGE_ERROR("-shadow_ret_stack requires -disable_traces, disabling");
+            dynamo_options.shadow_ret_stack = false;
+            changed_options = true;
+        }
+#endif
+    }
+
+#ifndef X86
+    if (DYNAMO_OPTION(vmarea_lockfree_reads)) {
+        /* the reader relies on x86's load ordering */
+        USAGE_ERROR("-vmarea_lockfree_reads is only supported on x86");
+        dynamo_options.vmarea_lockfree_reads = false;
+        changed_options = true;
+    }
+#endif
+
     if (!ALIGNED(DYNAMO_OPTION(stack_size), PAGE_SIZE)) {
         USAGE_ERROR("-stack_size must be at least 12K and a multiple of the page size");
         SET_DEFAULT_VALUE(stack_size);
@@ -473,13 +473,24 @@
      * 2 - simple callee inline optimization,
      *     callee save reg analysis
      *     aflags usage analysis and optimization on the instrumented ilist
-     * 3 - more aggressive callee inline optimization
+     * 3 - more aggressive callee inline optimization:
+     *     callees with forward-only branches, calls to small leaf functions
+     *     (spliced in place of the call), and multiple register args (x64),
+     *     and no saves of regs that are dead after the call site
      * All the optimizations assume that clean callee will not be changed
      * later.
      */
     /* FIXME i#1621: NYI on ARM, partly implemented on AArch64 */
     OPTION_DEFAULT_INTERNAL(uint, opt_cleancall, IF_X86_ELSE(2, IF_AARCH64_ELSE(1, 0)),
                             "optimization level on optimizing clean call sequences")
+    /* With -opt_cleancall 3, skip saving GPRs the app overwrites after the call
+     * site without reading.  Off by default: the scan happens at insertion time,
+     * so it cannot see instrumentation the client inserts later at the same
+     * point (another clean call arg, dr_save_reg, address materialization)
+     * that reads the app value.
+     */
+    OPTION_DEFAULT_INTERNAL(bool, cleancall_skip_dead_regs, false,
+                            "skip saving GPRs dead after an inlined clean call")
     /* Assuming the client's clean call does not rely on the cleared eflags,
      * i.e., initialize the eflags before using it, we can skip the eflags
      * clear code.
@@ -488,6 +499,16 @@
      */
     OPTION_DEFAULT(bool, cleancall_ignore_eflags, true,
                    "skip eflags clear code with assumption that clean call does not rely on cleared eflags")
+    /* When a clean call callee calls out to other functions, full callee analysis
+     * bails out and every SIMD register is saved.  With this option we still scan
+     * the callee and its direct callees (bounded in depth and size) and skip the
+     * SIMD save when none of them touch the vector registers.
+     * The verdict is cached in the callee info table.
+     * XXX i#975: off by default, as the scan cannot tell a call into a static
+     * DR (e.g., dr_get_mcontext(), which reads the SIMD slots) from app code.
+     */
+    OPTION_DEFAULT(bool, cleancall_lazy_simd, false,
+                   "skip SIMD save for clean calls whose callee call tree never touches SIMD")
 #ifdef X86
     /* TLS handling summary:
      * On X86, we use -mangle_app_seg to control if we will steal app's TLS.
@@ -668,6 +689,15 @@
      */
     OPTION_DEFAULT(bool, use_all_memory_areas, true, "Use all_memory_areas "
                    "address space cache to query page protections.")
+    /* By default a query that misses all_memory_areas re-reads the maps file in
+     * case memory was mapped behind our back.  These two options instead rely
+     * on our syscall handling to keep the cache current and check it against
+     * the maps file only every Nth query, adding any region we find missing.
+     */
+    OPTION_DEFAULT(bool, memcache_trust_syscalls, false, "treat all_memory_areas "
+                   "misses as free memory without reading /proc/self/maps")
+    OPTION_DEFAULT(uint, memcache_audit, 0, "check every Nth all_memory_areas query "
+                   "against /proc/self/maps and repair missing regions (0 disables)")
 #endif /* UNIX */
 
     /* Disable diagnostics by default. -security turns it on */
@@ -774,6 +804,12 @@
      }, "enable trace creation", STATIC, OP_PCACHE_GLOBAL)
     OPTION_DEFAULT_INTERNAL(uint, trace_counter_on_delete, 0U,
         "trace head counter will be reset to this value upon trace deletion")
+    OPTION_DEFAULT(bool, trace_threshold_adapt, false,
+        "tune each thread's trace threshold from the rate of early trace exits")
+    OPTION_DEFAULT(uint, trace_threshold_min, 8U,
+        "lowest trace threshold -trace_threshold_adapt will use")
+    OPTION_DEFAULT(uint, trace_threshold_max, 800U,
+        "highest trace threshold -trace_threshold_adapt will use")
 
     OPTION_DEFAULT(uint, max_elide_jmp,  16,
         "maximum direct jumps to elide in a basic block")
@@ -936,6 +972,14 @@
     OPTION_DEFAULT(bool, ref_count_shared_ibt_tables, true,
         "use ref-counting to free thread-shared IBT tables prior to process exit")
 
+    /* Treats each cache exit as a quiescent point for the shared IBT tables:
+     * a thread refreshes its private table pointers there instead of only on
+     * an IBL miss, so tables retired by a resize are freed once every thread
+     * has left the cache, rather than being pinned by idle threads.
+     */
+    OPTION_DEFAULT(bool, ibt_table_quiescent_update, true,
+        "refresh private ptrs to shared IBT tables on every cache exit")
+
     /* PR 361894: if no TLS available, we fall back to thread-private */
     OPTION_DEFAULT(bool, ibl_table_in_tls, IF_HAVE_TLS_ELSE(true, false),
         "use TLS to hold IBL table addresses & masks")
@@ -997,6 +1041,18 @@
                    "share ibl routine for traces")
     OPTION_DEFAULT(bool, speculate_last_exit, false,
         "enable speculative linking of trace last IB exit")
+    /* With -speculate_last_exit, the number of targets compared inline at a
+     * trace's final indirect branch, picked from a per-thread profile of the
+     * targets seen from that branch while it was in a bb.
+     */
+    OPTION_DEFAULT(uint, speculate_last_exit_targets, 1,
+        "number of speculated targets for a trace's last IB exit (1-4)")
+    /* Predicts bb returns from a per-thread shadow stack of call sites, going
+     * straight to a direct exit to the return address on a hit.  Traces already
+     * inline returns, so this is for -disable_traces; x86 Linux only.
+     */
+    OPTION_DEFAULT(bool, shadow_ret_stack, false,
+        "predict returns with a per-thread shadow return stack")
 
     OPTION_DEFAULT(uint, max_trace_bbs, 128, "maximum number of basic blocks in a trace")
 
@@ -1160,6 +1216,12 @@
                    "initial private non-persistent heap unit size")
     /* initial_global_heap_unit_size may be adjusted by adjust_defaults_for_page_size(). */
     OPTION_DEFAULT(uint_size, initial_global_heap_unit_size, 32*1024, "initial global heap unit size")
+    /* Each thread caches up to this many free global heap blocks per fixed-size
+     * bucket and refills or returns half of that at a time, so most global
+     * allocations and frees avoid global_alloc_lock.  0 disables the caches.
+     */
+    OPTION_DEFAULT(uint, global_heap_magazine, 0,
+                   "per-thread cache size, in blocks per bucket, for global heap")
     /* if this is too small then once past the vm reservation we have too many
      * DR areas and subsequent problems with DR areas and allmem synch (i#369)
      */
@@ -1265,6 +1327,9 @@
         "adaptive working set shared bb cache management")
     OPTION_DEFAULT(bool, finite_shared_trace_cache, false,
         "adaptive working set shared trace cache management")
+    OPTION_DEFAULT(bool, finite_shared_hot_units, false,
+        "finite shared caches keep the newest unit and flush the coldest other unit, "
+        "by trace head hits, instead of the oldest")
     OPTION_DEFAULT(bool, finite_coarse_bb_cache, false,
         "adaptive working set shared bb cache management")
     OPTION_DEFAULT(uint_size, cache_bb_unit_upgrade, (64*1024),
@@ -1430,6 +1495,19 @@
     OPTION_DEFAULT(bool, vm_base_near_app, true,
                    "allocate vm region near the app if possible (if not, if "
                    "-vm_allow_not_at_base, will try elsewhere)")
+    OPTION_DEFAULT(bool, vm_cache_top_down, false,
+                   "allocate code cache units from the top of the vm region, keeping "
+                   "heap and separate exit stubs at the bottom")
+#ifdef LINUX
+    /* Only 2MB-aligned ranges can be backed by a huge page, so either of these
+     * also aligns the vm region to 2MB.
+     */
+    OPTION_DEFAULT(bool, vm_huge_pages, false,
+                   "cluster code cache units at the top of the vm region and ask the "
+                   "kernel to back them with transparent huge pages")
+    OPTION_DEFAULT(bool, vm_huge_pages_heap, false,
+                   "ask the kernel to back heap units with transparent huge pages")
+#endif
 #ifdef X64
     /* We prefer low addresses in general, and only need this option if it's
      * an absolute requirement (XXX i#829: it is required for mixed-mode).
@@ -1552,6 +1630,8 @@
         "synch_with_thread before we give up (UINT_MAX loops forever)")
     OPTION_DEFAULT(uint, synch_all_threads_max_loops, 10000, "max number of wait loops "
         "in synch_with_all_threads before we give up (UINT_MAX loops forever)")
+    OPTION_DEFAULT(bool, synch_all_broadcast, false, "in synch_with_all_threads, "
+        "send the suspend signal to every thread before waiting on any (Linux only)")
     OPTION_DEFAULT(bool, synch_thread_sleep_UP, true, "for uni-proc machines : if true "
         "use sleep in synch_with_* wait loops instead of yield")
     OPTION_DEFAULT(bool, synch_thread_sleep_MP, true, "for multi-proc machines : if "
@@ -2789,6 +2869,8 @@ IF_RCT_IND_BRANCH(options->rct_ind_jump = OPTION_DISABLED;)
     /* FIXME: case 4471 should start smaller and double instead */
     OPTION_DEFAULT_INTERNAL(uint, vmarea_increment_size, 100,
         "incremental vmarea vector size")
+    OPTION_DEFAULT(bool, vmarea_lockfree_reads, false,
+        "look up executable areas without taking their lock")
     OPTION_INTERNAL(uint_addr, stress_fake_userva,
         "pretend system address space starts at this address (case 9022)")
 
@@ -2845,6 +2927,12 @@ IF_RCT_IND_BRANCH(options->rct_ind_jump = OPTION_DISABLED;)
 # ifdef SIDELINE
     OPTION(bool, sideline, "use sideline thread for optimization")
 # endif
+    /* Runs the optimizations below on a background thread, off the critical path,
+     * and swaps each result in for its unoptimized private trace.  Only passes
+     * that depend on nothing but the trace itself are applied: see
+     * optimize_trace_async_safe().
+     */
+    OPTION_DEFAULT(bool, optimize_async, false, "optimize traces on a background thread")
     /* optimizations */
 
 # if 0 /* this flag does nothing yet...disable so people don't try to use it */
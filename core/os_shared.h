@@ -136,6 +136,10 @@ void os_heap_decommit(void *p, size_t size, heap_error_code_t *error_code);
 /* frees size bytes starting at address p (note - on windows the entire allocation
  * containing p is freed and size is ignored) */
 void os_heap_free(void *p, size_t size, heap_error_code_t *error_code);
+#ifdef LINUX
+/* asks the kernel to (or not to) back reserved pages with transparent huge pages */
+bool os_heap_advise_huge_pages(void *p, size_t size, bool huge);
+#endif
 
 /* prognosticate whether systemwide memory pressure based on
  * last_error_code and systemwide omens
@@ -111,38 +111,31 @@ coarse_unit_mark_primary(coarse_info_t *info)
 {
     if (!info->in_use)
         return;
-#ifdef WINDOWS
-    /* FIXME PR 295529: put in for Linux once we have per-module flags */
     /* Go ahead and get write lock up front; else have to check again; not
      * frequently called so don't need perf opt here.
      */
     os_get_module_info_write_lock();
     if (!os_module_get_flag(info->base_pc, MODULE_HAS_PRIMARY_COARSE)) {
-        os_module_set_flag(info->base_pc, MODULE_HAS_PRIMARY_COARSE);
-        ASSERT(os_module_get_flag(info->base_pc, MODULE_HAS_PRIMARY_COARSE));
+        if (os_module_set_flag(info->base_pc, MODULE_HAS_PRIMARY_COARSE)) {
+            ASSERT(os_module_get_flag(info->base_pc, MODULE_HAS_PRIMARY_COARSE));
+            LOG(GLOBAL, LOG_CACHE, 1, "marking "PFX"-"PFX" as primary coarse for %s\n",
+                info->base_pc, info->end_pc, info->module);
+        }
+        /* else not in the module list (e.g., the vdso): no other unit to share with */
         info->primary_for_module = true;
-        LOG(GLOBAL, LOG_CACHE, 1, "marking "PFX"-"PFX" as primary coarse for %s\n",
-            info->base_pc, info->end_pc, info->module);
     }
     os_get_module_info_write_unlock();
-#else
-    info->primary_for_module = true;
-#endif
 }
 
 static void
 coarse_unit_unmark_primary(coarse_info_t *info)
 {
-#ifdef WINDOWS
-    /* FIXME PR 295529: put in for Linux once we have per-module flags */
     if (info->primary_for_module && info->in_use) {
-        ASSERT(os_module_get_flag(info->base_pc, MODULE_HAS_PRIMARY_COARSE));
+        ASSERT(os_module_get_flag(info->base_pc, MODULE_HAS_PRIMARY_COARSE) ||
+               !pc_is_in_module(info->base_pc));
         os_module_clear_flag(info->base_pc, MODULE_HAS_PRIMARY_COARSE);
         info->primary_for_module = false;
     }
-#else
-    info->primary_for_module = false;
-#endif
 }
 
 void
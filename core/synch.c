@@ -1145,6 +1145,11 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
     thread_synch_result_t synch_res;
     const uint max_loops = TEST(THREAD_SYNCH_SMALL_LOOP_MAX, flags) ?
         (SYNCH_ALL_THREADS_MAXIMUM_LOOPS/10) : SYNCH_ALL_THREADS_MAXIMUM_LOOPS;
+#ifdef UNIX
+    /* for -synch_all_broadcast: which threads we hold a suspend reference on */
+    bool *presuspended = NULL;
+#endif
+    DEBUG_DECLARE(uint64 synch_start_time;)
 #ifdef CLIENT_INTERFACE
     /* We treat client-owned threads as native but they don't have a clean native state
      * for us to suspend them in (they are always in client or dr code).  We need to be
@@ -1202,6 +1207,7 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
         "synch with all threads my id = "SZFMT
         " Giving %d permission and seeking %d state\n",
         my_id, cur_state, desired_synch_state);
+    DOSTATS({ synch_start_time = query_time_millis(); });
 
     /* grab all_threads_synch_lock */
     /* since all_threads synch doesn't give any permissions this is necessary
@@ -1322,6 +1328,35 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
         num_threads_temp = num_threads;
         synch_array_temp = synch_array;
 
+#ifdef UNIX
+        /* Send the suspend signal to every thread we still need before waiting on
+         * any of them, so their signal handlers run in parallel and
+         * synch_with_thread() below mostly finds its target already suspended,
+         * rather than paying a full signal round trip per thread.  We hold our
+         * own suspend reference until synch_with_thread() has taken its own.
+         * Client threads are left to the regular path as they must go last.
+         */
+        if (DYNAMO_OPTION(synch_all_broadcast)) {
+            presuspended = (bool *) global_heap_alloc(num_threads * sizeof(bool)
+                                                      HEAPACCT(ACCT_THREAD_MGT));
+            for (i = 0; i < num_threads; i++) {
+                presuspended[i] = false;
+                if (synch_array[i] == SYNCH_WITH_ALL_SYNCHED ||
+                    threads[i]->id == my_id || threads[i]->execve
+                    IF_CLIENT_INTERFACE(|| IS_CLIENT_THREAD(threads[i]->dcontext)))
+                    continue;
+                if (synch_array[i] == SYNCH_WITH_ALL_NEW) {
+                    adjust_wait_at_safe_spot(threads[i]->dcontext, 1);
+                    synch_array[i] = SYNCH_WITH_ALL_NOTIFIED;
+                }
+                presuspended[i] = os_thread_suspend_async(threads[i]);
+                DOSTATS({
+                    if (presuspended[i])
+                        STATS_INC(synchall_broadcast_suspends);
+                });
+            }
+        }
+#endif
         for (i = 0; i < num_threads; i++) {
             /* do not de-ref threads[i] after synching if it was cleaned up! */
             if (synch_array[i] != SYNCH_WITH_ALL_SYNCHED && threads[i]->id != my_id) {
@@ -1364,6 +1399,17 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
                 synch_res = synch_with_thread(threads[i]->id, false, true,
                                               THREAD_SYNCH_NONE,
                                               desired_synch_state, flags_one);
+#ifdef UNIX
+                if (presuspended != NULL && presuspended[i]) {
+                    /* synch_with_thread() has its own reference now.  A cleaned
+                     * thread's record is gone, and our reference with it.
+                     */
+                    presuspended[i] = false;
+                    if (synch_res != THREAD_SYNCH_RESULT_SUCCESS ||
+                        !THREAD_SYNCH_IS_CLEANED(desired_synch_state))
+                        os_thread_resume(threads[i]);
+                }
+#endif
                 if (synch_res == THREAD_SYNCH_RESULT_SUCCESS) {
                     LOG(THREAD, LOG_SYNCH, 2, "Synch succeeded!\n");
                     /* successful synch */
@@ -1384,6 +1430,13 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
                     "Skipping synch with thread "TIDFMT"\n", thread_ids_temp[i]);
             }
         }
+#ifdef UNIX
+        if (presuspended != NULL) {
+            global_heap_free(presuspended, num_threads * sizeof(bool)
+                             HEAPACCT(ACCT_THREAD_MGT));
+            presuspended = NULL;
+        }
+#endif
 
         if (loop_count++ >= max_loops)
             break;
@@ -1438,6 +1491,21 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
      * small loop counts and abort on failure, so only a curiosity. */
     ASSERT_CURIOSITY(loop_count < max_loops);
     ASSERT(threads != NULL);
+    DOSTATS({
+        if (all_synched) {
+            uint64 elapsed = query_time_millis() - synch_start_time;
+            STATS_INC(synchall_successes);
+            STATS_TRACK_MAX(synchall_max_passes, loop_count);
+            if (elapsed < 1)
+                STATS_INC(synchall_time_under_1ms);
+            else if (elapsed < 10)
+                STATS_INC(synchall_time_1_10ms);
+            else if (elapsed < 100)
+                STATS_INC(synchall_time_10_100ms);
+            else
+                STATS_INC(synchall_time_over_100ms);
+        }
+    });
     /* Since the set of threads can change we don't set the success field
      * until we're passing back the thread list.
      * We would use an tsd field directly instead of synch_array except
@@ -1487,6 +1555,23 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
 
  synch_with_all_abort:
     /* undo everything! */
+#ifdef UNIX
+    if (presuspended != NULL) {
+        /* We bailed out mid-pass: drop the references synch_with_thread() never
+         * took over.  The target must reach its suspend point first or it would
+         * miss the resume.
+         */
+        for (i = 0; i < num_threads; i++) {
+            if (presuspended[i]) {
+                os_thread_suspend_wait(threads[i]);
+                os_thread_resume(threads[i]);
+            }
+        }
+        global_heap_free(presuspended, num_threads * sizeof(bool)
+                         HEAPACCT(ACCT_THREAD_MGT));
+        presuspended = NULL;
+    }
+#endif
     for (i = 0; i < num_threads; i++) {
         DEBUG_DECLARE(bool ok;)
         if (threads[i]->id != my_id) {
@@ -89,6 +89,11 @@ static void *allmem_info_merge(void *dst_data, void *src_data);
  */
 DECLARE_CXTSWPROT_VAR(uint all_memory_areas_recursion, 0);
 
+/* Queries since the last -memcache_audit check.
+ * Protected by all_memory_areas->lock.
+ */
+DECLARE_CXTSWPROT_VAR(static uint memcache_audit_count, 0);
+
 void
 memcache_init(void)
 {
@@ -354,15 +359,31 @@ memcache_remove(app_pc start, app_pc end)
     return ok;
 }
 
+/* Returns whether this query should be checked against the maps file for
+ * -memcache_audit.  Caller must hold all_memory_areas->lock.
+ */
+static bool
+memcache_audit_due(void)
+{
+    ASSERT_OWN_WRITE_LOCK(true, &all_memory_areas->lock);
+    if (DYNAMO_OPTION(memcache_audit) == 0 ||
+        ++memcache_audit_count < DYNAMO_OPTION(memcache_audit))
+        return false;
+    memcache_audit_count = 0;
+    STATS_INC(num_memcache_audits);
+    return true;
+}
+
 bool
 memcache_query_memory(const byte *pc, OUT dr_mem_info_t *out_info)
 {
     allmem_info_t *info;
-    bool found;
+    bool found, audit;
     app_pc start, end;
     ASSERT(out_info != NULL);
     memcache_lock();
     sync_all_memory_areas();
+    audit = memcache_audit_due();
     if (vmvector_lookup_data(all_memory_areas, (app_pc)pc, &start, &end,
                              (void **) &info)) {
         ASSERT(info != NULL);
@@ -415,6 +436,15 @@ memcache_query_memory(const byte *pc, OUT dr_mem_info_t *out_info)
                 }
             }
         });
+        if (audit && !get_memory_info_from_os(pc, NULL, NULL, NULL)) {
+            /* We apparently missed an unmap.  We do not remove the entry: an
+             * munmap or mremap whose post-syscall handling has not yet run
+             * looks just like this, and that handling expects to find it.
+             */
+            LOG(GLOBAL, LOG_VMAREAS, 1,
+                "memcache audit: "PFX"-"PFX" is not in the maps file\n", start, end);
+            STATS_INC(num_memcache_drift_stale);
+        }
 #endif
     } else {
         app_pc prev, next;
@@ -440,7 +470,8 @@ memcache_query_memory(const byte *pc, OUT dr_mem_info_t *out_info)
         byte *from_os_base_pc;
         size_t from_os_size;
         uint from_os_prot;
-        if (get_memory_info_from_os(pc, &from_os_base_pc, &from_os_size,
+        if ((!DYNAMO_OPTION(memcache_trust_syscalls) || audit) &&
+            get_memory_info_from_os(pc, &from_os_base_pc, &from_os_size,
                                     &from_os_prot) &&
             /* maps file shows our reserved-but-not-committed regions, which
              * are holes in all_memory_areas
@@ -452,20 +483,33 @@ memcache_query_memory(const byte *pc, OUT dr_mem_info_t *out_info)
              * cache at start.  For now we just quiet the complaints here.
              */
             DODEBUG({
-                if (!dr_api_entry) {
+                if (!dr_api_entry && !audit) {
                     SYSLOG_INTERNAL_ERROR
                         ("all_memory_areas is missing region " PFX"-"PFX"!",
                          from_os_base_pc, from_os_base_pc + from_os_size);
                 }
             });
             DOLOG(4, LOG_VMAREAS, memcache_print(THREAD_GET, ""););
-            ASSERT(dr_api_entry);
+            ASSERT(dr_api_entry || audit);
             /* be paranoid */
             out_info->base_pc = from_os_base_pc;
             out_info->size = from_os_size;
             out_info->prot = from_os_prot;
             out_info->type = DR_MEMTYPE_DATA; /* hopefully we won't miss an image */
+            if (audit) {
+                /* Add the region so later queries need not come back here.
+                 * If an in-flight mmap handler adds it too, it just replaces
+                 * our entry.  -1 keeps the type of any image we overlap.
+                 */
+                memcache_update(from_os_base_pc, from_os_base_pc + from_os_size,
+                                from_os_prot, -1);
+                STATS_INC(num_memcache_drift_repairs);
+            }
         }
+        DOSTATS({
+            if (!DYNAMO_OPTION(memcache_trust_syscalls) || audit)
+                STATS_INC(num_memcache_os_checks);
+        });
 #else
         /* We now have nested probes, but currently probing sometimes calls
          * get_memory_info(), so we can't probe here unless we remove that call
@@ -79,11 +79,15 @@ static mutex_t maps_iter_buf_lock = INIT_LOCK_FREE(maps_iter_buf_lock);
 
 /* these are defined in /usr/src/linux/fs/proc/array.c */
 #define MAPS_LINE_LENGTH        4096
+/* Lines have the form
+ *   "%08lx-%08lx %s %08lx %*s "UINT64_FORMAT_STRING" %4096[^\n]"
+ * with 16-digit addresses and offsets when sizeof(void*) == 8.
+ * We parse them by hand in maps_parse_line() as sscanf is a large part of
+ * the cost of walking the maps file of a process with many mappings.
+ */
 /* for systems with sizeof(void*) == 4: */
-#define MAPS_LINE_FORMAT4  "%08lx-%08lx %s %08lx %*s "UINT64_FORMAT_STRING" %4096[^\n]"
 #define MAPS_LINE_MAX4  49 /* sum of 8  1  8  1 4 1 8 1 5 1 10 1 */
 /* for systems with sizeof(void*) == 8: */
-#define MAPS_LINE_FORMAT8  "%016lx-%016lx %s %016lx %*s "UINT64_FORMAT_STRING" %4096[^\n]"
 #define MAPS_LINE_MAX8  73 /* sum of 16  1  16  1 4 1 16 1 5 1 10 1 */
 
 #define MAPS_LINE_MAX   MAPS_LINE_MAX8
@@ -196,6 +200,93 @@ memquery_iterator_stop(memquery_iter_t *iter)
         mutex_unlock(&memory_info_buf_lock);
 }
 
+static const char *
+maps_skip_space(const char *c)
+{
+    while (*c == ' ' || *c == '\t')
+        c++;
+    return c;
+}
+
+/* Parses the number in the given base (16 or 10) at *pos and advances *pos
+ * past it.  Returns false if there are no digits.
+ */
+static bool
+maps_parse_number(const char **pos, uint base, uint64 *val)
+{
+    const char *c = *pos;
+    uint64 res = 0;
+    for (;; c++) {
+        uint digit;
+        if (*c >= '0' && *c <= '9')
+            digit = *c - '0';
+        else if (base == 16 && *c >= 'a' && *c <= 'f')
+            digit = *c - 'a' + 10;
+        else if (base == 16 && *c >= 'A' && *c <= 'F')
+            digit = *c - 'A' + 10;
+        else
+            break;
+        res = res * base + digit;
+    }
+    if (c == *pos)
+        return false;
+    *val = res;
+    *pos = c;
+    return true;
+}
+
+/* Parses a NULL-terminated maps file line into iter, perm, and comment.
+ * Like the sscanf it replaces, returns the number of fields filled in,
+ * stopping at the first one that does not parse: 6 if there is a comment.
+ */
+static int
+maps_parse_line(const char *line, memquery_iter_t *iter, char *perm, size_t perm_size,
+                char *comment)
+{
+    const char *c = maps_skip_space(line);
+    uint64 val;
+    size_t len;
+    if (!maps_parse_number(&c, 16, &val))
+        return 0;
+    iter->vm_start = (app_pc)(ptr_uint_t) val;
+    if (*c != '-')
+        return 1;
+    c++;
+    if (!maps_parse_number(&c, 16, &val))
+        return 1;
+    iter->vm_end = (app_pc)(ptr_uint_t) val;
+    c = maps_skip_space(c);
+    for (len = 0; c[len] != '\0' && c[len] != ' ' && c[len] != '\t'; len++)
+        ; /* nothing */
+    if (len == 0)
+        return 2;
+    len = MIN(len, perm_size - 1);
+    memcpy(perm, c, len);
+    perm[len] = '\0';
+    while (*c != '\0' && *c != ' ' && *c != '\t')
+        c++;
+    c = maps_skip_space(c);
+    if (!maps_parse_number(&c, 16, &val))
+        return 3;
+    iter->offset = (size_t) val;
+    /* skip the device */
+    c = maps_skip_space(c);
+    if (*c == '\0')
+        return 4;
+    while (*c != '\0' && *c != ' ' && *c != '\t')
+        c++;
+    c = maps_skip_space(c);
+    if (!maps_parse_number(&c, 10, &iter->inode))
+        return 4;
+    c = maps_skip_space(c);
+    if (*c == '\0')
+        return 5;
+    len = MIN(strlen(c), MAPS_LINE_LENGTH);
+    memcpy(comment, c, len);
+    comment[len] = '\0';
+    return 6;
+}
+
 bool
 memquery_iterator_next(memquery_iter_t *iter)
 {
@@ -254,15 +345,8 @@ memquery_iterator_next(memquery_iter_t *iter)
     LOG(GLOBAL, LOG_VMAREAS, 6,
         "\nget_memory_info_from_os: line=[%s]\n", line);
     mi->comment_buffer[0]='\0';
-    len = sscanf(line,
-#ifdef IA32_ON_IA64
-                 MAPS_LINE_FORMAT8, /* cross-compiling! */
-#else
-                 sizeof(void*) == 4 ? MAPS_LINE_FORMAT4 : MAPS_LINE_FORMAT8,
-#endif
-                 (unsigned long*)&iter->vm_start, (unsigned long*)&iter->vm_end,
-                 perm, (unsigned long*)&iter->offset, &iter->inode,
-                 mi->comment_buffer);
+    len = maps_parse_line(line, iter, perm, BUFFER_SIZE_ELEMENTS(perm),
+                          mi->comment_buffer);
     if (iter->vm_start == iter->vm_end) {
         /* i#366 & i#599: Merge an empty regions caused by stack guard pages
          * into the stack region if the stack region is less than one page away.
@@ -190,12 +190,28 @@ os_module_area_init(module_area_t *ma, app_pc base, size_t view_size,
      * all libs: I see DT_CHECKSUM and the prelink field on FC12 but not
      * on Ubuntu 9.04.
      */
+#ifdef LINUX
+    if (ma->os_data.build_id_len > 0 &&
+        (DYNAMO_OPTION(coarse_enable_freeze) || DYNAMO_OPTION(use_persisted))) {
+        /* The build id is the best identity we have: unlike the first page, it
+         * differs between any two builds, and unlike the prelink fields it is
+         * present in nearly all modules.  Both fields go into the pcache name
+         * and are checked at load time.
+         */
+        uint id_hi = 0;
+        memcpy(&id_hi, ma->os_data.build_id, MIN(sizeof(id_hi),
+                                                 ma->os_data.build_id_len));
+        ma->os_data.checksum = crc32((const char *)ma->os_data.build_id,
+                                     ma->os_data.build_id_len);
+        ma->os_data.timestamp = id_hi;
+    }
+#endif
     if (ma->os_data.checksum == 0 &&
         (DYNAMO_OPTION(coarse_enable_freeze) || DYNAMO_OPTION(use_persisted))) {
         /* Use something so we have usable pcache names */
         ma->os_data.checksum = crc32((const char *)ma->start, PAGE_SIZE);
     }
-    /* Timestamp we just leave as 0 */
+    /* Otherwise, timestamp we just leave as 0 */
 }
 
 void
@@ -81,6 +81,11 @@ typedef struct _os_module_data_t {
     size_t dynstr_size;   /* size of .dynstr */
     size_t symentry_size; /* size of a .dynsym entry */
     bool has_runpath;     /* is DT_RUNPATH present? */
+    /* NT_GNU_BUILD_ID, which identifies the exact build of the module (for pcaches),
+     * truncated to fit.  build_id_len is 0 if there is none.
+     */
+    byte build_id[32];
+    uint build_id_len;
     /* for .gnu.hash */
     app_pc gnu_bitmask;
     ptr_uint_t gnu_shift;
@@ -485,6 +485,46 @@ module_fill_os_data(ELF_PROGRAM_HEADER_TYPE *prog_hdr, /* PT_DYNAMIC entry */
     return res;
 }
 
+/* Copies the GNU build id, if any, from the PT_NOTE segment prog_hdr into out_data.
+ * At map time the notes must lie in the initial view, which they normally do as
+ * the linker places them right after the program headers.
+ */
+static void
+module_read_build_id(ELF_PROGRAM_HEADER_TYPE *prog_hdr, app_pc base, size_t view_size,
+                     bool at_map, ptr_int_t load_delta, os_module_data_t *out_data)
+{
+    byte *note, *end;
+    ASSERT(prog_hdr->p_type == PT_NOTE);
+    if (at_map) {
+        if (prog_hdr->p_offset + prog_hdr->p_filesz > view_size)
+            return;
+        note = base + prog_hdr->p_offset;
+    } else
+        note = (byte *)prog_hdr->p_vaddr + load_delta;
+    end = note + prog_hdr->p_filesz;
+    TRY_EXCEPT_ALLOW_NO_DCONTEXT(get_thread_private_dcontext(), {
+        while (note + sizeof(ELF_NOTE_HEADER_TYPE) <= end) {
+            ELF_NOTE_HEADER_TYPE *nhdr = (ELF_NOTE_HEADER_TYPE *) note;
+            const char *name = (const char *) (nhdr + 1);
+            byte *desc = (byte *) name + ALIGN_FORWARD(nhdr->n_namesz, 4);
+            byte *next = desc + ALIGN_FORWARD(nhdr->n_descsz, 4);
+            if (next > end || next <= note)
+                break; /* malformed */
+            if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == sizeof("GNU") &&
+                strcmp(name, "GNU") == 0 && nhdr->n_descsz > 0) {
+                out_data->build_id_len = MIN(nhdr->n_descsz,
+                                             BUFFER_SIZE_BYTES(out_data->build_id));
+                memcpy(out_data->build_id, desc, out_data->build_id_len);
+                break;
+            }
+            note = next;
+        }
+    } , { /* EXCEPT */
+        ASSERT_CURIOSITY(false && "crashed while reading ELF notes");
+        out_data->build_id_len = 0;
+    });
+}
+
 /* Returned addresses out_base and out_end are relative to the actual
  * loaded module base, so the "base" param should be added to produce
  * absolute addresses.
@@ -543,6 +583,11 @@ module_walk_program_headers(app_pc base, size_t view_size, bool at_map, bool dyn
                 }
                 found_load = true;
             }
+            if (out_data != NULL && prog_hdr->p_type == PT_NOTE &&
+                out_data->build_id_len == 0) {
+                module_read_build_id(prog_hdr, base, view_size, at_map, load_delta,
+                                     out_data);
+            }
             if ((out_soname != NULL || out_data != NULL) &&
                 prog_hdr->p_type == PT_DYNAMIC) {
                 module_fill_os_data(prog_hdr, mod_base, max_end,
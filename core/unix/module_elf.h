@@ -57,6 +57,7 @@
 # define ELF_REL_TYPE Elf64_Rel
 # define ELF_RELA_TYPE Elf64_Rela
 # define ELF_AUXV_TYPE Elf64_auxv_t
+# define ELF_NOTE_HEADER_TYPE Elf64_Nhdr
 /* system like android has ELF_ST_TYPE and ELF_ST_BIND */
 # ifndef ELF_ST_TYPE
 #  define ELF_ST_TYPE ELF64_ST_TYPE
@@ -78,6 +79,7 @@
 # define ELF_REL_TYPE Elf32_Rel
 # define ELF_RELA_TYPE Elf32_Rela
 # define ELF_AUXV_TYPE Elf32_auxv_t
+# define ELF_NOTE_HEADER_TYPE Elf32_Nhdr
 /* system like android has ELF_ST_TYPE and ELF_ST_BIND */
 # ifndef ELF_ST_TYPE
 #  define ELF_ST_TYPE ELF32_ST_TYPE
@@ -85,6 +87,10 @@
 # endif
 #endif
 
+#ifndef NT_GNU_BUILD_ID
+# define NT_GNU_BUILD_ID 3
+#endif
+
 #ifdef X86
 # ifdef X64
 /* AMD x86-64 relocations.  */
@@ -3326,6 +3326,24 @@ os_heap_decommit(void *p, size_t size, heap_error_code_t *error_code)
     ASSERT(rc == 0);
 }
 
+#ifdef LINUX
+bool
+os_heap_advise_huge_pages(void *p, size_t size, bool huge)
+{
+    long res;
+    ASSERT(ALIGNED(p, PAGE_SIZE) && ALIGNED(size, PAGE_SIZE));
+    /* The advice is a property of the mapping and survives our mprotect-based
+     * commits, so it can be given on reserved-only memory.  Kernels without
+     * THP return EINVAL, which callers treat as a no-op.
+     */
+    res = dynamorio_syscall(SYS_madvise, 3, p, size,
+                            huge ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+    LOG(GLOBAL, LOG_HEAP, 3, "os_heap_advise_huge_pages "PFX"-"PFX" %d => %d\n",
+        p, (byte *)p + size, huge, res);
+    return res == 0;
+}
+#endif
+
 bool
 os_heap_systemwide_overcommit(heap_error_code_t last_error_code)
 {
@@ -3439,8 +3457,14 @@ os_thread_sleep(uint64 milliseconds)
 #endif
 }
 
+/* Takes a suspend reference on tr and sends the suspend signal if this is the
+ * first reference, but does not wait for the target to reach the suspend point.
+ * This lets synch_with_all_threads() broadcast the signal to every thread
+ * before waiting on any of them.  Every successful call must be paired with an
+ * os_thread_resume().
+ */
 bool
-os_thread_suspend(thread_record_t *tr)
+os_thread_suspend_async(thread_record_t *tr)
 {
     os_thread_data_t *ostd = (os_thread_data_t *) tr->dcontext->os_field;
     ASSERT(ostd != NULL);
@@ -3455,10 +3479,10 @@ os_thread_suspend(thread_record_t *tr)
      * just return.
      */
     if (ostd->suspend_count == 1) {
-        /* PR 212090: we use a custom signal handler to suspend.  We wait
-         * here until the target reaches the suspend point, and leave it
-         * up to the caller to check whether it is a safe suspend point,
-         * to match Windows behavior.
+        /* PR 212090: we use a custom signal handler to suspend.
+         * os_thread_suspend() waits until the target reaches the suspend
+         * point, and leaves it up to its caller to check whether it is a
+         * safe suspend point, to match Windows behavior.
          */
         ASSERT(ksynch_get_value(&ostd->suspended) == 0);
         if (!known_thread_signal(tr, SUSPEND_SIGNAL)) {
@@ -3473,6 +3497,15 @@ os_thread_suspend(thread_record_t *tr)
      * suspending thread gets scheduled again.
      */
     mutex_unlock(&ostd->suspend_lock);
+    return true;
+}
+
+/* Waits for a target we hold a suspend reference on to reach the suspend point. */
+void
+os_thread_suspend_wait(thread_record_t *tr)
+{
+    os_thread_data_t *ostd = (os_thread_data_t *) tr->dcontext->os_field;
+    ASSERT(ostd != NULL);
     while (ksynch_get_value(&ostd->suspended) == 0) {
         /* For Linux, waits only if the suspended flag is not set as 1. Return value
          * doesn't matter because the flag will be re-checked.
@@ -3483,6 +3516,14 @@ os_thread_suspend(thread_record_t *tr)
             os_thread_yield();
         }
     }
+}
+
+bool
+os_thread_suspend(thread_record_t *tr)
+{
+    if (!os_thread_suspend_async(tr))
+        return false;
+    os_thread_suspend_wait(tr);
     return true;
 }
 
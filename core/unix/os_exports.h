@@ -158,6 +158,8 @@ app_pc get_dynamorio_dll_end(void);
 thread_id_t get_tls_thread_id(void);
 thread_id_t get_sys_thread_id(void);
 bool is_thread_terminated(dcontext_t *dcontext);
+bool os_thread_suspend_async(thread_record_t *tr);
+void os_thread_suspend_wait(thread_record_t *tr);
 void os_wait_thread_terminated(dcontext_t *dcontext);
 void os_wait_thread_detached(dcontext_t *dcontext);
 void os_signal_thread_detach(dcontext_t *dcontext);
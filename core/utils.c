@@ -1490,16 +1490,18 @@ hashtable_num_bits(uint size)
 /****************************************************************************/
 /* BITMAP */
 
-/* Since there is no ffs() on windows we use the one from
- *  /usr/src/linux-2.4/include/linux/bitops.h.  TODO: An easier
- *  x86-specific way using BSF is
- *  /usr/src/linux-2.4/include/asm/bitops.h
+/* Returns the position of the first set bit - betwen 0 and 31.
+ * We use the compiler's bit-scan builtin (bsf/tzcnt on x86) where we have
+ * one; for cl we keep the binary search from
+ * /usr/src/linux-2.4/include/linux/bitops.h.
  */
-
-/* Returns the position of the first set bit - betwen 0 and 31 */
 static inline uint
 bitmap_find_first_set_bit(bitmap_element_t x)
 {
+#ifdef UNIX
+    ASSERT(x);
+    return (uint) __builtin_ctz(x);
+#else
     int r = 0;
 
     ASSERT(x);
@@ -1524,6 +1526,7 @@ bitmap_find_first_set_bit(bitmap_element_t x)
         r += 1;
     }
     return r;
+#endif
 }
 
 /* A block is marked free with a set bit.
@@ -1535,7 +1538,7 @@ bitmap_find_set_block(bitmap_t b, uint bitmap_size)
     uint i = 0;
     uint last_index = BITMAP_INDEX(bitmap_size);
 
-    while (b[i] == 0 && i < last_index)
+    while (i < last_index && b[i] == 0)
         i++;
     if (i == last_index)
         return BITMAP_NOT_FOUND;
@@ -1544,34 +1547,46 @@ bitmap_find_set_block(bitmap_t b, uint bitmap_size)
 
 /* Looks for a sequence of free blocks
  * Returns -1 if no such sequence is found!
-
- * Considering the fact that the majority of our allocations will be
- * for a single block this operation is not terribly efficient.
+ *
+ * We walk whole elements, skipping fully allocated ones and measuring runs
+ * of set and clear bits with bitmap_find_first_set_bit(), so the cost is
+ * proportional to the number of runs rather than the number of blocks.
  */
 static uint
 bitmap_find_set_block_sequence(bitmap_t b, uint bitmap_size, uint requested)
 {
-    uint last_bit = bitmap_size - requested + 1;
-    /* find quickly at least a single block */
-    uint first = bitmap_find_set_block(b, bitmap_size);
-    if (first == BITMAP_NOT_FOUND)
-        return BITMAP_NOT_FOUND;
+    uint last_index = BITMAP_INDEX(bitmap_size);
+    uint i, first = BITMAP_NOT_FOUND, run = 0;
 
-    do {
-        /* now check if there is room for the requested number of bits */
-        uint hole_size = 1;
-        while (hole_size < requested &&
-               bitmap_test(b, first + hole_size)) {
-            hole_size++;
+    for (i = 0; i < last_index; i++) {
+        bitmap_element_t x = b[i];
+        uint pos = 0;
+        if (x == 0) {
+            run = 0;
+            continue;
         }
-        if (hole_size == requested)
-            return first;
-        /* otherwise first + hole_size is not set, so we should skip that */
-        first += hole_size + 1;
-        while (first < last_bit && !bitmap_test(b, first))
-            first++;
-    } while (first < last_bit);
-
+        while (pos < BITMAP_DENSITY) {
+            bitmap_element_t rest = x >> pos;
+            if (TEST(1, rest)) {
+                /* ~rest has its top pos bits set, so it is non-zero unless
+                 * the whole element is free
+                 */
+                uint ones = (~rest == 0) ? BITMAP_DENSITY :
+                    bitmap_find_first_set_bit(~rest);
+                if (run == 0)
+                    first = i*BITMAP_DENSITY + pos;
+                run += ones;
+                if (run >= requested)
+                    return first;
+                pos += ones;
+            } else {
+                run = 0;
+                if (rest == 0)
+                    break;
+                pos += bitmap_find_first_set_bit(rest);
+            }
+        }
+    }
     return BITMAP_NOT_FOUND;
 }
 
@@ -1600,6 +1615,34 @@ bitmap_allocate_blocks(bitmap_t b, uint bitmap_size, uint request_blocks)
     return res;
 }
 
+/* Like bitmap_allocate_blocks() but takes the highest sequence of free blocks,
+ * so that one kind of allocation can be kept clustered at the end.
+ */
+uint
+bitmap_allocate_blocks_from_end(bitmap_t b, uint bitmap_size, uint request_blocks)
+{
+    uint i = bitmap_size, run = 0, res;
+    ASSERT(request_blocks > 0);
+    while (i > 0 && run < request_blocks) {
+        i--;
+        if (ALIGNED(i + 1, BITMAP_DENSITY) && b[BITMAP_INDEX(i)] == 0) {
+            /* skip a fully allocated element */
+            run = 0;
+            i -= BITMAP_DENSITY - 1;
+        } else if (bitmap_test(b, i))
+            run++;
+        else
+            run = 0;
+    }
+    if (run < request_blocks)
+        return BITMAP_NOT_FOUND;
+    res = i;
+    do {
+        bitmap_clear(b, i++);
+    } while (--request_blocks);
+    return res;
+}
+
 void
 bitmap_free_blocks(bitmap_t b, uint bitmap_size, uint first_block, uint num_free)
 {
@@ -4449,7 +4492,176 @@ test_date_conversion_day(dr_time_t *dr_time)
     }
 }
 
-/* Tests for double_print(), divide_uint64_print(), and date routines. */
+/* Returns the first run of requested set bits by testing each bit in turn. */
+static uint
+bitmap_find_set_block_sequence_slow(bitmap_t b, uint bitmap_size, uint requested)
+{
+    uint i, run = 0;
+    for (i = 0; i < BITMAP_INDEX(bitmap_size) * BITMAP_DENSITY; i++) {
+        if (bitmap_test(b, i)) {
+            if (++run >= requested)
+                return i + 1 - run;
+        } else
+            run = 0;
+    }
+    return BITMAP_NOT_FOUND;
+}
+
+static void
+test_bitmap_sequence(bitmap_t b, uint bitmap_size, uint requested)
+{
+    uint res = bitmap_find_set_block_sequence(b, bitmap_size, requested);
+    uint expect = bitmap_find_set_block_sequence_slow(b, bitmap_size, requested);
+    if (res != expect) {
+        printf("FAIL : bitmap_find_set_block_sequence for %u blocks returned %u, "
+               "expected %u\n", requested, res, expect);
+        exit(-1);
+    }
+}
+
+/* Compares bitmap_find_set_block_sequence() against a bit-by-bit search on
+ * runs that start and end anywhere within and across elements.
+ */
+static void
+test_bitmap_find_set_block_sequence(void)
+{
+    bitmap_element_t b[4];
+    uint size = BUFFER_SIZE_ELEMENTS(b) * BITMAP_DENSITY;
+    uint start, len, requested, t, seed = 42;
+
+    memset(b, 0, sizeof(b));
+    EXPECT(bitmap_find_set_block_sequence(b, size, 2), BITMAP_NOT_FOUND);
+    bitmap_initialize_free(b, size);
+    EXPECT(bitmap_find_set_block_sequence(b, size, size), 0);
+    EXPECT(bitmap_find_set_block_sequence(b, size, size + 1), BITMAP_NOT_FOUND);
+
+    /* A single run of each position and length. */
+    for (start = 0; start < size; start++) {
+        for (len = 1; start + len <= size; len++) {
+            memset(b, 0, sizeof(b));
+            for (t = start; t < start + len; t++)
+                bitmap_set(b, t);
+            for (requested = 2; requested <= len + 1; requested++)
+                test_bitmap_sequence(b, size, requested);
+        }
+    }
+    /* Many short runs, where an earlier run that is too short must be passed
+     * over for a later, longer one.
+     */
+    for (t = 0; t < 10000; t++) {
+        uint i;
+        for (i = 0; i < BUFFER_SIZE_ELEMENTS(b); i++) {
+            seed = seed * 1103515245 + 12345;
+            b[i] = seed;
+            seed = seed * 1103515245 + 12345;
+            b[i] |= seed >> 16;
+        }
+        for (requested = 2; requested <= 12; requested++)
+            test_bitmap_sequence(b, size, requested);
+    }
+    printf("PASS\n");
+}
+
+/* Returns the start of the highest run of requested set bits by testing each
+ * bit in turn, without clearing it.
+ */
+static uint
+bitmap_find_set_block_sequence_from_end_slow(bitmap_t b, uint bitmap_size,
+                                             uint requested)
+{
+    uint i = bitmap_size, run = 0;
+    while (i > 0) {
+        i--;
+        if (bitmap_test(b, i)) {
+            if (++run >= requested)
+                return i;
+        } else
+            run = 0;
+    }
+    return BITMAP_NOT_FOUND;
+}
+
+static void
+test_bitmap_from_end(bitmap_t b, uint bitmap_size, uint requested)
+{
+    bitmap_element_t before[4];
+    uint expect = bitmap_find_set_block_sequence_from_end_slow(b, bitmap_size,
+                                                               requested);
+    uint res, i;
+    ASSERT(BITMAP_INDEX(bitmap_size) <= BUFFER_SIZE_ELEMENTS(before));
+    memcpy(before, b, BITMAP_INDEX(bitmap_size) * sizeof(bitmap_element_t));
+    res = bitmap_allocate_blocks_from_end(b, bitmap_size, requested);
+    if (res != expect) {
+        printf("FAIL : bitmap_allocate_blocks_from_end for %u blocks returned %u, "
+               "expected %u\n", requested, res, expect);
+        exit(-1);
+    }
+    /* Exactly the returned blocks must have been taken. */
+    for (i = 0; i < bitmap_size; i++) {
+        bool taken = res != BITMAP_NOT_FOUND && i >= res && i < res + requested;
+        if (bitmap_test(b, i) != (bitmap_test(before, i) && !taken)) {
+            printf("FAIL : bitmap_allocate_blocks_from_end for %u blocks changed "
+                   "block %u\n", requested, i);
+            exit(-1);
+        }
+    }
+    if (res != BITMAP_NOT_FOUND)
+        bitmap_free_blocks(b, bitmap_size, res, requested);
+}
+
+/* Compares bitmap_allocate_blocks_from_end() against a bit-by-bit search from
+ * the top, including runs that cross the fully allocated elements it skips.
+ */
+static void
+test_bitmap_allocate_blocks_from_end(void)
+{
+    bitmap_element_t b[4];
+    uint size = BUFFER_SIZE_ELEMENTS(b) * BITMAP_DENSITY;
+    uint start, len, requested, t, seed = 42;
+
+    memset(b, 0, sizeof(b));
+    EXPECT(bitmap_allocate_blocks_from_end(b, size, 1), BITMAP_NOT_FOUND);
+    bitmap_initialize_free(b, size);
+    EXPECT(bitmap_allocate_blocks_from_end(b, size, 1), size - 1);
+    EXPECT(bitmap_allocate_blocks_from_end(b, size, BITMAP_DENSITY),
+           size - 1 - BITMAP_DENSITY);
+    bitmap_initialize_free(b, size);
+    EXPECT(bitmap_allocate_blocks_from_end(b, size, size), 0);
+    bitmap_initialize_free(b, size);
+    EXPECT(bitmap_allocate_blocks_from_end(b, size, size + 1), BITMAP_NOT_FOUND);
+    /* Successive allocations stay clustered at the top. */
+    bitmap_initialize_free(b, size);
+    for (t = 1; t <= size / 3; t++)
+        EXPECT(bitmap_allocate_blocks_from_end(b, size, 3), size - 3 * t);
+
+    /* A single run of each position and length. */
+    for (start = 0; start < size; start++) {
+        for (len = 1; start + len <= size; len++) {
+            memset(b, 0, sizeof(b));
+            for (t = start; t < start + len; t++)
+                bitmap_set(b, t);
+            for (requested = 1; requested <= len + 1; requested++)
+                test_bitmap_from_end(b, size, requested);
+        }
+    }
+    /* Random maps, with some elements fully allocated so they get skipped. */
+    for (t = 0; t < 10000; t++) {
+        uint i;
+        for (i = 0; i < BUFFER_SIZE_ELEMENTS(b); i++) {
+            seed = seed * 1103515245 + 12345;
+            b[i] = seed;
+            seed = seed * 1103515245 + 12345;
+            b[i] |= seed >> 16;
+            if (((seed >> 8) & 3) == 0)
+                b[i] = 0;
+        }
+        for (requested = 1; requested <= 12; requested++)
+            test_bitmap_from_end(b, size, requested);
+    }
+    printf("PASS\n");
+}
+
+/* Tests for double_print(), divide_uint64_print(), date routines, and bitmaps. */
 void
 unit_test_utils(void)
 {
@@ -4529,6 +4741,9 @@ unit_test_utils(void)
         dr_time.month = 1 + t % 12;
         test_date_conversion_day(&dr_time);
     }
+
+    test_bitmap_find_set_block_sequence();
+    test_bitmap_allocate_blocks_from_end();
 }
 
 # undef printf
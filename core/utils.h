@@ -430,6 +430,7 @@ enum {
 #endif
     LOCK_RANK(written_areas), /* > executable_areas, < module_data_lock,
                                * < dynamo_areas < global_alloc_lock */
+    LOCK_RANK(jitopt_lock), /* > bb_building_lock, < special_heap_lock */
     LOCK_RANK(module_data_lock),  /* < loaded_module_areas, < special_heap_lock,
                                    * > executable_areas */
     LOCK_RANK(special_units_list_lock), /* < special_heap_lock */
@@ -534,6 +535,7 @@ enum {
     LOCK_RANK(landing_pad_areas_lock),  /* < global_alloc_lock, < dynamo_areas */
     LOCK_RANK(dynamo_areas),    /* < global_alloc_lock */
     LOCK_RANK(map_intercept_pc_lock), /* < global_alloc_lock */
+    LOCK_RANK(optimize_async_lock), /* > fragment_delete_mutex, < global_alloc_lock */
     LOCK_RANK(global_alloc_lock),/* < heap_unit_lock */
     LOCK_RANK(heap_unit_lock),   /* recursive */
     LOCK_RANK(vmh_lock),        /* lowest level */
@@ -545,6 +547,9 @@ enum {
                           * need to be even lower: as it is, only used for set */
 #endif
     LOCK_RANK(reset_pending_lock), /* > heap_unit_lock */
+#ifdef HASHTABLE_STATISTICS
+    LOCK_RANK(ib_site_stats_lock), /* leaf */
+#endif
 
     LOCK_RANK(initstack_mutex),  /* FIXME: NOT TESTED */
 
@@ -1100,6 +1105,7 @@ bitmap_clear(bitmap_t b, uint i)
 /* bitmap_size is number of bits in the bitmap_t */
 void bitmap_initialize_free(bitmap_t b, uint bitmap_size);
 uint bitmap_allocate_blocks(bitmap_t b, uint bitmap_size, uint request_blocks);
+uint bitmap_allocate_blocks_from_end(bitmap_t b, uint bitmap_size, uint request_blocks);
 void bitmap_free_blocks(bitmap_t b, uint bitmap_size, uint first_block, uint num_free);
 
 #ifdef DEBUG
@@ -832,6 +832,37 @@ writelock_if_not_already(vm_area_vector_t *v)
     return false;
 }
 
+/* A buffer replaced by growing a VECTOR_LOCKFREE_READ vector */
+typedef struct _vmvector_retired_buf_t {
+    struct vm_area_t *buf;
+    int size;
+    struct _vmvector_retired_buf_t *next;
+} vmvector_retired_buf_t;
+
+/* Brackets a change to v's buf or length so VECTOR_LOCKFREE_READ readers
+ * can detect it.  add_vm_area() and remove_vm_area() call each other, so
+ * only the outermost call opens and closes the bracket: the return value is
+ * to be passed to vmvector_lockfree_write_end().
+ * Assumes caller holds v->lock.
+ */
+static bool
+vmvector_lockfree_write_begin(vm_area_vector_t *v)
+{
+    if (!TEST(VECTOR_LOCKFREE_READ, v->flags) || TEST(1, v->lockfree_seq))
+        return false;
+    ATOMIC_INC(int, v->lockfree_seq);
+    return true;
+}
+
+static void
+vmvector_lockfree_write_end(vm_area_vector_t *v, bool began)
+{
+    if (began) {
+        ASSERT(TEST(1, v->lockfree_seq));
+        ATOMIC_INC(int, v->lockfree_seq);
+    }
+}
+
 static void
 vm_area_vector_check_size(vm_area_vector_t *v)
 {
@@ -848,9 +879,28 @@ vm_area_vector_check_size(vm_area_vector_t *v)
             /* FIXME: case 4471 we should be doubling size here */
             int new_size = (INTERNAL_OPTION(vmarea_increment_size) + v->length);
             STATS_INC(num_vmareas_resized);
-            v->buf = global_heap_realloc(v->buf, v->size, new_size,
-                                         sizeof(struct vm_area_t)
-                                         HEAPACCT(ACCT_VMAREAS));
+            if (TEST(VECTOR_LOCKFREE_READ, v->flags)) {
+                /* A lock-free reader may still be walking the old buffer, so
+                 * we keep it until the vector is reset.  We double here so
+                 * that what we keep stays smaller than the live buffer.
+                 */
+                vmvector_retired_buf_t *retired = (vmvector_retired_buf_t *)
+                    global_heap_alloc(sizeof(*retired) HEAPACCT(ACCT_VMAREAS));
+                vm_area_t *buf;
+                new_size = MAX(new_size, 2*v->size);
+                buf = (vm_area_t *) global_heap_alloc(new_size*sizeof(struct vm_area_t)
+                                                      HEAPACCT(ACCT_VMAREAS));
+                memcpy(buf, v->buf, v->length*sizeof(struct vm_area_t));
+                retired->buf = v->buf;
+                retired->size = v->size;
+                retired->next = (vmvector_retired_buf_t *) v->retired_bufs;
+                v->retired_bufs = retired;
+                v->buf = buf;
+            } else {
+                v->buf = global_heap_realloc(v->buf, v->size, new_size,
+                                             sizeof(struct vm_area_t)
+                                             HEAPACCT(ACCT_VMAREAS));
+            }
             v->size = new_size;
         }
         ASSERT(v->buf != NULL);
@@ -883,6 +933,25 @@ vm_area_merge_fraglists(vm_area_t *dst, vm_area_t *src)
     }
 }
 
+/* Returns the index of the first area in v that ends at or after pc, or
+ * v->length if there is none: no area before it can overlap or be adjacent
+ * to a region starting at pc.
+ * Assumes caller holds v->lock, if necessary.
+ */
+static int
+vm_area_first_ending_at_or_after(vm_area_vector_t *v, app_pc pc)
+{
+    int min = 0, max = v->length;
+    while (min < max) {
+        int i = (min + max) / 2;
+        if (v->buf[i].end < pc)
+            min = i + 1;
+        else
+            max = i;
+    }
+    return min;
+}
+
 /* Assumes caller holds v->lock, if necessary.
  * Does not return the area added since it may be merged or split depending
  * on existing areas->
@@ -911,18 +980,20 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end,
     int i, j, diff;
     /* if we have overlap, we extend an existing area -- else we add a new area */
     int overlap_start = -1, overlap_end = -1;
+    bool lockfree_began;
     DEBUG_DECLARE(uint flagignore;)
     IF_UNIX(IF_DEBUG(IF_NO_MEMQUERY(extern vm_area_vector_t *all_memory_areas;)))
 
     ASSERT(start < end);
 
     ASSERT_VMAREA_VECTOR_PROTECTED(v, WRITE);
+    lockfree_began = vmvector_lockfree_write_begin(v);
     LOG(GLOBAL, LOG_VMAREAS, 4, "in add_vm_area%s "PFX" "PFX" %s\n",
         (v == executable_areas ? " executable_areas" :
          (v == IF_LINUX_ELSE(all_memory_areas, NULL) ? " all_memory_areas" :
           (v == dynamo_areas ? " dynamo_areas" : ""))), start, end, comment);
     /* N.B.: new area could span multiple existing areas! */
-    for (i = 0; i < v->length; i++) {
+    for (i = vm_area_first_ending_at_or_after(v, start); i < v->length; i++) {
         /* look for overlap, or adjacency of same type (including all flags, and never
          * merge adjacent if keeping write counts)
          */
@@ -1149,6 +1220,7 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end,
         LOG(GLOBAL, LOG_VMAREAS, 3, "=> adding "PFX"-"PFX"\n", start, end);
         vm_area_vector_check_size(v);
         /* shift subsequent entries */
+        STATS_ADD(vmareas_entries_shifted, v->length - i);
         for (j = v->length; j > i; j--)
             v->buf[j] = v->buf[j-1];
         v->buf[i] = new_area;
@@ -1231,6 +1303,7 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end,
                 vm_area_merge_fraglists(&v->buf[overlap_start], &v->buf[i]);
         }
         diff = overlap_end - (overlap_start+1);
+        STATS_ADD(vmareas_entries_shifted, v->length - overlap_end);
         for (i = overlap_start+1; i < v->length-diff; i++)
             v->buf[i] = v->buf[i+diff];
         v->length -= diff;
@@ -1242,6 +1315,7 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end,
             vm_area_clean_fraglist(dcontext, &v->buf[i]);
         }
     }
+    vmvector_lockfree_write_end(v, lockfree_began);
     DOLOG(5, LOG_VMAREAS, { print_vm_areas(v, GLOBAL); });
 }
 
@@ -1300,6 +1374,7 @@ remove_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, bool restore_prot)
     int i, diff;
     int overlap_start = -1, overlap_end = -1;
     bool add_new_area = false;
+    bool lockfree_began;
     vm_area_t new_area = {0};     /* used only when add_new_area, wimpy compiler */
     /* FIXME: cleaner test? shared_data copies flags, but uses
      * custom.frags and not custom.client
@@ -1309,7 +1384,7 @@ remove_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, bool restore_prot)
     ASSERT_VMAREA_VECTOR_PROTECTED(v, WRITE);
     LOG(GLOBAL, LOG_VMAREAS, 4, "in remove_vm_area "PFX" "PFX"\n", start, end);
     /* N.B.: removed area could span multiple areas! */
-    for (i = 0; i < v->length; i++) {
+    for (i = vm_area_first_ending_at_or_after(v, start); i < v->length; i++) {
         /* look for overlap */
         if (start < v->buf[i].end && end > v->buf[i].start) {
             if (overlap_start == -1)
@@ -1324,6 +1399,7 @@ remove_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, bool restore_prot)
         return false;
     if (overlap_end == -1)
         overlap_end = v->length;
+    lockfree_began = vmvector_lockfree_write_begin(v);
     /* since it's sorted and there are no overlaps, we do not have to re-sort.
      * we just delete entire intervals affected, and shorten non-entire
      */
@@ -1428,6 +1504,7 @@ remove_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, bool restore_prot)
                    v->buf[i].custom.frags == NULL);
         }
         diff = overlap_end - overlap_start;
+        STATS_ADD(vmareas_entries_shifted, v->length - overlap_end);
         for (i = overlap_start; i < v->length-diff; i++)
             v->buf[i] = v->buf[i+diff];
 #ifdef DEBUG
@@ -1459,6 +1536,7 @@ remove_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, bool restore_prot)
                     new_area.frag_flags, new_area.custom.client
                     _IF_DEBUG(new_area.comment));
     }
+    vmvector_lockfree_write_end(v, lockfree_began);
     DOLOG(5, LOG_VMAREAS, { print_vm_areas(v, GLOBAL); });
     return true;
 }
@@ -1552,6 +1630,54 @@ vm_area_overlap(vm_area_vector_t *v, app_pc start, app_pc end)
     return binary_search(v, start, end, NULL, NULL, false);
 }
 
+/* How many times vm_area_overlap_lockfree() retries before taking the lock */
+#define VMVECTOR_LOCKFREE_TRIES 4
+
+/* vm_area_overlap() for a VECTOR_LOCKFREE_READ vector, without its lock.
+ * A search that sees the same even lockfree_seq before and after it saw a
+ * consistent vector; if writers keep getting in the way we take the read lock.
+ */
+static bool
+vm_area_overlap_lockfree(vm_area_vector_t *v, app_pc start, app_pc end)
+{
+    bool overlap;
+    int tries;
+    ASSERT(TEST(VECTOR_LOCKFREE_READ, v->flags));
+    ASSERT(start < end || end == NULL /* wraparound */);
+    for (tries = 0; tries < VMVECTOR_LOCKFREE_TRIES; tries++) {
+        int seq = v->lockfree_seq;
+        if (!TEST(1, seq)) {
+            /* Read length before buf: vm_area_vector_check_size() installs the
+             * larger buffer before the length grows past the old one.
+             */
+            int min = 0, max = *(volatile int *)&v->length - 1;
+            volatile vm_area_t *buf = *(vm_area_t * volatile *)&v->buf;
+            overlap = false;
+            while (max >= min) {
+                int i = (min + max) / 2;
+                if (end != NULL && end <= buf[i].start)
+                    max = i - 1;
+                else if (start >= buf[i].end)
+                    min = i + 1;
+                else {
+                    overlap = true;
+                    break;
+                }
+            }
+            if (v->lockfree_seq == seq) {
+                STATS_INC(num_vmareas_lockfree_lookups);
+                return overlap;
+            }
+        }
+        STATS_INC(num_vmareas_lockfree_retries);
+    }
+    STATS_INC(num_vmareas_lockfree_fallbacks);
+    read_lock(&v->lock);
+    overlap = vm_area_overlap(v, start, end);
+    read_unlock(&v->lock);
+    return overlap;
+}
+
 /*********************** EXPORTED ROUTINES **********************/
 
 /* thread-shared initialization that should be repeated after a reset */
@@ -1583,7 +1709,9 @@ vm_areas_init()
      * We're already paying the indirection cost by passing their addresses
      * to generic routines, after all.
      */
-    VMVECTOR_ALLOC_VECTOR(executable_areas, GLOBAL_DCONTEXT, VECTOR_SHARED,
+    VMVECTOR_ALLOC_VECTOR(executable_areas, GLOBAL_DCONTEXT, VECTOR_SHARED |
+                          (DYNAMO_OPTION(vmarea_lockfree_reads) ?
+                           VECTOR_LOCKFREE_READ : 0),
                           executable_areas);
     VMVECTOR_ALLOC_VECTOR(pretend_writable_areas, GLOBAL_DCONTEXT, VECTOR_SHARED,
                           pretend_writable_areas);
@@ -1963,6 +2091,8 @@ vmvector_overlap(vm_area_vector_t *v, app_pc start, app_pc end)
     bool release_lock; /* 'true' means this routine needs to unlock */
     if (vmvector_empty(v))
         return false;
+    if (TEST(VECTOR_LOCKFREE_READ, v->flags))
+        return vm_area_overlap_lockfree(v, start, end);
     LOCK_VECTOR(v, release_lock, read);
     ASSERT_OWN_READWRITE_LOCK(SHOULD_LOCK_VECTOR(v), &v->lock);
     overlap = vm_area_overlap(v, start, end);
@@ -2114,6 +2244,13 @@ vmvector_reset_vector(dcontext_t *dcontext, vm_area_vector_t *v)
                              HEAPACCT(ACCT_VMAREAS));
         }
     });
+    while (v->retired_bufs != NULL) {
+        vmvector_retired_buf_t *retired = (vmvector_retired_buf_t *) v->retired_bufs;
+        v->retired_bufs = retired->next;
+        global_heap_free(retired->buf, retired->size*sizeof(struct vm_area_t)
+                         HEAPACCT(ACCT_VMAREAS));
+        global_heap_free(retired, sizeof(*retired) HEAPACCT(ACCT_VMAREAS));
+    }
     /* with thread shared cache it is in fact possible to have no thread local vmareas */
     if (v->buf != NULL) {
         /* FIXME: walk through and make sure frags lists are all freed */
@@ -2430,6 +2567,7 @@ add_executable_vm_area_check_IAT(app_pc *start /*IN/OUT*/, app_pc *end /*IN/OUT*
             /* We stored the IAT code at +rw time */
             os_module_cmp_IAT_code(orig_start)) {
             vm_area_t *area = NULL;
+            bool lockfree_began;
             bool all_new = !executable_vm_area_overlap(orig_start, orig_end-1,
                                                        true/*wlock*/);
             ASSERT(IAT_start != NULL); /* should have found bounds above */
@@ -2456,7 +2594,12 @@ add_executable_vm_area_check_IAT(app_pc *start /*IN/OUT*/, app_pc *end /*IN/OUT*
                 ASSERT(IAT_end > orig_start && IAT_end < area->start);
                 ASSERT(*start == IAT_end); /* set up above */
                 *end = area->end;
+                /* Growing an area in place changes what a lock-free reader of
+                 * executable_areas sees just like add_vm_area() does.
+                 */
+                lockfree_began = vmvector_lockfree_write_begin(executable_areas);
                 area->start = *start;
+                vmvector_lockfree_write_end(executable_areas, lockfree_began);
                 *existing_area = area;
                 STATS_INC(coarse_merge_IAT);
                 /* If info was loaded prior to rebinding just use it.
@@ -2952,9 +3095,16 @@ bool
 is_executable_address(app_pc addr)
 {
     bool found;
-    read_lock(&executable_areas->lock);
-    found = lookup_addr(executable_areas, addr, NULL);
-    read_unlock(&executable_areas->lock);
+    /* timed either way, to compare -vmarea_lockfree_reads against the lock */
+    KSTART(execarea_lookup);
+    if (TEST(VECTOR_LOCKFREE_READ, executable_areas->flags))
+        found = vm_area_overlap_lockfree(executable_areas, addr, addr+1/*open end*/);
+    else {
+        read_lock(&executable_areas->lock);
+        found = lookup_addr(executable_areas, addr, NULL);
+        read_unlock(&executable_areas->lock);
+    }
+    KSTOP(execarea_lookup);
     return found;
 }
 
@@ -10720,8 +10870,7 @@ handle_modified_code(dcontext_t *dcontext, cache_pc instr_cache_pc,
                                              false /*don't keep initexit_lock*/);
             if (DYNAMO_OPTION(opt_jit) && !TEST(MEMPROT_WRITE, prot) &&
                 is_jit_managed_area((app_pc)tgt_pstart)) {
-                jitopt_clear_span((app_pc) tgt_pstart,
-                                             (app_pc) (tgt_pend+PAGE_SIZE-tgt_pstart));
+                jitopt_clear_span((app_pc) tgt_pstart, (app_pc) tgt_pend+PAGE_SIZE);
             }
             /* must execute instr_app_pc next, even though that new bb will be
              * useless afterward (will most likely re-enter from bb_start)
@@ -11638,6 +11787,76 @@ vmvector_tests()
     vmvector_print(&v, STDERR);
 }
 
+/* Checks vm_area_overlap_lockfree() against vm_area_overlap() for every
+ * address around each area.
+ */
+static void
+check_lockfree_lookups(vm_area_vector_t *v, uint max_pc)
+{
+    uint pc;
+    for (pc = 0; pc < max_pc; pc++) {
+        bool expect = vm_area_overlap(v, INT_TO_PC(pc), INT_TO_PC(pc+1));
+        EXPECT(vm_area_overlap_lockfree(v, INT_TO_PC(pc), INT_TO_PC(pc+1)), expect);
+        expect = vm_area_overlap(v, INT_TO_PC(pc), INT_TO_PC(pc+5));
+        EXPECT(vm_area_overlap_lockfree(v, INT_TO_PC(pc), INT_TO_PC(pc+5)), expect);
+    }
+}
+
+/* Tests the VECTOR_LOCKFREE_READ path: each outermost add or remove moves
+ * lockfree_seq from even to even, growing the vector retires rather than
+ * frees its buffer, and a reader that sees a write in progress still gets
+ * the right answer from the lock.
+ */
+static void
+vmvector_lockfree_tests(void)
+{
+    vm_area_vector_t v = {0, 0, 0, VECTOR_SHARED | VECTOR_LOCKFREE_READ,
+                          INIT_READWRITE_LOCK(thread_vm_areas)};
+    int i, seq, num = 2 * INTERNAL_OPTION(vmarea_initial_size);
+    print_file(STDERR, "\nlock-free vm_area_vector_t tests\n");
+    EXPECT(vm_area_overlap_lockfree(&v, INT_TO_PC(0), INT_TO_PC(10)), false);
+
+    write_lock(&v.lock);
+    for (i = 0; i < num; i++) {
+        seq = v.lockfree_seq;
+        add_vm_area(&v, INT_TO_PC(0x10*i + 4), INT_TO_PC(0x10*i + 8), 0, 0, NULL
+                    _IF_DEBUG("L"));
+        EXPECT(v.lockfree_seq, seq + 2);
+    }
+    write_unlock(&v.lock);
+    EXPECT(v.length, num);
+    /* the vector grew, so at least one buffer was retired */
+    EXPECT(v.retired_bufs != NULL, true);
+    check_lockfree_lookups(&v, 0x10*num + 0x10);
+
+    write_lock(&v.lock);
+    seq = v.lockfree_seq;
+    /* splits 0x24-0x28: remove_vm_area() then calls add_vm_area(), but only
+     * the outermost call bumps the sequence
+     */
+    remove_vm_area(&v, INT_TO_PC(0x25), INT_TO_PC(0x27), false);
+    EXPECT(v.lockfree_seq, seq + 2);
+    seq = v.lockfree_seq;
+    remove_vm_area(&v, INT_TO_PC(0x30), INT_TO_PC(0x40), false);
+    EXPECT(v.lockfree_seq, seq + 2);
+    seq = v.lockfree_seq;
+    /* merges 0x4-0x8 and 0x14-0x18 */
+    add_vm_area(&v, INT_TO_PC(0x8), INT_TO_PC(0x14), 0, 0, NULL _IF_DEBUG("M"));
+    EXPECT(v.lockfree_seq, seq + 2);
+    write_unlock(&v.lock);
+    check_lockfree_lookups(&v, 0x10*num + 0x10);
+
+    /* A reader that only ever sees an odd sequence falls back to the lock. */
+    v.lockfree_seq++;
+    EXPECT(vm_area_overlap_lockfree(&v, INT_TO_PC(0x4), INT_TO_PC(0x5)), true);
+    EXPECT(vm_area_overlap_lockfree(&v, INT_TO_PC(0x30), INT_TO_PC(0x34)), false);
+    v.lockfree_seq++;
+
+    vmvector_reset_vector(GLOBAL_DCONTEXT, &v);
+    EXPECT(v.retired_bufs == NULL, true);
+    DELETE_READWRITE_LOCK(v.lock);
+}
+
 /* initial vector tests
  * FIXME: should add a lot more, esp. wrt other flags -- these only
  * test no flags or interactions w/ selfmod flag
@@ -11764,5 +11983,6 @@ unit_test_vmareas(void)
     check_vec(&v, 2, INT_TO_PC(3), INT_TO_PC(4), 0, 0, NULL);
 
     vmvector_tests();
+    vmvector_lockfree_tests();
 }
 #endif  /* STANDALONE_UNIT_TEST */
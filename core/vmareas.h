@@ -67,6 +67,10 @@ enum {
      * flag to avoid the redundant vector-level lock
      */
     VECTOR_NO_LOCK       = 0x0010,
+    /* address-only queries (vmvector_overlap()) may skip the lock: see
+     * lockfree_seq below.  Writers must still hold the write lock.
+     */
+    VECTOR_LOCKFREE_READ = 0x0020,
 };
 
 #define VECTOR_NEVER_MERGE (VECTOR_NEVER_MERGE_ADJACENT | VECTOR_NEVER_OVERLAP)
@@ -89,6 +93,14 @@ struct vm_area_vector_t {
      * to perform a read (don't need full recursive lock)
      */
     read_write_lock_t lock;
+    /* For VECTOR_LOCKFREE_READ: odd while a writer is changing buf or length,
+     * and bumped again when it is done, so lock-free readers can tell whether
+     * what they read is consistent.  Buffers replaced by growing the vector
+     * are kept on retired_bufs until the vector is reset, as a reader may
+     * still be walking one.
+     */
+    volatile int lockfree_seq;
+    void *retired_bufs;
 
     /* Callbacks to support payloads */
     /* Frees a payload */
@@ -56,9 +56,11 @@
 #include "drcovlib.h"
 #include "hashtable.h"
 #include "drtable.h"
+#include "drvector.h"
 #include "modules.h"
 #include "drcovlib_private.h"
 #include <limits.h>
+#include <stddef.h> /* offsetof */
 #include <string.h>
 
 #define UNKNOWN_MODULE_ID USHRT_MAX
@@ -71,10 +73,44 @@ uint verbose;
 static drcovlib_options_t options;
 static char logdir[MAXIMUM_PATH];
 
+/* State for DRCOVLIB_DUMP_INCREMENTAL.  It is shared by the global data and
+ * its per-thread copies.
+ */
+typedef struct _incr_state_t {
+    /* Protects the delta bitmaps and orders bb_table additions for dumping. */
+    void *lock;
+    /* Serializes dumps. */
+    void *dump_lock;
+    /* Indexed by module id: a delta_bitmap_t with one bit per module offset,
+     * set once a block starting there has been added to bb_table.
+     */
+    drvector_t bitmaps;
+    /* The starts of blocks outside any known module already added to bb_table. */
+    hashtable_t unknown_starts;
+    /* The number of bb_table entries already written to the log. */
+    ptr_uint_t num_dumped;
+    bool header_written;
+    /* Set once a write to the log fails.  The failed record may be torn, which
+     * readers tolerate only at the end of the file, so nothing more is written.
+     */
+    bool write_failed;
+    /* The length of the module list last written to the log. */
+    size_t modlist_len;
+    char *modbuf;
+    size_t modbuf_size;
+    uint64 last_dump_ms;
+} incr_state_t;
+
+typedef struct _delta_bitmap_t {
+    byte *bits;
+    size_t size; /* the number of module offsets covered by bits */
+} delta_bitmap_t;
+
 typedef struct _per_thread_t {
     void *bb_table;
     file_t  log;
     char logname[MAXIMUM_PATH];
+    incr_state_t *incr; /* NULL unless DRCOVLIB_DUMP_INCREMENTAL */
 } per_thread_t;
 
 static per_thread_t *global_data;
@@ -83,6 +119,11 @@ static bool drcov_per_thread = false;
 static int sysnum_execve = IF_X64_ELSE(59, 11);
 #endif
 static volatile bool go_native;
+/* For DRCOVLIB_HIT_COUNTS: indexed by module id, a hit_table_t. */
+static drvector_t hit_tables;
+static void *hit_lock;
+/* Blocks given an id past their module's counter capacity, guarded by hit_lock. */
+static uint hit_uncounted;
 static int tls_idx = -1;
 static int drcovlib_init_count;
 
@@ -116,6 +157,367 @@ log_file_create(void *drcontext, per_thread_t *data)
                                        BUFFER_SIZE_ELEMENTS(data->logname));
 }
 
+/****************************************************************************
+ * Incremental Dumping
+ */
+
+static void
+delta_bitmap_free(void *ptr)
+{
+    delta_bitmap_t *bitmap = (delta_bitmap_t *)ptr;
+    if (bitmap->bits != NULL) {
+        dr_raw_mem_free(bitmap->bits, ALIGN_FORWARD(bitmap->size/8 + 1,
+                                                    dr_page_size()));
+    }
+    dr_global_free(bitmap, sizeof(*bitmap));
+}
+
+/* Returns whether a block starting at offset in module mod_id was already added,
+ * and marks it as added.  The caller must hold incr->lock.
+ */
+static bool
+delta_bitmap_test_and_set(incr_state_t *incr, uint mod_id, app_pc mod_start,
+                          uint offset)
+{
+    delta_bitmap_t *bitmap = drvector_get_entry(&incr->bitmaps, mod_id);
+    if (bitmap == NULL) {
+        module_data_t *mod = dr_lookup_module(mod_start);
+        bitmap = dr_global_alloc(sizeof(*bitmap));
+        bitmap->bits = NULL;
+        bitmap->size = 0;
+        if (mod != NULL) {
+            bitmap->size = mod->end - mod->start;
+            /* The mapping is zeroed and untouched pages cost nothing, which
+             * matters since most of a module's offsets never start a block.
+             */
+            bitmap->bits = dr_raw_mem_alloc(ALIGN_FORWARD(bitmap->size/8 + 1,
+                                                          dr_page_size()),
+                                            DR_MEMPROT_READ | DR_MEMPROT_WRITE,
+                                            NULL);
+            if (bitmap->bits == NULL)
+                bitmap->size = 0;
+            dr_free_module_data(mod);
+        }
+        drvector_set_entry(&incr->bitmaps, mod_id, bitmap);
+    }
+    if (offset >= bitmap->size)
+        return false; /* not tracked: we err on the side of duplicates */
+    if (TEST(1 << (offset % 8), bitmap->bits[offset / 8]))
+        return true;
+    bitmap->bits[offset / 8] |= (byte)(1 << (offset % 8));
+    return false;
+}
+
+static incr_state_t *
+incr_state_create(void)
+{
+    incr_state_t *incr = dr_global_alloc(sizeof(*incr));
+    memset(incr, 0, sizeof(*incr));
+    incr->lock = dr_mutex_create();
+    incr->dump_lock = dr_mutex_create();
+    drvector_init(&incr->bitmaps, 16, false/*!synch*/, delta_bitmap_free);
+    hashtable_init(&incr->unknown_starts, 8, HASH_INTPTR, false/*!strdup*/);
+    incr->last_dump_ms = dr_get_milliseconds();
+    return incr;
+}
+
+static void
+incr_state_destroy(incr_state_t *incr)
+{
+    drvector_delete(&incr->bitmaps);
+    hashtable_delete(&incr->unknown_starts);
+    if (incr->modbuf != NULL)
+        dr_global_free(incr->modbuf, incr->modbuf_size);
+    dr_mutex_destroy(incr->lock);
+    dr_mutex_destroy(incr->dump_lock);
+    dr_global_free(incr, sizeof(*incr));
+}
+
+/* Starts a new log file from scratch, keeping the coverage collected so far. */
+static void
+incr_state_reset_log(incr_state_t *incr)
+{
+    incr->num_dumped = 0;
+    incr->header_written = false;
+    incr->write_failed = false;
+    incr->modlist_len = 0;
+}
+
+static bool
+incr_write_record(file_t log, uint type, uint count, const void *payload,
+                  size_t payload_size)
+{
+    static const char padding[8];
+    drcov_record_t record;
+    size_t pad = ALIGN_FORWARD(payload_size, 8) - payload_size;
+    record.type = type;
+    record.count = count;
+    record.size = payload_size + pad;
+    if (dr_write_file(log, &record, sizeof(record)) != sizeof(record))
+        return false;
+    if (payload != NULL &&
+        dr_write_file(log, payload, payload_size) != (ssize_t)payload_size)
+        return false;
+    return pad == 0 || dr_write_file(log, padding, pad) == (ssize_t)pad;
+}
+
+/* Writes the module list if it gained entries since it was last written. */
+static bool
+incr_dump_modules(per_thread_t *data)
+{
+    incr_state_t *incr = data->incr;
+    size_t len;
+    drcovlib_status_t res;
+    while (true) {
+        if (incr->modbuf != NULL) {
+            res = drmodtrack_dump_buf(incr->modbuf, incr->modbuf_size, &len);
+            if (res == DRCOVLIB_SUCCESS)
+                break;
+            if (res != DRCOVLIB_ERROR_BUF_TOO_SMALL)
+                return false;
+            dr_global_free(incr->modbuf, incr->modbuf_size);
+        }
+        incr->modbuf_size = incr->modbuf_size == 0 ? 8192 : incr->modbuf_size * 2;
+        incr->modbuf = dr_global_alloc(incr->modbuf_size);
+    }
+    /* drmodtrack never removes or reorders entries, so an unchanged length
+     * means an unchanged list.
+     */
+    if (len == incr->modlist_len)
+        return true;
+    if (!incr_write_record(data->log, DRCOV_RECORD_MODULES, (uint)len,
+                           incr->modbuf, len))
+        return false;
+    incr->modlist_len = len;
+    return true;
+}
+
+static bool
+incr_dump_bbs(per_thread_t *data, ptr_uint_t end)
+{
+    incr_state_t *incr = data->incr;
+    bb_entry_t buf[256];
+    ptr_uint_t i, num = end - incr->num_dumped;
+    uint count = 0;
+    if (!incr_write_record(data->log, DRCOV_RECORD_BBS, (uint)num, NULL,
+                           /* bb_entry_t arrays need no padding */
+                           num * sizeof(bb_entry_t)))
+        return false;
+    for (i = incr->num_dumped; i < end; i++) {
+        buf[count++] = *(bb_entry_t *)drtable_get_entry(data->bb_table, i);
+        if (count == BUFFER_SIZE_ELEMENTS(buf) || i + 1 == end) {
+            if (dr_write_file(data->log, buf, count * sizeof(buf[0])) !=
+                (ssize_t)(count * sizeof(buf[0])))
+                return false;
+            count = 0;
+        }
+    }
+    return true;
+}
+
+/* Stops all further dumps to the log after a failed write. */
+static void
+incr_write_failed(per_thread_t *data)
+{
+    data->incr->write_failed = true;
+    NOTIFY(0, "drcovlib: failed to write to %s: no more coverage will be "
+           "dumped to it\n", data->logname);
+}
+
+/* Appends the blocks added since the previous dump.  Returns false if the log
+ * could not be written, now or by an earlier dump.  The caller must hold
+ * data->incr->dump_lock.
+ */
+static bool
+dump_drcov_delta(per_thread_t *data)
+{
+    incr_state_t *incr = data->incr;
+    ptr_uint_t end;
+    if (data->log == INVALID_FILE) {
+        ASSERT(false, "invalid log file");
+        return false;
+    }
+    if (incr->write_failed)
+        return false;
+    if (!incr->header_written) {
+        drcov_incr_header_t header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, DRCOV_INCR_MAGIC, sizeof(header.magic));
+        header.version = DRCOV_VERSION;
+        header.header_size = sizeof(header);
+        ASSERT(sizeof(DRCOV_FLAVOR) <= sizeof(header.flavor), "flavor too long");
+        memcpy(header.flavor, DRCOV_FLAVOR, sizeof(DRCOV_FLAVOR));
+        if (dr_write_file(data->log, &header, sizeof(header)) != sizeof(header)) {
+            incr_write_failed(data);
+            return false;
+        }
+        incr->header_written = true;
+    }
+    /* Every entry below end is complete as entries are filled in under the lock.
+     * The modules are dumped after this so they include every referenced id.
+     */
+    dr_mutex_lock(incr->lock);
+    end = drtable_num_entries(data->bb_table);
+    dr_mutex_unlock(incr->lock);
+    if (!incr_dump_modules(data) ||
+        (end > incr->num_dumped && !incr_dump_bbs(data, end))) {
+        incr_write_failed(data);
+        return false;
+    }
+    incr->num_dumped = end;
+    incr->last_dump_ms = dr_get_milliseconds();
+    return true;
+}
+
+/* Called after a new block is added: dumps if the interval has elapsed, unless
+ * a dump is already in progress.
+ */
+static void
+maybe_dump_periodically(per_thread_t *data)
+{
+    if (options.dump_interval_ms == 0 ||
+        dr_get_milliseconds() - data->incr->last_dump_ms < options.dump_interval_ms)
+        return;
+    if (dr_mutex_trylock(data->incr->dump_lock)) {
+        dump_drcov_delta(data);
+        dr_mutex_unlock(data->incr->dump_lock);
+    }
+}
+
+/****************************************************************************
+ * Hit Counts
+ */
+
+/* Module bytes per counter, and the most counters given to one module. */
+#define HIT_COUNTER_GRANULARITY 16
+#define HIT_COUNTERS_MAX (256*1024)
+
+/* With DRCOVLIB_HIT_COUNTS, each distinct block start in a module is given the
+ * next module-relative id when it is first built, and the block's inlined
+ * instrumentation increments counters[id] without any lock.
+ */
+typedef struct _hit_table_t {
+    hashtable_t ids;    /* module offset to id + 1 */
+    uint *counters;
+    uint num_ids;
+    uint capacity;      /* entries in counters */
+    size_t map_size;
+} hit_table_t;
+
+static void
+hit_table_free(void *ptr)
+{
+    hit_table_t *table = (hit_table_t *)ptr;
+    hashtable_delete(&table->ids);
+    if (table->counters != NULL)
+        dr_custom_free(NULL, DR_ALLOC_NON_HEAP | DR_ALLOC_CACHE_REACHABLE,
+                       table->counters, table->map_size);
+    dr_global_free(table, sizeof(*table));
+}
+
+static hit_table_t *
+hit_table_lookup(uint mod_id, app_pc mod_start, bool create)
+{
+    hit_table_t *table = drvector_get_entry(&hit_tables, mod_id);
+    module_data_t *mod;
+    if (table != NULL || !create)
+        return table;
+    table = dr_global_alloc(sizeof(*table));
+    hashtable_init(&table->ids, 8, HASH_INTPTR, false/*!strdup*/);
+    table->counters = NULL;
+    table->num_ids = 0;
+    table->capacity = 0;
+    table->map_size = 0;
+    mod = dr_lookup_module(mod_start);
+    if (mod != NULL) {
+        /* We provide one counter per HIT_COUNTER_GRANULARITY bytes of the
+         * module, up to HIT_COUNTERS_MAX.  As ids are dense, only the pages
+         * holding assigned ids are ever touched.  Ids go to distinct block
+         * starts, not disjoint blocks, so a module entered at many points within
+         * its blocks can run out: such blocks are not counted, and are tallied
+         * in hit_uncounted to be reported.
+         * The counters are updated with absolute memory references from the
+         * code cache, so on x64 they must be reachable from it.  That space is
+         * limited, which is why the array is sparser than the module's code.
+         */
+        size_t num = (mod->end - mod->start) / HIT_COUNTER_GRANULARITY;
+        if (num > HIT_COUNTERS_MAX)
+            num = HIT_COUNTERS_MAX;
+        table->map_size = ALIGN_FORWARD(num * sizeof(uint), dr_page_size());
+        table->counters =
+            dr_custom_alloc(NULL, DR_ALLOC_NON_HEAP | DR_ALLOC_CACHE_REACHABLE,
+                            table->map_size, DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+        if (table->counters != NULL)
+            table->capacity = (uint)(table->map_size / sizeof(uint));
+        dr_free_module_data(mod);
+    }
+    drvector_set_entry(&hit_tables, mod_id, table);
+    return table;
+}
+
+/* Returns the counter for the block at offset in module mod_id, or NULL if it
+ * is not counted.  If is_new is not NULL, a new block is assigned an id and
+ * *is_new says whether that happened.  The caller must hold hit_lock.
+ */
+static uint *
+hit_counter_lookup(uint mod_id, app_pc mod_start, uint offset, OUT bool *is_new)
+{
+    hit_table_t *table = hit_table_lookup(mod_id, mod_start, is_new != NULL);
+    ptr_uint_t id;
+    if (is_new != NULL)
+        *is_new = false;
+    if (table == NULL)
+        return NULL;
+    id = (ptr_uint_t)hashtable_lookup(&table->ids, (void *)(ptr_uint_t)offset);
+    if (id == 0) {
+        if (is_new == NULL)
+            return NULL;
+        id = ++table->num_ids;
+        hashtable_add(&table->ids, (void *)(ptr_uint_t)offset, (void *)id);
+        *is_new = true;
+        if (id - 1 >= table->capacity)
+            hit_uncounted++;
+    }
+    if (id - 1 >= table->capacity)
+        return NULL;
+    return &table->counters[id - 1];
+}
+
+/* Writes a count for each bb_table entry, in the same order. */
+static void
+hit_counts_print(per_thread_t *data)
+{
+    ptr_uint_t i, num = drtable_num_entries(data->bb_table);
+    uint buf[256];
+    uint count = 0;
+    dr_fprintf(data->log, "BB Hit Counts: %u bbs\n", (uint)num);
+    if (TEST(DRCOVLIB_DUMP_AS_TEXT, options.flags))
+        dr_fprintf(data->log, "module id, start, hits:\n");
+    dr_mutex_lock(hit_lock);
+    for (i = 0; i < num; i++) {
+        bb_entry_t *entry = (bb_entry_t *)drtable_get_entry(data->bb_table, i);
+        uint *counter = NULL;
+        if (entry->mod_id != UNKNOWN_MODULE_ID) {
+            counter = hit_counter_lookup(entry->mod_id, NULL, entry->start, NULL);
+        }
+        if (TEST(DRCOVLIB_DUMP_AS_TEXT, options.flags)) {
+            dr_fprintf(data->log, "module[%3u]: "PFX", %u\n", entry->mod_id,
+                       entry->start, counter == NULL ? 0 : *counter);
+            continue;
+        }
+        buf[count++] = counter == NULL ? 0 : *counter;
+        if (count == BUFFER_SIZE_ELEMENTS(buf) || i + 1 == num) {
+            dr_write_file(data->log, buf, count * sizeof(buf[0]));
+            count = 0;
+        }
+    }
+    if (hit_uncounted > 0) {
+        NOTIFY(0, "drcovlib: %u blocks exceeded their module's hit counters and "
+               "are reported as 0\n", hit_uncounted);
+    }
+    dr_mutex_unlock(hit_lock);
+}
+
 /****************************************************************************
  * BB Table Functions
  */
@@ -148,14 +550,47 @@ bb_table_print(void *drcontext, per_thread_t *data)
         drtable_dump_entries(data->bb_table, data->log);
 }
 
-static void
-bb_table_entry_add(void *drcontext, per_thread_t *data, app_pc start, uint size)
+/* Returns whether an entry was added.  For DRCOVLIB_HIT_COUNTS, returns the
+ * block's counter, if any, in counter.
+ */
+static bool
+bb_table_entry_add(void *drcontext, per_thread_t *data, app_pc start, uint size,
+                   OUT uint **counter)
 {
-    bb_entry_t *bb_entry = drtable_alloc(data->bb_table, 1, NULL);
+    bb_entry_t *bb_entry;
     uint mod_id;
     app_pc mod_start;
     drcovlib_status_t res = drmodtrack_lookup(drcontext, start, &mod_id, &mod_start);
-    /* we do not de-duplicate repeated bbs */
+    *counter = NULL;
+    if (TEST(DRCOVLIB_HIT_COUNTS, options.flags) && res == DRCOVLIB_SUCCESS) {
+        /* The counts tell how often a block ran, so each block has just one
+         * entry, which is matched with its counter when dumping.
+         */
+        bool is_new;
+        dr_mutex_lock(hit_lock);
+        *counter = hit_counter_lookup(mod_id, mod_start, (uint)(start - mod_start),
+                                      &is_new);
+        if (!is_new) {
+            dr_mutex_unlock(hit_lock);
+            return false;
+        }
+    }
+    if (data->incr != NULL) {
+        /* Incremental dumps are meant for long-running processes, where
+         * repeated bbs would make the log grow without bound, so we only
+         * record the first instance of each.
+         */
+        dr_mutex_lock(data->incr->lock);
+        if (res == DRCOVLIB_SUCCESS ?
+            delta_bitmap_test_and_set(data->incr, mod_id, mod_start,
+                                      (uint)(start - mod_start)) :
+            !hashtable_add(&data->incr->unknown_starts, start, (void *)start)) {
+            dr_mutex_unlock(data->incr->lock);
+            return false;
+        }
+    }
+    /* Otherwise, we do not de-duplicate repeated bbs */
+    bb_entry = drtable_alloc(data->bb_table, 1, NULL);
     ASSERT(size < USHRT_MAX, "size overflow");
     bb_entry->size = (ushort)size;
     if (res == DRCOVLIB_SUCCESS) {
@@ -172,6 +607,11 @@ bb_table_entry_add(void *drcontext, per_thread_t *data, app_pc start, uint size)
         bb_entry->mod_id = UNKNOWN_MODULE_ID;
         bb_entry->start  = (uint)(ptr_uint_t)start;
     }
+    if (data->incr != NULL)
+        dr_mutex_unlock(data->incr->lock);
+    if (TEST(DRCOVLIB_HIT_COUNTS, options.flags) && res == DRCOVLIB_SUCCESS)
+        dr_mutex_unlock(hit_lock);
+    return true;
 }
 
 #define INIT_BB_TABLE_ENTRIES 4096
@@ -203,20 +643,34 @@ version_print(file_t log)
     dr_fprintf(log, "DRCOV FLAVOR: %s\n", DRCOV_FLAVOR);
 }
 
-static void
+/* Returns false if an incremental dump failed to write. */
+static bool
 dump_drcov_data(void *drcontext, per_thread_t *data)
 {
+    if (data->incr != NULL) {
+        bool ok;
+        /* A per-thread copy of the global data has a stale log after a fork. */
+        if (!drcov_per_thread)
+            data = global_data;
+        dr_mutex_lock(data->incr->dump_lock);
+        ok = dump_drcov_delta(data);
+        dr_mutex_unlock(data->incr->dump_lock);
+        return ok;
+    }
     if (data->log == INVALID_FILE) {
         /* It is possible that failure on log file creation is caused by the
          * running process not having enough privilege, so this is not a
          * release-build fatal error
          */
         ASSERT(false, "invalid log file");
-        return;
+        return true;
     }
     version_print(data->log);
     drmodtrack_dump(data->log);
     bb_table_print(drcontext, data);
+    if (TEST(DRCOVLIB_HIT_COUNTS, options.flags))
+        hit_counts_print(data);
+    return true;
 }
 
 /****************************************************************************
@@ -249,6 +703,10 @@ thread_data_create(void *drcontext)
      * if so, no lock is required for bb_table operation.
      */
     data->bb_table = bb_table_create(drcontext == NULL ? true : false);
+    if (TEST(DRCOVLIB_DUMP_INCREMENTAL, options.flags))
+        data->incr = incr_state_create();
+    else
+        data->incr = NULL;
     log_file_create(drcontext, data);
     return data;
 }
@@ -258,6 +716,8 @@ thread_data_destroy(void *drcontext, per_thread_t *data)
 {
     /* destroy the bb table */
     bb_table_destroy(data->bb_table, data);
+    if (data->incr != NULL)
+        incr_state_destroy(data->incr);
     dr_close_file(data->log);
     /* free thread data */
     if (drcontext == NULL) {
@@ -329,10 +789,24 @@ event_basic_block_analysis(void *drcontext, void *tag, instrlist_t *bb,
     per_thread_t *data;
     instr_t *instr;
     app_pc tag_pc, start_pc, end_pc;
+    uint *counter;
 
-    /* do nothing for translation */
-    if (translating)
+    *user_data = NULL;
+    /* do nothing for translation, other than reproducing the hit counter update */
+    if (translating) {
+        uint mod_id;
+        app_pc mod_start;
+        tag_pc = dr_fragment_app_pc(tag);
+        if (TEST(DRCOVLIB_HIT_COUNTS, options.flags) &&
+            drmodtrack_lookup(drcontext, tag_pc, &mod_id, &mod_start) ==
+            DRCOVLIB_SUCCESS) {
+            dr_mutex_lock(hit_lock);
+            *user_data = hit_counter_lookup(mod_id, mod_start,
+                                            (uint)(tag_pc - mod_start), NULL);
+            dr_mutex_unlock(hit_lock);
+        }
         return DR_EMIT_DEFAULT;
+    }
 
     data = (per_thread_t *)drmgr_get_tls_field(drcontext, tls_idx);
     /* Collect the number of instructions and the basic block size,
@@ -367,7 +841,11 @@ event_basic_block_analysis(void *drcontext, void *tag, instrlist_t *bb,
      * 4. The duplication can be easily handled in a post-processing step,
      *    which is required anyway.
      */
-    bb_table_entry_add(drcontext, data, tag_pc, (uint)(end_pc - start_pc));
+    if (bb_table_entry_add(drcontext, data, tag_pc, (uint)(end_pc - start_pc),
+                           &counter) &&
+        data->incr != NULL)
+        maybe_dump_periodically(drcov_per_thread ? data : global_data);
+    *user_data = counter;
 
     if (go_native)
         return DR_EMIT_GO_NATIVE;
@@ -375,6 +853,24 @@ event_basic_block_analysis(void *drcontext, void *tag, instrlist_t *bb,
         return DR_EMIT_DEFAULT;
 }
 
+/* For DRCOVLIB_HIT_COUNTS, increments the block's counter on each execution. */
+static dr_emit_flags_t
+event_app_instruction(void *drcontext, void *tag, instrlist_t *bb, instr_t *instr,
+                      bool for_trace, bool translating, void *user_data)
+{
+    if (user_data == NULL || !drmgr_is_first_instr(drcontext, instr))
+        return DR_EMIT_DEFAULT;
+    /* The update is racy: we trade precision under contention for the absence
+     * of any lock or atomic operation, as in AFL.
+     */
+    if (!drx_insert_counter_update(drcontext, bb, instr,
+                                   SPILL_SLOT_MAX+1/*use drreg*/,
+                                   IF_NOT_X86_(SPILL_SLOT_MAX+1)
+                                   user_data, 1, 0))
+        ASSERT(false, "failed to insert hit counter update");
+    return DR_EMIT_DEFAULT;
+}
+
 static void
 event_thread_exit(void *drcontext)
 {
@@ -444,6 +940,9 @@ event_fork(void *drcontext)
 {
     if (!drcov_per_thread) {
         log_file_create(NULL, global_data);
+        /* The child's log must stand alone. */
+        if (global_data->incr != NULL)
+            incr_state_reset_log(global_data->incr);
     } else {
         per_thread_t *data = drmgr_get_tls_field(drcontext, tls_idx);
         if (data != NULL) {
@@ -483,11 +982,13 @@ drcovlib_dump(void *drcontext)
             return DRCOVLIB_ERROR_INVALID_PARAMETER;
         data = (per_thread_t *)drmgr_get_tls_field(drcontext, tls_idx);
         ASSERT(data != NULL, "data must not be NULL");
-        dump_drcov_data(drcontext, data);
+        if (!dump_drcov_data(drcontext, data))
+            return DRCOVLIB_ERROR;
     } else {
         if (drcov_per_thread)
             return DRCOVLIB_ERROR_INVALID_PARAMETER;
-        dump_drcov_data(drcontext, global_data);
+        if (!dump_drcov_data(drcontext, global_data))
+            return DRCOVLIB_ERROR;
     }
     return DRCOVLIB_SUCCESS;
 }
@@ -508,6 +1009,10 @@ drcovlib_exit(void)
 
     drmgr_unregister_tls_field(tls_idx);
 
+    if (TEST(DRCOVLIB_HIT_COUNTS, options.flags)) {
+        drvector_delete(&hit_tables);
+        dr_mutex_destroy(hit_lock);
+    }
     drx_exit();
     drmgr_exit();
 
@@ -544,16 +1049,24 @@ drcovlib_init(drcovlib_options_t *ops)
     if (count > 1)
         return DRCOVLIB_SUCCESS;
 
-    if (ops->struct_size != sizeof(options))
+    /* We accept the smaller struct from before dump_interval_ms was added. */
+    if (ops->struct_size < offsetof(drcovlib_options_t, dump_interval_ms) ||
+        ops->struct_size > sizeof(options))
+        return DRCOVLIB_ERROR_INVALID_PARAMETER;
+    if ((ops->flags & (~(DRCOVLIB_DUMP_AS_TEXT|DRCOVLIB_THREAD_PRIVATE|
+                         DRCOVLIB_DUMP_INCREMENTAL|DRCOVLIB_HIT_COUNTS))) != 0)
         return DRCOVLIB_ERROR_INVALID_PARAMETER;
-    if ((ops->flags & (~(DRCOVLIB_DUMP_AS_TEXT|DRCOVLIB_THREAD_PRIVATE))) != 0)
+    if (TESTALL(DRCOVLIB_DUMP_AS_TEXT|DRCOVLIB_DUMP_INCREMENTAL, ops->flags) ||
+        TESTALL(DRCOVLIB_HIT_COUNTS|DRCOVLIB_DUMP_INCREMENTAL, ops->flags) ||
+        TESTALL(DRCOVLIB_HIT_COUNTS|DRCOVLIB_THREAD_PRIVATE, ops->flags))
         return DRCOVLIB_ERROR_INVALID_PARAMETER;
     if (TEST(DRCOVLIB_THREAD_PRIVATE, ops->flags)) {
         if (!dr_using_all_private_caches())
             return DRCOVLIB_ERROR_INVALID_SETUP;
         drcov_per_thread = true;
     }
-    options = *ops;
+    memset(&options, 0, sizeof(options));
+    memcpy(&options, ops, ops->struct_size);
     if (options.logdir != NULL)
         dr_snprintf(logdir, BUFFER_SIZE_ELEMENTS(logdir), "%s", ops->logdir);
     else /* default */
@@ -563,8 +1076,26 @@ drcovlib_init(drcovlib_options_t *ops)
     if (options.native_until_thread > 0)
         go_native = true;
 
-    drmgr_init();
-    drx_init();
+    if (!drmgr_init())
+        return DRCOVLIB_ERROR;
+    if (!drx_init()) {
+        drmgr_exit();
+        return DRCOVLIB_ERROR;
+    }
+    tls_idx = drmgr_register_tls_field();
+    if (tls_idx == -1) {
+        drx_exit();
+        drmgr_exit();
+        return DRCOVLIB_ERROR;
+    }
+    if (TEST(DRCOVLIB_HIT_COUNTS, options.flags)) {
+        /* drx_init() has already initialized drreg with the slot that
+         * drx_insert_counter_update() needs for the arithmetic flags.
+         */
+        hit_uncounted = 0;
+        hit_lock = dr_mutex_create();
+        drvector_init(&hit_tables, 16, false/*!synch*/, hit_table_free);
+    }
 
     /* We follow a simple model of the caller requesting the coverage dump,
      * either via calling the exit routine, using its own soft_kills nudge, or
@@ -576,16 +1107,14 @@ drcovlib_init(drcovlib_options_t *ops)
 
     drmgr_register_thread_init_event(event_thread_init);
     drmgr_register_thread_exit_event(event_thread_exit);
-    drmgr_register_bb_instrumentation_event(event_basic_block_analysis, NULL, NULL);
+    drmgr_register_bb_instrumentation_event(event_basic_block_analysis,
+                                            TEST(DRCOVLIB_HIT_COUNTS, options.flags) ?
+                                            event_app_instruction : NULL, NULL);
     dr_register_filter_syscall_event(event_filter_syscall);
     drmgr_register_pre_syscall_event(event_pre_syscall);
 #ifdef UNIX
     dr_register_fork_init_event(event_fork);
 #endif
 
-    tls_idx = drmgr_register_tls_field();
-    if (tls_idx == -1)
-        return DRCOVLIB_ERROR;
-
     return event_init();
 }
@@ -78,6 +78,36 @@ typedef enum {
      * drcovlib's own thread exit events rather than in drcovlib_exit().
      */
     DRCOVLIB_THREAD_PRIVATE  = 0x0002,
+    /**
+     * Requests incremental dumping for long-running processes.  The log file
+     * starts with a #drcov_incr_header_t and each dump appends only the
+     * basic blocks that were first executed since the previous dump, plus the
+     * module list if it changed since then.  Each block is written only once,
+     * so drcovlib_dump() may be called any number of times.  Blocks outside
+     * any known module are de-duplicated by their start address.
+     * If a write to the log fails, nothing more is written to it, so that the
+     * partial record stays at the end where readers ignore it, and
+     * drcovlib_dump() returns #DRCOVLIB_ERROR.
+     * Blocks are also dumped periodically if \p dump_interval_ms is set in
+     * #drcovlib_options_t.  This flag cannot be combined with
+     * #DRCOVLIB_DUMP_AS_TEXT.
+     */
+    DRCOVLIB_DUMP_INCREMENTAL = 0x0004,
+    /**
+     * Requests execution counts in addition to coverage.  Each distinct basic
+     * block is given a module-relative id when it is first built, and inlined
+     * instrumentation increments the id's slot in a per-module counter array
+     * on every execution, without any lock.  The increments are not atomic, so
+     * under contention a few counts may be lost.  The log file then holds each
+     * block only once, and the BB table is followed by "BB Hit Counts: N bbs"
+     * and a 32-bit count for each entry of the BB table, in the same order.
+     * Each module has one counter per 16 bytes of its size, up to 256K
+     * counters; in the rare case of more distinct block starts than that, the
+     * extra blocks are reported with a count of 0.
+     * This flag cannot be combined with #DRCOVLIB_DUMP_INCREMENTAL or
+     * #DRCOVLIB_THREAD_PRIVATE.
+     */
+    DRCOVLIB_HIT_COUNTS       = 0x0008,
 } drcovlib_flags_t;
 
 /** Specifies the options when initializing drcovlib. */
@@ -97,6 +127,14 @@ typedef struct _drcovlib_options_t {
      * option, is created.  This option only works under Windows.
      */
     int native_until_thread;
+    /**
+     * With #DRCOVLIB_DUMP_INCREMENTAL, newly executed blocks are dumped once
+     * at least this many milliseconds have passed since the previous dump.
+     * The check happens when a new block is built, so blocks can stay
+     * unwritten until the next new block, the next drcovlib_dump() call, or
+     * drcovlib_exit().  A value of 0 disables periodic dumps.
+     */
+    uint dump_interval_ms;
 } drcovlib_options_t;
 
 /***************************************************************************
@@ -137,6 +175,47 @@ typedef struct _bb_entry_t {
     ushort mod_id;
 } bb_entry_t;
 
+/**
+ * The magic string that starts an incremental log file.  It is not
+ * null-terminated in the file.
+ */
+#define DRCOV_INCR_MAGIC "DRCOVINC"
+
+/**
+ * The header at the start of an incremental log file.
+ * Incremental log files (#DRCOVLIB_DUMP_INCREMENTAL) contain no text headers:
+ * they start with this header, which is followed by a sequence of
+ * records.  Each record is a #drcov_record_t followed by its payload, which is
+ * padded to a multiple of 8 bytes so that every record and every bb_entry_t
+ * array is naturally aligned when the file is mapped.
+ * A #DRCOV_RECORD_MODULES payload is a null-terminated module list as written
+ * by drmodtrack_dump(); the mod_id fields of the bb_entry_t elements in later
+ * #DRCOV_RECORD_BBS records index into the most recent such list.  Each
+ * module list contains every entry of the previous one, at the same index.
+ * A reader should stop at a truncated final record, which is what a process
+ * killed in the middle of a dump leaves behind.
+ */
+typedef struct _drcov_incr_header_t {
+    char magic[8];     /**< #DRCOV_INCR_MAGIC, without its null. */
+    uint version;      /**< The file format version, DRCOV_VERSION. */
+    uint header_size;  /**< sizeof(#drcov_incr_header_t). */
+    char flavor[16];   /**< DRCOV_FLAVOR, null-padded. */
+} drcov_incr_header_t;
+
+/** The type of a #drcov_record_t in an incremental log file. */
+typedef enum {
+    DRCOV_RECORD_MODULES = 1, /**< The payload is a module list. */
+    DRCOV_RECORD_BBS     = 2, /**< The payload is an array of bb_entry_t. */
+} drcov_record_type_t;
+
+/** The header of each record in an incremental log file. */
+typedef struct _drcov_record_t {
+    uint type;   /**< A #drcov_record_type_t. */
+    /** The module list length including its null, or the number of bbs. */
+    uint count;
+    uint64 size; /**< The size in bytes of the padded payload after this header. */
+} drcov_record_t;
+
 /***************************************************************************
  * Coverage interface
  */
@@ -196,6 +275,10 @@ DR_EXPORT
  * information will be dumped to the log files.  Thus, this routine should only
  * be called when the regular dump will not occur.
  *
+ * The exception is #DRCOVLIB_DUMP_INCREMENTAL, where this routine only appends
+ * the blocks executed since the previous dump and can be called at any time,
+ * e.g., from a nudge handler in a long-running process.
+ *
  * @return whether successful or an error code on failure.
  */
 drcovlib_status_t
@@ -129,6 +129,16 @@ static reg_id_t tls_seg;
 static uint stats_max_slot;
 #endif
 
+/* Counters for drreg_get_stats(), updated atomically. */
+static int stats_reg_spills;
+static int stats_reg_restores;
+static int stats_aflags_spills;
+static int stats_aflags_restores;
+static int stats_trace_reg_pairs;
+static int stats_trace_aflags_pairs;
+
+static bool trace_event_registered;
+
 static drreg_status_t
 drreg_restore_reg_now(void *drcontext, instrlist_t *ilist, instr_t *inst,
                       per_thread_t *pt, reg_id_t reg);
@@ -197,6 +207,7 @@ spill_reg(void *drcontext, per_thread_t *pt, reg_id_t reg, uint slot,
         dr_spill_slot_t DR_slot = (dr_spill_slot_t)(slot - ops.num_spill_slots);
         dr_save_reg(drcontext, ilist, where, reg, DR_slot);
     }
+    dr_atomic_add32_return_sum(&stats_reg_spills, 1);
 #ifdef DEBUG
     if (slot > stats_max_slot)
         stats_max_slot = slot; /* racy but that's ok */
@@ -224,6 +235,7 @@ restore_reg(void *drcontext, per_thread_t *pt, reg_id_t reg, uint slot,
         dr_spill_slot_t DR_slot = (dr_spill_slot_t)(slot - ops.num_spill_slots);
         dr_restore_reg(drcontext, ilist, where, reg, DR_slot);
     }
+    dr_atomic_add32_return_sum(&stats_reg_restores, 1);
 }
 
 static reg_t
@@ -252,6 +264,20 @@ drreg_max_slots_used(OUT uint *max)
 #endif
 }
 
+drreg_status_t
+drreg_get_stats(OUT drreg_stats_t *stats)
+{
+    if (stats == NULL || stats->struct_size != sizeof(*stats))
+        return DRREG_ERROR_INVALID_PARAMETER;
+    stats->reg_spills = (uint) stats_reg_spills;
+    stats->reg_restores = (uint) stats_reg_restores;
+    stats->aflags_spills = (uint) stats_aflags_spills;
+    stats->aflags_restores = (uint) stats_aflags_restores;
+    stats->trace_reg_pairs_removed = (uint) stats_trace_reg_pairs;
+    stats->trace_aflags_pairs_removed = (uint) stats_trace_aflags_pairs;
+    return DRREG_SUCCESS;
+}
+
 /***************************************************************************
  * ANALYSIS AND CROSS-APP-INSTR
  */
@@ -1199,6 +1225,7 @@ drreg_spill_aflags(void *drcontext, instrlist_t *ilist, instr_t *where, per_thre
     pt->reg[DR_REG_XAX-DR_REG_START_GPR].native = false;
     pt->reg[DR_REG_XAX-DR_REG_START_GPR].ever_spilled = true;
     pt->aflags.xchg = DR_REG_XAX;
+    dr_atomic_add32_return_sum(&stats_aflags_spills, 1);
 
 #elif defined(AARCHXX)
     drreg_status_t res = DRREG_SUCCESS;
@@ -1211,6 +1238,7 @@ drreg_spill_aflags(void *drcontext, instrlist_t *ilist, instr_t *where, per_thre
     res = drreg_unreserve_register(drcontext, ilist, where, scratch);
     if (res != DRREG_SUCCESS)
         return res; /* XXX: undo already-inserted instrs? */
+    dr_atomic_add32_return_sum(&stats_aflags_spills, 1);
 #endif
     return DRREG_SUCCESS;
 }
@@ -1266,6 +1294,7 @@ drreg_restore_aflags(void *drcontext, instrlist_t *ilist, instr_t *where,
             == REG_LIVE)
             restore_reg(drcontext, pt, DR_REG_XAX, temp_slot, ilist, where, true);
     }
+    dr_atomic_add32_return_sum(&stats_aflags_restores, 1);
 #elif defined(AARCHXX)
     drreg_status_t res = DRREG_SUCCESS;
     reg_id_t scratch;
@@ -1277,6 +1306,7 @@ drreg_restore_aflags(void *drcontext, instrlist_t *ilist, instr_t *where,
     res = drreg_unreserve_register(drcontext, ilist, where, scratch);
     if (res != DRREG_SUCCESS)
         return res; /* XXX: undo already-inserted instrs? */
+    dr_atomic_add32_return_sum(&stats_aflags_restores, 1);
 #endif
     return DRREG_SUCCESS;
 }
@@ -1416,6 +1446,268 @@ drreg_restore_app_aflags(void *drcontext, instrlist_t *ilist, instr_t *where)
     return res;
 }
 
+/***************************************************************************
+ * TRACE OPTIMIZATION
+ */
+
+/* Each block in a trace was instrumented on its own, so a register reserved
+ * on both sides of a block boundary is restored at the end of one block and
+ * spilled again at the start of the next.  Once the blocks are stitched into
+ * a trace, the boundary is no longer an exit, and if nothing in between needs
+ * the app value we drop both.  The app value then stays in its slot across
+ * the gap, which is exactly what drreg_event_restore_state() sees when it
+ * decodes the trace (no restore clears the spilled slot, and for aflags no
+ * sahf clears aflags_in_xax), so fault translation needs no extra state.
+ */
+
+/* Returns whether inst is a spill or restore to one of our raw TLS slots. */
+static bool
+is_raw_slot_spill_or_restore(void *drcontext, instr_t *inst, bool *spill OUT,
+                             reg_id_t *reg OUT, uint *slot OUT)
+{
+    bool tls;
+    uint offs;
+    if (!instr_is_meta(inst) ||
+        !instr_is_reg_spill_or_restore(drcontext, inst, &tls, spill, reg, &offs) ||
+        !tls || offs < tls_slot_offs ||
+        offs >= tls_slot_offs + ops.num_spill_slots*sizeof(reg_t))
+        return false;
+    *slot = (offs - tls_slot_offs) / sizeof(reg_t);
+    return true;
+}
+
+static bool
+is_raw_slot_spill_or_restore_of(void *drcontext, instr_t *inst, bool spill,
+                                reg_id_t reg, uint slot)
+{
+    bool is_spill;
+    reg_id_t inst_reg;
+    uint inst_slot;
+    return is_raw_slot_spill_or_restore(drcontext, inst, &is_spill, &inst_reg,
+                                        &inst_slot) &&
+        is_spill == spill && inst_reg == reg && inst_slot == slot;
+}
+
+static bool
+instr_refs_raw_slot(void *drcontext, instr_t *inst, uint slot)
+{
+    opnd_t slot_opnd = dr_raw_tls_opnd(drcontext, tls_seg,
+                                       tls_slot_offs + slot*sizeof(reg_t));
+    int i;
+    for (i = 0; i < instr_num_srcs(inst); i++) {
+        opnd_t opnd = instr_get_src(inst, i);
+        if (opnd_is_memory_reference(opnd) && opnd_same_address(opnd, slot_opnd))
+            return true;
+    }
+    for (i = 0; i < instr_num_dsts(inst); i++) {
+        opnd_t opnd = instr_get_dst(inst, i);
+        if (opnd_is_memory_reference(opnd) && opnd_same_address(opnd, slot_opnd))
+            return true;
+    }
+    return false;
+}
+
+/* Returns whether control cannot leave the trace or enter DR at inst.  The
+ * direct jumps and calls that joined two blocks stay inside the trace; any
+ * other app cti is an exit, and a meta cti may be a clean call that looks at
+ * the machine state.
+ */
+static bool
+stays_in_trace(instr_t *inst)
+{
+    if (instr_is_cti(inst)) {
+        return instr_is_app(inst) &&
+            (instr_is_ubr(inst) || instr_is_call_direct(inst));
+    }
+    return !instr_is_syscall(inst) && !instr_is_interrupt(inst);
+}
+
+/* Returns the respill of reg to slot matching the restore "restore", if
+ * nothing in between uses reg or slot or leaves the trace.
+ */
+static instr_t *
+find_trace_respill(void *drcontext, instr_t *restore, reg_id_t reg, uint slot)
+{
+    instr_t *inst;
+    for (inst = instr_get_next(restore); inst != NULL; inst = instr_get_next(inst)) {
+        if (is_raw_slot_spill_or_restore_of(drcontext, inst, true, reg, slot))
+            return inst;
+        if (!stays_in_trace(inst) || instr_uses_reg(inst, reg) ||
+            instr_refs_raw_slot(drcontext, inst, slot))
+            return NULL;
+    }
+    return NULL;
+}
+
+/* Returns whether reg is written before it is read after where, without
+ * leaving the trace.  Dropping a restore-and-respill pair leaves a stale
+ * value in reg after the respill, so the tool must overwrite it first.
+ */
+static bool
+trace_reg_dead_after(instr_t *where, reg_id_t reg)
+{
+    instr_t *inst;
+    for (inst = instr_get_next(where); inst != NULL; inst = instr_get_next(inst)) {
+        if (instr_is_cti(inst) || !stays_in_trace(inst))
+            return false;
+        /* DRi#1849: COND_SRCS here includes addressing regs in dsts */
+        if (instr_reads_from_reg(inst, reg, DR_QUERY_INCLUDE_COND_SRCS))
+            return false;
+        if (instr_writes_to_exact_reg(inst, reg, DR_QUERY_DEFAULT))
+            return true;
+        if (instr_writes_to_reg(inst, reg, DR_QUERY_INCLUDE_ALL))
+            return false;
+    }
+    return false;
+}
+
+static void
+remove_trace_instr(void *drcontext, instrlist_t *trace, instr_t *inst)
+{
+    if (inst == NULL)
+        return;
+    instrlist_remove(trace, inst);
+    instr_destroy(drcontext, inst);
+}
+
+#ifdef X86
+/* Removes "[cmp al,-127]; sahf; [restore xax]" ... "[spill xax]; lahf; [seto al]"
+ * where the flags and xax are left alone in between, as produced by
+ * drreg_restore_aflags() and drreg_spill_aflags() with the flags kept in xax.
+ * Afterward xax still holds exactly what the lahf and seto would have put there.
+ * The caller must ensure the flags are in xax at sahf.  Returns whether the
+ * pair was removed and sets *next to the instruction to resume from.
+ */
+static bool
+remove_trace_aflags_pair(void *drcontext, instrlist_t *trace, instr_t *sahf,
+                         bool translating, instr_t **next OUT)
+{
+    instr_t *cmp = instr_get_prev(sahf), *xax_restore = instr_get_next(sahf);
+    instr_t *xax_spill = NULL, *lahf = NULL, *seto = NULL, *inst;
+    bool spill;
+    reg_id_t reg;
+    uint slot = 0;
+    *next = instr_get_next(sahf);
+    if (cmp != NULL &&
+        (!instr_is_meta(cmp) || instr_get_opcode(cmp) != OP_cmp ||
+         !opnd_is_reg(instr_get_src(cmp, 0)) ||
+         opnd_get_reg(instr_get_src(cmp, 0)) != DR_REG_AL ||
+         !opnd_is_immed_int(instr_get_src(cmp, 1)) ||
+         opnd_get_immed_int(instr_get_src(cmp, 1)) != -127))
+        cmp = NULL;
+    if (xax_restore != NULL &&
+        (!is_raw_slot_spill_or_restore(drcontext, xax_restore, &spill, &reg, &slot) ||
+         spill || reg != DR_REG_XAX))
+        xax_restore = NULL;
+    for (inst = instr_get_next(xax_restore == NULL ? sahf : xax_restore);
+         inst != NULL; inst = instr_get_next(inst)) {
+        if (xax_restore != NULL &&
+            is_raw_slot_spill_or_restore_of(drcontext, inst, true, DR_REG_XAX, slot)) {
+            xax_spill = inst;
+            lahf = instr_get_next(inst);
+            break;
+        }
+        if (xax_restore == NULL && instr_is_meta(inst) &&
+            instr_get_opcode(inst) == OP_lahf) {
+            lahf = inst;
+            break;
+        }
+        if (!stays_in_trace(inst) || instr_uses_reg(inst, DR_REG_XAX) ||
+            (xax_restore != NULL && instr_refs_raw_slot(drcontext, inst, slot)) ||
+            TESTANY(EFLAGS_READ_ARITH | EFLAGS_WRITE_ARITH,
+                    instr_get_eflags(inst, DR_QUERY_INCLUDE_ALL)))
+            return false;
+    }
+    if (lahf == NULL || !instr_is_meta(lahf) || instr_get_opcode(lahf) != OP_lahf)
+        return false;
+    seto = instr_get_next(lahf);
+    if (seto != NULL &&
+        (!instr_is_meta(seto) || instr_get_opcode(seto) != OP_seto))
+        seto = NULL;
+    /* The flags in xax must be in the same form on both sides. */
+    if ((cmp == NULL) != (seto == NULL))
+        return false;
+    LOG(drcontext, LOG_ALL, 3, "%s: removing aflags restore @"PFX" and respill @"PFX
+        "\n", __FUNCTION__, instr_get_app_pc(sahf), instr_get_app_pc(lahf));
+    *next = instr_get_next(xax_restore == NULL ? sahf : xax_restore);
+    if (*next == xax_spill || *next == lahf)
+        *next = instr_get_next(seto == NULL ? lahf : seto);
+    remove_trace_instr(drcontext, trace, cmp);
+    remove_trace_instr(drcontext, trace, sahf);
+    remove_trace_instr(drcontext, trace, xax_restore);
+    remove_trace_instr(drcontext, trace, xax_spill);
+    remove_trace_instr(drcontext, trace, lahf);
+    remove_trace_instr(drcontext, trace, seto);
+    if (!translating)
+        dr_atomic_add32_return_sum(&stats_trace_aflags_pairs, 1);
+    return true;
+}
+#endif
+
+static dr_emit_flags_t
+drreg_event_trace(void *drcontext, void *tag, instrlist_t *trace, bool translating)
+{
+    instr_t *inst, *next, *respill;
+    bool spill;
+    reg_id_t reg;
+    uint slot;
+#ifdef X86
+    bool aflags_in_xax = false;
+#endif
+    /* As in drreg_event_bb_analysis(), we give up on internal control flow:
+     * a jump could bypass a restore we would otherwise pair up.
+     */
+    for (inst = instrlist_first(trace); inst != NULL; inst = instr_get_next(inst)) {
+        if (instr_is_cti(inst) && opnd_is_instr(instr_get_target(inst)))
+            return DR_EMIT_DEFAULT;
+    }
+#ifdef X86
+    /* The aflags pass goes first: it also owns the xax restore and respill
+     * around the flags, which the register pass would reject as xax is
+     * partially written by the lahf right after its respill.  We follow
+     * drreg_event_restore_state()'s notion of the flags being in xax, so that
+     * it still finds them there across each removed gap.
+     */
+    for (inst = instrlist_first(trace); inst != NULL; inst = next) {
+        bool tls;
+        uint offs;
+        next = instr_get_next(inst);
+        if (instr_is_reg_spill_or_restore(drcontext, inst, &tls, &spill, &reg, &offs)) {
+            if (reg == DR_REG_XAX)
+                aflags_in_xax = false;
+        } else if (instr_is_meta(inst) && instr_get_opcode(inst) == OP_lahf) {
+            instr_t *prev = instr_get_prev(inst);
+            aflags_in_xax = prev != NULL &&
+                is_raw_slot_spill_or_restore(drcontext, prev, &spill, &reg, &slot) &&
+                spill && reg == DR_REG_XAX;
+        } else if (aflags_in_xax && instr_is_meta(inst) &&
+                   instr_get_opcode(inst) == OP_sahf) {
+            if (!remove_trace_aflags_pair(drcontext, trace, inst, translating, &next))
+                aflags_in_xax = false;
+        }
+    }
+#endif
+    for (inst = instrlist_first(trace); inst != NULL; inst = next) {
+        next = instr_get_next(inst);
+        if (!is_raw_slot_spill_or_restore(drcontext, inst, &spill, &reg, &slot) ||
+            spill || slot == AFLAGS_SLOT)
+            continue;
+        respill = find_trace_respill(drcontext, inst, reg, slot);
+        if (respill == NULL || !trace_reg_dead_after(respill, reg))
+            continue;
+        LOG(drcontext, LOG_ALL, 3, "%s: removing %s restore @"PFX" and respill @"PFX
+            "\n", __FUNCTION__, get_register_name(reg), instr_get_app_pc(inst),
+            instr_get_app_pc(respill));
+        if (next == respill)
+            next = instr_get_next(respill);
+        remove_trace_instr(drcontext, trace, inst);
+        remove_trace_instr(drcontext, trace, respill);
+        if (!translating)
+            dr_atomic_add32_return_sum(&stats_trace_reg_pairs, 1);
+    }
+    return DR_EMIT_DEFAULT;
+}
+
 /***************************************************************************
  * RESTORE STATE
  */
@@ -1671,6 +1963,17 @@ drreg_init(drreg_options_t *ops_in)
         ops.error_callback == NULL)
         ops.error_callback = ops_in->error_callback;
 
+    /* If anyone wants traces optimized, then optimize them. */
+    if (ops_in->struct_size > offsetof(drreg_options_t, optimize_traces))
+        ops.optimize_traces = ops.optimize_traces || ops_in->optimize_traces;
+    /* We only register for traces on request, as a trace event makes DR hand
+     * every trace to clients and then re-mangle it.
+     */
+    if (ops.optimize_traces && !trace_event_registered) {
+        dr_register_trace_event(drreg_event_trace);
+        trace_event_registered = true;
+    }
+
     if (prior_slots > 0) {
         if (!dr_raw_tls_cfree(tls_slot_offs, prior_slots))
             return DRREG_ERROR;
@@ -1698,6 +2001,11 @@ drreg_exit(void)
         !drmgr_unregister_bb_instrumentation_event(drreg_event_bb_analysis) ||
         !drmgr_unregister_restore_state_ex_event(drreg_event_restore_state))
         return DRREG_ERROR;
+    if (trace_event_registered) {
+        if (!dr_unregister_trace_event(drreg_event_trace))
+            return DRREG_ERROR;
+        trace_event_registered = false;
+    }
 
     drmgr_exit();
 
@@ -167,6 +167,25 @@ typedef struct _drreg_options_t {
      * needed.
      */
     bool do_not_sum_slots;
+    /**
+     * Each basic block is instrumented on its own, so a register or the
+     * arithmetic flags reserved on both sides of a block boundary are
+     * restored at the end of one block and spilled again at the start of
+     * the next.  When this flag is set, drreg examines each trace once its
+     * constituent blocks have been stitched together and removes such
+     * restore-and-respill pairs wherever nothing in between needs the
+     * application value: there is no trace exit, system call, clean call,
+     * or application instruction reading the register or flags.  The
+     * application value stays in its spill slot across the gap and is
+     * recovered from there on a fault.  Only spills to drreg's own TLS
+     * slots are considered.  On x86, only arithmetic flags that drreg keeps
+     * in xax are handled.  Tools that insert their own instrumentation from
+     * a trace event should not set this flag.
+     *
+     * If multiple drreg_init() calls are made, this field is combined by
+     * logical OR.
+     */
+    bool optimize_traces;
 } drreg_options_t;
 
 DR_EXPORT
@@ -208,6 +227,51 @@ DR_EXPORT
 drreg_status_t
 drreg_max_slots_used(OUT uint *max);
 
+/** Counters returned by drreg_get_stats(). */
+typedef struct _drreg_stats_t {
+    /** Set this to the size of this structure. */
+    size_t struct_size;
+    /**
+     * The number of general-purpose register spills inserted, including
+     * moves of the arithmetic flags into their dedicated slot.
+     */
+    uint reg_spills;
+    /**
+     * The number of general-purpose register restores inserted, including
+     * moves of the arithmetic flags out of their dedicated slot.
+     */
+    uint reg_restores;
+    /** The number of arithmetic flags spills inserted. */
+    uint aflags_spills;
+    /** The number of arithmetic flags restores inserted. */
+    uint aflags_restores;
+    /**
+     * The number of register restore-and-respill pairs removed from traces
+     * by drreg_options_t.optimize_traces.
+     */
+    uint trace_reg_pairs_removed;
+    /**
+     * The number of arithmetic flags restore-and-respill pairs removed from
+     * traces by drreg_options_t.optimize_traces.
+     */
+    uint trace_aflags_pairs_removed;
+} drreg_stats_t;
+
+DR_EXPORT
+/**
+ * Returns counts of the spills and restores that drreg has inserted so far,
+ * summed over all threads, and of those removed from traces.  These are
+ * counts of inserted instrumentation rather than of dynamic executions, and
+ * they include instrumentation re-created for state translation.  This can
+ * help a user to gauge the effect of drreg_options_t.optimize_traces.
+ *
+ * @param[out] stats  The counters are written here.  The caller must set
+ *   its \p struct_size field.
+ * @return whether successful or an error code on failure.
+ */
+drreg_status_t
+drreg_get_stats(OUT drreg_stats_t *stats);
+
 /***************************************************************************
  * ARITHMETIC FLAGS
  */
@@ -364,6 +364,99 @@ drx_buf_t *
 drx_buf_create_trace_buffer(size_t buffer_size,
                             drx_buf_full_cb_t full_cb);
 
+/**
+ * What the application thread does when an asynchronous trace buffer fills up
+ * and all of its thread's buffers are still waiting for the worker threads.
+ * See drx_buf_create_async_trace_buffer().
+ */
+typedef enum {
+    /** Wait for a worker thread to return a buffer. */
+    DRX_BUF_ASYNC_BLOCK,
+    /** Discard the contents of the full buffer and reuse it. */
+    DRX_BUF_ASYNC_DROP,
+    /**
+     * Wait for a worker thread on every
+     * drx_buf_async_options_t.sample_interval-th such occasion and discard
+     * the full buffer on the others.
+     */
+    DRX_BUF_ASYNC_SAMPLE,
+} drx_buf_async_policy_t;
+
+/** Options for drx_buf_create_async_trace_buffer(). */
+typedef struct _drx_buf_async_options_t {
+    /** Set this to the size of this structure. */
+    size_t struct_size;
+    /** The number of buffers to allocate for each thread.  Must be at least 2. */
+    uint num_buffers;
+    /** The number of worker threads that call the full callback.  Must be at least 1. */
+    uint num_workers;
+    /** What to do when a thread has no free buffer left. */
+    drx_buf_async_policy_t policy;
+    /** For #DRX_BUF_ASYNC_SAMPLE, how often to wait rather than discard. */
+    uint sample_interval;
+} drx_buf_async_options_t;
+
+/** Per-thread counters returned by drx_buf_get_async_stats(). */
+typedef struct _drx_buf_async_stats_t {
+    /** Set this to the size of this structure. */
+    size_t struct_size;
+    /** The number of full buffers handed to a worker thread. */
+    uint64 buffers_flushed;
+    /** The number of full buffers discarded by the back-pressure policy. */
+    uint64 buffers_dropped;
+    /** The number of times the thread waited for a free buffer. */
+    uint64 stalls;
+    /** The total time in microseconds spent waiting for a free buffer. */
+    uint64 stall_us;
+    /** The longest single wait in microseconds for a free buffer. */
+    uint64 max_stall_us;
+    /**
+     * The total time in microseconds from handing a buffer to a worker
+     * thread until its full callback returned.
+     */
+    uint64 flush_latency_us;
+    /** The longest such time in microseconds for a single buffer. */
+    uint64 max_flush_latency_us;
+} drx_buf_async_stats_t;
+
+DR_EXPORT
+/**
+ * Initializes the drx_buf extension with a trace buffer whose full callback
+ * runs on worker threads rather than on the application thread.  Each thread
+ * gets \p ops->num_buffers buffers of \p buffer_size bytes.  When one fills
+ * up, it is queued for a worker and the thread carries on with a free buffer,
+ * subject to \p ops->policy when none is left.  Buffers from one thread are
+ * always handled by the same worker, in the order they were filled, but
+ * buffers from different threads are handled concurrently, so \p full_cb must
+ * be thread-safe.
+ *
+ * \p full_cb is passed the drcontext of the thread that filled the buffer.  It
+ * may be used to identify that thread or read its drmgr TLS fields, but not to
+ * allocate memory or otherwise act on the thread's behalf.  It must not create
+ * or free drx_buf buffers.  At thread exit, drx_buf waits for the thread's
+ * queued buffers and then calls \p full_cb for the final partial buffer on the
+ * exiting thread itself.
+ *
+ * \note Requires that the worker threads can be created with
+ * dr_create_client_thread().
+ *
+ * \return NULL if unsuccessful, a valid opaque struct pointer if successful.
+ */
+drx_buf_t *
+drx_buf_create_async_trace_buffer(size_t buffer_size, drx_buf_full_cb_t full_cb,
+                                  drx_buf_async_options_t *ops);
+
+DR_EXPORT
+/**
+ * Retrieves the counters of the thread \p drcontext for an asynchronous
+ * trace buffer created with drx_buf_create_async_trace_buffer().
+ * The caller must set \p stats->struct_size.
+ * \return whether successful.
+ */
+bool
+drx_buf_get_async_stats(void *drcontext, drx_buf_t *buf,
+                        drx_buf_async_stats_t *stats OUT);
+
 DR_EXPORT
 /** Cleans up the buffer associated with \p buf. \returns whether successful. */
 bool
@@ -409,6 +502,72 @@ drx_buf_insert_buf_store(void *drcontext, drx_buf_t *buf, instrlist_t *ilist,
                          instr_t *where, reg_id_t buf_ptr, reg_id_t scratch,
                          opnd_t opnd, opnd_size_t opsz, short offset);
 
+/**
+ * Describes one field of a fixed-layout record stored by
+ * drx_buf_insert_buf_store_record().
+ */
+typedef struct _drx_buf_field_t {
+    /** The register or immediate integer operand to store. */
+    opnd_t opnd;
+    /** The size of the field: \p OPSZ_1, \p OPSZ_2, \p OPSZ_4 or \p OPSZ_8. */
+    opnd_size_t opsz;
+    /** The offset of the field from the start of the record. */
+    short offset;
+} drx_buf_field_t;
+
+DR_EXPORT
+/**
+ * Inserts instructions to store the \p num_fields fields described by \p
+ * fields as one record at \p offset bytes from \p buf_ptr.  The fields must
+ * be sorted by increasing offset and must not overlap.  Rather than emitting
+ * one store per field, as a series of drx_buf_insert_buf_store() calls would,
+ * this combines adjacent immediate fields into a single wider store and, on
+ * AArch64, adjacent register fields of the same size into a single store pair.
+ * \return whether successful.
+ *
+ * The buffer pointer is not updated.  Passing the running size of the records
+ * stored so far as \p offset allows all of the records for a basic block to be
+ * followed by a single drx_buf_insert_update_buf_ptr().  If such a block
+ * overflows a trace buffer partway through, the records it already stored are
+ * not lost: they are moved to the start of the buffer once it is flushed, along
+ * with the buffer pointer register.  The overflow fault is only caught when
+ * each store lands within one page of the buffer end, however, so a block that
+ * stores more than a page of records must first call
+ * drx_buf_insert_check_space().
+ *
+ * \note \p scratch is required on ARM and AArch64 when any field is an
+ * immediate.
+ *
+ * \note As with drx_buf_insert_buf_store(), make sure that \p where has a
+ * translation set.
+ */
+bool
+drx_buf_insert_buf_store_record(void *drcontext, drx_buf_t *buf, instrlist_t *ilist,
+                                instr_t *where, reg_id_t buf_ptr, reg_id_t scratch,
+                                const drx_buf_field_t *fields, uint num_fields,
+                                short offset);
+
+DR_EXPORT
+/**
+ * Inserts instructions to make sure that there are at least \p size bytes
+ * left in a trace or circular buffer past \p buf_ptr, using a single compare
+ * and branch.  If there are not, the buffer is flushed as though it had
+ * overflowed, with the full callback called for a trace buffer, and \p
+ * buf_ptr is reloaded with the reset buffer pointer.  This lets a block store
+ * more than a page of records with a single pointer update, which the
+ * overflow fault used by default cannot detect.  \return whether successful.
+ * This is not supported for the fast circular buffer, or on ARM and AArch64
+ * when \p size is larger than 255.
+ *
+ * \note The arithmetic flags must be dead or reserved at \p where, and \p
+ * scratch is clobbered.  The check assumes the buffer has not been replaced
+ * through drx_buf_set_buffer_ptr() with memory of a different extent.
+ */
+bool
+drx_buf_insert_check_space(void *drcontext, drx_buf_t *buf, instrlist_t *ilist,
+                           instr_t *where, reg_id_t buf_ptr, reg_id_t scratch,
+                           ushort size);
+
 DR_EXPORT
 /**
  * Retrieves a pointer to the top of the buffer, that is, returns the
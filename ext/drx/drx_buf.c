@@ -46,6 +46,10 @@
 
 #define TLS_SLOT(tls_base, offs) (void **)((byte *)(tls_base)+(offs))
 #define BUF_PTR(tls_base, offs) *(byte **) TLS_SLOT(tls_base, offs)
+/* The second raw TLS slot holds the end of the buffer, for explicit space checks */
+#define BUF_END_OFFS(offs) ((offs) + sizeof(void *))
+#define BUF_END(tls_base, offs) *(byte **) TLS_SLOT(tls_base, BUF_END_OFFS(offs))
+#define NUM_TLS_SLOTS 2
 
 #define MINSERT instrlist_meta_preinsert
 
@@ -56,11 +60,15 @@ typedef enum {
     DRX_BUF_TRACE
 } drx_buf_type_t;
 
+struct _async_thread_t;
+struct _async_pool_t;
+
 typedef struct {
     byte  *seg_base;
     byte  *cli_base;   /* the base of the buffer from the client's perspective */
     byte  *buf_base;   /* the actual base of the buffer */
     size_t total_size; /* the actual size of the buffer */
+    struct _async_thread_t *async; /* NULL unless an async trace buffer */
 } per_thread_t;
 
 struct _drx_buf_t {
@@ -72,8 +80,51 @@ struct _drx_buf_t {
     int      tls_idx;
     uint     tls_offs;
     reg_id_t tls_seg;
+    /* worker pool, for async trace buffers only */
+    struct _async_pool_t *async;
 };
 
+/* One of the buffers pre-allocated for a thread of an async trace buffer. */
+typedef struct _async_chunk_t {
+    byte  *cli_base;
+    byte  *buf_base;
+    size_t total_size;
+    size_t used;         /* the size passed to the full callback */
+    uint64 queue_time;   /* when it was handed to a worker, in microseconds */
+    struct _async_chunk_t *next; /* in a free list or a worker queue */
+    struct _async_thread_t *owner;
+} async_chunk_t;
+
+typedef struct _async_worker_t {
+    drx_buf_t *buf;
+    async_chunk_t *head, *tail;
+    void *work_ready; /* signaled when a chunk is queued or on exit */
+    void *done;       /* signaled once the worker has returned */
+    bool exit;
+} async_worker_t;
+
+/* All fields of the pool and of its threads' async_thread_t are protected
+ * by the pool lock.  A chunk is touched only by its owner thread while it is
+ * current and only by its worker while it is queued.
+ */
+typedef struct _async_pool_t {
+    drx_buf_async_options_t ops;
+    void *lock;
+    async_worker_t *workers;
+    uint next_worker; /* round-robin assignment of threads to workers */
+} async_pool_t;
+
+typedef struct _async_thread_t {
+    void *drcontext; /* of the owning thread, passed to the full callback */
+    async_worker_t *worker;
+    async_chunk_t *cur;
+    async_chunk_t *free_list;
+    uint in_flight;  /* chunks handed to the worker and not yet returned */
+    uint exhausted;  /* times the free list was empty, for DRX_BUF_ASYNC_SAMPLE */
+    void *chunk_returned; /* signaled when the worker returns a chunk */
+    drx_buf_async_stats_t stats;
+} async_thread_t;
+
 /* global rwlock to lock against updates to the clients vector */
 static void *global_buf_rwlock;
 /* holds per-client (also per-buf) information */
@@ -86,10 +137,13 @@ bool drx_buf_init_library(void);
 void drx_buf_exit_library(void);
 
 static drx_buf_t *drx_buf_init(drx_buf_type_t bt, size_t bsz,
-                               drx_buf_full_cb_t full_cb);
+                               drx_buf_full_cb_t full_cb, async_pool_t *async);
 
 static per_thread_t *per_thread_init_2byte(void *drcontext, drx_buf_t *buf);
 static per_thread_t *per_thread_init_fault(void *drcontext, drx_buf_t *buf);
+static per_thread_t *per_thread_init_async(void *drcontext, drx_buf_t *buf);
+static void per_thread_exit_async(void *drcontext, drx_buf_t *buf, per_thread_t *data);
+static void flush_buffer(void *drcontext, drx_buf_t *buf, per_thread_t *data);
 
 static void drx_buf_insert_update_buf_ptr_2byte(void *drcontext, drx_buf_t *buf,
                                                 instrlist_t *ilist, instr_t *where,
@@ -112,8 +166,8 @@ static dr_signal_action_t signal_event(void *drcontext, dr_siginfo_t *info);
 #endif
 
 static reg_id_t deduce_buf_ptr(instr_t *instr);
-static bool reset_buf_ptr(void *drcontext, dr_mcontext_t *raw_mcontext, byte *seg_base,
-                          byte *cli_base, drx_buf_t *buf);
+static bool reset_buf_ptr(void *drcontext, dr_mcontext_t *raw_mcontext,
+                          per_thread_t *data, drx_buf_t *buf);
 static bool fault_event_helper(void *drcontext, byte *target,
                                dr_mcontext_t *raw_mcontext);
 
@@ -174,7 +228,7 @@ drx_buf_create_circular_buffer(size_t buf_size)
     /* We can optimize circular buffers that are this size */
     drx_buf_type_t buf_type = (buf_size == DRX_BUF_FAST_CIRCULAR_BUFSZ) ?
         DRX_BUF_CIRCULAR_FAST : DRX_BUF_CIRCULAR;
-    return drx_buf_init(buf_type, buf_size, NULL);
+    return drx_buf_init(buf_type, buf_size, NULL, NULL);
 }
 
 DR_EXPORT
@@ -182,12 +236,123 @@ drx_buf_t *
 drx_buf_create_trace_buffer(size_t buf_size,
                             drx_buf_full_cb_t full_cb)
 {
-    return drx_buf_init(DRX_BUF_TRACE, buf_size, full_cb);
+    return drx_buf_init(DRX_BUF_TRACE, buf_size, full_cb, NULL);
+}
+
+static void
+async_worker_main(void *arg)
+{
+    async_worker_t *worker = (async_worker_t *) arg;
+    async_pool_t *pool = worker->buf->async;
+
+    dr_mutex_lock(pool->lock);
+    while (true) {
+        async_chunk_t *chunk = worker->head;
+        async_thread_t *owner;
+        uint64 latency;
+        if (chunk == NULL) {
+            if (worker->exit)
+                break;
+            /* The event is only signaled with the lock held, so resetting it
+             * here cannot lose a wakeup.
+             */
+            dr_event_reset(worker->work_ready);
+            dr_mutex_unlock(pool->lock);
+            dr_event_wait(worker->work_ready);
+            dr_mutex_lock(pool->lock);
+            continue;
+        }
+        worker->head = chunk->next;
+        if (worker->head == NULL)
+            worker->tail = NULL;
+        owner = chunk->owner;
+        dr_mutex_unlock(pool->lock);
+
+        (*worker->buf->full_cb)(owner->drcontext, chunk->cli_base, chunk->used);
+        latency = dr_get_microseconds() - chunk->queue_time;
+
+        dr_mutex_lock(pool->lock);
+        owner->stats.flush_latency_us += latency;
+        if (latency > owner->stats.max_flush_latency_us)
+            owner->stats.max_flush_latency_us = latency;
+        chunk->next = owner->free_list;
+        owner->free_list = chunk;
+        owner->in_flight--;
+        dr_event_signal(owner->chunk_returned);
+    }
+    dr_mutex_unlock(pool->lock);
+    dr_event_signal(worker->done);
+}
+
+/* Stops the first num_started workers and frees the pool. */
+static void
+async_pool_destroy(async_pool_t *pool, uint num_started)
+{
+    uint i;
+    for (i = 0; i < num_started; i++) {
+        async_worker_t *worker = &pool->workers[i];
+        dr_mutex_lock(pool->lock);
+        worker->exit = true;
+        dr_event_signal(worker->work_ready);
+        dr_mutex_unlock(pool->lock);
+        dr_event_wait(worker->done);
+    }
+    for (i = 0; i < pool->ops.num_workers; i++) {
+        dr_event_destroy(pool->workers[i].work_ready);
+        dr_event_destroy(pool->workers[i].done);
+    }
+    dr_global_free(pool->workers, pool->ops.num_workers * sizeof(*pool->workers));
+    dr_mutex_destroy(pool->lock);
+    dr_global_free(pool, sizeof(*pool));
+}
+
+DR_EXPORT
+drx_buf_t *
+drx_buf_create_async_trace_buffer(size_t buf_size, drx_buf_full_cb_t full_cb,
+                                  drx_buf_async_options_t *ops)
+{
+    async_pool_t *pool;
+    drx_buf_t *buf;
+    uint i;
+
+    if (full_cb == NULL || ops == NULL || ops->struct_size != sizeof(*ops) ||
+        ops->num_buffers < 2 || ops->num_workers == 0 ||
+        (ops->policy == DRX_BUF_ASYNC_SAMPLE && ops->sample_interval == 0))
+        return NULL;
+
+    pool = dr_global_alloc(sizeof(*pool));
+    memset(pool, 0, sizeof(*pool));
+    pool->ops = *ops;
+    pool->lock = dr_mutex_create();
+    pool->workers = dr_global_alloc(ops->num_workers * sizeof(*pool->workers));
+    memset(pool->workers, 0, ops->num_workers * sizeof(*pool->workers));
+    for (i = 0; i < ops->num_workers; i++) {
+        pool->workers[i].work_ready = dr_event_create();
+        pool->workers[i].done = dr_event_create();
+    }
+
+    /* The pool must be in place before the buffer is visible to thread init. */
+    buf = drx_buf_init(DRX_BUF_TRACE, buf_size, full_cb, pool);
+    if (buf == NULL) {
+        async_pool_destroy(pool, 0);
+        return NULL;
+    }
+    for (i = 0; i < ops->num_workers; i++) {
+        pool->workers[i].buf = buf;
+        if (!dr_create_client_thread(async_worker_main, &pool->workers[i])) {
+            /* drx_buf_free() would stop all of them */
+            async_pool_destroy(pool, i);
+            buf->async = NULL;
+            drx_buf_free(buf);
+            return NULL;
+        }
+    }
+    return buf;
 }
 
 static drx_buf_t *
 drx_buf_init(drx_buf_type_t bt, size_t bsz,
-             drx_buf_full_cb_t full_cb)
+             drx_buf_full_cb_t full_cb, async_pool_t *async)
 {
     drx_buf_t *new_client;
     int        tls_idx;
@@ -195,7 +360,7 @@ drx_buf_init(drx_buf_type_t bt, size_t bsz,
     reg_id_t   tls_seg;
 
     /* allocate raw TLS so we can access it from the code cache */
-    if (!dr_raw_tls_calloc(&tls_seg, &tls_offs, 1, 0))
+    if (!dr_raw_tls_calloc(&tls_seg, &tls_offs, NUM_TLS_SLOTS, 0))
         return NULL;
 
     tls_idx = drmgr_register_tls_field();
@@ -210,6 +375,7 @@ drx_buf_init(drx_buf_type_t bt, size_t bsz,
     new_client->tls_seg = tls_seg;
     new_client->tls_idx = tls_idx;
     new_client->full_cb = full_cb;
+    new_client->async = async;
     dr_rwlock_write_lock(global_buf_rwlock);
     /* We don't attempt to re-use NULL entries (presumably which
      * have already been freed), for simplicity.
@@ -241,8 +407,10 @@ drx_buf_free(drx_buf_t *buf)
     dr_rwlock_write_unlock(global_buf_rwlock);
 
     if (!drmgr_unregister_tls_field(buf->tls_idx) ||
-        !dr_raw_tls_cfree(buf->tls_offs, 1))
+        !dr_raw_tls_cfree(buf->tls_offs, NUM_TLS_SLOTS))
         return false;
+    if (buf->async != NULL)
+        async_pool_destroy(buf->async, buf->async->ops.num_workers);
     dr_global_free(buf, sizeof(*buf));
 
     return true;
@@ -279,6 +447,24 @@ drx_buf_get_buffer_size(void *drcontext, drx_buf_t *buf)
     return buf->buf_size;
 }
 
+DR_EXPORT
+bool
+drx_buf_get_async_stats(void *drcontext, drx_buf_t *buf,
+                        drx_buf_async_stats_t *stats OUT)
+{
+    per_thread_t *data;
+    if (buf == NULL || buf->async == NULL || stats == NULL ||
+        stats->struct_size != sizeof(*stats))
+        return false;
+    data = drmgr_get_tls_field(drcontext, buf->tls_idx);
+    if (data == NULL || data->async == NULL)
+        return false;
+    dr_mutex_lock(buf->async->lock);
+    *stats = data->async->stats;
+    dr_mutex_unlock(buf->async->lock);
+    return true;
+}
+
 void
 event_thread_init(void *drcontext)
 {
@@ -290,10 +476,13 @@ event_thread_init(void *drcontext)
         if (buf != NULL) {
             if (buf->buf_type == DRX_BUF_CIRCULAR_FAST)
                 data = per_thread_init_2byte(drcontext, buf);
+            else if (buf->async != NULL)
+                data = per_thread_init_async(drcontext, buf);
             else
                 data = per_thread_init_fault(drcontext, buf);
             drmgr_set_tls_field(drcontext, buf->tls_idx, data);
             BUF_PTR(data->seg_base, buf->tls_offs) = data->cli_base;
+            BUF_END(data->seg_base, buf->tls_offs) = data->cli_base + buf->buf_size;
         }
     }
     dr_rwlock_read_unlock(global_buf_rwlock);
@@ -309,12 +498,20 @@ event_thread_exit(void *drcontext)
         if (buf != NULL) {
             per_thread_t *data = drmgr_get_tls_field(drcontext, buf->tls_idx);
             byte *cli_ptr = BUF_PTR(data->seg_base, buf->tls_offs);
-            /* buffer has not yet been deleted, call user callback(s) */
-            if (buf->full_cb != NULL) {
-                (*buf->full_cb)(drcontext, data->cli_base,
-                             (size_t)(cli_ptr - data->cli_base));
+            /* This may wait for a worker thread with the lock held.  Workers
+             * never acquire it, so that only delays drx_buf_free() and buffer
+             * creation, which is rare enough that we keep the walk simple.
+             */
+            if (data->async != NULL)
+                per_thread_exit_async(drcontext, buf, data);
+            else {
+                /* buffer has not yet been deleted, call user callback(s) */
+                if (buf->full_cb != NULL) {
+                    (*buf->full_cb)(drcontext, data->cli_base,
+                                    (size_t)(cli_ptr - data->cli_base));
+                }
+                dr_raw_mem_free(data->buf_base, data->total_size);
             }
-            dr_raw_mem_free(data->buf_base, data->total_size);
             dr_thread_free(drcontext, data, sizeof(per_thread_t));
         }
     }
@@ -339,37 +536,202 @@ per_thread_init_2byte(void *drcontext, drx_buf_t *buf)
                            NULL);
     per_thread->buf_base = ret;
     per_thread->cli_base = (void *) ALIGN_FORWARD(ret, buf->buf_size);
+    per_thread->async = NULL;
     return per_thread;
 }
 
-static per_thread_t *
-per_thread_init_fault(void *drcontext, drx_buf_t *buf)
+/* Returns the client base of a new buffer of buf->buf_size bytes that ends
+ * right before a read-only page.
+ */
+static byte *
+alloc_fault_buffer(drx_buf_t *buf, byte **buf_base OUT, size_t *total_size OUT)
 {
     size_t page_size = dr_page_size();
-    per_thread_t *per_thread = dr_thread_alloc(drcontext, sizeof(per_thread_t));
     byte *ret;
     bool ok;
-    /* Keep seg_base in a per-thread data structure so we can get the TLS
-     * slot and find where the pointer points to in the buffer.
-     */
-    per_thread->seg_base = dr_get_dr_segment_base(buf->tls_seg);
     /* We construct a buffer right before a fault by allocating as
      * many pages as needed to fit the buffer, plus another read-only
      * page. Then, we return an address such that we have exactly
      * buf_size bytes usable before we hit the ro page.
      */
-    per_thread->total_size = ALIGN_FORWARD(buf->buf_size, page_size) + page_size;
-    ret = dr_raw_mem_alloc(per_thread->total_size,
+    *total_size = ALIGN_FORWARD(buf->buf_size, page_size) + page_size;
+    ret = dr_raw_mem_alloc(*total_size,
                            DR_MEMPROT_READ | DR_MEMPROT_WRITE,
                            NULL);
-    ok = dr_memory_protect(ret + per_thread->total_size - page_size,
+    ok = dr_memory_protect(ret + *total_size - page_size,
                            page_size, DR_MEMPROT_READ);
     DR_ASSERT(ok);
-    per_thread->buf_base = ret;
-    per_thread->cli_base = ret + ALIGN_FORWARD(buf->buf_size, page_size) - buf->buf_size;
+    *buf_base = ret;
+    return ret + ALIGN_FORWARD(buf->buf_size, page_size) - buf->buf_size;
+}
+
+static per_thread_t *
+per_thread_init_fault(void *drcontext, drx_buf_t *buf)
+{
+    per_thread_t *per_thread = dr_thread_alloc(drcontext, sizeof(per_thread_t));
+    /* Keep seg_base in a per-thread data structure so we can get the TLS
+     * slot and find where the pointer points to in the buffer.
+     */
+    per_thread->seg_base = dr_get_dr_segment_base(buf->tls_seg);
+    per_thread->cli_base = alloc_fault_buffer(buf, &per_thread->buf_base,
+                                              &per_thread->total_size);
+    per_thread->async = NULL;
     return per_thread;
 }
 
+static void
+async_use_chunk(per_thread_t *data, async_chunk_t *chunk)
+{
+    data->async->cur = chunk;
+    data->cli_base = chunk->cli_base;
+    data->buf_base = chunk->buf_base;
+    data->total_size = chunk->total_size;
+}
+
+static per_thread_t *
+per_thread_init_async(void *drcontext, drx_buf_t *buf)
+{
+    async_pool_t *pool = buf->async;
+    per_thread_t *per_thread = dr_thread_alloc(drcontext, sizeof(per_thread_t));
+    async_thread_t *at = dr_thread_alloc(drcontext, sizeof(*at));
+    async_chunk_t *chunk;
+    uint i;
+
+    memset(at, 0, sizeof(*at));
+    at->drcontext = drcontext;
+    at->chunk_returned = dr_event_create();
+    at->stats.struct_size = sizeof(at->stats);
+    for (i = 0; i < pool->ops.num_buffers; i++) {
+        chunk = dr_thread_alloc(drcontext, sizeof(*chunk));
+        memset(chunk, 0, sizeof(*chunk));
+        chunk->cli_base = alloc_fault_buffer(buf, &chunk->buf_base, &chunk->total_size);
+        chunk->owner = at;
+        chunk->next = at->free_list;
+        at->free_list = chunk;
+    }
+    dr_mutex_lock(pool->lock);
+    /* A thread sticks to one worker so its buffers are flushed in order. */
+    at->worker = &pool->workers[pool->next_worker++ % pool->ops.num_workers];
+    chunk = at->free_list;
+    at->free_list = chunk->next;
+    dr_mutex_unlock(pool->lock);
+
+    per_thread->seg_base = dr_get_dr_segment_base(buf->tls_seg);
+    per_thread->async = at;
+    async_use_chunk(per_thread, chunk);
+    return per_thread;
+}
+
+static void
+per_thread_exit_async(void *drcontext, drx_buf_t *buf, per_thread_t *data)
+{
+    async_pool_t *pool = buf->async;
+    async_thread_t *at = data->async;
+    byte *cli_ptr = BUF_PTR(data->seg_base, buf->tls_offs);
+    async_chunk_t *chunk, *next;
+
+    /* Let the worker finish our queued buffers first so the callback sees them
+     * in order.  Client threads are only suspended after the process exit
+     * event (i#297), so this does not hang when the process exits.
+     */
+    dr_mutex_lock(pool->lock);
+    while (at->in_flight > 0) {
+        dr_event_reset(at->chunk_returned);
+        dr_mutex_unlock(pool->lock);
+        dr_event_wait(at->chunk_returned);
+        dr_mutex_lock(pool->lock);
+    }
+    dr_mutex_unlock(pool->lock);
+
+    (*buf->full_cb)(drcontext, data->cli_base, (size_t)(cli_ptr - data->cli_base));
+    at->cur->next = at->free_list;
+    for (chunk = at->cur; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        dr_raw_mem_free(chunk->buf_base, chunk->total_size);
+        dr_thread_free(drcontext, chunk, sizeof(*chunk));
+    }
+    dr_event_destroy(at->chunk_returned);
+    dr_thread_free(drcontext, at, sizeof(*at));
+}
+
+/* Hands the current chunk to the thread's worker and switches to a free one,
+ * applying the back-pressure policy when there is none.  If the contents are
+ * dropped instead, the current chunk is simply reused.
+ */
+static void
+async_flush_buffer(drx_buf_t *buf, per_thread_t *data, size_t used)
+{
+    async_pool_t *pool = buf->async;
+    async_thread_t *at = data->async;
+    async_worker_t *worker = at->worker;
+    async_chunk_t *chunk = at->cur;
+
+    dr_mutex_lock(pool->lock);
+    if (at->free_list == NULL) {
+        at->exhausted++;
+        if (pool->ops.policy == DRX_BUF_ASYNC_DROP ||
+            (pool->ops.policy == DRX_BUF_ASYNC_SAMPLE &&
+             at->exhausted % pool->ops.sample_interval != 0)) {
+            at->stats.buffers_dropped++;
+            dr_mutex_unlock(pool->lock);
+            return;
+        }
+    }
+    chunk->used = used;
+    chunk->queue_time = dr_get_microseconds();
+    chunk->next = NULL;
+    if (worker->tail == NULL)
+        worker->head = chunk;
+    else
+        worker->tail->next = chunk;
+    worker->tail = chunk;
+    at->in_flight++;
+    at->stats.buffers_flushed++;
+    dr_event_signal(worker->work_ready);
+
+    if (at->free_list == NULL) {
+        uint64 start = dr_get_microseconds(), stall;
+        while (at->free_list == NULL) {
+            dr_event_reset(at->chunk_returned);
+            dr_mutex_unlock(pool->lock);
+            dr_event_wait(at->chunk_returned);
+            dr_mutex_lock(pool->lock);
+        }
+        stall = dr_get_microseconds() - start;
+        at->stats.stalls++;
+        at->stats.stall_us += stall;
+        if (stall > at->stats.max_stall_us)
+            at->stats.max_stall_us = stall;
+    }
+    chunk = at->free_list;
+    at->free_list = chunk->next;
+    dr_mutex_unlock(pool->lock);
+    async_use_chunk(data, chunk);
+}
+
+/* Hands the filled part of the buffer to the full callback and resets the
+ * buffer pointer, as is done on overflow.
+ */
+static void
+flush_buffer(void *drcontext, drx_buf_t *buf, per_thread_t *data)
+{
+    byte *cli_ptr = BUF_PTR(data->seg_base, buf->tls_offs);
+    byte *cli_base = data->cli_base;
+
+    if (data->async != NULL) {
+        async_flush_buffer(buf, data, (size_t)(cli_ptr - cli_base));
+        BUF_PTR(data->seg_base, buf->tls_offs) = data->cli_base;
+        BUF_END(data->seg_base, buf->tls_offs) = data->cli_base + buf->buf_size;
+        return;
+    }
+    /* We set the buffer pointer before the callback so it's easier
+     * for the user to override it in the callback.
+     */
+    BUF_PTR(data->seg_base, buf->tls_offs) = cli_base;
+    if (buf->full_cb != NULL)
+        (*buf->full_cb)(drcontext, cli_base, (size_t)(cli_ptr - cli_base));
+}
+
 DR_EXPORT
 void
 drx_buf_insert_load_buf_ptr(void *drcontext, drx_buf_t *buf, instrlist_t *ilist,
@@ -650,6 +1012,151 @@ drx_buf_insert_buf_store(void *drcontext, drx_buf_t *buf, instrlist_t *ilist,
     }
 }
 
+/* Returns the low size bytes of val */
+static ptr_uint_t
+field_bits(ptr_int_t val, uint size)
+{
+    if (size >= sizeof(ptr_uint_t))
+        return (ptr_uint_t)val;
+    return (ptr_uint_t)val & (((ptr_uint_t)1 << (size * 8)) - 1);
+}
+
+DR_EXPORT
+bool
+drx_buf_insert_buf_store_record(void *drcontext, drx_buf_t *buf, instrlist_t *ilist,
+                                instr_t *where, reg_id_t buf_ptr, reg_id_t scratch,
+                                const drx_buf_field_t *fields, uint num_fields,
+                                short offset)
+{
+    uint i, j;
+    for (i = 0; i < num_fields; i = j) {
+        const drx_buf_field_t *field = &fields[i];
+        short rec_offs = offset + field->offset;
+#ifdef AARCH64
+        uint size = opnd_size_in_bytes(field->opsz);
+#endif
+        if (i > 0 && field->offset < fields[i-1].offset +
+            (short)opnd_size_in_bytes(fields[i-1].opsz))
+            return false;
+        j = i + 1;
+        if (opnd_is_immed_int(field->opnd)) {
+            /* Combine a run of adjacent immediates into one little-endian store
+             * whose size is a power of two no larger than a pointer.
+             */
+            ptr_uint_t val = 0;
+            uint len = 0;
+            uint k;
+            for (k = i; k < num_fields && opnd_is_immed_int(fields[k].opnd) &&
+                     fields[k].offset == field->offset + (short)len; k++) {
+                uint fsize = opnd_size_in_bytes(fields[k].opsz);
+                uint new_len = len + fsize;
+                if (new_len > sizeof(reg_t) || (new_len & (new_len - 1)) != 0)
+                    break;
+                val |= field_bits(opnd_get_immed_int(fields[k].opnd), fsize) << (len * 8);
+                len += fsize;
+            }
+            if (k > i + 1) {
+                ptr_int_t sval = (ptr_int_t)val;
+                opnd_size_t opsz = opnd_size_from_bytes(len);
+                if (len < sizeof(ptr_int_t)) {
+                    /* sign-extend so the immediate fits its store size */
+                    uint shift = (sizeof(ptr_int_t) - len) * 8;
+                    sval = (ptr_int_t)(val << shift) >> shift;
+                }
+                if (!drx_buf_insert_buf_store(drcontext, buf, ilist, where, buf_ptr,
+                                              scratch, opnd_create_immed_int(sval, opsz),
+                                              opsz, rec_offs))
+                    return false;
+                j = k;
+                continue;
+            }
+        }
+#ifdef AARCH64
+        /* Two adjacent registers of the same size become a single stp */
+        if (opnd_is_reg(field->opnd) && i + 1 < num_fields &&
+            (size == 4 || size == 8) && opnd_is_reg(fields[i+1].opnd) &&
+            fields[i+1].opsz == field->opsz &&
+            fields[i+1].offset == field->offset + (short)size &&
+            rec_offs % (short)size == 0 &&
+            rec_offs >= -64 * (short)size && rec_offs < 64 * (short)size) {
+            instr_t *instr = INSTR_CREATE_stp
+                (drcontext,
+                 opnd_create_base_disp(buf_ptr, DR_REG_NULL, 0, rec_offs,
+                                       size == 8 ? OPSZ_16 : OPSZ_8),
+                 opnd_create_reg(reg_resize_to_opsz(opnd_get_reg(field->opnd),
+                                                    field->opsz)),
+                 opnd_create_reg(reg_resize_to_opsz(opnd_get_reg(fields[i+1].opnd),
+                                                    field->opsz)));
+            INSTR_XL8(instr, instr_get_app_pc(where));
+            MINSERT(ilist, where, instr);
+            j = i + 2;
+            continue;
+        }
+#endif
+        if (!drx_buf_insert_buf_store(drcontext, buf, ilist, where, buf_ptr, scratch,
+                                      field->opnd, field->opsz, rec_offs))
+            return false;
+    }
+    return true;
+}
+
+/* Called when drx_buf_insert_check_space() finds too little room left: flushes
+ * the buffer just like an overflow fault would.
+ */
+static void
+flush_for_space(drx_buf_t *buf)
+{
+    void *drcontext = dr_get_current_drcontext();
+    per_thread_t *data = drmgr_get_tls_field(drcontext, buf->tls_idx);
+    flush_buffer(drcontext, buf, data);
+}
+
+DR_EXPORT
+bool
+drx_buf_insert_check_space(void *drcontext, drx_buf_t *buf, instrlist_t *ilist,
+                           instr_t *where, reg_id_t buf_ptr, reg_id_t scratch,
+                           ushort size)
+{
+    instr_t *skip;
+    if (buf->buf_type == DRX_BUF_CIRCULAR_FAST)
+        return false;
+#ifdef AARCHXX
+    /* keep the compare immediate encodable */
+    if (size > 255)
+        return false;
+#endif
+    skip = INSTR_CREATE_label(drcontext);
+#ifdef X86
+    MINSERT(ilist, where, INSTR_CREATE_lea
+            (drcontext,
+             opnd_create_reg(scratch),
+             opnd_create_base_disp(buf_ptr, DR_REG_NULL, 0, size, OPSZ_lea)));
+    MINSERT(ilist, where, XINST_CREATE_cmp
+            (drcontext,
+             opnd_create_reg(scratch),
+             opnd_create_far_base_disp(buf->tls_seg, DR_REG_NULL, DR_REG_NULL, 0,
+                                       BUF_END_OFFS(buf->tls_offs), OPSZ_PTR)));
+    MINSERT(ilist, where, XINST_CREATE_jump_cond
+            (drcontext, DR_PRED_BE, opnd_create_instr(skip)));
+#elif defined(AARCHXX)
+    dr_insert_read_raw_tls(drcontext, ilist, where, buf->tls_seg,
+                           BUF_END_OFFS(buf->tls_offs), scratch);
+    MINSERT(ilist, where, XINST_CREATE_sub
+            (drcontext, opnd_create_reg(scratch), opnd_create_reg(buf_ptr)));
+    MINSERT(ilist, where, XINST_CREATE_cmp
+            (drcontext, opnd_create_reg(scratch), OPND_CREATE_INT16(size)));
+    MINSERT(ilist, where, XINST_CREATE_jump_cond
+            (drcontext, DR_PRED_CS, opnd_create_instr(skip)));
+#else
+# error NYI
+#endif
+    dr_insert_clean_call(drcontext, ilist, where, (void *)flush_for_space, false, 1,
+                         OPND_CREATE_INTPTR(buf));
+    drx_buf_insert_load_buf_ptr(drcontext, buf, ilist, where, buf_ptr);
+    MINSERT(ilist, where, skip);
+    return true;
+}
+
 static void
 insert_load(void *drcontext, instrlist_t *ilist, instr_t *where, reg_id_t dst,
             reg_id_t src, opnd_size_t opsz)
@@ -697,11 +1204,8 @@ safe_memcpy(drx_buf_t *buf, void *src, size_t len)
     /* try to perform a safe memcpy */
     if (!dr_safe_write(cli_ptr, len, src, NULL)) {
         /* we overflowed the client buffer, so flush it and try again */
-        byte *cli_base = data->cli_base;
-        BUF_PTR(data->seg_base, buf->tls_offs) = cli_base;
-        if (buf->full_cb != NULL)
-            (*buf->full_cb)(drcontext, cli_base, (size_t)(cli_ptr - cli_base));
-        memcpy(cli_base, src, len);
+        flush_buffer(drcontext, buf, data);
+        memcpy(data->cli_base, src, len);
     }
 }
 
@@ -765,7 +1269,8 @@ deduce_buf_ptr(instr_t *instr)
     /* drx_buf will only emit these instructions to store a value */
     if (IF_X86_ELSE(opcode == OP_mov_st, opcode == OP_str  ||
                                          opcode == OP_strb ||
-                                         opcode == OP_strh)) {
+                                         opcode == OP_strh
+                                         IF_AARCH64(|| opcode == OP_stp))) {
         int i;
         for (i = 0; i < instr_num_dsts(instr); ++i) {
             opnd_t dst = instr_get_dst(instr, i);
@@ -786,12 +1291,15 @@ deduce_buf_ptr(instr_t *instr)
 
 /* returns true if we won't intercept the fault, false otherwise */
 static bool
-reset_buf_ptr(void *drcontext, dr_mcontext_t *raw_mcontext, byte *seg_base,
-              byte *cli_base, drx_buf_t *buf)
+reset_buf_ptr(void *drcontext, dr_mcontext_t *raw_mcontext, per_thread_t *data,
+              drx_buf_t *buf)
 {
     instr_t *instr;
     reg_id_t buf_ptr;
-    app_pc tmp_base;
+    byte *cli_ptr = BUF_PTR(data->seg_base, buf->tls_offs);
+    byte *cli_end = data->cli_base + buf->buf_size;
+    byte *ptr_val, *new_ptr, *tail = NULL;
+    size_t tail_size = 0;
 
     /* decode the instruction to extract the base register */
     instr = instr_create(drcontext);
@@ -801,17 +1309,33 @@ reset_buf_ptr(void *drcontext, dr_mcontext_t *raw_mcontext, byte *seg_base,
     if (buf_ptr == DR_REG_NULL)
         return true;
 
-    /* We set the buffer pointer before the callback so it's easier
-     * for the user to override it in the callback.
+    /* A block may store several records past buf_ptr before its single pointer
+     * update (see drx_buf_insert_buf_store_record()), so the stores preceding
+     * the faulting one may have written records that the buffer pointer does
+     * not cover yet.  Rather than lose them, we carry them over into the
+     * flushed buffer and move buf_ptr along with them.
      */
-    tmp_base = BUF_PTR(seg_base, buf->tls_offs);
-    BUF_PTR(seg_base, buf->tls_offs) = cli_base;
-    if (buf->full_cb != NULL)
-        (*buf->full_cb)(drcontext, cli_base, (size_t)(tmp_base - cli_base));
+    ptr_val = (byte *)reg_get_value(buf_ptr, raw_mcontext);
+    if (cli_ptr >= data->cli_base && cli_ptr <= ptr_val && ptr_val <= cli_end &&
+        cli_ptr < cli_end) {
+        tail_size = cli_end - cli_ptr;
+        tail = dr_thread_alloc(drcontext, tail_size);
+        memcpy(tail, cli_ptr, tail_size);
+    }
+
+    flush_buffer(drcontext, buf, data);
 
     /* change contents of buf_ptr and retry the instruction */
-    reg_set_value(buf_ptr, raw_mcontext,
-                  (reg_t)BUF_PTR(seg_base, buf->tls_offs));
+    new_ptr = BUF_PTR(data->seg_base, buf->tls_offs);
+    if (tail != NULL) {
+        /* the full callback may have moved the buffer pointer */
+        if (new_ptr + tail_size <= data->cli_base + buf->buf_size) {
+            memcpy(new_ptr, tail, tail_size);
+            new_ptr += ptr_val - cli_ptr;
+        }
+        dr_thread_free(drcontext, tail, tail_size);
+    }
+    reg_set_value(buf_ptr, raw_mcontext, (reg_t)new_ptr);
     return false;
 }
 
@@ -840,10 +1364,13 @@ fault_event_helper(void *drcontext, byte *target,
 
             /* we found the right client */
             if (target >= ro_lo && target < ro_lo + page_size) {
-                bool ret = reset_buf_ptr(drcontext, raw_mcontext, data->seg_base,
-                                         data->cli_base, buf);
+                /* Flushing an async buffer may wait for a worker thread, so we
+                 * drop the lock first rather than stall drx_buf_free() and
+                 * buffer creation behind that wait.  Like the instrumentation
+                 * writing to it, buf must not be freed while still in use.
+                 */
                 dr_rwlock_read_unlock(global_buf_rwlock);
-                return ret;
+                return reset_buf_ptr(drcontext, raw_mcontext, data, buf);
             }
         }
     }
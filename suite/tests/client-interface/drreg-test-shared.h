@@ -36,18 +36,28 @@
 # define TEST_REG_ASM_LSB dl
 # define TEST_REG_CXT IF_X64_ELSE(Rdx, Edx)
 # define TEST_REG_SIG SC_XDX
+# define TEST_REG2 DR_REG_XBX
+# define TEST_REG2_ASM REG_XBX
+# define TEST_REG2_CXT IF_X64_ELSE(Rbx, Ebx)
+# define TEST_REG2_SIG SC_XBX
 #endif
 
 #ifdef ARM
 # define TEST_REG DR_REG_R12
 # define TEST_REG_ASM r12
 # define TEST_REG_SIG arm_ip
+# define TEST_REG2 DR_REG_R2
+# define TEST_REG2_ASM r2
+# define TEST_REG2_SIG arm_r2
 #endif
 
 #ifdef AARCH64
 # define TEST_REG DR_REG_X4
 # define TEST_REG_ASM x4
 # define TEST_REG_SIG regs[4]
+# define TEST_REG2 DR_REG_X5
+# define TEST_REG2_ASM x5
+# define TEST_REG2_SIG regs[5]
 #endif
 
 #define TEST_FLAGS_SIG SC_XFLAGS
@@ -93,3 +103,9 @@
 
 #define DRREG_TEST_5_ASM MAKE_HEX_ASM(DRREG_TEST_CONST(5))
 #define DRREG_TEST_5_C   MAKE_HEX_C(DRREG_TEST_CONST(5))
+
+#define DRREG_TEST_6_ASM MAKE_HEX_ASM(DRREG_TEST_CONST(6))
+#define DRREG_TEST_6_C   MAKE_HEX_C(DRREG_TEST_CONST(6))
+
+#define DRREG_TEST_7_ASM MAKE_HEX_ASM(DRREG_TEST_CONST(7))
+#define DRREG_TEST_7_C   MAKE_HEX_C(DRREG_TEST_CONST(7))
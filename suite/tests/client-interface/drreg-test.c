@@ -39,8 +39,14 @@
 void test_asm();
 void test_asm_faultA();
 void test_asm_faultB();
+void test_asm_faultC();
+void test_asm_faultD();
 
 static SIGJMP_BUF mark;
+/* Set to the subtest while test_asm_faultC or test_asm_faultD runs, as they
+ * also raise access violations.
+ */
+static int trace_test;
 
 #if defined(UNIX)
 # include <signal.h>
@@ -51,6 +57,14 @@ handle_signal(int signal, siginfo_t *siginfo, ucontext_t *ucxt)
         sigcontext_t *sc = SIGCXT_FROM_UCXT(ucxt);
         if (sc->TEST_REG_SIG != DRREG_TEST_3_C)
             print("ERROR: spilled register value was not preserved!\n");
+    } else if (signal == SIGSEGV && trace_test == 6) {
+        sigcontext_t *sc = SIGCXT_FROM_UCXT(ucxt);
+        if (sc->TEST_REG2_SIG != DRREG_TEST_6_C)
+            print("ERROR: spilled register value was not preserved in trace!\n");
+    } else if (signal == SIGSEGV && trace_test == 7) {
+        sigcontext_t *sc = SIGCXT_FROM_UCXT(ucxt);
+        if (((sc->TEST_FLAGS_SIG) & DRREG_TEST_AFLAGS_C) != DRREG_TEST_AFLAGS_C)
+            print("ERROR: spilled flags value was not preserved in trace!\n");
     } else if (signal == SIGSEGV) {
         sigcontext_t *sc = SIGCXT_FROM_UCXT(ucxt);
         if (((sc->TEST_FLAGS_SIG) & DRREG_TEST_AFLAGS_C) != DRREG_TEST_AFLAGS_C)
@@ -66,6 +80,14 @@ handle_exception(struct _EXCEPTION_POINTERS *ep)
     if (ep->ExceptionRecord->ExceptionCode == EXCEPTION_ILLEGAL_INSTRUCTION) {
         if (ep->ContextRecord->TEST_REG_CXT != DRREG_TEST_3_C)
             print("ERROR: spilled register value was not preserved!\n");
+    } else if (ep->ExceptionRecord->ExceptionCode == EXCEPTION_ACCESS_VIOLATION &&
+               trace_test == 6) {
+        if (ep->ContextRecord->TEST_REG2_CXT != DRREG_TEST_6_C)
+            print("ERROR: spilled register value was not preserved in trace!\n");
+    } else if (ep->ExceptionRecord->ExceptionCode == EXCEPTION_ACCESS_VIOLATION &&
+               trace_test == 7) {
+        if ((ep->ContextRecord->CXT_XFLAGS & DRREG_TEST_AFLAGS_C) != DRREG_TEST_AFLAGS_C)
+            print("ERROR: spilled flags value was not preserved in trace!\n");
     } else if (ep->ExceptionRecord->ExceptionCode == EXCEPTION_ACCESS_VIOLATION) {
         if ((ep->ContextRecord->CXT_XFLAGS & DRREG_TEST_AFLAGS_C) != DRREG_TEST_AFLAGS_C)
             print("ERROR: spilled flags value was not preserved!\n");
@@ -98,6 +120,23 @@ main(int argc, const char *argv[])
         test_asm_faultB();
     }
 
+    /* Test fault reg restore in a trace where drreg removed the restore
+     * and respill around the faulting instruction.
+     */
+    trace_test = 6;
+    if (SIGSETJMP(mark) == 0) {
+        test_asm_faultC();
+    }
+
+    /* Test fault aflags restore in a trace where drreg removed the aflags
+     * restore and respill around the faulting instruction.
+     */
+    trace_test = 7;
+    if (SIGSETJMP(mark) == 0) {
+        test_asm_faultD();
+    }
+    trace_test = 0;
+
     /* XXX i#511: add more fault tests and other tricky corner cases */
 
     print("drreg-test finished\n");
@@ -340,5 +379,193 @@ GLOBAL_LABEL(FUNCNAME:)
         END_FUNC(FUNCNAME)
 #undef FUNCNAME
 
+#define FUNCNAME test_asm_faultC
+        DECLARE_FUNC_SEH(FUNCNAME)
+GLOBAL_LABEL(FUNCNAME:)
+#ifdef X86
+        /* push callee-saved registers */
+        PUSH_SEH(REG_XBX)
+        PUSH_SEH(REG_XBP)
+        PUSH_SEH(REG_XSI)
+        PUSH_SEH(REG_XDI)
+        sub      REG_XSP, FRAME_PADDING /* align */
+        END_PROLOG
+
+        mov      TEST_REG2_ASM, DRREG_TEST_6_ASM
+        mov      REG_XCX, HEX(100)
+        mov      REG_XSI, REG_XSP
+        jmp      test6A
+        /* Test 6: fault reg restore in a trace.  test6A is a trace head, so
+         * test6A and test6B become a trace once hot, and the client's
+         * reservations of TEST_REG2 in each are joined across the gap.
+         */
+     test6A:
+        mov      TEST_REG_ASM, DRREG_TEST_6_ASM
+        mov      TEST_REG_ASM, DRREG_TEST_6_ASM
+        nop
+        jmp      test6B
+     test6B:
+        mov      TEST_REG_ASM, PTRSZ [REG_XSI] /* crash on the last pass */
+        mov      TEST_REG_ASM, DRREG_TEST_6_ASM
+        mov      TEST_REG_ASM, DRREG_TEST_6_ASM
+        nop
+        dec      REG_XCX
+        jnz      test6A
+        mov      REG_XSI, 0
+        jmp      test6A
+
+        jmp      epilog4
+     epilog4:
+        add      REG_XSP, FRAME_PADDING /* make a legal SEH64 epilog */
+        pop      REG_XDI
+        pop      REG_XSI
+        pop      REG_XBP
+        pop      REG_XBX
+        ret
+#elif defined(ARM)
+        movw     TEST_REG2_ASM, DRREG_TEST_6_ASM
+        mov      r1, HEX(100)
+        mov      r0, sp
+        b        test6A
+        /* Test 6: fault reg restore in a trace */
+     test6A:
+        movw     TEST_REG_ASM, DRREG_TEST_6_ASM
+        movw     TEST_REG_ASM, DRREG_TEST_6_ASM
+        nop
+        b        test6B
+     test6B:
+        ldr      TEST_REG_ASM, PTRSZ [r0] /* crash on the last pass */
+        movw     TEST_REG_ASM, DRREG_TEST_6_ASM
+        movw     TEST_REG_ASM, DRREG_TEST_6_ASM
+        nop
+        subs     r1, r1, HEX(1)
+        bne      test6A
+        mov      r0, HEX(0)
+        b        test6A
+
+        b        epilog4
+    epilog4:
+        bx       lr
+#elif defined(AARCH64)
+        movz     TEST_REG2_ASM, DRREG_TEST_6_ASM
+        mov      x1, HEX(100)
+        mov      x0, sp
+        b        test6A
+        /* Test 6: fault reg restore in a trace */
+     test6A:
+        movz     TEST_REG_ASM, DRREG_TEST_6_ASM
+        movz     TEST_REG_ASM, DRREG_TEST_6_ASM
+        nop
+        b        test6B
+     test6B:
+        ldr      TEST_REG_ASM, PTRSZ [x0] /* crash on the last pass */
+        movz     TEST_REG_ASM, DRREG_TEST_6_ASM
+        movz     TEST_REG_ASM, DRREG_TEST_6_ASM
+        nop
+        subs     x1, x1, HEX(1)
+        b.ne     test6A
+        mov      x0, HEX(0)
+        b        test6A
+
+        b        epilog4
+    epilog4:
+        ret
+#endif
+        END_FUNC(FUNCNAME)
+#undef FUNCNAME
+
+#define FUNCNAME test_asm_faultD
+        DECLARE_FUNC_SEH(FUNCNAME)
+GLOBAL_LABEL(FUNCNAME:)
+#ifdef X86
+        /* push callee-saved registers */
+        PUSH_SEH(REG_XBX)
+        PUSH_SEH(REG_XBP)
+        PUSH_SEH(REG_XSI)
+        PUSH_SEH(REG_XDI)
+        sub      REG_XSP, FRAME_PADDING /* align */
+        END_PROLOG
+
+        mov      REG_XCX, HEX(100)
+        mov      REG_XSI, REG_XSP
+        mov      ah, DRREG_TEST_AFLAGS_ASM
+        sahf
+        jmp      test7A
+        /* Test 7: fault aflags restore in a trace.  As in test 6, test7A and
+         * test7B become a trace and the client's aflags reservations in each
+         * are joined across the gap.  Nothing in the loop writes the flags.
+         */
+     test7A:
+        mov      TEST_REG_ASM, DRREG_TEST_7_ASM
+        mov      TEST_REG_ASM, DRREG_TEST_7_ASM
+        nop
+        jmp      test7B
+     test7B:
+        mov      TEST_REG_ASM, PTRSZ [REG_XSI] /* crash on the last pass */
+        mov      TEST_REG_ASM, DRREG_TEST_7_ASM
+        mov      TEST_REG_ASM, DRREG_TEST_7_ASM
+        nop
+        loop     test7A
+        mov      REG_XSI, 0
+        jmp      test7A
+
+        jmp      epilog5
+     epilog5:
+        add      REG_XSP, FRAME_PADDING /* make a legal SEH64 epilog */
+        pop      REG_XDI
+        pop      REG_XSI
+        pop      REG_XBP
+        pop      REG_XBX
+        ret
+#elif defined(ARM)
+        /* Test 7: fault aflags restore across blocks.  With no flag-free loop
+         * and no traces by default, this runs each block once.
+         */
+        msr      APSR_nzcvq, DRREG_TEST_AFLAGS_ASM
+        mov      r0, HEX(0)
+        b        test7A
+     test7A:
+        movw     TEST_REG_ASM, DRREG_TEST_7_ASM
+        movw     TEST_REG_ASM, DRREG_TEST_7_ASM
+        nop
+        b        test7B
+     test7B:
+        ldr      TEST_REG_ASM, PTRSZ [r0] /* crash */
+        movw     TEST_REG_ASM, DRREG_TEST_7_ASM
+        movw     TEST_REG_ASM, DRREG_TEST_7_ASM
+        nop
+
+        b        epilog5
+    epilog5:
+        bx       lr
+#elif defined(AARCH64)
+        /* Test 7: fault aflags restore in a trace */
+        movz     TEST_REG_ASM, DRREG_TEST_AFLAGS_H_ASM, LSL 16
+        msr      nzcv, TEST_REG_ASM
+        mov      x1, HEX(100)
+        mov      x0, sp
+        b        test7A
+     test7A:
+        movz     TEST_REG_ASM, DRREG_TEST_7_ASM
+        movz     TEST_REG_ASM, DRREG_TEST_7_ASM
+        nop
+        b        test7B
+     test7B:
+        ldr      TEST_REG_ASM, PTRSZ [x0] /* crash on the last pass */
+        movz     TEST_REG_ASM, DRREG_TEST_7_ASM
+        movz     TEST_REG_ASM, DRREG_TEST_7_ASM
+        nop
+        sub      x1, x1, HEX(1)
+        cbnz     x1, test7A
+        mov      x0, HEX(0)
+        b        test7A
+
+        b        epilog5
+    epilog5:
+        ret
+#endif
+        END_FUNC(FUNCNAME)
+#undef FUNCNAME
+
 END_FILE
 #endif
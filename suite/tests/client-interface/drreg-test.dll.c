@@ -37,7 +37,7 @@
 #include "drreg.h"
 #include "client_tools.h"
 #include "drreg-test-shared.h"
-#include <string.h> /* memset */
+#include <string.h> /* memset, strstr */
 
 #define CHECK(x, msg) do {               \
     if (!(x)) {                          \
@@ -48,28 +48,43 @@
 
 #define MAGIC_VAL 0xabcd
 
-static dr_emit_flags_t
-event_app_analysis(void *drcontext, void *tag, instrlist_t *bb,
-                   bool for_trace, bool translating, OUT void **user_data)
+/* Set by the "-optimize_traces" client option. */
+static bool optimize_traces;
+
+/* Looks for duplicate mov immediates telling us which subtest we're in.
+ * Returns the subtest, or 0 if none, and the second mov in *marker.
+ */
+static ptr_int_t
+find_subtest(instrlist_t *bb, instr_t **marker OUT)
 {
     instr_t *inst;
     bool prev_was_mov_const = false;
     ptr_int_t val1, val2;
-    *user_data = NULL;
-    /* Look for duplicate mov immediates telling us which subtest we're in */
     for (inst = instrlist_first_app(bb); inst != NULL; inst = instr_get_next_app(inst)) {
         if (instr_is_mov_constant(inst, prev_was_mov_const ? &val2 : &val1)) {
             if (prev_was_mov_const && val1 == val2 &&
                 val1 != 0 && /* rule out xor w/ self */
                 opnd_is_reg(instr_get_dst(inst, 0)) &&
                 opnd_get_reg(instr_get_dst(inst, 0)) == TEST_REG) {
-                *user_data = (void *) val1;
-                instrlist_meta_postinsert(bb, inst, INSTR_CREATE_label(drcontext));
+                *marker = inst;
+                return val1;
             } else
                 prev_was_mov_const = true;
         } else
             prev_was_mov_const = false;
     }
+    return 0;
+}
+
+static dr_emit_flags_t
+event_app_analysis(void *drcontext, void *tag, instrlist_t *bb,
+                   bool for_trace, bool translating, OUT void **user_data)
+{
+    instr_t *marker;
+    ptr_int_t subtest = find_subtest(bb, &marker);
+    *user_data = (void *) subtest;
+    if (subtest != 0)
+        instrlist_meta_postinsert(bb, marker, INSTR_CREATE_label(drcontext));
     return DR_EMIT_DEFAULT;
 }
 
@@ -89,7 +104,8 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst
     ptr_int_t subtest = (ptr_int_t) user_data;
 
     drreg_init_and_fill_vector(&allowed, false);
-    drreg_set_vector_entry(&allowed, TEST_REG, true);
+    drreg_set_vector_entry(&allowed,
+                           subtest == DRREG_TEST_6_C ? TEST_REG2 : TEST_REG, true);
 
     if (subtest == 0) {
         uint flags;
@@ -181,9 +197,13 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst
             CHECK(res == DRREG_SUCCESS, "unreserve should work");
         }
     } else if (subtest == DRREG_TEST_4_C ||
-               subtest == DRREG_TEST_5_C) {
-        /* Cross-app-instr aflags test */
-        dr_log(drcontext, LOG_ALL, 1, "drreg test #4\n");
+               subtest == DRREG_TEST_5_C ||
+               subtest == DRREG_TEST_7_C) {
+        /* Cross-app-instr aflags test.  For test #7, with optimize_traces, the
+         * aflags restore at the end of one block and the respill in the next
+         * are removed once both are in a trace.
+         */
+        dr_log(drcontext, LOG_ALL, 1, "drreg test #4/5/7\n");
         if (instr_is_label(inst)) {
             res = drreg_reserve_aflags(drcontext, bb, inst);
             CHECK(res == DRREG_SUCCESS, "reserve of aflags should work");
@@ -199,6 +219,24 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst
             res = drreg_unreserve_aflags(drcontext, bb, inst);
             CHECK(res == DRREG_SUCCESS, "unreserve of aflags should work");
         }
+    } else if (subtest == DRREG_TEST_6_C) {
+        /* Cross-block test: with optimize_traces, the restore at the end of
+         * one block and the respill in the next are removed once both are in
+         * a trace, leaving the app fault between them to be translated.
+         */
+        dr_log(drcontext, LOG_ALL, 1, "drreg test #6\n");
+        if (instr_is_label(inst)) {
+            res = drreg_reserve_register(drcontext, bb, inst, &allowed, &reg);
+            CHECK(res == DRREG_SUCCESS && reg == TEST_REG2,
+                  "reserve of test reg should work");
+            /* Overwrite the tool value right away, as optimize_traces requires. */
+            instrlist_meta_preinsert(bb, inst, XINST_CREATE_load_int
+                                     (drcontext, opnd_create_reg(reg),
+                                      OPND_CREATE_INT32(MAGIC_VAL)));
+        } else if (drmgr_is_last_instr(drcontext, inst)) {
+            res = drreg_unreserve_register(drcontext, bb, inst, TEST_REG2);
+            CHECK(res == DRREG_SUCCESS, "unreserve should work");
+        }
     }
 
     drvector_delete(&allowed);
@@ -219,6 +257,14 @@ event_instru2instru(void *drcontext, void *tag, instrlist_t *bb,
     drreg_status_t res;
     drvector_t allowed;
     reg_id_t reg;
+    instr_t *marker;
+    ptr_int_t subtest = find_subtest(bb, &marker);
+
+    /* Keep the block boundaries of tests #6 and #7 free of other spills that
+     * would block the trace optimization.
+     */
+    if (subtest == DRREG_TEST_6_C || subtest == DRREG_TEST_7_C)
+        return DR_EMIT_DEFAULT;
 
     drreg_init_and_fill_vector(&allowed, false);
     drreg_set_vector_entry(&allowed, TEST_REG, true);
@@ -259,6 +305,27 @@ event_instru2instru(void *drcontext, void *tag, instrlist_t *bb,
 static void
 event_exit(void)
 {
+    drreg_stats_t stats = {sizeof(stats),};
+    if (drreg_get_stats(&stats) != DRREG_SUCCESS)
+        CHECK(false, "get stats failed");
+    CHECK(stats.reg_spills > 0 && stats.reg_restores > 0 &&
+          stats.aflags_spills > 0 && stats.aflags_restores > 0,
+          "spills and restores should be counted");
+    if (optimize_traces) {
+#ifdef X86 /* traces are disabled by default elsewhere */
+        CHECK(stats.trace_reg_pairs_removed > 0, "test #6 trace should be optimized");
+        CHECK(stats.trace_aflags_pairs_removed > 0,
+              "test #7 trace should be optimized");
+#endif
+    } else {
+        CHECK(stats.trace_reg_pairs_removed == 0 &&
+              stats.trace_aflags_pairs_removed == 0,
+              "traces should not be optimized by default");
+    }
+    CHECK(stats.trace_reg_pairs_removed <= stats.reg_restores &&
+          stats.trace_aflags_pairs_removed <= stats.aflags_restores,
+          "cannot remove more than was inserted");
+
     if (!drmgr_unregister_bb_insertion_event(event_app_instruction) ||
         drreg_exit() != DRREG_SUCCESS)
         CHECK(false, "exit failed");
@@ -273,6 +340,10 @@ dr_init(client_id_t id)
      * a DR slot.
      */
     drreg_options_t ops = {sizeof(ops), 2 /*max slots needed*/, false};
+    const char *options = dr_get_options(id);
+    if (options != NULL && strstr(options, "-optimize_traces") != NULL)
+        optimize_traces = true;
+    ops.optimize_traces = optimize_traces;
     if (!drmgr_init() ||
         drreg_init(&ops) != DRREG_SUCCESS)
         CHECK(false, "init failed");
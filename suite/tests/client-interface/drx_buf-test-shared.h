@@ -80,4 +80,17 @@
 #define DRX_BUF_TEST_6_ASM MAKE_HEX_ASM(DRX_BUF_TEST_CONST(6))
 #define DRX_BUF_TEST_6_C   MAKE_HEX_C(DRX_BUF_TEST_CONST(6))
 
+#define DRX_BUF_TEST_7_ASM MAKE_HEX_ASM(DRX_BUF_TEST_CONST(7))
+#define DRX_BUF_TEST_7_C   MAKE_HEX_C(DRX_BUF_TEST_CONST(7))
+
+#define DRX_BUF_TEST_8_ASM MAKE_HEX_ASM(DRX_BUF_TEST_CONST(8))
+#define DRX_BUF_TEST_8_C   MAKE_HEX_C(DRX_BUF_TEST_CONST(8))
+
+#define DRX_BUF_TEST_9_ASM MAKE_HEX_ASM(DRX_BUF_TEST_CONST(9))
+#define DRX_BUF_TEST_9_C   MAKE_HEX_C(DRX_BUF_TEST_CONST(9))
+
+/* 0xf1f10 would not fit in 16 bits */
+#define DRX_BUF_TEST_10_ASM MAKE_HEX_ASM(DRX_BUF_TEST_CONST(a))
+#define DRX_BUF_TEST_10_C   MAKE_HEX_C(DRX_BUF_TEST_CONST(a))
+
 #define NUM_ITER 100
@@ -62,10 +62,10 @@ void *
 thread_asm_test(void *unused)
 {
     int i;
-    /* tests 1, 2 and 3 */
+    /* tests 1, 2, 3 and 7 */
     for (i = 0; i < NUM_ITER; ++i)
         test_asm_123();
-    /* tests 4 and 5 */
+    /* tests 4, 5, 6, 8, 9 and 10 */
     test_asm_45();
     return NULL;
 }
@@ -82,10 +82,10 @@ DWORD WINAPI
 thread_asm_test(LPVOID lpParam)
 {
     int i;
-    /* tests 1, 2 and 3 */
+    /* tests 1, 2, 3 and 7 */
     for (i = 0; i < NUM_ITER; ++i)
         test_asm_123();
-    /* tests 4 and 5 */
+    /* tests 4, 5, 6, 8, 9 and 10 */
     test_asm_45();
     return 0;
 }
@@ -175,6 +175,11 @@ GLOBAL_LABEL(FUNCNAME:)
      test3:
         mov      TEST_REG_ASM, DRX_BUF_TEST_3_ASM
         mov      TEST_REG_ASM, DRX_BUF_TEST_3_ASM
+        jmp      test7
+        /* Test 7: test the async trace buffers */
+     test7:
+        mov      TEST_REG_ASM, DRX_BUF_TEST_7_ASM
+        mov      TEST_REG_ASM, DRX_BUF_TEST_7_ASM
         jmp      epilog1
      epilog1:
         add      REG_XSP, FRAME_PADDING /* make a legal SEH64 epilog */
@@ -199,6 +204,11 @@ GLOBAL_LABEL(FUNCNAME:)
      test3:
         MOV16    TEST_REG_ASM, DRX_BUF_TEST_3_ASM
         MOV16    TEST_REG_ASM, DRX_BUF_TEST_3_ASM
+        b        test7
+        /* Test 7: test the async trace buffers */
+     test7:
+        MOV16    TEST_REG_ASM, DRX_BUF_TEST_7_ASM
+        MOV16    TEST_REG_ASM, DRX_BUF_TEST_7_ASM
         b        epilog1
     epilog1:
         RETURN
@@ -235,6 +245,21 @@ GLOBAL_LABEL(FUNCNAME:)
      test6:
         mov      TEST_REG_ASM, DRX_BUF_TEST_6_ASM
         mov      TEST_REG_ASM, DRX_BUF_TEST_6_ASM
+        jmp      test8
+        /* Test 8: test drx_buf_insert_buf_store_record() */
+     test8:
+        mov      TEST_REG_ASM, DRX_BUF_TEST_8_ASM
+        mov      TEST_REG_ASM, DRX_BUF_TEST_8_ASM
+        jmp      test9
+        /* Test 9: test drx_buf_insert_check_space() */
+     test9:
+        mov      TEST_REG_ASM, DRX_BUF_TEST_9_ASM
+        mov      TEST_REG_ASM, DRX_BUF_TEST_9_ASM
+        jmp      test10
+        /* Test 10: test a batch of records overflowing the buffer */
+     test10:
+        mov      TEST_REG_ASM, DRX_BUF_TEST_10_ASM
+        mov      TEST_REG_ASM, DRX_BUF_TEST_10_ASM
         jmp      epilog2
      epilog2:
         add      REG_XSP, FRAME_PADDING /* make a legal SEH64 epilog */
@@ -259,6 +284,21 @@ GLOBAL_LABEL(FUNCNAME:)
      test6:
         MOV16    TEST_REG_ASM, DRX_BUF_TEST_6_ASM
         MOV16    TEST_REG_ASM, DRX_BUF_TEST_6_ASM
+        b        test8
+        /* Test 8: test drx_buf_insert_buf_store_record() */
+     test8:
+        MOV16    TEST_REG_ASM, DRX_BUF_TEST_8_ASM
+        MOV16    TEST_REG_ASM, DRX_BUF_TEST_8_ASM
+        b        test9
+        /* Test 9: test drx_buf_insert_check_space() */
+     test9:
+        MOV16    TEST_REG_ASM, DRX_BUF_TEST_9_ASM
+        MOV16    TEST_REG_ASM, DRX_BUF_TEST_9_ASM
+        b        test10
+        /* Test 10: test a batch of records overflowing the buffer */
+     test10:
+        MOV16    TEST_REG_ASM, DRX_BUF_TEST_10_ASM
+        MOV16    TEST_REG_ASM, DRX_BUF_TEST_10_ASM
         b        epilog2
     epilog2:
         RETURN
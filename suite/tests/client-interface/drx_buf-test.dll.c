@@ -49,6 +49,15 @@
 #define CIRCULAR_FAST_SZ DRX_BUF_FAST_CIRCULAR_BUFSZ
 #define CIRCULAR_SLOW_SZ 256
 #define TRACE_SZ      256
+#define ASYNC_SZ      256
+/* What the space check test leaves free in its buffer */
+#define SPACE_LEFT    8
+/* The records stored by the batch test, which only the first two fit */
+#define BATCH_RECS    4
+#define BATCH_VAL(i)  (0x10 + (i))
+
+/* One async trace buffer per back-pressure policy, indexed by the policy */
+#define NUM_ASYNC     3
 
 #define MINSERT instrlist_meta_preinsert
 
@@ -68,7 +77,24 @@ static const char test_null[TRACE_SZ];
 static drx_buf_t *circular_fast;
 static drx_buf_t *circular_slow;
 static drx_buf_t *trace;
+static drx_buf_t *space;
+static drx_buf_t *async_bufs[NUM_ASYNC];
 static volatile int num_faults;
+static volatile int num_async_drained;
+static int tls_idx;
+
+/* Each full async buffer starts with a per-thread sequence number, so the
+ * full callback can check that buffers arrive in order.
+ */
+typedef struct {
+    uint seq[NUM_ASYNC];       /* last number stamped by the app thread */
+    uint last_seen[NUM_ASYNC]; /* last number seen by the full callback */
+    uint seen[NUM_ASYNC];      /* full buffers seen by the full callback */
+    uint space_flushes;        /* calls to the space buffer's full callback */
+    size_t space_flush_size;   /* the size passed to the last such call */
+} per_thread_t;
+
+static void async_init(void *drcontext);
 
 static void
 event_thread_init(void *drcontext)
@@ -86,6 +112,17 @@ event_thread_init(void *drcontext)
 
     buf_base = drx_buf_get_buffer_base(drcontext, trace);
     memset(buf_base, 0, TRACE_SZ);
+
+    async_init(drcontext);
+}
+
+static void
+event_thread_exit(void *drcontext)
+{
+    /* drx_buf has already drained our async buffers */
+    per_thread_t *data = drmgr_get_tls_field(drcontext, tls_idx);
+    if (data != NULL)
+        dr_thread_free(drcontext, data, sizeof(*data));
 }
 
 static void
@@ -145,6 +182,178 @@ verify_buffers_nulled(drx_buf_t *client)
     CHECK(memcmp(buf_base, test_null, sizeof(test_null)) == 0, "buffer not nulled");
 }
 
+static void
+space_full(void *drcontext, void *buf_base, size_t size)
+{
+    per_thread_t *data = drmgr_get_tls_field(drcontext, tls_idx);
+    data->space_flushes++;
+    data->space_flush_size = size;
+}
+
+/* Leaves room for only SPACE_LEFT more bytes in the space buffer */
+static void
+space_fill(void)
+{
+    void *drcontext = dr_get_current_drcontext();
+    byte *buf_base = drx_buf_get_buffer_base(drcontext, space);
+    per_thread_t *data = drmgr_get_tls_field(drcontext, tls_idx);
+    data->space_flushes = 0;
+    drx_buf_set_buffer_ptr(drcontext, space, buf_base + TRACE_SZ - SPACE_LEFT);
+}
+
+static void
+space_check(uint flushes, byte *buf_ptr)
+{
+    void *drcontext = dr_get_current_drcontext();
+    byte *buf_base = drx_buf_get_buffer_base(drcontext, space);
+    per_thread_t *data = drmgr_get_tls_field(drcontext, tls_idx);
+    CHECK(data->space_flushes == flushes, "wrong number of space check flushes");
+    CHECK(buf_ptr == drx_buf_get_buffer_ptr(drcontext, space),
+          "buffer pointer register not reloaded");
+    if (flushes == 0) {
+        CHECK(buf_ptr == buf_base + TRACE_SZ - SPACE_LEFT, "buffer flushed early");
+    } else {
+        CHECK(buf_ptr == buf_base, "buffer not reset by the space check");
+        CHECK(data->space_flush_size == TRACE_SZ - SPACE_LEFT,
+              "space check flushed the wrong size");
+    }
+}
+
+/* Called after a batch of records overflowed the space buffer midway */
+static void
+batch_check(byte *buf_ptr)
+{
+    void *drcontext = dr_get_current_drcontext();
+    uint *buf_base = drx_buf_get_buffer_base(drcontext, space);
+    per_thread_t *data = drmgr_get_tls_field(drcontext, tls_idx);
+    uint i;
+    CHECK(data->space_flushes == 1, "batch overflow did not flush");
+    CHECK(data->space_flush_size == TRACE_SZ - SPACE_LEFT,
+          "batch overflow flushed the wrong size");
+    CHECK(buf_ptr == (byte *)(buf_base + BATCH_RECS) &&
+          buf_ptr == drx_buf_get_buffer_ptr(drcontext, space),
+          "buffer pointer not moved along with the batch");
+    for (i = 0; i < BATCH_RECS; i++) {
+        CHECK(buf_base[i] == BATCH_VAL(i),
+              "records stored before the overflow were lost");
+    }
+}
+
+static void
+set_field(drx_buf_field_t *field, opnd_t opnd, opnd_size_t opsz, short offset)
+{
+    field->opnd = opnd;
+    field->opsz = opsz;
+    field->offset = offset;
+}
+
+/* Stamps the next sequence number at the start of each async buffer */
+static void
+async_stamp_next(void *drcontext, per_thread_t *data, uint idx)
+{
+    byte *buf_base = drx_buf_get_buffer_base(drcontext, async_bufs[idx]);
+    *(uint *)buf_base = ++data->seq[idx];
+    drx_buf_set_buffer_ptr(drcontext, async_bufs[idx], buf_base + sizeof(uint));
+}
+
+static void
+async_init(void *drcontext)
+{
+    per_thread_t *data = dr_thread_alloc(drcontext, sizeof(*data));
+    uint i;
+    memset(data, 0, sizeof(*data));
+    drmgr_set_tls_field(drcontext, tls_idx, data);
+    for (i = 0; i < NUM_ASYNC; i++)
+        async_stamp_next(drcontext, data, i);
+}
+
+static void
+async_full(uint idx, void *drcontext, void *buf_base, size_t size)
+{
+    per_thread_t *data = drmgr_get_tls_field(drcontext, tls_idx);
+    uint seq = *(uint *)buf_base;
+    if (size == ASYNC_SZ) {
+        /* on a worker thread */
+        CHECK(drcontext != dr_get_current_drcontext(), "not called by a worker");
+        CHECK(seq > data->last_seen[idx], "async buffers out of order");
+        if (idx == DRX_BUF_ASYNC_BLOCK) {
+            CHECK(seq == data->last_seen[idx] + 1, "blocking async buffer lost");
+        }
+        data->last_seen[idx] = seq;
+        data->seen[idx]++;
+        /* Be slow enough that threads run out of free buffers */
+        dr_sleep(1);
+    } else {
+        /* the final partial buffer, on the exiting thread */
+        drx_buf_async_stats_t stats;
+        CHECK(drcontext == dr_get_current_drcontext(), "not called at thread exit");
+        CHECK(size == sizeof(uint) && seq == data->seq[idx],
+              "wrong final async buffer");
+        stats.struct_size = sizeof(stats);
+        CHECK(drx_buf_get_async_stats(drcontext, async_bufs[idx], &stats),
+              "drx_buf_get_async_stats failed");
+        CHECK(stats.buffers_flushed == data->seen[idx],
+              "queued async buffers were not drained before thread exit");
+        if (idx == DRX_BUF_ASYNC_BLOCK) {
+            CHECK(data->seen[idx] == seq - 1, "blocking async buffers lost");
+        }
+        /* skip the worker threads, which never fill a buffer */
+        if (seq > 1)
+            dr_atomic_add32_return_sum(&num_async_drained, 1);
+    }
+}
+
+static void
+async_full_block(void *drcontext, void *buf_base, size_t size)
+{
+    async_full(DRX_BUF_ASYNC_BLOCK, drcontext, buf_base, size);
+}
+
+static void
+async_full_drop(void *drcontext, void *buf_base, size_t size)
+{
+    async_full(DRX_BUF_ASYNC_DROP, drcontext, buf_base, size);
+}
+
+static void
+async_full_sample(void *drcontext, void *buf_base, size_t size)
+{
+    async_full(DRX_BUF_ASYNC_SAMPLE, drcontext, buf_base, size);
+}
+
+/* Moves the buffer pointer to the end so that the next store faults */
+static void
+async_fill(uint idx)
+{
+    void *drcontext = dr_get_current_drcontext();
+    byte *buf_base = drx_buf_get_buffer_base(drcontext, async_bufs[idx]);
+    drx_buf_set_buffer_ptr(drcontext, async_bufs[idx], buf_base + ASYNC_SZ);
+}
+
+/* Called once the overflow was handled */
+static void
+async_check(uint idx)
+{
+    void *drcontext = dr_get_current_drcontext();
+    per_thread_t *data = drmgr_get_tls_field(drcontext, tls_idx);
+    drx_buf_async_stats_t stats;
+    verify_buffers_empty(async_bufs[idx]);
+    stats.struct_size = sizeof(stats);
+    CHECK(drx_buf_get_async_stats(drcontext, async_bufs[idx], &stats),
+          "drx_buf_get_async_stats failed");
+    CHECK(stats.buffers_flushed + stats.buffers_dropped == data->seq[idx],
+          "async buffer overflow not counted");
+    CHECK(stats.max_stall_us <= stats.stall_us &&
+          stats.max_flush_latency_us <= stats.flush_latency_us,
+          "inconsistent async stats");
+    if (idx == DRX_BUF_ASYNC_BLOCK) {
+        CHECK(stats.buffers_dropped == 0, "blocking async buffer dropped");
+    } else if (idx == DRX_BUF_ASYNC_DROP) {
+        CHECK(stats.stalls == 0, "dropping async buffer stalled");
+    }
+    async_stamp_next(drcontext, data, idx);
+}
+
 static dr_emit_flags_t
 event_app_analysis(void *drcontext, void *tag, instrlist_t *bb,
                    bool for_trace, bool translating, OUT void **user_data)
@@ -366,6 +575,97 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst
 #endif
         dr_insert_clean_call(drcontext, bb, inst, verify_store, false, 1,
                              OPND_CREATE_INTPTR(circular_fast));
+    } else if (subtest == DRX_BUF_TEST_7_C) {
+        /* testing the async trace buffers: trigger a fault in each */
+        uint i;
+        for (i = 0; i < NUM_ASYNC; i++) {
+            dr_insert_clean_call(drcontext, bb, inst, async_fill, false, 1,
+                                 OPND_CREATE_INT32(i));
+            drx_buf_insert_load_buf_ptr(drcontext, async_bufs[i], bb, inst, reg_ptr);
+            drx_buf_insert_buf_store(drcontext, async_bufs[i], bb, inst, reg_ptr,
+                                     DR_REG_NULL, opnd_create_reg(scratch), OPSZ_4, 0);
+            dr_insert_clean_call(drcontext, bb, inst, async_check, false, 1,
+                                 OPND_CREATE_INT32(i));
+        }
+    } else if (subtest == DRX_BUF_TEST_8_C) {
+        /* test record stores: "ABCDEFGH\x00" (x2 for x64) again.  The leading
+         * immediates are packed into one store, which on x64 is an 8-byte
+         * immediate that takes two 32-bit stores.
+         */
+        drx_buf_field_t fields[6];
+        uint num_fields = 0, num_stores = 0;
+        instr_t *prev, *in;
+        drx_buf_insert_load_buf_ptr(drcontext, circular_fast, bb, inst, reg_ptr);
+        prev = instr_get_prev(inst);
+        set_field(&fields[num_fields++], opnd_create_immed_int(0x41, OPSZ_1),
+                  OPSZ_1, 0);
+        set_field(&fields[num_fields++], opnd_create_immed_int(0x42, OPSZ_1),
+                  OPSZ_1, 1);
+        set_field(&fields[num_fields++], opnd_create_immed_int(0x4443, OPSZ_2),
+                  OPSZ_2, 2);
+        set_field(&fields[num_fields++], opnd_create_immed_int(0x48474645, OPSZ_4),
+                  OPSZ_4, 4);
+#ifdef X64
+        instrlist_insert_mov_immed_ptrsz(drcontext, 0x4847464544434241,
+                                         opnd_create_reg(reg_tmp), bb, inst,
+                                         NULL, NULL);
+        set_field(&fields[num_fields++], opnd_create_reg(reg_tmp), OPSZ_8, 8);
+        set_field(&fields[num_fields++], opnd_create_immed_int(0x00, OPSZ_1),
+                  OPSZ_1, 17);
+#else
+        set_field(&fields[num_fields++], opnd_create_immed_int(0x00, OPSZ_1),
+                  OPSZ_1, 9);
+#endif
+        CHECK(drx_buf_insert_buf_store_record(drcontext, circular_fast, bb, inst,
+                                              reg_ptr,
+                                              IF_X86_ELSE(DR_REG_NULL, scratch),
+                                              fields, num_fields, 0),
+              "drx_buf_insert_buf_store_record failed");
+        for (in = instr_get_next(prev); in != inst; in = instr_get_next(in)) {
+            if (instr_writes_memory(in))
+                num_stores++;
+        }
+        /* On 32-bit the packed immediate stops at 4 bytes */
+        CHECK(num_stores == IF_X64_ELSE(IF_X86_ELSE(4, 3), 3),
+              "record immediates were not packed");
+        dr_insert_clean_call(drcontext, bb, inst, verify_store, false, 1,
+                             OPND_CREATE_INTPTR(circular_fast));
+    } else if (subtest == DRX_BUF_TEST_9_C) {
+        /* test the explicit space check: no flush while there is room... */
+        dr_insert_clean_call(drcontext, bb, inst, space_fill, false, 0);
+        drx_buf_insert_load_buf_ptr(drcontext, space, bb, inst, reg_ptr);
+        CHECK(drx_buf_insert_check_space(drcontext, space, bb, inst, reg_ptr,
+                                         reg_tmp, SPACE_LEFT),
+              "drx_buf_insert_check_space failed");
+        dr_insert_clean_call(drcontext, bb, inst, space_check, false, 2,
+                             OPND_CREATE_INT32(0), opnd_create_reg(reg_ptr));
+        /* ...and a flush of what was stored so far once there is not */
+        drx_buf_insert_load_buf_ptr(drcontext, space, bb, inst, reg_ptr);
+        CHECK(drx_buf_insert_check_space(drcontext, space, bb, inst, reg_ptr,
+                                         reg_tmp, SPACE_LEFT + 1),
+              "drx_buf_insert_check_space failed");
+        dr_insert_clean_call(drcontext, bb, inst, space_check, false, 2,
+                             OPND_CREATE_INT32(1), opnd_create_reg(reg_ptr));
+    } else if (subtest == DRX_BUF_TEST_10_C) {
+        /* test a batch of records with a single pointer update that crosses the
+         * end of the buffer after its first two records
+         */
+        drx_buf_field_t field;
+        uint i;
+        dr_insert_clean_call(drcontext, bb, inst, space_fill, false, 0);
+        drx_buf_insert_load_buf_ptr(drcontext, space, bb, inst, reg_ptr);
+        for (i = 0; i < BATCH_RECS; i++) {
+            set_field(&field, opnd_create_immed_int(BATCH_VAL(i), OPSZ_4), OPSZ_4, 0);
+            CHECK(drx_buf_insert_buf_store_record(drcontext, space, bb, inst,
+                                                  reg_ptr,
+                                                  IF_X86_ELSE(DR_REG_NULL, scratch),
+                                                  &field, 1, i * sizeof(uint)),
+                  "drx_buf_insert_buf_store_record failed");
+        }
+        drx_buf_insert_update_buf_ptr(drcontext, space, bb, inst, reg_ptr,
+                                      DR_REG_NULL, BATCH_RECS * sizeof(uint));
+        dr_insert_clean_call(drcontext, bb, inst, batch_check, false, 1,
+                             opnd_create_reg(reg_ptr));
     } else if (subtest == DRX_BUF_TEST_6_C) {
         /* Currently, the fast circular buffer does not recommend variable-size
          * writes, for good reason. We don't test the memcpy operation on the
@@ -430,12 +730,20 @@ event_exit(void)
      */
     CHECK(num_faults == NUM_ITER * 2 + 2 + 2,
             "the number of faults don't match up");
+    /* each of our two threads drained each async buffer at exit */
+    CHECK(num_async_drained == 2 * NUM_ASYNC, "async buffers not drained");
     if (!drmgr_unregister_bb_insertion_event(event_app_instruction))
         CHECK(false, "exit failed");
     drx_buf_free(circular_fast);
     drx_buf_free(circular_slow);
     drx_buf_free(trace);
+    drx_buf_free(space);
+    drx_buf_free(async_bufs[DRX_BUF_ASYNC_BLOCK]);
+    drx_buf_free(async_bufs[DRX_BUF_ASYNC_DROP]);
+    drx_buf_free(async_bufs[DRX_BUF_ASYNC_SAMPLE]);
+    drmgr_unregister_tls_field(tls_idx);
     drmgr_unregister_thread_init_event(event_thread_init);
+    drmgr_unregister_thread_exit_event(event_thread_exit);
     drmgr_exit();
     drx_exit();
 }
@@ -443,6 +751,7 @@ event_exit(void)
 DR_EXPORT void
 dr_init(client_id_t id)
 {
+    drx_buf_async_options_t async_ops;
     if (!drmgr_init())
         CHECK(false, "init failed");
 
@@ -454,9 +763,32 @@ dr_init(client_id_t id)
     CHECK(circular_fast != NULL, "circular fast failed");
     CHECK(circular_slow != NULL, "circular slow failed");
     CHECK(trace != NULL, "trace failed");
+    space = drx_buf_create_trace_buffer(TRACE_SZ, space_full);
+    CHECK(space != NULL, "space trace failed");
+
+    tls_idx = drmgr_register_tls_field();
+    CHECK(tls_idx != -1, "tls field failed");
+    async_ops.struct_size = sizeof(async_ops);
+    async_ops.num_buffers = 2;
+    async_ops.num_workers = 1;
+    async_ops.sample_interval = 2;
+    async_ops.policy = DRX_BUF_ASYNC_BLOCK;
+    async_bufs[DRX_BUF_ASYNC_BLOCK] =
+        drx_buf_create_async_trace_buffer(ASYNC_SZ, async_full_block, &async_ops);
+    async_ops.policy = DRX_BUF_ASYNC_DROP;
+    async_bufs[DRX_BUF_ASYNC_DROP] =
+        drx_buf_create_async_trace_buffer(ASYNC_SZ, async_full_drop, &async_ops);
+    async_ops.policy = DRX_BUF_ASYNC_SAMPLE;
+    async_bufs[DRX_BUF_ASYNC_SAMPLE] =
+        drx_buf_create_async_trace_buffer(ASYNC_SZ, async_full_sample, &async_ops);
+    CHECK(async_bufs[DRX_BUF_ASYNC_BLOCK] != NULL &&
+          async_bufs[DRX_BUF_ASYNC_DROP] != NULL &&
+          async_bufs[DRX_BUF_ASYNC_SAMPLE] != NULL, "async trace failed");
 
     CHECK(drmgr_register_thread_init_event(event_thread_init),
           "event thread init failed");
+    CHECK(drmgr_register_thread_exit_event(event_thread_exit),
+          "event thread exit failed");
 
     /* register events */
     dr_register_exit_event(event_exit);
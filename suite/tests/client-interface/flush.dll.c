@@ -48,6 +48,9 @@ static bool delay_flush_at_next_build = false;
 
 static int bb_build_count = 0;
 static uint callback_count = 0;
+static bool queued_flush_pending = false;
+static int queued_flushes = 0;
+static int queued_flush_rebuilds = 0;
 
 /* Keep a list that tracks which tags have been created and deleted.
  * We need to make sure we're informed of all flushed fragments.
@@ -152,6 +155,8 @@ void exit_event(void)
     }
 
     dr_fprintf(STDERR, "%d undeleted fragments\n", count);
+    dr_fprintf(STDERR, "marker rebuilt after %d of %d queued flushes\n",
+               queued_flush_rebuilds, queued_flushes);
     /* get around nondeterminism */
     if (bb_build_count >= 5 && bb_build_count <= 15)
         dr_fprintf(STDERR, "constructed BB 5-15 times\n");
@@ -179,6 +184,11 @@ void flush_event(int flush_id)
     dr_fprintf(STDERR, "Flush completion id=%d\n", flush_id);
 }
 
+void queued_flush_event(int flush_id)
+{
+    dr_fprintf(STDERR, "Queued flush completion id=%d\n", flush_id);
+}
+
 static
 void callback(void *tag, app_pc next_pc)
 {
@@ -187,11 +197,32 @@ void callback(void *tag, app_pc next_pc)
     /* Flush all fragments containing this tag twice every hundred calls alternating
      * between a sync_all and delay flush (if available) and an unlink and delay flush
      * (if available). */
-    if (callback_count % 100 == 0) {
+    if (callback_count % 100 == 50) {
+        /* Queue adjacent requests without a callback, which are flushed
+         * together without a synchall, and go back through the dispatcher so
+         * they are processed before we execute into the flushed marker.
+         */
+        dr_mcontext_t mcontext = {sizeof(mcontext),DR_MC_ALL,};
+        dr_delay_flush_region((app_pc)tag, 1, callback_count, NULL);
+        dr_delay_flush_region((app_pc)tag + 1, 2, callback_count, NULL);
+        queued_flushes++;
+        queued_flush_pending = true;
+        dr_get_mcontext(dr_get_current_drcontext(), &mcontext);
+        mcontext.pc = next_pc;
+        dr_redirect_execution(&mcontext);
+        *(volatile uint *)NULL = 0; /* ASSERT_NOT_REACHED() */
+    } else if (callback_count % 100 == 0) {
         if (callback_count % 200 == 0) {
             /* For windows test dr_flush_region() half the time */
             dr_mcontext_t mcontext = {sizeof(mcontext),DR_MC_ALL,};
 
+            /* Adjacent and overlapping requests are flushed together, but their
+             * callbacks must still run in the order they were queued.
+             */
+            dr_delay_flush_region((app_pc)tag - 20, 10, callback_count + 1,
+                                  queued_flush_event);
+            dr_delay_flush_region((app_pc)tag - 10, 10, callback_count + 2,
+                                  queued_flush_event);
             dr_delay_flush_region((app_pc)tag - 20, 30, callback_count, flush_event);
             dr_get_mcontext(dr_get_current_drcontext(), &mcontext);
             mcontext.pc = next_pc;
@@ -261,7 +292,12 @@ dr_emit_flags_t bb_event(void* drcontext, void *tag, instrlist_t *bb,
                 instr_get_opcode(next) == OP_xchg &&
                 instr_writes_to_exact_reg(next, REG_XBP, DR_QUERY_DEFAULT)) {
 
-                bb_build_count++;
+                if (!translating && queued_flush_pending) {
+                    /* The queued flush removed the marker block. */
+                    queued_flush_pending = false;
+                    queued_flush_rebuilds++;
+                } else
+                    bb_build_count++;
 
                 if (delay_flush_at_next_build) {
                     delay_flush_at_next_build = false;
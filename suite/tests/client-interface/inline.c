@@ -50,6 +50,11 @@
         FUNCTION(tls_clobber) \
         FUNCTION(aflags_clobber) \
         FUNCTION(compiler_inscount) \
+        FUNCTION(fwd_br) \
+        FUNCTION(leaf_call) \
+        FUNCTION(multi_arg) \
+        FUNCTION(dead_reg) \
+        FUNCTION(simd_clobber) \
         FUNCTION(xax_arg) \
         LAST_FUNCTION()
 
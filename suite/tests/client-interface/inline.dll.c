@@ -55,6 +55,11 @@
         FUNCTION(tls_clobber) \
         FUNCTION(aflags_clobber) \
         FUNCTION(compiler_inscount) \
+        FUNCTION(fwd_br) \
+        FUNCTION(leaf_call) \
+        FUNCTION(multi_arg) \
+        FUNCTION(dead_reg) \
+        FUNCTION(simd_clobber) \
         FUNCTION(bbcount) \
         LAST_FUNCTION()
 
@@ -66,6 +71,7 @@ static void compiler_inscount(ptr_uint_t count);
 
 static void test_inlined_call_args(void *dc, instrlist_t *bb, instr_t *where,
                                    int fn_idx);
+static void check_dead_reg_skipped(app_pc start_inline, app_pc end_inline);
 
 static void
 fill_scratch(void)
@@ -172,6 +178,7 @@ event_basic_block(void *dc, void *tag, instrlist_t *bb,
     bool inline_expected = true;
     instr_t *before_label;
     instr_t *after_label;
+    instr_t *dead_write;
 
     for (i = 0; i < N_FUNCS; i++) {
         if (entry_pc == func_app_pcs[i])
@@ -182,6 +189,15 @@ event_basic_block(void *dc, void *tag, instrlist_t *bb,
 
     /* We're inserting a call to a function in this bb. */
     func_called[i] = 1;
+    if (i == FN_dead_reg) {
+        /* dead_reg clobbers xdx, which the app overwrites right after the call.
+         * Zero it up front too so the mcontexts match, and put back the app
+         * value at the end.
+         */
+        dr_save_reg(dc, bb, entry, DR_REG_XDX, SPILL_SLOT_2);
+        PRE(bb, entry, INSTR_CREATE_mov_imm
+            (dc, opnd_create_reg(DR_REG_XDX), OPND_CREATE_INTPTR(0)));
+    }
     dr_insert_clean_call(dc, bb, entry, (void*)before_callee, false, 2,
                          OPND_CREATE_INTPTR(func_ptrs[i]),
                          OPND_CREATE_INTPTR(func_names[i]));
@@ -202,14 +218,41 @@ event_basic_block(void *dc, void *tag, instrlist_t *bb,
     case FN_inscount:
     case FN_gcc47_inscount:
     case FN_compiler_inscount:
+    case FN_fwd_br:
         PRE(bb, entry, before_label);
         dr_insert_clean_call(dc, bb, entry, func_ptrs[i], false, 1,
                              OPND_CREATE_INT32(0xDEAD));
         PRE(bb, entry, after_label);
         break;
-    case FN_nonleaf:
     case FN_cond_br:
-        /* These functions cannot be inlined (yet). */
+        /* jecxz has no long form, so this cannot be inlined (yet). */
+        PRE(bb, entry, before_label);
+        dr_insert_clean_call(dc, bb, entry, func_ptrs[i], false, 0);
+        PRE(bb, entry, after_label);
+        inline_expected = false;
+        break;
+    case FN_multi_arg:
+        /* The third arg is never read, so its param reg must be left alone. */
+        PRE(bb, entry, before_label);
+        dr_insert_clean_call(dc, bb, entry, func_ptrs[i], false, 3,
+                             OPND_CREATE_INT32(0xDE00), OPND_CREATE_INT32(0xAD),
+                             OPND_CREATE_INT32(0xBEEF));
+        PRE(bb, entry, after_label);
+        /* Only x64 passes multiple args in regs. */
+        inline_expected = IF_X64_ELSE(true, false);
+        break;
+    case FN_dead_reg:
+        /* Insert the call before the write that kills xdx so the inliner sees
+         * it when scanning for dead regs.
+         */
+        dead_write = INSTR_CREATE_mov_imm
+            (dc, opnd_create_reg(DR_REG_XDX), OPND_CREATE_INTPTR(0));
+        PRE(bb, entry, before_label);
+        PRE(bb, entry, dead_write);
+        dr_insert_clean_call(dc, bb, dead_write, func_ptrs[i], false, 0);
+        PRE(bb, dead_write, after_label);
+        break;
+    case FN_simd_clobber:
         PRE(bb, entry, before_label);
         dr_insert_clean_call(dc, bb, entry, func_ptrs[i], false, 0);
         PRE(bb, entry, after_label);
@@ -243,6 +286,17 @@ event_basic_block(void *dc, void *tag, instrlist_t *bb,
     if (i == FN_inscount || i == FN_empty_1arg) {
         test_inlined_call_args(dc, bb, entry, i);
     }
+    if (i == FN_dead_reg) {
+        uint64 skip_dead_regs;
+        /* Only the client.inline-skip_dead_regs run turns this on. */
+        if (dr_get_integer_option("cleancall_skip_dead_regs", &skip_dead_regs) &&
+            skip_dead_regs) {
+            dr_insert_clean_call(dc, bb, entry, (void*)check_dead_reg_skipped, false,
+                                 2, opnd_create_instr(before_label),
+                                 opnd_create_instr(after_label));
+        }
+        dr_restore_reg(dc, bb, entry, DR_REG_XDX, SPILL_SLOT_2);
+    }
 
     return DR_EMIT_DEFAULT;
 }
@@ -352,9 +406,43 @@ test_inlined_call_args(void *dc, instrlist_t *bb, instr_t *where, int fn_idx)
     }
 }
 
+/* With -cleancall_skip_dead_regs, xdx is overwritten after the dead_reg call
+ * without being read, so the inlined code must not save it.
+ */
+static void
+check_dead_reg_skipped(app_pc start_inline, app_pc end_inline)
+{
+    void *dc = dr_get_current_drcontext();
+    app_pc pc, next_pc;
+    instr_t instr;
+    instr_init(dc, &instr);
+    for (pc = start_inline; pc != end_inline; pc = next_pc) {
+        next_pc = decode(dc, pc, &instr);
+        if (instr_writes_memory(&instr) &&
+            instr_reads_from_reg(&instr, DR_REG_XDX, DR_QUERY_DEFAULT)) {
+            dr_fprintf(STDERR, "Dead xdx was saved around dead_reg!\n");
+            dump_cc_code(dc, start_inline, end_inline, FN_dead_reg);
+            break;
+        }
+        instr_reset(dc, &instr);
+    }
+    instr_free(dc, &instr);
+}
+
 /*****************************************************************************/
 /* Instrumentation function code generation. */
 
+/* The second arg, as a stack access opnd_t or the second regparm. */
+static opnd_t
+codegen_opnd_arg2(void)
+{
+#ifdef X64
+    return opnd_create_reg(IF_WINDOWS_ELSE(DR_REG_RDX, DR_REG_RSI));
+#else
+    return OPND_CREATE_MEMPTR(DR_REG_XBP, 3 * sizeof(reg_t));
+#endif
+}
+
 /* i#988: We fail to inline if the number of arguments to the same clean call
  * routine increases. empty is used for a 0 arg clean call, so we add empty_1arg
  * for test_inlined_call_args(), which passes 1 arg.
@@ -412,7 +500,7 @@ codegen_callpic_mov(void *dc)
     return ilist;
 }
 
-/* Non-leaf functions cannot be inlined.
+/* The call to the empty leaf is spliced out at -opt_cleancall 3.
 nonleaf:
     push REG_XBP
     mov REG_XBP, REG_XSP
@@ -587,3 +675,147 @@ codegen_gcc47_inscount(void *dc)
 #endif
     return ilist;
 }
+
+/* A forward conditional branch with a long form is inlined as a meta branch.
+fwd_br:
+    push REG_XBP
+    mov REG_XBP, REG_XSP
+    mov REG_XCX, ARG1
+    cmp REG_XCX, 0
+    jz Larg_zero
+        mov REG_XCX, &global_count
+        mov [REG_XCX], HEX(DEADBEEF)
+    Larg_zero:
+    leave
+    ret
+*/
+static instrlist_t *
+codegen_fwd_br(void *dc)
+{
+    instrlist_t *ilist = instrlist_create(dc);
+    instr_t *arg_zero = INSTR_CREATE_label(dc);
+    opnd_t xcx = opnd_create_reg(DR_REG_XCX);
+    codegen_prologue(dc, ilist);
+    APP(ilist, INSTR_CREATE_mov_ld(dc, xcx, codegen_opnd_arg1()));
+    APP(ilist, INSTR_CREATE_cmp(dc, xcx, OPND_CREATE_INT8(0)));
+    APP(ilist, INSTR_CREATE_jcc(dc, OP_jz, opnd_create_instr(arg_zero)));
+    APP(ilist, INSTR_CREATE_mov_imm(dc, xcx, OPND_CREATE_INTPTR(&global_count)));
+    APP(ilist, INSTR_CREATE_mov_st(dc, OPND_CREATE_MEMPTR(DR_REG_XCX, 0),
+                                   OPND_CREATE_INT32((int)0xDEADBEEF)));
+    APP(ilist, arg_zero);
+    codegen_epilogue(dc, ilist);
+    return ilist;
+}
+
+/* The leaf's body replaces the call to it.
+leaf_call:
+    push REG_XBP
+    mov REG_XBP, REG_XSP
+    call leaf
+    leave
+    ret
+leaf:
+    mov REG_XAX, HEX(DEAD)
+    mov REG_XDX, REG_XAX
+    ret
+*/
+static instrlist_t *
+codegen_leaf_call(void *dc)
+{
+    instrlist_t *ilist = instrlist_create(dc);
+    instr_t *leaf = INSTR_CREATE_label(dc);
+    codegen_prologue(dc, ilist);
+    APP(ilist, INSTR_CREATE_call(dc, opnd_create_instr(leaf)));
+    codegen_epilogue(dc, ilist);
+    APP(ilist, leaf);
+    APP(ilist, INSTR_CREATE_mov_imm
+        (dc, opnd_create_reg(DR_REG_XAX), OPND_CREATE_INTPTR(0xDEAD)));
+    APP(ilist, INSTR_CREATE_mov_ld
+        (dc, opnd_create_reg(DR_REG_XDX), opnd_create_reg(DR_REG_XAX)));
+    APP(ilist, INSTR_CREATE_ret(dc));
+    return ilist;
+}
+
+/* Reads two of the three args it is passed.
+multi_arg:
+    push REG_XBP
+    mov REG_XBP, REG_XSP
+    mov REG_XAX, ARG1
+    add REG_XAX, ARG2
+    mov [global_count], REG_XAX
+    leave
+    ret
+*/
+static instrlist_t *
+codegen_multi_arg(void *dc)
+{
+    instrlist_t *ilist = instrlist_create(dc);
+    opnd_t xax = opnd_create_reg(DR_REG_XAX);
+    codegen_prologue(dc, ilist);
+    APP(ilist, INSTR_CREATE_mov_ld(dc, xax, codegen_opnd_arg1()));
+    APP(ilist, INSTR_CREATE_add(dc, xax, codegen_opnd_arg2()));
+    APP(ilist, INSTR_CREATE_mov_st
+        (dc, OPND_CREATE_ABSMEM(&global_count, OPSZ_PTR), xax));
+    codegen_epilogue(dc, ilist);
+    return ilist;
+}
+
+/* Clobbers xdx, which is dead at the call site.
+dead_reg:
+    push REG_XBP
+    mov REG_XBP, REG_XSP
+    mov REG_XDX, HEX(BEEF)
+    leave
+    ret
+*/
+static instrlist_t *
+codegen_dead_reg(void *dc)
+{
+    instrlist_t *ilist = instrlist_create(dc);
+    codegen_prologue(dc, ilist);
+    APP(ilist, INSTR_CREATE_mov_imm
+        (dc, opnd_create_reg(DR_REG_XDX), OPND_CREATE_INT32(0xBEEF)));
+    codegen_epilogue(dc, ilist);
+    return ilist;
+}
+
+/* Clobbers xmm0 and, with AVX, the top of ymm1 two calls down.  The nested
+ * call makes the full analysis bail out, so -cleancall_lazy_simd has to find
+ * the SIMD use by scanning the call tree.
+simd_clobber:
+    push REG_XBP
+    mov REG_XBP, REG_XSP
+    call Lnonleaf
+    leave
+    ret
+  Lnonleaf:
+    call Lleaf
+    ret
+  Lleaf:
+    pcmpeqd xmm0, xmm0
+    vinsertf128 ymm1, ymm1, xmm0, 1
+    ret
+*/
+static instrlist_t *
+codegen_simd_clobber(void *dc)
+{
+    instrlist_t *ilist = instrlist_create(dc);
+    instr_t *nonleaf = INSTR_CREATE_label(dc);
+    instr_t *leaf = INSTR_CREATE_label(dc);
+    opnd_t xmm0 = opnd_create_reg(DR_REG_XMM0);
+    codegen_prologue(dc, ilist);
+    APP(ilist, INSTR_CREATE_call(dc, opnd_create_instr(nonleaf)));
+    codegen_epilogue(dc, ilist);
+    APP(ilist, nonleaf);
+    APP(ilist, INSTR_CREATE_call(dc, opnd_create_instr(leaf)));
+    APP(ilist, INSTR_CREATE_ret(dc));
+    APP(ilist, leaf);
+    APP(ilist, INSTR_CREATE_pcmpeqd(dc, xmm0, xmm0));
+    if (proc_has_feature(FEATURE_AVX)) {
+        APP(ilist, INSTR_CREATE_vinsertf128
+            (dc, opnd_create_reg(DR_REG_YMM1), opnd_create_reg(DR_REG_YMM1), xmm0,
+             OPND_CREATE_INT8(1)));
+    }
+    APP(ilist, INSTR_CREATE_ret(dc));
+    return ilist;
+}
@@ -0,0 +1,94 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Runs many short loops that each iterate fewer times than the default
+ * -trace_threshold.  The client checks whether any of them became a trace.
+ */
+
+#include "tools.h"
+
+#ifdef WINDOWS
+# define EXPORT __declspec(dllexport)
+#else
+# define EXPORT __attribute__((visibility("default")))
+#endif
+
+static volatile int iters = 20;
+static volatile int sum;
+
+EXPORT NOINLINE void
+start_monitor(void)
+{
+}
+
+EXPORT NOINLINE void
+stop_monitor(void)
+{
+}
+
+/* Each loop adds a different constant so the compiler cannot fold the
+ * functions together.
+ */
+#define LOOP(n)                                   \
+    static NOINLINE void loop_##n(void)           \
+    {                                             \
+        int i;                                    \
+        for (i = 0; i < iters; i++)               \
+            sum += 0##n;                          \
+    }
+#define LOOP8(n) \
+    LOOP(n##0) LOOP(n##1) LOOP(n##2) LOOP(n##3) \
+    LOOP(n##4) LOOP(n##5) LOOP(n##6) LOOP(n##7)
+#define LOOP64(n) \
+    LOOP8(n##0) LOOP8(n##1) LOOP8(n##2) LOOP8(n##3) \
+    LOOP8(n##4) LOOP8(n##5) LOOP8(n##6) LOOP8(n##7)
+
+#define CALL8(n) \
+    loop_##n##0(); loop_##n##1(); loop_##n##2(); loop_##n##3(); \
+    loop_##n##4(); loop_##n##5(); loop_##n##6(); loop_##n##7();
+#define CALL64(n) \
+    CALL8(n##0) CALL8(n##1) CALL8(n##2) CALL8(n##3) \
+    CALL8(n##4) CALL8(n##5) CALL8(n##6) CALL8(n##7)
+
+LOOP64(0)
+LOOP64(1)
+
+int
+main(void)
+{
+    start_monitor();
+    CALL64(0)
+    CALL64(1)
+    stop_monitor();
+    print("all done\n");
+    return 0;
+}
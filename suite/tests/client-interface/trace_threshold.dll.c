@@ -0,0 +1,94 @@
+/* **********************************************************
+ * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL GOOGLE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Counts the traces built while the app runs its short loops.  None of the
+ * loops reaches the default -trace_threshold, so with a fixed threshold no
+ * trace should be built there.  With -trace_threshold_adapt the thread sees
+ * several windows of trace head hits with no early trace exits, lowers its
+ * threshold, and should trace at least some of the later loops.
+ */
+
+#include "dr_api.h"
+#include "client_tools.h"
+
+static app_pc start_pc;
+static app_pc stop_pc;
+static bool monitoring;
+static uint traces_in_loops;
+
+static dr_emit_flags_t
+event_bb(void *drcontext, void *tag, instrlist_t *bb, bool for_trace, bool translating)
+{
+    app_pc pc = dr_fragment_app_pc(tag);
+    /* The app is single-threaded and calls each marker once. */
+    if (pc == start_pc)
+        monitoring = true;
+    else if (pc == stop_pc)
+        monitoring = false;
+    return DR_EMIT_DEFAULT;
+}
+
+static dr_emit_flags_t
+event_trace(void *drcontext, void *tag, instrlist_t *trace, bool translating)
+{
+    if (monitoring && !translating)
+        traces_in_loops++;
+    return DR_EMIT_DEFAULT;
+}
+
+static void
+event_exit(void)
+{
+    uint64 adapt;
+    bool ok = dr_get_integer_option("trace_threshold_adapt", &adapt);
+    ASSERT(ok);
+    if (adapt)
+        ASSERT(traces_in_loops > 0);
+    else
+        ASSERT(traces_in_loops == 0);
+    dr_fprintf(STDERR, "short loops traced as expected\n");
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    module_data_t *exe = dr_get_main_module();
+    ASSERT(exe != NULL);
+    start_pc = (app_pc)dr_get_proc_address(exe->handle, "start_monitor");
+    stop_pc = (app_pc)dr_get_proc_address(exe->handle, "stop_monitor");
+    ASSERT(start_pc != NULL && stop_pc != NULL);
+    dr_free_module_data(exe);
+
+    dr_register_exit_event(event_exit);
+    dr_register_bb_event(event_bb);
+    dr_register_trace_event(event_trace);
+}